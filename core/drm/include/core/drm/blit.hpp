@@ -0,0 +1,44 @@
+#ifndef CORE_DRM_BLIT_HPP
+#define CORE_DRM_BLIT_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace drm_core {
+
+// ---------------------------------------------
+// Software blitting
+// ---------------------------------------------
+
+// All kernels operate on a single row of pixels and have no alignment requirements.
+// They are dispatched at runtime to AVX2, SSE2 or plain C++ implementations,
+// depending on what the CPU supports.
+
+// Copies a row of `size` bytes.
+void blitCopy(void *dest, const void *src, size_t size);
+
+// Format conversions. `count` is the number of pixels.
+void convertXrgb8888ToRgb565(void *dest, const void *src, size_t count);
+void convertRgb565ToXrgb8888(void *dest, const void *src, size_t count);
+// Swaps the R and B channels, i.e., converts XRGB8888 <-> XBGR8888.
+void convertXrgb8888ToXbgr8888(void *dest, const void *src, size_t count);
+
+// Composites premultiplied ARGB8888 pixels from `src` over `dest` (e.g., for cursors).
+void blendArgb8888(void *dest, const void *src, size_t count);
+
+using ConvertFunction = void (*)(void *dest, const void *src, size_t count);
+
+// Returns a kernel that converts rows from src_fourcc to dest_fourcc,
+// or nullptr if the conversion is not supported. Identical formats
+// are not handled here; use blitCopy() for those.
+ConvertFunction findConverter(uint32_t dest_fourcc, uint32_t src_fourcc);
+
+// Returns the name of the implementation that was selected ("avx2", "sse2" or "generic").
+const char *blitImplementation();
+
+// Forces a specific implementation; used by benchmarks. Returns false if unsupported.
+bool selectBlitImplementation(const char *name);
+
+} // namespace drm_core
+
+#endif // CORE_DRM_BLIT_HPP
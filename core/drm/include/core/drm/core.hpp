@@ -59,20 +59,42 @@ using PropertyType = std::variant<
 >;
 
 struct Event {
-	uint64_t cookie;
+	uint64_t cookie = 0;
+	uint64_t timestamp = 0;
+	uint32_t crtcId = 0;
+	uint32_t sequence = 0;
+};
+
+struct VblankInfo {
+	uint64_t sequence;
 	uint64_t timestamp;
 };
 
+// Layout-compatible with struct drm_mode_rect (as used by FB_DAMAGE_CLIPS).
+// Coordinates are in framebuffer pixels; x2 and y2 are exclusive.
+struct DamageRect {
+	int32_t x1;
+	int32_t y1;
+	int32_t x2;
+	int32_t y2;
+};
+
 struct Property {
-	Property(PropertyType property_type)
-	: _propertyType(property_type) { }
+	Property(std::string name, PropertyType property_type)
+	: _id(0), _name(std::move(name)), _propertyType(property_type) { }
 
 	virtual ~Property() = default;
 
 	virtual bool validate(const Assignment& assignment);
 	PropertyType propertyType();
 
+	uint32_t id();
+	const std::string &name();
+	void setupId(uint32_t id);
+
 private:
+	uint32_t _id;
+	std::string _name;
 	PropertyType _propertyType;
 };
 
@@ -133,6 +155,9 @@ public:
 	void registerObject(ModeObject *object);
 	std::shared_ptr<ModeObject> findObject(uint32_t);
 
+	void registerProperty(Property *property);
+	Property *findProperty(uint32_t id);
+
 	uint64_t installMapping(drm_core::BufferObject *bo);
 
 	void setupMinDimensions(uint32_t width, uint32_t height);
@@ -147,6 +172,7 @@ private:
 	std::vector<Encoder *> _encoders;
 	std::vector<Connector *> _connectors;
 	std::unordered_map<uint32_t, ModeObject *> _objects;
+	std::unordered_map<uint32_t, Property *> _properties;
 	id_allocator<uint32_t> _memorySlotAllocator;
 	std::map<uint64_t, BufferObject *> _mappings;
 	uint32_t _minWidth;
@@ -159,6 +185,7 @@ private:
 	std::shared_ptr<Property> _modeIdProperty;
 	std::shared_ptr<Property> _crtcXProperty;
 	std::shared_ptr<Property> _crtcYProperty;
+	std::shared_ptr<Property> _fbDamageClipsProperty;
 
 public:
 	id_allocator<uint32_t> allocator;
@@ -168,6 +195,7 @@ public:
 	Property *modeIdProperty();
 	Property *crtcXProperty();
 	Property *crtcYProperty();
+	Property *fbDamageClipsProperty();
 };
 
 struct File {
@@ -194,6 +222,10 @@ struct File {
 	uint32_t createHandle(std::shared_ptr<BufferObject> bo);
 	BufferObject *resolveHandle(uint32_t handle);
 
+	uint32_t createBlob(std::shared_ptr<Blob> blob);
+	std::shared_ptr<Blob> resolveBlob(uint32_t id);
+	bool destroyBlob(uint32_t id);
+
 	void postEvent(Event event);
 
 	helix::BorrowedDescriptor statusPageMemory() {
@@ -201,7 +233,7 @@ struct File {
 	}
 
 private:
-	async::detached _retirePageFlip(std::unique_ptr<Configuration> config,
+	async::detached _retirePageFlip(Crtc *crtc, std::unique_ptr<Configuration> config,
 			uint64_t cookie);
 
 	std::shared_ptr<Device> _device;
@@ -214,6 +246,9 @@ private:
 	std::unordered_map<uint32_t, std::shared_ptr<BufferObject>> _buffers;
 	id_allocator<uint32_t> _allocator;
 
+	// Blobs created by this file (via CREATEPROPBLOB).
+	std::unordered_map<uint32_t, std::shared_ptr<Blob>> _blobs;
+
 	// Event queuing structures.
 	bool _isBlocking = true;
 	std::deque<Event> _pendingEvents;
@@ -257,11 +292,16 @@ struct ModeObject {
 
 	void setupWeakPtr(std::weak_ptr<ModeObject> self);
 	std::shared_ptr<ModeObject> sharedModeObject();
+
+	// Properties that are reported by OBJ_GETPROPERTIES and can be set by OBJ_SETPROPERTY.
+	void attachProperty(Property *property);
+	const std::vector<Property *> &getProperties();
 	
 private:
 	ObjectType _type;
 	uint32_t _id;
 	std::weak_ptr<ModeObject> _self;
+	std::vector<Property *> _properties;
 };
 
 struct Crtc : ModeObject {
@@ -277,10 +317,36 @@ public:
 	std::shared_ptr<Blob> currentMode();
 	void setCurrentMode(std::shared_ptr<Blob> mode);
 
+	// Vertical blanking. Unless a driver calls setupHardwareVblank() and reports
+	// vblanks via signalVblank(), they are simulated by a timer that runs at the
+	// refresh rate of the current mode while there are waiters.
+	void setupHardwareVblank();
+	void signalVblank(uint64_t timestamp);
+	async::result<VblankInfo> waitForVblank();
+
+	// Page flips. At most one flip (or SETCRTC) can be pending per CRTC;
+	// a flip completes at the vblank after its commit.
+	bool beginFlip();
+	void endFlip();
+	async::result<void> waitForFlip();
+
 	int index;
 
 private:
+	uint64_t _refreshPeriod();
+	async::detached _runVblankTimer();
+
 	std::shared_ptr<Blob> _curMode;
+
+	bool _hardwareVblank = false;
+	bool _vblankTimerRunning = false;
+	int _vblankWaiters = 0;
+	uint64_t _vblankSequence = 0;
+	uint64_t _vblankTimestamp = 0;
+	async::doorbell _vblankBell;
+
+	bool _flipPending = false;
+	async::doorbell _flipBell;
 };
 
 struct Encoder : ModeObject {
@@ -344,11 +410,21 @@ protected:
 	~FrameBuffer() = default;
 
 public:
-	virtual void notifyDirty() = 0;
+	// Called for DRM_IOCTL_MODE_DIRTYFB. An empty damage list means that
+	// the whole framebuffer needs to be updated.
+	virtual void notifyDirty(std::vector<DamageRect> damage) = 0;
 };
 
 struct Plane : ModeObject {
 	Plane(uint32_t id);	
+
+	// FB_DAMAGE_CLIPS that were set by OBJ_SETPROPERTY.
+	// Like on Linux, they only apply to the next commit (i.e., page flip).
+	void setDamageClips(std::shared_ptr<Blob> clips);
+	std::shared_ptr<Blob> takeDamageClips();
+
+private:
+	std::shared_ptr<Blob> _damageClips;
 };
 
 struct Assignment {
@@ -374,6 +450,21 @@ struct FormatInfo {
 
 std::optional<FormatInfo> getFormatInfo(uint32_t fourcc);
 
+// ---------------------------------------------
+// Damage tracking
+// ---------------------------------------------
+
+// Decodes the contents of a FB_DAMAGE_CLIPS blob.
+std::vector<DamageRect> damageFromBlob(Blob *blob);
+
+// Clips damage rectangles to a width x height surface and drops empty ones.
+// An empty input is treated as damage to the whole surface. If the list
+// is longer than maxDamageRects, it is collapsed into its bounding box.
+std::vector<DamageRect> clipDamage(const std::vector<DamageRect> &damage,
+		uint32_t width, uint32_t height);
+
+inline constexpr size_t maxDamageRects = 16;
+
 drm_mode_modeinfo makeModeInfo(const char *name, uint32_t type,
 		uint32_t clock, unsigned int hdisplay, unsigned int hsync_start,
 		unsigned int hsync_end, unsigned int htotal, unsigned int hskew,
@@ -1,6 +1,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <algorithm>
 #include <deque>
 #include <experimental/optional>
 #include <optional>
@@ -8,6 +9,7 @@
 #include <iostream>
 #include <memory>
 #include <numeric>
+#include <utility>
 #include <sys/epoll.h>
 
 #include <arch/bits.hpp>
@@ -31,7 +33,7 @@
 drm_core::Device::Device() {
 	struct SrcWProperty : drm_core::Property {
 		SrcWProperty()
-		: drm_core::Property{drm_core::IntPropertyType{}} { }
+		: drm_core::Property{"SRC_W", drm_core::IntPropertyType{}} { }
 
 		bool validate(const Assignment& assignment) override {
 			return true;
@@ -41,7 +43,7 @@ drm_core::Device::Device() {
 	
 	struct SrcHProperty : drm_core::Property {
 		SrcHProperty()
-		: drm_core::Property{drm_core::IntPropertyType{}} { }
+		: drm_core::Property{"SRC_H", drm_core::IntPropertyType{}} { }
 
 		bool validate(const Assignment& assignment) override {
 			return true;
@@ -51,7 +53,7 @@ drm_core::Device::Device() {
 
 	struct FbIdProperty : drm_core::Property {
 		FbIdProperty()
-		: drm_core::Property{drm_core::ObjectPropertyType{}} { }
+		: drm_core::Property{"FB_ID", drm_core::ObjectPropertyType{}} { }
 		
 		bool validate(const Assignment& assignment) override {
 			if(!assignment.objectValue)
@@ -67,7 +69,7 @@ drm_core::Device::Device() {
 
 	struct ModeIdProperty : drm_core::Property {
 		ModeIdProperty()
-		: drm_core::Property{drm_core::BlobPropertyType{}} { }
+		: drm_core::Property{"MODE_ID", drm_core::BlobPropertyType{}} { }
 
 		bool validate(const Assignment& assignment) override {
 			if(!assignment.blobValue)
@@ -99,7 +101,7 @@ drm_core::Device::Device() {
 
 	struct CrtcXProperty : drm_core::Property {
 		CrtcXProperty()
-		: drm_core::Property{drm_core::IntPropertyType{}} { }
+		: drm_core::Property{"CRTC_X", drm_core::IntPropertyType{}} { }
 
 		bool validate(const Assignment& assignment) override {
 			return true;
@@ -109,7 +111,7 @@ drm_core::Device::Device() {
 	
 	struct CrtcYProperty : drm_core::Property {
 		CrtcYProperty()
-		: drm_core::Property{drm_core::IntPropertyType{}} { }
+		: drm_core::Property{"CRTC_Y", drm_core::IntPropertyType{}} { }
 
 		bool validate(const Assignment& assignment) override {
 			return true;
@@ -117,7 +119,29 @@ drm_core::Device::Device() {
 	};
 	_crtcYProperty = std::make_shared<CrtcYProperty>();
 
+	struct FbDamageClipsProperty : drm_core::Property {
+		FbDamageClipsProperty()
+		: drm_core::Property{"FB_DAMAGE_CLIPS", drm_core::BlobPropertyType{}} { }
 
+		bool validate(const Assignment& assignment) override {
+			if(!assignment.blobValue)
+				return true;
+
+			if(assignment.blobValue->size() % sizeof(DamageRect))
+				return false;
+
+			return true;
+		};
+	};
+	_fbDamageClipsProperty = std::make_shared<FbDamageClipsProperty>();
+
+	registerProperty(_srcWProperty.get());
+	registerProperty(_srcHProperty.get());
+	registerProperty(_fbIdProperty.get());
+	registerProperty(_modeIdProperty.get());
+	registerProperty(_crtcXProperty.get());
+	registerProperty(_crtcYProperty.get());
+	registerProperty(_fbDamageClipsProperty.get());
 }
 
 void drm_core::Device::setupCrtc(drm_core::Crtc *crtc) {
@@ -157,6 +181,19 @@ std::shared_ptr<drm_core::ModeObject> drm_core::Device::findObject(uint32_t id)
 	return it->second->sharedModeObject();
 }
 
+void drm_core::Device::registerProperty(drm_core::Property *property) {
+	// Properties share their ID space with mode objects.
+	property->setupId(allocator.allocate());
+	_properties.insert({property->id(), property});
+}
+
+drm_core::Property *drm_core::Device::findProperty(uint32_t id) {
+	auto it = _properties.find(id);
+	if(it == _properties.end())
+		return nullptr;
+	return it->second;
+}
+
 uint64_t drm_core::Device::installMapping(drm_core::BufferObject *bo) {
 	assert(bo->getSize() < (UINT64_C(1) << 32));
 	return static_cast<uint64_t>(_memorySlotAllocator.allocate()) << 32;
@@ -211,6 +248,10 @@ drm_core::Property *drm_core::Device::crtcXProperty() {
 drm_core::Property *drm_core::Device::crtcYProperty() {
 	return _crtcYProperty.get();
 }
+
+drm_core::Property *drm_core::Device::fbDamageClipsProperty() {
+	return _fbDamageClipsProperty.get();
+}
 	
 // ----------------------------------------------------------------
 // Property
@@ -224,6 +265,18 @@ drm_core::PropertyType drm_core::Property::propertyType() {
 	return _propertyType;
 }
 
+uint32_t drm_core::Property::id() {
+	return _id;
+}
+
+const std::string &drm_core::Property::name() {
+	return _name;
+}
+
+void drm_core::Property::setupId(uint32_t id) {
+	_id = id;
+}
+
 // ----------------------------------------------------------------
 // BufferObject
 // ----------------------------------------------------------------
@@ -324,6 +377,14 @@ std::shared_ptr<drm_core::ModeObject> drm_core::ModeObject::sharedModeObject() {
 	return _self.lock();
 }
 
+void drm_core::ModeObject::attachProperty(drm_core::Property *property) {
+	_properties.push_back(property);
+}
+
+const std::vector<drm_core::Property *> &drm_core::ModeObject::getProperties() {
+	return _properties;
+}
+
 // ----------------------------------------------------------------
 // Crtc
 // ----------------------------------------------------------------
@@ -345,6 +406,84 @@ drm_core::Plane *drm_core::Crtc::cursorPlane() {
 	return nullptr;
 }
 
+void drm_core::Crtc::setupHardwareVblank() {
+	_hardwareVblank = true;
+}
+
+void drm_core::Crtc::signalVblank(uint64_t timestamp) {
+	_vblankSequence++;
+	_vblankTimestamp = timestamp;
+	_vblankBell.ring();
+}
+
+async::result<drm_core::VblankInfo> drm_core::Crtc::waitForVblank() {
+	auto sequence = _vblankSequence;
+
+	_vblankWaiters++;
+	if(!_hardwareVblank && !_vblankTimerRunning)
+		_runVblankTimer();
+
+	while(_vblankSequence == sequence)
+		co_await _vblankBell.async_wait();
+	_vblankWaiters--;
+
+	co_return VblankInfo{_vblankSequence, _vblankTimestamp};
+}
+
+bool drm_core::Crtc::beginFlip() {
+	if(_flipPending)
+		return false;
+	_flipPending = true;
+	return true;
+}
+
+void drm_core::Crtc::endFlip() {
+	assert(_flipPending);
+	_flipPending = false;
+	_flipBell.ring();
+}
+
+async::result<void> drm_core::Crtc::waitForFlip() {
+	while(_flipPending)
+		co_await _flipBell.async_wait();
+}
+
+uint64_t drm_core::Crtc::_refreshPeriod() {
+	// Fall back to 60 Hz if there is no (valid) mode.
+	uint64_t period = 1'000'000'000 / 60;
+	if(_curMode) {
+		drm_mode_modeinfo mode_info;
+		memcpy(&mode_info, _curMode->data(), sizeof(drm_mode_modeinfo));
+		if(mode_info.clock && mode_info.htotal && mode_info.vtotal)
+			period = static_cast<uint64_t>(mode_info.htotal) * mode_info.vtotal
+					* 1'000'000 / mode_info.clock;
+	}
+	return period;
+}
+
+async::detached drm_core::Crtc::_runVblankTimer() {
+	_vblankTimerRunning = true;
+
+	while(_vblankWaiters) {
+		uint64_t tick;
+		HEL_CHECK(helGetClock(&tick));
+
+		// Align vblanks to a fixed grid such that timestamps are evenly spaced.
+		auto period = _refreshPeriod();
+		auto deadline = tick + period - (tick % period);
+
+		helix::AwaitClock await_clock;
+		auto &&submit = helix::submitAwaitClock(&await_clock, deadline,
+				helix::Dispatcher::global());
+		co_await submit.async_wait();
+		HEL_CHECK(await_clock.error());
+
+		signalVblank(deadline);
+	}
+
+	_vblankTimerRunning = false;
+}
+
 // ----------------------------------------------------------------
 // FrameBuffer
 // ----------------------------------------------------------------
@@ -361,6 +500,14 @@ drm_core::Plane::Plane(uint32_t id)
 	:drm_core::ModeObject { ObjectType::plane, id } {
 }
 
+void drm_core::Plane::setDamageClips(std::shared_ptr<drm_core::Blob> clips) {
+	_damageClips = std::move(clips);
+}
+
+std::shared_ptr<drm_core::Blob> drm_core::Plane::takeDamageClips() {
+	return std::exchange(_damageClips, nullptr);
+}
+
 // ----------------------------------------------------------------
 // Connector
 // ----------------------------------------------------------------
@@ -493,8 +640,29 @@ drm_core::BufferObject *drm_core::File::resolveHandle(uint32_t handle) {
 	return it->second.get();
 };
 
+uint32_t drm_core::File::createBlob(std::shared_ptr<drm_core::Blob> blob) {
+	auto id = _device->allocator.allocate();
+	_blobs.insert({id, std::move(blob)});
+	return id;
+}
+
+std::shared_ptr<drm_core::Blob> drm_core::File::resolveBlob(uint32_t id) {
+	auto it = _blobs.find(id);
+	if(it == _blobs.end())
+		return nullptr;
+	return it->second;
+}
+
+bool drm_core::File::destroyBlob(uint32_t id) {
+	if(!_blobs.erase(id))
+		return false;
+	_device->allocator.free(id);
+	return true;
+}
+
 void drm_core::File::postEvent(drm_core::Event event) {
-	HEL_CHECK(helGetClock(&event.timestamp));
+	if(!event.timestamp)
+		HEL_CHECK(helGetClock(&event.timestamp));
 
 	if(_pendingEvents.empty()) {
 		++_eventSequence;
@@ -516,7 +684,6 @@ drm_core::File::read(void *object, const char *,
 
 	auto ev = &self->_pendingEvents.front();
 
-	// TODO: Support sequence number and CRTC id.
 	drm_event_vblank out;
 	memset(&out, 0, sizeof(drm_event_vblank));
 	out.base.type = DRM_EVENT_FLIP_COMPLETE;
@@ -524,6 +691,8 @@ drm_core::File::read(void *object, const char *,
 	out.user_data = ev->cookie;
 	out.tv_sec = ev->timestamp / 1000000000;
 	out.tv_usec = (ev->timestamp % 1000000000) / 1000;
+	out.sequence = ev->sequence;
+	out.crtc_id = ev->crtcId;
 
 	assert(length >= sizeof(drm_event_vblank));
 	memcpy(buffer, &out, sizeof(drm_event_vblank));
@@ -577,6 +746,9 @@ drm_core::File::ioctl(void *object, managarm::fs::CntRequest req,
 		}else if(req.drm_capability() == DRM_CAP_DUMB_BUFFER) {
 			resp.set_drm_value(1);
 			resp.set_error(managarm::fs::Errors::SUCCESS);
+		}else if(req.drm_capability() == DRM_CAP_CRTC_IN_VBLANK_EVENT) {
+			resp.set_drm_value(1);
+			resp.set_error(managarm::fs::Errors::SUCCESS);
 		}else{
 			std::cout << "core/drm: Unknown capability " << req.drm_capability() << std::endl;
 			resp.set_drm_value(0);
@@ -716,9 +888,14 @@ drm_core::File::ioctl(void *object, managarm::fs::CntRequest req,
 		auto fourcc = convertLegacyFormat(req.drm_bpp(), req.drm_depth());
 		auto fb = self->_device->createFrameBuffer(buffer, req.drm_width(), req.drm_height(),
 				fourcc, req.drm_pitch());
-		self->attachFrameBuffer(fb);
-		resp.set_drm_fb_id(fb->id());
-		resp.set_error(managarm::fs::Errors::SUCCESS);
+		if(fb) {
+			self->attachFrameBuffer(fb);
+			resp.set_drm_fb_id(fb->id());
+			resp.set_error(managarm::fs::Errors::SUCCESS);
+		}else{
+			// The driver cannot scan out this format.
+			resp.set_error(managarm::fs::Errors::ILLEGAL_ARGUMENT);
+		}
 	
 		auto ser = resp.SerializeAsString();
 		auto &&transmit = helix::submitAsync(conversation, helix::Dispatcher::global(),
@@ -834,12 +1011,18 @@ drm_core::File::ioctl(void *object, managarm::fs::CntRequest req,
 			});
 		}
 
+		// Do not race with the flip pipeline: wait for pending flips and occupy the flip slot
+		// such that page flips that arrive in the meantime fail.
+		while(!crtc->beginFlip())
+			co_await crtc->waitForFlip();
+
 		auto config = self->_device->createConfiguration();
 		auto valid = config->capture(assignments);
 		assert(valid);
 		config->commit();
 
 		co_await config->waitForCompletion();
+		crtc->endFlip();
 
 		resp.set_error(managarm::fs::Errors::SUCCESS);
 
@@ -869,14 +1052,28 @@ drm_core::File::ioctl(void *object, managarm::fs::CntRequest req,
 			nullptr
 		});
 
-		auto config = self->_device->createConfiguration();
-		auto valid = config->capture(assignments);
-		assert(valid);
-		config->commit();
+		if(auto clips = crtc->primaryPlane()->takeDamageClips(); clips)
+			assignments.push_back(Assignment{
+				crtc->primaryPlane()->sharedModeObject(),
+				self->_device->fbDamageClipsProperty(),
+				0,
+				nullptr,
+				std::move(clips)
+			});
 
-		self->_retirePageFlip(std::move(config), req.drm_cookie());
-			
-		resp.set_error(managarm::fs::Errors::SUCCESS);
+		// Queue at most one flip per CRTC. Clients are expected to wait
+		// for the DRM_EVENT_FLIP_COMPLETE of the previous flip.
+		if(crtc->beginFlip()) {
+			auto config = self->_device->createConfiguration();
+			auto valid = config->capture(assignments);
+			assert(valid);
+
+			self->_retirePageFlip(crtc, std::move(config), req.drm_cookie());
+
+			resp.set_error(managarm::fs::Errors::SUCCESS);
+		}else{
+			resp.set_error(managarm::fs::Errors::WOULD_BLOCK);
+		}
 
 		auto ser = resp.SerializeAsString();
 		auto &&transmit = helix::submitAsync(conversation, helix::Dispatcher::global(),
@@ -891,7 +1088,11 @@ drm_core::File::ioctl(void *object, managarm::fs::CntRequest req,
 		assert(obj);
 		auto fb = obj->asFrameBuffer();
 		assert(fb);
-		fb->notifyDirty();
+
+		std::vector<DamageRect> damage;
+		for(auto &clip : req.drm_clips())
+			damage.push_back(DamageRect{clip.x1(), clip.y1(), clip.x2(), clip.y2()});
+		fb->notifyDirty(std::move(damage));
 
 		resp.set_error(managarm::fs::Errors::SUCCESS);
 		auto ser = resp.SerializeAsString();
@@ -998,6 +1199,124 @@ drm_core::File::ioctl(void *object, managarm::fs::CntRequest req,
 		helix::action(&send_resp, ser.data(), ser.size()));
 		co_await transmit.async_wait();
 		HEL_CHECK(send_resp.error());
+	}else if(req.command() == DRM_IOCTL_MODE_OBJ_GETPROPERTIES) {
+		helix::SendBuffer send_resp;
+		managarm::fs::SvrResponse resp;
+
+		auto obj = self->_device->findObject(req.drm_obj_id());
+		if(obj) {
+			for(auto property : obj->getProperties()) {
+				// FB_DAMAGE_CLIPS only applies to a single commit; it always reads back as zero.
+				// We cannot read back other properties yet, hence we do not report them.
+				if(property != self->_device->fbDamageClipsProperty()) {
+					std::cout << "core/drm: Skipping property " << property->name()
+							<< " in OBJ_GETPROPERTIES" << std::endl;
+					continue;
+				}
+				resp.add_drm_obj_property_ids(property->id());
+				resp.add_drm_obj_property_values(0);
+			}
+			resp.set_error(managarm::fs::Errors::SUCCESS);
+		}else{
+			resp.set_error(managarm::fs::Errors::ILLEGAL_ARGUMENT);
+		}
+
+		auto ser = resp.SerializeAsString();
+		auto &&transmit = helix::submitAsync(conversation, helix::Dispatcher::global(),
+			helix::action(&send_resp, ser.data(), ser.size()));
+		co_await transmit.async_wait();
+		HEL_CHECK(send_resp.error());
+	}else if(req.command() == DRM_IOCTL_MODE_GETPROPERTY) {
+		helix::SendBuffer send_resp;
+		managarm::fs::SvrResponse resp;
+
+		auto property = self->_device->findProperty(req.drm_property_id());
+		if(property) {
+			uint32_t flags = 0;
+			if(std::holds_alternative<IntPropertyType>(property->propertyType())) {
+				flags = DRM_MODE_PROP_SIGNED_RANGE;
+			}else if(std::holds_alternative<ObjectPropertyType>(property->propertyType())) {
+				flags = DRM_MODE_PROP_OBJECT;
+			}else{
+				assert(std::holds_alternative<BlobPropertyType>(property->propertyType()));
+				flags = DRM_MODE_PROP_BLOB;
+			}
+
+			resp.set_drm_property_name(property->name());
+			resp.set_drm_property_flags(flags);
+			resp.set_error(managarm::fs::Errors::SUCCESS);
+		}else{
+			resp.set_error(managarm::fs::Errors::ILLEGAL_ARGUMENT);
+		}
+
+		auto ser = resp.SerializeAsString();
+		auto &&transmit = helix::submitAsync(conversation, helix::Dispatcher::global(),
+			helix::action(&send_resp, ser.data(), ser.size()));
+		co_await transmit.async_wait();
+		HEL_CHECK(send_resp.error());
+	}else if(req.command() == DRM_IOCTL_MODE_OBJ_SETPROPERTY) {
+		helix::SendBuffer send_resp;
+		managarm::fs::SvrResponse resp;
+
+		auto obj = self->_device->findObject(req.drm_obj_id());
+		auto property = self->_device->findProperty(req.drm_property_id());
+		bool attached = false;
+		if(obj && property) {
+			auto &properties = obj->getProperties();
+			attached = std::find(properties.begin(), properties.end(), property)
+					!= properties.end();
+		}
+
+		// FB_DAMAGE_CLIPS is the only property that can be set this way.
+		std::shared_ptr<Blob> blob;
+		if(attached && req.drm_property_value())
+			blob = self->resolveBlob(req.drm_property_value());
+
+		if(attached && property == self->_device->fbDamageClipsProperty()
+				&& (blob || !req.drm_property_value())
+				&& property->validate(Assignment{obj, property, 0, nullptr, blob})) {
+			auto plane = obj->asPlane();
+			assert(plane);
+			plane->setDamageClips(std::move(blob));
+			resp.set_error(managarm::fs::Errors::SUCCESS);
+		}else{
+			resp.set_error(managarm::fs::Errors::ILLEGAL_ARGUMENT);
+		}
+
+		auto ser = resp.SerializeAsString();
+		auto &&transmit = helix::submitAsync(conversation, helix::Dispatcher::global(),
+			helix::action(&send_resp, ser.data(), ser.size()));
+		co_await transmit.async_wait();
+		HEL_CHECK(send_resp.error());
+	}else if(req.command() == DRM_IOCTL_MODE_CREATEPROPBLOB) {
+		helix::SendBuffer send_resp;
+		managarm::fs::SvrResponse resp;
+
+		auto data = req.drm_blob_data();
+		auto blob = std::make_shared<Blob>(std::vector<char>(data.begin(), data.end()));
+		resp.set_drm_blob_id(self->createBlob(std::move(blob)));
+		resp.set_error(managarm::fs::Errors::SUCCESS);
+
+		auto ser = resp.SerializeAsString();
+		auto &&transmit = helix::submitAsync(conversation, helix::Dispatcher::global(),
+			helix::action(&send_resp, ser.data(), ser.size()));
+		co_await transmit.async_wait();
+		HEL_CHECK(send_resp.error());
+	}else if(req.command() == DRM_IOCTL_MODE_DESTROYPROPBLOB) {
+		helix::SendBuffer send_resp;
+		managarm::fs::SvrResponse resp;
+
+		if(self->destroyBlob(req.drm_blob_id())) {
+			resp.set_error(managarm::fs::Errors::SUCCESS);
+		}else{
+			resp.set_error(managarm::fs::Errors::ILLEGAL_ARGUMENT);
+		}
+
+		auto ser = resp.SerializeAsString();
+		auto &&transmit = helix::submitAsync(conversation, helix::Dispatcher::global(),
+			helix::action(&send_resp, ser.data(), ser.size()));
+		co_await transmit.async_wait();
+		HEL_CHECK(send_resp.error());
 	}else if(req.command() == DRM_IOCTL_MODE_DESTROY_DUMB){
 		self->_buffers.erase(req.drm_handle());
 
@@ -1048,12 +1367,20 @@ drm_core::File::poll(void *object, uint64_t sequence, async::cancellation_token
 }
 
 async::detached
-drm_core::File::_retirePageFlip(std::unique_ptr<drm_core::Configuration> config,
-			uint64_t cookie) {
+drm_core::File::_retirePageFlip(drm_core::Crtc *crtc,
+		std::unique_ptr<drm_core::Configuration> config, uint64_t cookie) {
+	// The ioctl() returns immediately. Commit right away and report the flip
+	// at the vblank that follows, at which the new FB is on screen.
+	config->commit();
 	co_await config->waitForCompletion();
+	auto vblank = co_await crtc->waitForVblank();
+	crtc->endFlip();
 
 	Event event;
 	event.cookie = cookie;
+	event.timestamp = vblank.timestamp;
+	event.crtcId = crtc->id();
+	event.sequence = vblank.sequence;
 	postEvent(event);
 }
 
@@ -1183,6 +1510,49 @@ std::optional<drm_core::FormatInfo> drm_core::getFormatInfo(uint32_t fourcc) {
 	}
 }
 
+std::vector<drm_core::DamageRect> drm_core::damageFromBlob(Blob *blob) {
+	std::vector<DamageRect> damage;
+	if(!blob)
+		return damage;
+
+	damage.resize(blob->size() / sizeof(DamageRect));
+	memcpy(damage.data(), blob->data(), damage.size() * sizeof(DamageRect));
+	return damage;
+}
+
+std::vector<drm_core::DamageRect> drm_core::clipDamage(const std::vector<DamageRect> &damage,
+		uint32_t width, uint32_t height) {
+	if(damage.empty())
+		return {DamageRect{0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height)}};
+
+	std::vector<DamageRect> clipped;
+	for(auto rect : damage) {
+		rect.x1 = std::max(rect.x1, 0);
+		rect.y1 = std::max(rect.y1, 0);
+		rect.x2 = std::min(rect.x2, static_cast<int32_t>(width));
+		rect.y2 = std::min(rect.y2, static_cast<int32_t>(height));
+		if(rect.x1 >= rect.x2 || rect.y1 >= rect.y2)
+			continue;
+		clipped.push_back(rect);
+	}
+
+	// Per-rectangle overhead (one command or one copy loop each) dominates
+	// for many small rectangles; fall back to the bounding box.
+	if(clipped.size() > maxDamageRects) {
+		DamageRect bounds = clipped.front();
+		for(auto &rect : clipped) {
+			bounds.x1 = std::min(bounds.x1, rect.x1);
+			bounds.y1 = std::min(bounds.y1, rect.y1);
+			bounds.x2 = std::max(bounds.x2, rect.x2);
+			bounds.y2 = std::max(bounds.y2, rect.y2);
+		}
+		clipped.clear();
+		clipped.push_back(bounds);
+	}
+
+	return clipped;
+}
+
 drm_mode_modeinfo drm_core::makeModeInfo(const char *name, uint32_t type,
 		uint32_t clock, unsigned int hdisplay, unsigned int hsync_start,
 		unsigned int hsync_end, unsigned int htotal, unsigned int hskew,
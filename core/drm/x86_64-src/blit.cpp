@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <cpuid.h>
+#include <immintrin.h>
+#include <string.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "core/drm/blit.hpp"
+
+namespace drm_core {
+
+namespace {
+
+// ----------------------------------------------------------------
+// Generic implementation.
+// ----------------------------------------------------------------
+
+inline uint32_t loadPixel(const char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(uint32_t));
+	return v;
+}
+
+inline void storePixel(char *p, uint32_t v) {
+	memcpy(p, &v, sizeof(uint32_t));
+}
+
+inline uint16_t packRgb565(uint32_t p) {
+	return ((p >> 8) & 0xF800) | ((p >> 5) & 0x07E0) | ((p >> 3) & 0x001F);
+}
+
+inline uint32_t unpackRgb565(uint16_t p) {
+	uint32_t r = (p >> 11) & 0x1F;
+	uint32_t g = (p >> 5) & 0x3F;
+	uint32_t b = p & 0x1F;
+	r = (r << 3) | (r >> 2);
+	g = (g << 2) | (g >> 4);
+	b = (b << 3) | (b >> 2);
+	return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+inline uint32_t swapRedBlue(uint32_t p) {
+	return (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+}
+
+// Exact x / 255 for x <= 255 * 255, rounded to nearest.
+inline uint32_t div255(uint32_t x) {
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+inline uint32_t blendPixel(uint32_t d, uint32_t s) {
+	uint32_t inv_alpha = 255 - (s >> 24);
+	uint32_t out = 0;
+	for(int shift = 0; shift < 32; shift += 8) {
+		uint32_t c = ((s >> shift) & 0xFF) + div255(((d >> shift) & 0xFF) * inv_alpha);
+		out |= std::min(c, uint32_t{255}) << shift;
+	}
+	return out;
+}
+
+void copyGeneric(void *dest, const void *src, size_t size) {
+	memcpy(dest, src, size);
+}
+
+void toRgb565Generic(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	for(size_t i = 0; i < count; i++) {
+		uint16_t v = packRgb565(loadPixel(s + i * 4));
+		memcpy(d + i * 2, &v, sizeof(uint16_t));
+	}
+}
+
+void fromRgb565Generic(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	for(size_t i = 0; i < count; i++) {
+		uint16_t v;
+		memcpy(&v, s + i * 2, sizeof(uint16_t));
+		storePixel(d + i * 4, unpackRgb565(v));
+	}
+}
+
+void swapRedBlueGeneric(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	for(size_t i = 0; i < count; i++)
+		storePixel(d + i * 4, swapRedBlue(loadPixel(s + i * 4)));
+}
+
+void blendGeneric(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	for(size_t i = 0; i < count; i++)
+		storePixel(d + i * 4, blendPixel(loadPixel(d + i * 4), loadPixel(s + i * 4)));
+}
+
+// ----------------------------------------------------------------
+// SSE2 implementation. SSE2 is part of the x86_64 baseline.
+// ----------------------------------------------------------------
+
+void copySse2(void *dest, const void *src, size_t size) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	while(size >= 64) {
+		auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+		auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 16));
+		auto c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 32));
+		auto e = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 48));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(d), a);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(d + 16), b);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(d + 32), c);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(d + 48), e);
+		d += 64;
+		s += 64;
+		size -= 64;
+	}
+	while(size >= 16) {
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(d),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(s)));
+		d += 16;
+		s += 16;
+		size -= 16;
+	}
+	memcpy(d, s, size);
+}
+
+inline __m128i packRgb565Sse2(__m128i p) {
+	auto r = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xF800));
+	auto g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07E0));
+	auto b = _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001F));
+	auto v = _mm_or_si128(_mm_or_si128(r, g), b);
+	// Sign-extend such that the signed saturation of packs_epi32 preserves all bits.
+	return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+void toRgb565Sse2(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	while(count >= 8) {
+		auto lo = packRgb565Sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s)));
+		auto hi = packRgb565Sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 16)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(d), _mm_packs_epi32(lo, hi));
+		d += 16;
+		s += 32;
+		count -= 8;
+	}
+	toRgb565Generic(d, s, count);
+}
+
+inline __m128i unpackRgb565Sse2(__m128i x) {
+	auto r = _mm_and_si128(_mm_srli_epi32(x, 11), _mm_set1_epi32(0x1F));
+	auto g = _mm_and_si128(_mm_srli_epi32(x, 5), _mm_set1_epi32(0x3F));
+	auto b = _mm_and_si128(x, _mm_set1_epi32(0x1F));
+	r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+	g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+	b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+	return _mm_or_si128(_mm_or_si128(_mm_set1_epi32(0xFF000000), _mm_slli_epi32(r, 16)),
+			_mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+
+void fromRgb565Sse2(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	auto zero = _mm_setzero_si128();
+	while(count >= 8) {
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(d),
+				unpackRgb565Sse2(_mm_unpacklo_epi16(v, zero)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(d + 16),
+				unpackRgb565Sse2(_mm_unpackhi_epi16(v, zero)));
+		d += 32;
+		s += 16;
+		count -= 8;
+	}
+	fromRgb565Generic(d, s, count);
+}
+
+void swapRedBlueSse2(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	while(count >= 4) {
+		auto p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+		auto ga = _mm_and_si128(p, _mm_set1_epi32(0xFF00FF00));
+		auto rb = _mm_and_si128(p, _mm_set1_epi32(0x00FF00FF));
+		auto v = _mm_or_si128(ga, _mm_or_si128(_mm_srli_epi32(rb, 16), _mm_slli_epi32(rb, 16)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(d), v);
+		d += 16;
+		s += 16;
+		count -= 4;
+	}
+	swapRedBlueGeneric(d, s, count);
+}
+
+// Blends two pixels that were unpacked to 16-bit channels.
+inline __m128i blendUnpackedSse2(__m128i d, __m128i s) {
+	auto alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+	auto inv_alpha = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+	auto t = _mm_add_epi16(_mm_mullo_epi16(d, inv_alpha), _mm_set1_epi16(128));
+	t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+	return _mm_adds_epu16(s, t);
+}
+
+void blendSse2(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	auto zero = _mm_setzero_si128();
+	while(count >= 4) {
+		auto sv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+		auto dv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(d));
+		auto lo = blendUnpackedSse2(_mm_unpacklo_epi8(dv, zero), _mm_unpacklo_epi8(sv, zero));
+		auto hi = blendUnpackedSse2(_mm_unpackhi_epi8(dv, zero), _mm_unpackhi_epi8(sv, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(d), _mm_packus_epi16(lo, hi));
+		d += 16;
+		s += 16;
+		count -= 4;
+	}
+	blendGeneric(d, s, count);
+}
+
+// ----------------------------------------------------------------
+// AVX2 implementation.
+// ----------------------------------------------------------------
+
+[[gnu::target("avx2")]]
+void copyAvx2(void *dest, const void *src, size_t size) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	while(size >= 128) {
+		auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+		auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 32));
+		auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 64));
+		auto e = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 96));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(d), a);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(d + 32), b);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(d + 64), c);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(d + 96), e);
+		d += 128;
+		s += 128;
+		size -= 128;
+	}
+	while(size >= 32) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(d),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s)));
+		d += 32;
+		s += 32;
+		size -= 32;
+	}
+	memcpy(d, s, size);
+}
+
+[[gnu::target("avx2")]]
+inline __m256i packRgb565Avx2(__m256i p) {
+	auto r = _mm256_and_si256(_mm256_srli_epi32(p, 8), _mm256_set1_epi32(0xF800));
+	auto g = _mm256_and_si256(_mm256_srli_epi32(p, 5), _mm256_set1_epi32(0x07E0));
+	auto b = _mm256_and_si256(_mm256_srli_epi32(p, 3), _mm256_set1_epi32(0x001F));
+	auto v = _mm256_or_si256(_mm256_or_si256(r, g), b);
+	return _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+}
+
+[[gnu::target("avx2")]]
+void toRgb565Avx2(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	while(count >= 16) {
+		auto lo = packRgb565Avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s)));
+		auto hi = packRgb565Avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 32)));
+		// packs_epi32 works per 128-bit lane; restore the pixel order afterwards.
+		auto v = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(d), v);
+		d += 32;
+		s += 64;
+		count -= 16;
+	}
+	toRgb565Sse2(d, s, count);
+}
+
+[[gnu::target("avx2")]]
+void fromRgb565Avx2(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	while(count >= 8) {
+		auto x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s)));
+		auto r = _mm256_and_si256(_mm256_srli_epi32(x, 11), _mm256_set1_epi32(0x1F));
+		auto g = _mm256_and_si256(_mm256_srli_epi32(x, 5), _mm256_set1_epi32(0x3F));
+		auto b = _mm256_and_si256(x, _mm256_set1_epi32(0x1F));
+		r = _mm256_or_si256(_mm256_slli_epi32(r, 3), _mm256_srli_epi32(r, 2));
+		g = _mm256_or_si256(_mm256_slli_epi32(g, 2), _mm256_srli_epi32(g, 4));
+		b = _mm256_or_si256(_mm256_slli_epi32(b, 3), _mm256_srli_epi32(b, 2));
+		auto v = _mm256_or_si256(
+				_mm256_or_si256(_mm256_set1_epi32(0xFF000000), _mm256_slli_epi32(r, 16)),
+				_mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(d), v);
+		d += 32;
+		s += 16;
+		count -= 8;
+	}
+	fromRgb565Generic(d, s, count);
+}
+
+[[gnu::target("avx2")]]
+void swapRedBlueAvx2(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	auto mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	while(count >= 8) {
+		auto p = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(d), _mm256_shuffle_epi8(p, mask));
+		d += 32;
+		s += 32;
+		count -= 8;
+	}
+	swapRedBlueGeneric(d, s, count);
+}
+
+[[gnu::target("avx2")]]
+inline __m256i blendUnpackedAvx2(__m256i d, __m256i s) {
+	auto alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+	auto inv_alpha = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+	auto t = _mm256_add_epi16(_mm256_mullo_epi16(d, inv_alpha), _mm256_set1_epi16(128));
+	t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+	return _mm256_adds_epu16(s, t);
+}
+
+[[gnu::target("avx2")]]
+void blendAvx2(void *dest, const void *src, size_t count) {
+	auto d = static_cast<char *>(dest);
+	auto s = static_cast<const char *>(src);
+	auto zero = _mm256_setzero_si256();
+	while(count >= 8) {
+		auto sv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+		auto dv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(d));
+		// unpack and packus both operate per 128-bit lane, so the pixel order is preserved.
+		auto lo = blendUnpackedAvx2(_mm256_unpacklo_epi8(dv, zero),
+				_mm256_unpacklo_epi8(sv, zero));
+		auto hi = blendUnpackedAvx2(_mm256_unpackhi_epi8(dv, zero),
+				_mm256_unpackhi_epi8(sv, zero));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(d), _mm256_packus_epi16(lo, hi));
+		d += 32;
+		s += 32;
+		count -= 8;
+	}
+	blendSse2(d, s, count);
+}
+
+// ----------------------------------------------------------------
+// Runtime dispatch.
+// ----------------------------------------------------------------
+
+struct Kernels {
+	const char *name;
+	void (*copy)(void *, const void *, size_t);
+	ConvertFunction toRgb565;
+	ConvertFunction fromRgb565;
+	ConvertFunction swapRedBlue;
+	ConvertFunction blend;
+};
+
+constexpr Kernels genericKernels{"generic", &copyGeneric,
+		&toRgb565Generic, &fromRgb565Generic, &swapRedBlueGeneric, &blendGeneric};
+constexpr Kernels sse2Kernels{"sse2", &copySse2,
+		&toRgb565Sse2, &fromRgb565Sse2, &swapRedBlueSse2, &blendSse2};
+constexpr Kernels avx2Kernels{"avx2", &copyAvx2,
+		&toRgb565Avx2, &fromRgb565Avx2, &swapRedBlueAvx2, &blendAvx2};
+
+bool cpuHasAvx2() {
+	unsigned int a, b, c, d;
+	if(!__get_cpuid(1, &a, &b, &c, &d))
+		return false;
+	if(!(c & bit_OSXSAVE) || !(c & bit_AVX))
+		return false;
+
+	// The kernel must have enabled the SSE and AVX state components in XCR0.
+	uint32_t xcr0_lo, xcr0_hi;
+	asm volatile ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	if((xcr0_lo & 6) != 6)
+		return false;
+
+	if(!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+		return false;
+	return b & bit_AVX2;
+}
+
+const Kernels *activeKernels = nullptr;
+
+const Kernels *kernels() {
+	if(!activeKernels)
+		activeKernels = cpuHasAvx2() ? &avx2Kernels : &sse2Kernels;
+	return activeKernels;
+}
+
+} // anonymous namespace
+
+void blitCopy(void *dest, const void *src, size_t size) {
+	kernels()->copy(dest, src, size);
+}
+
+void convertXrgb8888ToRgb565(void *dest, const void *src, size_t count) {
+	kernels()->toRgb565(dest, src, count);
+}
+
+void convertRgb565ToXrgb8888(void *dest, const void *src, size_t count) {
+	kernels()->fromRgb565(dest, src, count);
+}
+
+void convertXrgb8888ToXbgr8888(void *dest, const void *src, size_t count) {
+	kernels()->swapRedBlue(dest, src, count);
+}
+
+void blendArgb8888(void *dest, const void *src, size_t count) {
+	kernels()->blend(dest, src, count);
+}
+
+ConvertFunction findConverter(uint32_t dest_fourcc, uint32_t src_fourcc) {
+	// The X channel is ignored, hence XRGB8888 and ARGB8888 are interchangeable.
+	auto normalize = [] (uint32_t fourcc) -> uint32_t {
+		if(fourcc == DRM_FORMAT_ARGB8888)
+			return DRM_FORMAT_XRGB8888;
+		if(fourcc == DRM_FORMAT_ABGR8888)
+			return DRM_FORMAT_XBGR8888;
+		return fourcc;
+	};
+	dest_fourcc = normalize(dest_fourcc);
+	src_fourcc = normalize(src_fourcc);
+
+	if(dest_fourcc == DRM_FORMAT_RGB565 && src_fourcc == DRM_FORMAT_XRGB8888)
+		return &convertXrgb8888ToRgb565;
+	if(dest_fourcc == DRM_FORMAT_XRGB8888 && src_fourcc == DRM_FORMAT_RGB565)
+		return &convertRgb565ToXrgb8888;
+	if((dest_fourcc == DRM_FORMAT_XBGR8888 && src_fourcc == DRM_FORMAT_XRGB8888)
+			|| (dest_fourcc == DRM_FORMAT_XRGB8888 && src_fourcc == DRM_FORMAT_XBGR8888))
+		return &convertXrgb8888ToXbgr8888;
+	return nullptr;
+}
+
+const char *blitImplementation() {
+	return kernels()->name;
+}
+
+bool selectBlitImplementation(const char *name) {
+	if(!strcmp(name, "generic")) {
+		activeKernels = &genericKernels;
+	}else if(!strcmp(name, "sse2")) {
+		activeKernels = &sse2Kernels;
+	}else if(!strcmp(name, "avx2")) {
+		if(!cpuHasAvx2())
+			return false;
+		activeKernels = &avx2Kernels;
+	}else{
+		return false;
+	}
+	return true;
+}
+
+} // namespace drm_core
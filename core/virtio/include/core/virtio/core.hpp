@@ -33,9 +33,12 @@ inline constexpr arch::scalar_register<uint32_t> PCI_DEVICE_FEATURE_SELECT(0);
 inline constexpr arch::scalar_register<uint32_t> PCI_DEVICE_FEATURE_WINDOW(4);
 inline constexpr arch::scalar_register<uint32_t> PCI_DRIVER_FEATURE_SELECT(8);
 inline constexpr arch::scalar_register<uint32_t> PCI_DRIVER_FEATURE_WINDOW(12);
+inline constexpr arch::scalar_register<uint16_t> PCI_CONFIG_MSIX_VECTOR(16);
+inline constexpr arch::scalar_register<uint16_t> PCI_NUM_QUEUES(18);
 inline constexpr arch::scalar_register<uint8_t> PCI_DEVICE_STATUS(20);
 inline constexpr arch::scalar_register<uint16_t> PCI_QUEUE_SELECT(22);
 inline constexpr arch::scalar_register<uint16_t> PCI_QUEUE_SIZE(24);
+inline constexpr arch::scalar_register<uint16_t> PCI_QUEUE_MSIX_VECTOR(26);
 inline constexpr arch::scalar_register<uint16_t> PCI_QUEUE_ENABLE(28);
 inline constexpr arch::scalar_register<uint16_t> PCI_QUEUE_NOTIFY(30);
 inline constexpr arch::scalar_register<uint32_t> PCI_QUEUE_TABLE[] = {
@@ -54,6 +57,9 @@ enum {
 	PCI_L_DEVICE_SPECIFIC = 20
 };
 
+// Value of the MSI-X vector registers that disables interrupts.
+inline constexpr uint16_t VIRTIO_MSI_NO_VECTOR = 0xFFFF;
+
 // bits of the device status register
 enum {
 	ACKNOWLEDGE = 1,
@@ -1,5 +1,6 @@
 
 #include <assert.h>
+#include <algorithm>
 #include <iostream>
 #include <optional>
 
@@ -271,7 +272,8 @@ struct StandardPciTransport : Transport {
 	StandardPciTransport(protocols::hw::Device hw_device,
 			Mapping common_mapping, Mapping notify_mapping,
 			Mapping isr_mapping, Mapping device_mapping,
-			unsigned int notify_multiplier, helix::UniqueDescriptor irq);
+			unsigned int notify_multiplier, helix::UniqueDescriptor irq,
+			std::vector<helix::UniqueDescriptor> msis);
 
 	protocols::hw::Device &hwDevice() override {
 		return _hwDevice;
@@ -296,7 +298,16 @@ private:
 	arch::mem_space _isrSpace() { return arch::mem_space{_isrMapping.get()}; }
 	arch::mem_space _deviceSpace() { return arch::mem_space{_deviceMapping.get()}; }
 
+	// Vector 0 is used for configuration changes, the remaining vectors for virtqs.
+	// If there is only a single vector, it is shared by all of them.
+	size_t _queueVector(unsigned int queue_index) {
+		if(_msis.size() == 1)
+			return 0;
+		return 1 + queue_index % (_msis.size() - 1);
+	}
+
 	async::detached _processIrqs();
+	async::detached _processMsis(size_t vector);
 
 	protocols::hw::Device _hwDevice;
 	Mapping _commonMapping;
@@ -304,7 +315,9 @@ private:
 	Mapping _isrMapping;
 	Mapping _deviceMapping;
 	unsigned int _notifyMultiplier;
+	// Only used if the device does not use MSI-X.
 	helix::UniqueDescriptor _irq;
+	std::vector<helix::UniqueDescriptor> _msis;
 
 	std::vector<std::unique_ptr<StandardPciQueue>> _queues;
 };
@@ -326,11 +339,18 @@ private:
 StandardPciTransport::StandardPciTransport(protocols::hw::Device hw_device,
 		Mapping common_mapping, Mapping notify_mapping,
 		Mapping isr_mapping, Mapping device_mapping,
-		unsigned int notify_multiplier, helix::UniqueDescriptor irq)
+		unsigned int notify_multiplier, helix::UniqueDescriptor irq,
+		std::vector<helix::UniqueDescriptor> msis)
 : _hwDevice{std::move(hw_device)},
 		_commonMapping{std::move(common_mapping)}, _notifyMapping{std::move(notify_mapping)},
 		_isrMapping{std::move(isr_mapping)}, _deviceMapping{std::move(device_mapping)},
-		_notifyMultiplier{notify_multiplier}, _irq{std::move(irq)} { }
+		_notifyMultiplier{notify_multiplier}, _irq{std::move(irq)}, _msis{std::move(msis)} {
+	if(!_msis.empty()) {
+		_commonSpace().store(PCI_CONFIG_MSIX_VECTOR, 0);
+		if(_commonSpace().load(PCI_CONFIG_MSIX_VECTOR) == VIRTIO_MSI_NO_VECTOR)
+			throw std::runtime_error("virtio: Device rejected MSI-X vector for config changes");
+	}
+}
 
 uint8_t StandardPciTransport::loadConfig8(size_t offset) {
 	return _deviceSpace().load(arch::scalar_register<uint8_t>(offset));
@@ -422,6 +442,11 @@ Queue *StandardPciTransport::setupQueue(unsigned int queue_index) {
 	_commonSpace().store(PCI_QUEUE_AVAILABLE[1], available_physical >> 32);
 	_commonSpace().store(PCI_QUEUE_USED[0], used_physical);
 	_commonSpace().store(PCI_QUEUE_USED[1], used_physical >> 32);
+	if(!_msis.empty()) {
+		_commonSpace().store(PCI_QUEUE_MSIX_VECTOR, _queueVector(queue_index));
+		if(_commonSpace().load(PCI_QUEUE_MSIX_VECTOR) == VIRTIO_MSI_NO_VECTOR)
+			throw std::runtime_error("virtio: Device rejected MSI-X vector for virtq");
+	}
 	_commonSpace().store(PCI_QUEUE_ENABLE, 1);
 
 	return _queues[queue_index].get();
@@ -431,7 +456,38 @@ void StandardPciTransport::runDevice() {
 	// Finally set the DRIVER_OK bit to finish the configuration.
 	_commonSpace().store(PCI_DEVICE_STATUS, _commonSpace().load(PCI_DEVICE_STATUS) | DRIVER_OK);
 
-	_processIrqs();
+	if(_msis.empty()) {
+		_processIrqs();
+	}else{
+		for(size_t i = 0; i < _msis.size(); i++)
+			_processMsis(i);
+	}
+}
+
+async::detached StandardPciTransport::_processMsis(size_t vector) {
+	auto &irq = _msis[vector];
+
+	uint64_t sequence = 0;
+	while(true) {
+		auto await = co_await helix_ng::awaitEvent(irq, sequence);
+		HEL_CHECK(await.error());
+		sequence = await.sequence();
+
+		// MSIs are edge-triggered and not shared. Hence, we can acknowledge them
+		// right away and we do not need to read the ISR.
+		HEL_CHECK(helAcknowledgeIrq(irq.getHandle(), kHelAckAcknowledge, sequence));
+
+		if(!vector) {
+			if(_msis.size() > 1)
+				std::cout << "core-virtio: Configuration change" << std::endl;
+			auto status = _commonSpace().load(PCI_DEVICE_STATUS);
+			assert(!(status & DEVICE_NEEDS_RESET));
+		}
+
+		for(auto &queue : _queues)
+			if(_queueVector(queue->queueIndex()) == vector)
+				queue->processInterrupt();
+	}
 }
 
 async::detached StandardPciTransport::_processIrqs() {
@@ -528,7 +584,11 @@ void StandardPciQueue::notifyTransport() {
 async::result<std::unique_ptr<Transport>>
 discover(protocols::hw::Device hw_device, DiscoverMode mode) {
 	auto info = co_await hw_device.getPciInfo();
-	auto irq = co_await hw_device.accessIrq();
+
+	bool have_msix = false;
+	for(size_t i = 0; i < info.caps.size(); i++)
+		if(info.caps[i].type == 0x11)
+			have_msix = true;
 
 	if(mode == DiscoverMode::transitional || mode == DiscoverMode::modernOnly) {
 		std::optional<Mapping> common_mapping;
@@ -580,11 +640,31 @@ discover(protocols::hw::Device hw_device, DiscoverMode mode) {
 			common_space.store(PCI_DEVICE_STATUS,
 					common_space.load(PCI_DEVICE_STATUS) | DRIVER);
 
+			// Try to get one MSI-X vector for configuration changes and one per virtq.
+			// If the first vector cannot be allocated, the device keeps using INTx.
+			std::vector<helix::UniqueDescriptor> msis;
+			helix::UniqueDescriptor irq;
+			if(have_msix) {
+				auto count = std::min(info.numMsis,
+						common_space.load(PCI_NUM_QUEUES) + 1u);
+				for(unsigned int i = 0; i < count; i++) {
+					auto msi = co_await hw_device.accessMsi(i);
+					if(!msi)
+						break;
+					msis.push_back(std::move(msi));
+				}
+			}
+			if(msis.empty()) {
+				irq = co_await hw_device.accessIrq();
+			}else{
+				std::cout << "virtio: Using " << msis.size() << " MSI-X vectors" << std::endl;
+			}
+
 			std::cout << "virtio: Using standard PCI transport" << std::endl;
 			co_return std::make_unique<StandardPciTransport>(std::move(hw_device),
 					std::move(*common_mapping), std::move(*notify_mapping),
 					std::move(*isr_mapping), std::move(*device_mapping),
-					notify_multiplier, std::move(irq));
+					notify_multiplier, std::move(irq), std::move(msis));
 		}
 	}
 
@@ -605,6 +685,10 @@ discover(protocols::hw::Device hw_device, DiscoverMode mode) {
 			legacy_space.store(PCI_L_DEVICE_STATUS,
 					legacy_space.load(PCI_L_DEVICE_STATUS) | DRIVER);
 
+			// Note that the legacy transport does not support MSI-X as that
+			// changes the layout of the legacy registers.
+			auto irq = co_await hw_device.accessIrq();
+
 			std::cout << "virtio: Using legacy PCI transport" << std::endl;
 			co_return std::make_unique<LegacyPciTransport>(std::move(hw_device),
 					legacy_space, std::move(irq));
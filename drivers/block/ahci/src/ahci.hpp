@@ -0,0 +1,189 @@
+#ifndef AHCI_AHCI_HPP
+#define AHCI_AHCI_HPP
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <arch/dma_pool.hpp>
+#include <arch/mem_space.hpp>
+#include <async/doorbell.hpp>
+#include <async/result.hpp>
+#include <helix/ipc.hpp>
+#include <helix/memory.hpp>
+#include <protocols/hw/client.hpp>
+
+#include <blockfs.hpp>
+
+#include "spec.hpp"
+
+namespace block {
+namespace ahci {
+
+// Suspends the calling coroutine for the given number of nanoseconds.
+async::result<void> sleepFor(uint64_t nanos);
+
+struct Controller;
+
+// --------------------------------------------------------
+// Port
+// --------------------------------------------------------
+
+// A port with an attached SATA disk. Read and write requests are issued as
+// NCQ commands (if the disk supports them) such that up to 32 commands are
+// outstanding at the same time.
+struct Port final : blockfs::BlockDevice {
+	Port(Controller *controller, unsigned int index, arch::mem_space space);
+
+	// Starts the command engine. Returns false if no SATA disk is attached.
+	async::result<bool> initialize();
+
+	// Identifies the disk and hands it to libblockfs.
+	async::detached run();
+
+	// Called by the controller when the port's bit in the HBA's IS register is set.
+	void handleIrq();
+
+	async::result<void> readSectors(uint64_t sector, void *buffer,
+			size_t num_sectors) override;
+
+	async::result<void> writeSectors(uint64_t sector, const void *buffer,
+			size_t num_sectors) override;
+
+private:
+	enum class Command {
+		identify,
+		readNcqLog,
+		read,
+		write
+	};
+
+	struct Request {
+		Request(Command command, uint64_t sector, void *buffer, size_t numSectors)
+		: command{command}, sector{sector}, buffer{buffer}, numSectors{numSectors} { }
+
+		Command command;
+		uint64_t sector;
+		void *buffer;
+		size_t numSectors;
+		unsigned int retries = 0;
+		// Set if the command could not be completed; checked once the promise is raised.
+		bool failed = false;
+		async::promise<void> promise;
+	};
+
+	// Returns false if any part of the transfer failed.
+	async::result<bool> _transfer(Command command, uint64_t sector,
+			void *buffer, size_t num_sectors);
+
+	// Moves requests from _pendingQueue to free command slots.
+	async::detached _processRequests();
+
+	bool _isQueued(Request *request);
+	void _issue(unsigned int slot, Request *request);
+	void _complete(unsigned int slot);
+	// Completes a request that was not (or not successfully) executed.
+	void _failRequest(Request *request);
+
+	// Restarts the command engine after an error and retries all outstanding commands.
+	void _recover(arch::bit_value<uint32_t> is);
+
+	// Stops using the port after it could not be recovered; all requests fail from now on.
+	void _failPort(const char *reason);
+
+	// Returns false if the engine does not stop within the time that the spec allows.
+	bool _stopCommandEngine();
+	void _startCommandEngine();
+
+	Controller *_controller;
+	unsigned int _index;
+	arch::mem_space _space;
+
+	arch::dma_object<CommandList> _commandList;
+	arch::dma_object<ReceivedFis> _receivedFis;
+	std::vector<arch::dma_object<CommandTable>> _commandTables;
+	// Receives IDENTIFY data and the NCQ error log.
+	arch::dma_buffer _scratchBuffer;
+
+	// Requests that have not been issued yet.
+	std::deque<Request *> _pendingQueue;
+	// Rung whenever a request is queued or a command slot becomes free.
+	async::doorbell _doorbell;
+
+	std::array<Request *, maxCommandSlots> _slotRequests{};
+	uint32_t _activeSlots = 0;
+	// Non-queued commands cannot overlap with any other command.
+	bool _nonQueuedActive = false;
+	// Set by _failPort().
+	bool _failed = false;
+
+	// Mask of command slots that may be used for this disk.
+	uint32_t _slotMask = 1;
+	bool _supportsNcq = false;
+	bool _supportsLba48 = false;
+	uint64_t _numSectors = 0;
+};
+
+// --------------------------------------------------------
+// Controller
+// --------------------------------------------------------
+
+struct Controller {
+	Controller(protocols::hw::Device hw_device, helix::Mapping mapping,
+			helix::UniqueDescriptor mmio, helix::UniqueDescriptor irq, bool use_msi);
+
+	async::detached run();
+
+	arch::os::contiguous_pool *memoryPool() {
+		return &_memoryPool;
+	}
+
+	unsigned int numCommandSlots() {
+		return _numCommandSlots;
+	}
+
+	bool supportsNcq() {
+		return _supportsNcq;
+	}
+
+	bool supports64Bit() {
+		return _supports64Bit;
+	}
+
+	bool supportsCommandListOverride() {
+		return _supportsClo;
+	}
+
+	bool supportsStaggeredSpinup() {
+		return _supportsSss;
+	}
+
+private:
+	// Both return false if the HBA does not respond in time.
+	async::result<bool> _takeOwnership();
+	async::result<bool> _reset();
+
+	async::detached _handleIrqs();
+
+	protocols::hw::Device _hwDevice;
+	helix::Mapping _mapping;
+	helix::UniqueDescriptor _mmio;
+	helix::UniqueDescriptor _irq;
+	bool _useMsi;
+	arch::mem_space _space;
+	arch::os::contiguous_pool _memoryPool;
+
+	unsigned int _numCommandSlots = 1;
+	bool _supportsNcq = false;
+	bool _supports64Bit = false;
+	bool _supportsClo = false;
+	bool _supportsSss = false;
+
+	// Indexed by port number; null for ports without a disk.
+	std::array<std::unique_ptr<Port>, 32> _ports;
+};
+
+} } // namespace block::ahci
+
+#endif // AHCI_AHCI_HPP
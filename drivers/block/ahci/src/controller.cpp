@@ -0,0 +1,229 @@
+#include <assert.h>
+#include <stdio.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <async/result.hpp>
+#include <hel.h>
+#include <hel-syscalls.h>
+#include <helix/ipc.hpp>
+#include <protocols/hw/client.hpp>
+#include <protocols/mbus/client.hpp>
+
+#include "ahci.hpp"
+
+namespace block {
+namespace ahci {
+
+namespace {
+	constexpr bool logIrqs = false;
+}
+
+async::result<void> sleepFor(uint64_t nanos) {
+	uint64_t tick;
+	HEL_CHECK(helGetClock(&tick));
+
+	helix::AwaitClock await_clock;
+	auto &&submit = helix::submitAwaitClock(&await_clock, tick + nanos,
+			helix::Dispatcher::global());
+	co_await submit.async_wait();
+	HEL_CHECK(await_clock.error());
+}
+
+// --------------------------------------------------------
+// Controller
+// --------------------------------------------------------
+
+Controller::Controller(protocols::hw::Device hw_device, helix::Mapping mapping,
+		helix::UniqueDescriptor mmio, helix::UniqueDescriptor irq, bool use_msi)
+: _hwDevice{std::move(hw_device)}, _mapping{std::move(mapping)},
+		_mmio{std::move(mmio)}, _irq{std::move(irq)}, _useMsi{use_msi},
+		_space{_mapping.get()} { }
+
+async::detached Controller::run() {
+	co_await _hwDevice.enableBusmaster();
+	if(!(co_await _takeOwnership())) {
+		printf("block/ahci: BIOS/OS handoff timed out, ignoring controller\n");
+		co_return;
+	}
+	if(!(co_await _reset())) {
+		printf("block/ahci: HBA reset timed out, ignoring controller\n");
+		co_return;
+	}
+
+	auto caps = _space.load(regs::cap);
+	_numCommandSlots = (caps & cap::numCommandSlots) + 1;
+	_supportsNcq = caps & cap::supportsNcq;
+	_supports64Bit = caps & cap::supports64Bit;
+	_supportsClo = caps & cap::supportsCommandListOverride;
+	_supportsSss = caps & cap::supportsStaggeredSpinup;
+
+	auto version = _space.load(regs::vs);
+	auto implemented = _space.load(regs::pi);
+	printf("block/ahci: AHCI %u.%u%u, %u ports (implemented: 0x%x), %u command slots,"
+			" %s NCQ, %s 64-bit DMA\n",
+			version >> 16, (version >> 8) & 0xFF, version & 0xFF,
+			(caps & cap::numPorts) + 1, implemented, _numCommandSlots,
+			_supportsNcq ? "supports" : "doesn't support",
+			_supports64Bit ? "supports" : "doesn't support");
+
+	for(unsigned int i = 0; i < 32; i++) {
+		if(!(implemented & (uint32_t(1) << i)))
+			continue;
+		auto port = std::make_unique<Port>(this, i,
+				_space.subspace(portBase + i * portSize));
+		if(!(co_await port->initialize()))
+			continue;
+		_ports[i] = std::move(port);
+	}
+
+	// Discard IRQs that are left over from the reset before enabling IRQs.
+	_space.store(regs::is, 0xFFFFFFFF);
+	if(!_useMsi)
+		co_await _hwDevice.enableBusIrq();
+	_handleIrqs();
+	_space.store(regs::ghc, _space.load(regs::ghc) | ghc::irqEnable(true));
+
+	for(auto &port : _ports)
+		if(port)
+			port->run();
+}
+
+// Performs the BIOS/OS handoff if the HBA supports it.
+async::result<bool> Controller::_takeOwnership() {
+	if(!(_space.load(regs::cap2) & cap2::biosHandoff))
+		co_return true;
+
+	// The BIOS has to set BOHC.BB within 25ms if it needs to finish outstanding commands;
+	// in that case, it may take up to two more seconds (AHCI 1.3.1, section 10.6.3).
+	_space.store(regs::bohc, _space.load(regs::bohc) | bohc::osOwned(true));
+	for(int i = 0; _space.load(regs::bohc) & bohc::biosOwned; i++) {
+		// Poll in 5ms steps: 5 steps without BOHC.BB, 405 steps (2s more) with BOHC.BB.
+		auto limit = (_space.load(regs::bohc) & bohc::biosBusy) ? 405 : 5;
+		if(i >= limit)
+			co_return false;
+		co_await sleepFor(5'000'000);
+	}
+	co_return true;
+}
+
+async::result<bool> Controller::_reset() {
+	_space.store(regs::ghc, ghc::ahciEnable(true));
+	_space.store(regs::ghc, ghc::ahciEnable(true) | ghc::hbaReset(true));
+
+	// The HBA has to complete the reset within one second.
+	for(int i = 0; _space.load(regs::ghc) & ghc::hbaReset; i++) {
+		if(i == 100)
+			co_return false;
+		co_await sleepFor(10'000'000);
+	}
+
+	// The reset clears GHC.AE again.
+	_space.store(regs::ghc, ghc::ahciEnable(true));
+	co_return true;
+}
+
+async::detached Controller::_handleIrqs() {
+	uint64_t sequence = 0;
+	while(true) {
+		auto await = co_await helix_ng::awaitEvent(_irq, sequence);
+		HEL_CHECK(await.error());
+		sequence = await.sequence();
+		if(logIrqs)
+			std::cout << "block/ahci: IRQ fired" << std::endl;
+
+		// MSIs are edge-triggered and not shared; acknowledge them before reading IS
+		// such that we do not miss events that arrive while we process the ports.
+		if(_useMsi)
+			HEL_CHECK(helAcknowledgeIrq(_irq.getHandle(), kHelAckAcknowledge, sequence));
+
+		auto is = _space.load(regs::is);
+		if(!is) {
+			if(!_useMsi)
+				HEL_CHECK(helAcknowledgeIrq(_irq.getHandle(), kHelAckNack, sequence));
+			continue;
+		}
+
+		// PxIS has to be cleared before the corresponding bit in IS.
+		// Loop until IS stays clear since ports might raise new events in between.
+		while(is) {
+			for(unsigned int i = 0; i < 32; i++) {
+				if(!(is & (uint32_t(1) << i)))
+					continue;
+				if(_ports[i])
+					_ports[i]->handleIrq();
+			}
+			_space.store(regs::is, is);
+			is = _space.load(regs::is);
+		}
+
+		if(!_useMsi)
+			HEL_CHECK(helAcknowledgeIrq(_irq.getHandle(), kHelAckAcknowledge, sequence));
+	}
+}
+
+} } // namespace block::ahci
+
+std::vector<std::unique_ptr<block::ahci::Controller>> globalControllers;
+
+// ------------------------------------------------------------------------
+// Freestanding discovery functions.
+// ------------------------------------------------------------------------
+
+async::detached bindController(mbus::Entity entity) {
+	protocols::hw::Device device(co_await entity.bind());
+	auto info = co_await device.getPciInfo();
+	// ABAR is always BAR 5.
+	assert(info.barInfo[5].ioType == protocols::hw::IoType::kIoTypeMemory);
+	auto bar = co_await device.accessBar(5);
+
+	// Prefer an MSI; fall back to the legacy IRQ if no vector is available.
+	helix::UniqueDescriptor irq;
+	if(info.numMsis)
+		irq = co_await device.accessMsi(0);
+	bool use_msi = static_cast<bool>(irq);
+	if(!use_msi)
+		irq = co_await device.accessIrq();
+	printf("block/ahci: Using %s\n", use_msi ? "MSI" : "legacy IRQ");
+
+	helix::Mapping mapping{bar, info.barInfo[5].offset, info.barInfo[5].length};
+
+	auto controller = std::make_unique<block::ahci::Controller>(std::move(device),
+			std::move(mapping), std::move(bar), std::move(irq), use_msi);
+	controller->run();
+	globalControllers.push_back(std::move(controller));
+}
+
+async::detached observeControllers() {
+	auto root = co_await mbus::Instance::global().getRoot();
+
+	auto filter = mbus::Conjunction({
+		mbus::EqualsFilter("pci-class", "01"),
+		mbus::EqualsFilter("pci-subclass", "06"),
+		mbus::EqualsFilter("pci-interface", "01")
+	});
+
+	auto handler = mbus::ObserverHandler{}
+	.withAttach([] (mbus::Entity entity, mbus::Properties) {
+		printf("block/ahci: Detected controller\n");
+		bindController(std::move(entity));
+	});
+
+	co_await root.linkObserver(std::move(filter), std::move(handler));
+}
+
+// --------------------------------------------------------
+// main() function
+// --------------------------------------------------------
+
+int main() {
+	printf("block/ahci: Starting driver\n");
+
+	{
+		async::queue_scope scope{helix::globalQueue()};
+		observeControllers();
+	}
+
+	async::run_forever(helix::globalQueue()->run_token(), helix::currentDispatcher);
+}
@@ -0,0 +1,545 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+#include <hel.h>
+#include <hel-syscalls.h>
+
+#include "ahci.hpp"
+
+namespace block {
+namespace ahci {
+
+namespace {
+	constexpr bool logRequests = false;
+
+	constexpr size_t pageSize = 0x1000;
+
+	// Even if the buffer is not page aligned, such a transfer fits into numPrdEntries PRDs.
+	constexpr size_t maxSectorsPerCommand = 256;
+	static_assert((maxSectorsPerCommand * 512) / pageSize + 1 <= numPrdEntries);
+
+	// Number of times that a command is retried after an error.
+	constexpr unsigned int maxRetries = 3;
+
+	// PxCMD.CR and PxCMD.FR have to clear within 500ms after PxCMD.ST (resp. PxCMD.FRE)
+	// is cleared (AHCI 1.3.1, section 10.1.2). We use the same timeout for PxCMD.CLO.
+	constexpr uint64_t commandEngineTimeout = 500'000'000;
+
+	// PxIS bits that indicate that the command engine stopped.
+	const arch::bit_value<uint32_t> errorMask = pxis::overflow(true)
+			| pxis::interfaceNonFatal(true) | pxis::interfaceFatal(true)
+			| pxis::hostBusData(true) | pxis::hostBusFatal(true)
+			| pxis::taskFileError(true);
+
+	const arch::bit_value<uint32_t> irqMask = errorMask
+			| pxis::d2hRegisterFis(true) | pxis::pioSetupFis(true)
+			| pxis::setDeviceBitsFis(true) | pxis::unknownFis(true);
+
+	bool isBusy(arch::bit_value<uint32_t> tfd) {
+		return (tfd & pxtfd::bsy) || (tfd & pxtfd::drq);
+	}
+
+	uintptr_t physicalOf(void *pointer) {
+		uintptr_t physical;
+		HEL_CHECK(helPointerPhysical(pointer, &physical));
+		return physical;
+	}
+
+	// Polls until the bit of PxCMD clears. Returns false if it is still set after the timeout.
+	// This runs in the IRQ path, hence we cannot sleep.
+	bool waitForCmdClear(arch::mem_space space, arch::field<uint32_t, bool> bit,
+			uint64_t timeout) {
+		uint64_t start;
+		HEL_CHECK(helGetClock(&start));
+		while(space.load(port_regs::cmd) & bit) {
+			uint64_t now;
+			HEL_CHECK(helGetClock(&now));
+			if(now - start > timeout)
+				return false;
+		}
+		return true;
+	}
+}
+
+Port::Port(Controller *controller, unsigned int index, arch::mem_space space)
+: BlockDevice{512}, _controller{controller}, _index{index}, _space{space},
+		_commandList{controller->memoryPool()}, _receivedFis{controller->memoryPool()},
+		_scratchBuffer{controller->memoryPool(), 512} {
+	for(size_t i = 0; i < controller->numCommandSlots(); i++)
+		_commandTables.push_back(arch::dma_object<CommandTable>{controller->memoryPool()});
+}
+
+async::result<bool> Port::initialize() {
+	if(!_stopCommandEngine()) {
+		printf("block/ahci: Cannot stop the command engine of port %u\n", _index);
+		co_return false;
+	}
+
+	memset(_commandList.data(), 0, sizeof(CommandList));
+	memset(_receivedFis.data(), 0, sizeof(ReceivedFis));
+	for(size_t i = 0; i < _commandTables.size(); i++) {
+		auto table = physicalOf(_commandTables[i].data());
+		_commandList.data()->slots[i].tableAddress.store(table);
+		_commandList.data()->slots[i].tableAddressHigh.store(table >> 32);
+	}
+
+	auto commandList = physicalOf(_commandList.data());
+	auto receivedFis = physicalOf(_receivedFis.data());
+	if(!_controller->supports64Bit() && ((commandList >> 32) || (receivedFis >> 32))) {
+		printf("block/ahci: DMA memory of port %u is not 32-bit addressable\n", _index);
+		co_return false;
+	}
+	_space.store(port_regs::clb, commandList);
+	_space.store(port_regs::clbu, commandList >> 32);
+	_space.store(port_regs::fb, receivedFis);
+	_space.store(port_regs::fbu, receivedFis >> 32);
+
+	auto command = _space.load(port_regs::cmd) | pxcmd::fisReceiveEnable(true);
+	if(_controller->supportsStaggeredSpinup())
+		command |= pxcmd::spinUpDevice(true) | pxcmd::powerOnDevice(true);
+	_space.store(port_regs::cmd, command);
+
+	// Give the link up to 10ms to come up.
+	for(int i = 0; (_space.load(port_regs::ssts) & pxssts::detection) != detectionPresent; i++) {
+		if(i == 10)
+			co_return false;
+		co_await sleepFor(1'000'000);
+	}
+
+	auto signature = _space.load(port_regs::sig);
+	if(signature != signatureAta) {
+		printf("block/ahci: Ignoring port %u with signature 0x%x%s\n", _index, signature,
+				signature == signatureAtapi ? " (ATAPI)" : "");
+		co_return false;
+	}
+
+	// Wait until the device is ready to accept commands.
+	for(int i = 0; isBusy(_space.load(port_regs::tfd)); i++) {
+		if(i == 100) {
+			printf("block/ahci: Device on port %u does not become ready\n", _index);
+			co_return false;
+		}
+		co_await sleepFor(10'000'000);
+	}
+
+	_space.store(port_regs::serr, 0xFFFFFFFF);
+	_space.store(port_regs::is, arch::bit_value<uint32_t>{0xFFFFFFFF});
+	_space.store(port_regs::ie, irqMask);
+	_startCommandEngine();
+
+	_processRequests();
+	co_return true;
+}
+
+async::detached Port::run() {
+	if(!(co_await _transfer(Command::identify, 0, _scratchBuffer.data(), 1))) {
+		printf("block/ahci: Cannot identify the disk on port %u\n", _index);
+		co_return;
+	}
+
+	auto identify = reinterpret_cast<uint16_t *>(_scratchBuffer.data());
+
+	char model[41];
+	for(int i = 0; i < 20; i++) {
+		// The model string is stored in big endian 16-bit words.
+		model[2 * i] = identify[27 + i] >> 8;
+		model[2 * i + 1] = identify[27 + i] & 0xFF;
+	}
+	model[40] = 0;
+
+	_supportsLba48 = identify[83] & (1 << 10);
+	if(_supportsLba48) {
+		_numSectors = static_cast<uint64_t>(identify[100])
+				| (static_cast<uint64_t>(identify[101]) << 16)
+				| (static_cast<uint64_t>(identify[102]) << 32)
+				| (static_cast<uint64_t>(identify[103]) << 48);
+	}else{
+		_numSectors = static_cast<uint64_t>(identify[60])
+				| (static_cast<uint64_t>(identify[61]) << 16);
+	}
+
+	// Word 106 is valid if bit 14 is set and bit 15 is clear.
+	if((identify[106] & 0xC000) == 0x4000 && (identify[106] & (1 << 12))) {
+		auto words = static_cast<uint32_t>(identify[117])
+				| (static_cast<uint32_t>(identify[118]) << 16);
+		if(words * 2 != sectorSize) {
+			printf("block/ahci: Disk on port %u has unsupported logical sector size %u\n",
+					_index, words * 2);
+			co_return;
+		}
+	}
+
+	_supportsNcq = _controller->supportsNcq() && (identify[76] & (1 << 8));
+	unsigned int depth = 1;
+	if(_supportsNcq) {
+		depth = std::min((identify[75] & 0x1F) + 1u, _controller->numCommandSlots());
+		_slotMask = (depth == 32) ? 0xFFFFFFFF : ((uint32_t(1) << depth) - 1);
+	}
+
+	printf("block/ahci: Port %u: model '%s', %lu sectors, %s 48-bit LBA, ",
+			_index, model, _numSectors, _supportsLba48 ? "supports" : "doesn't support");
+	if(_supportsNcq) {
+		printf("NCQ with queue depth %u\n", depth);
+	}else{
+		printf("no NCQ\n");
+	}
+
+	blockfs::runDevice(this);
+}
+
+void Port::handleIrq() {
+	auto is = _space.load(port_regs::is);
+	_space.store(port_regs::is, is);
+	if(_failed)
+		return;
+
+	// Commands are done once both their PxCI bit and (for NCQ) their PxSACT bit are clear.
+	// On errors, the bits of the failed commands stay set.
+	auto busy = _space.load(port_regs::ci) | _space.load(port_regs::sact);
+	auto completed = _activeSlots & ~busy;
+	for(unsigned int i = 0; i < maxCommandSlots; i++)
+		if(completed & (uint32_t(1) << i))
+			_complete(i);
+
+	if(static_cast<uint32_t>(is) & static_cast<uint32_t>(errorMask))
+		_recover(is);
+}
+
+async::result<void> Port::readSectors(uint64_t sector,
+		void *buffer, size_t num_sectors) {
+	if(!(co_await _transfer(Command::read, sector, buffer, num_sectors)))
+		throw std::runtime_error("block/ahci: I/O error");
+}
+
+async::result<void> Port::writeSectors(uint64_t sector,
+		const void *buffer, size_t num_sectors) {
+	if(!(co_await _transfer(Command::write, sector, const_cast<void *>(buffer), num_sectors)))
+		throw std::runtime_error("block/ahci: I/O error");
+}
+
+async::result<bool> Port::_transfer(Command command, uint64_t sector,
+		void *buffer, size_t num_sectors) {
+	// PRDs must describe an even number of bytes at an even address.
+	assert(!(reinterpret_cast<uintptr_t>(buffer) & 1));
+
+	if(logRequests)
+		std::cout << "block/ahci: Port " << _index << ": "
+				<< (command == Command::write ? "writing " : "reading ")
+				<< num_sectors << " sectors at " << sector << std::endl;
+
+	if(_failed)
+		co_return false;
+
+	// Queue all chunks at once such that the disk can reorder them.
+	std::vector<std::unique_ptr<Request>> requests;
+	for(size_t progress = 0; progress < num_sectors; progress += maxSectorsPerCommand) {
+		auto request = std::make_unique<Request>(command, sector + progress,
+				reinterpret_cast<char *>(buffer) + sectorSize * progress,
+				std::min(num_sectors - progress, maxSectorsPerCommand));
+		_pendingQueue.push_back(request.get());
+		requests.push_back(std::move(request));
+	}
+	_doorbell.ring();
+
+	// Wait for all chunks before returning; the port references the requests.
+	bool success = true;
+	for(auto &request : requests) {
+		co_await request->promise.async_get();
+		if(request->failed)
+			success = false;
+	}
+	co_return success;
+}
+
+async::detached Port::_processRequests() {
+	while(true) {
+		if(_pendingQueue.empty()) {
+			co_await _doorbell.async_wait();
+			continue;
+		}
+
+		auto request = _pendingQueue.front();
+		if(_failed) {
+			_pendingQueue.pop_front();
+			_failRequest(request);
+			continue;
+		}
+		auto queued = _isQueued(request);
+		auto free = _slotMask & ~_activeSlots;
+		if(_nonQueuedActive || (!queued && _activeSlots) || !free) {
+			co_await _doorbell.async_wait();
+			continue;
+		}
+		_pendingQueue.pop_front();
+
+		auto slot = __builtin_ctz(free);
+		_issue(slot, request);
+	}
+}
+
+bool Port::_isQueued(Request *request) {
+	return _supportsNcq
+			&& (request->command == Command::read || request->command == Command::write);
+}
+
+void Port::_issue(unsigned int slot, Request *request) {
+	assert(request->numSectors && request->numSectors <= maxSectorsPerCommand);
+	auto queued = _isQueued(request);
+	auto write = request->command == Command::write;
+
+	if(!_controller->supports64Bit()) {
+		auto pointer = reinterpret_cast<char *>(request->buffer);
+		size_t length = request->numSectors * sectorSize;
+		for(size_t progress = 0; progress < length; ) {
+			auto misalign = reinterpret_cast<uintptr_t>(pointer + progress) & (pageSize - 1);
+			if(physicalOf(pointer + progress) >> 32) {
+				printf("block/ahci: Port %u: Buffer is not 32-bit addressable\n", _index);
+				_failRequest(request);
+				return;
+			}
+			progress += pageSize - misalign;
+		}
+	}
+
+	auto table = _commandTables[slot].data();
+	memset(table->commandFis, 0, sizeof(table->commandFis));
+
+	// Build the command FIS.
+	H2dRegisterFis fis{};
+	fis.type = fisTypeH2dRegister;
+	fis.flags = 0x80;
+	switch(request->command) {
+	case Command::identify:
+		fis.command = kCommandIdentify;
+		break;
+	case Command::readNcqLog:
+		fis.command = kCommandReadLogExt;
+		fis.lba0 = kLogNcqCommandError;
+		fis.countLow = 1;
+		break;
+	case Command::read:
+	case Command::write:
+		fis.lba0 = request->sector;
+		fis.lba1 = request->sector >> 8;
+		fis.lba2 = request->sector >> 16;
+		fis.device = kDeviceLba;
+		if(queued) {
+			fis.command = write ? kCommandWriteFpdmaQueued : kCommandReadFpdmaQueued;
+			// For NCQ, the sector count is passed in the feature field
+			// while the count field holds the tag.
+			fis.featureLow = request->numSectors;
+			fis.featureHigh = request->numSectors >> 8;
+			fis.countLow = slot << 3;
+			fis.lba3 = request->sector >> 24;
+			fis.lba4 = request->sector >> 32;
+			fis.lba5 = request->sector >> 40;
+		}else if(_supportsLba48) {
+			fis.command = write ? kCommandWriteDmaExt : kCommandReadDmaExt;
+			fis.countLow = request->numSectors;
+			fis.countHigh = request->numSectors >> 8;
+			fis.lba3 = request->sector >> 24;
+			fis.lba4 = request->sector >> 32;
+			fis.lba5 = request->sector >> 40;
+		}else{
+			assert(!(request->sector >> 28));
+			fis.command = write ? kCommandWriteDma : kCommandReadDma;
+			fis.countLow = request->numSectors; // 256 sectors are encoded as zero.
+			fis.device |= (request->sector >> 24) & 0x0F;
+		}
+		break;
+	}
+	memcpy(table->commandFis, &fis, sizeof(H2dRegisterFis));
+
+	// Build the PRDT. Each PRD covers a physically contiguous part of the buffer.
+	auto pointer = reinterpret_cast<char *>(request->buffer);
+	size_t length = request->numSectors * sectorSize;
+	size_t numPrds = 0;
+	uintptr_t prdPhysical = 0;
+	size_t prdBytes = 0;
+	auto flushPrd = [&] {
+		assert(numPrds < numPrdEntries);
+		table->prdt[numPrds].address.store(prdPhysical);
+		table->prdt[numPrds].addressHigh.store(prdPhysical >> 32);
+		table->prdt[numPrds].byteCount.store(prdBytes - 1);
+		numPrds++;
+	};
+	for(size_t progress = 0; progress < length; ) {
+		auto misalign = reinterpret_cast<uintptr_t>(pointer + progress) & (pageSize - 1);
+		auto chunk = std::min(length - progress, pageSize - misalign);
+		auto physical = physicalOf(pointer + progress);
+		assert(_controller->supports64Bit() || !(physical >> 32));
+
+		if(prdBytes && prdPhysical + prdBytes == physical && prdBytes + chunk <= maxPrdBytes) {
+			prdBytes += chunk;
+		}else{
+			if(prdBytes)
+				flushPrd();
+			prdPhysical = physical;
+			prdBytes = chunk;
+		}
+		progress += chunk;
+	}
+	flushPrd();
+
+	auto &header = _commandList.data()->slots[slot];
+	header.flags.store(command_header::fisLength(sizeof(H2dRegisterFis) / 4)
+			| command_header::write(write)
+			| command_header::prdtLength(numPrds));
+	header.prdByteCount.store(0);
+
+	_slotRequests[slot] = request;
+	_activeSlots |= uint32_t(1) << slot;
+	if(queued) {
+		_space.store(port_regs::sact, uint32_t(1) << slot);
+	}else{
+		_nonQueuedActive = true;
+	}
+	_space.store(port_regs::ci, uint32_t(1) << slot);
+}
+
+void Port::_complete(unsigned int slot) {
+	auto request = _slotRequests[slot];
+	assert(request);
+	_slotRequests[slot] = nullptr;
+	_activeSlots &= ~(uint32_t(1) << slot);
+	if(!_isQueued(request))
+		_nonQueuedActive = false;
+
+	if(request->command == Command::readNcqLog) {
+		auto log = reinterpret_cast<uint8_t *>(_scratchBuffer.data());
+		if(!(log[0] & 0x80))
+			printf("block/ahci: Port %u: NCQ command with tag %u failed,"
+					" status 0x%x, error 0x%x\n",
+					_index, log[0] & 0x1F, log[2], log[3]);
+		delete request;
+	}else{
+		request->promise.set_value();
+	}
+
+	_doorbell.ring();
+}
+
+void Port::_failRequest(Request *request) {
+	if(request->command == Command::readNcqLog) {
+		delete request;
+		return;
+	}
+	request->failed = true;
+	request->promise.set_value();
+}
+
+void Port::_recover(arch::bit_value<uint32_t> is) {
+	auto tfd = _space.load(port_regs::tfd);
+	std::cout << "\e[31m" "block/ahci: Error on port " << _index << std::hex
+			<< ", PxIS: 0x" << static_cast<uint32_t>(is)
+			<< ", PxTFD: 0x" << static_cast<uint32_t>(tfd)
+			<< ", PxSERR: 0x" << _space.load(port_regs::serr)
+			<< std::dec << "\e[39m" << std::endl;
+
+	// After an NCQ error, the device rejects further NCQ commands
+	// until the NCQ command error log is read.
+	bool ncqError = (is & pxis::taskFileError) && _activeSlots && !_nonQueuedActive;
+
+	// Stopping the command engine clears PxCI and PxSACT.
+	if(!_stopCommandEngine()) {
+		_failPort("Command engine does not stop");
+		return;
+	}
+	_space.store(port_regs::serr, 0xFFFFFFFF);
+	_space.store(port_regs::is, arch::bit_value<uint32_t>{0xFFFFFFFF});
+	if(isBusy(_space.load(port_regs::tfd))) {
+		if(!_controller->supportsCommandListOverride()) {
+			_failPort("Cannot recover from error without CLO");
+			return;
+		}
+		_space.store(port_regs::cmd, _space.load(port_regs::cmd)
+				| pxcmd::commandListOverride(true));
+		if(!waitForCmdClear(_space, pxcmd::commandListOverride, commandEngineTimeout)) {
+			_failPort("Command list override timed out");
+			return;
+		}
+	}
+	_startCommandEngine();
+
+	// Retry everything that was in flight since the device aborts all outstanding commands.
+	// Requests are only failed once the port's state is consistent again.
+	std::vector<Request *> failedRequests;
+	for(int i = maxCommandSlots - 1; i >= 0; i--) {
+		auto request = _slotRequests[i];
+		if(!request)
+			continue;
+		_slotRequests[i] = nullptr;
+		if(request->command == Command::readNcqLog) {
+			delete request;
+			continue;
+		}
+		if(++request->retries > maxRetries) {
+			printf("block/ahci: Port %u: Command failed repeatedly\n", _index);
+			failedRequests.push_back(request);
+			continue;
+		}
+		_pendingQueue.push_front(request);
+	}
+	_activeSlots = 0;
+	_nonQueuedActive = false;
+
+	if(ncqError)
+		_pendingQueue.push_front(new Request{Command::readNcqLog, 0,
+				_scratchBuffer.data(), 1});
+	for(auto request : failedRequests)
+		_failRequest(request);
+	_doorbell.ring();
+}
+
+void Port::_failPort(const char *reason) {
+	std::cout << "\e[31m" "block/ahci: " << reason << " on port " << _index
+			<< ", disabling the port" "\e[39m" << std::endl;
+	_failed = true;
+
+	// Best effort: the engine might not stop, but at least the port stops raising IRQs.
+	_space.store(port_regs::ie, arch::bit_value<uint32_t>{0});
+	_stopCommandEngine();
+
+	std::vector<Request *> failedRequests;
+	for(unsigned int i = 0; i < maxCommandSlots; i++) {
+		auto request = _slotRequests[i];
+		if(!request)
+			continue;
+		_slotRequests[i] = nullptr;
+		failedRequests.push_back(request);
+	}
+	_activeSlots = 0;
+	_nonQueuedActive = false;
+	for(auto request : failedRequests)
+		_failRequest(request);
+
+	// _processRequests() fails the requests that are still pending.
+	_doorbell.ring();
+}
+
+bool Port::_stopCommandEngine() {
+	auto command = _space.load(port_regs::cmd);
+	if((command & pxcmd::start) || (command & pxcmd::commandListRunning)) {
+		_space.store(port_regs::cmd, command & ~pxcmd::start);
+		if(!waitForCmdClear(_space, pxcmd::commandListRunning, commandEngineTimeout))
+			return false;
+	}
+
+	command = _space.load(port_regs::cmd);
+	if((command & pxcmd::fisReceiveEnable) || (command & pxcmd::fisReceiveRunning)) {
+		_space.store(port_regs::cmd, command & ~pxcmd::fisReceiveEnable);
+		if(!waitForCmdClear(_space, pxcmd::fisReceiveRunning, commandEngineTimeout))
+			return false;
+	}
+	return true;
+}
+
+void Port::_startCommandEngine() {
+	auto command = _space.load(port_regs::cmd);
+	_space.store(port_regs::cmd, command | pxcmd::fisReceiveEnable(true) | pxcmd::start(true));
+}
+
+} } // namespace block::ahci
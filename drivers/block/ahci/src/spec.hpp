@@ -0,0 +1,211 @@
+#ifndef AHCI_SPEC_HPP
+#define AHCI_SPEC_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <arch/register.hpp>
+#include <arch/variable.hpp>
+
+// --------------------------------------------------------
+// HBA registers
+// --------------------------------------------------------
+
+namespace regs {
+	inline constexpr arch::bit_register<uint32_t> cap{0x00};
+	inline constexpr arch::bit_register<uint32_t> ghc{0x04};
+	inline constexpr arch::scalar_register<uint32_t> is{0x08};
+	inline constexpr arch::scalar_register<uint32_t> pi{0x0C};
+	inline constexpr arch::scalar_register<uint32_t> vs{0x10};
+	inline constexpr arch::bit_register<uint32_t> cap2{0x24};
+	inline constexpr arch::bit_register<uint32_t> bohc{0x28};
+}
+
+namespace cap {
+	inline constexpr arch::field<uint32_t, uint8_t> numPorts{0, 5};
+	inline constexpr arch::field<uint32_t, uint8_t> numCommandSlots{8, 5};
+	inline constexpr arch::field<uint32_t, bool> supportsCommandListOverride{24, 1};
+	inline constexpr arch::field<uint32_t, bool> supportsStaggeredSpinup{27, 1};
+	inline constexpr arch::field<uint32_t, bool> supportsNcq{30, 1};
+	inline constexpr arch::field<uint32_t, bool> supports64Bit{31, 1};
+}
+
+namespace ghc {
+	inline constexpr arch::field<uint32_t, bool> hbaReset{0, 1};
+	inline constexpr arch::field<uint32_t, bool> irqEnable{1, 1};
+	inline constexpr arch::field<uint32_t, bool> ahciEnable{31, 1};
+}
+
+namespace cap2 {
+	inline constexpr arch::field<uint32_t, bool> biosHandoff{0, 1};
+}
+
+namespace bohc {
+	inline constexpr arch::field<uint32_t, bool> biosOwned{0, 1};
+	inline constexpr arch::field<uint32_t, bool> osOwned{1, 1};
+	inline constexpr arch::field<uint32_t, bool> biosBusy{4, 1};
+}
+
+// Port registers are relative to portBase + index * portSize.
+inline constexpr ptrdiff_t portBase = 0x100;
+inline constexpr ptrdiff_t portSize = 0x80;
+
+namespace port_regs {
+	inline constexpr arch::scalar_register<uint32_t> clb{0x00};
+	inline constexpr arch::scalar_register<uint32_t> clbu{0x04};
+	inline constexpr arch::scalar_register<uint32_t> fb{0x08};
+	inline constexpr arch::scalar_register<uint32_t> fbu{0x0C};
+	inline constexpr arch::bit_register<uint32_t> is{0x10};
+	inline constexpr arch::bit_register<uint32_t> ie{0x14};
+	inline constexpr arch::bit_register<uint32_t> cmd{0x18};
+	inline constexpr arch::bit_register<uint32_t> tfd{0x20};
+	inline constexpr arch::scalar_register<uint32_t> sig{0x24};
+	inline constexpr arch::bit_register<uint32_t> ssts{0x28};
+	inline constexpr arch::scalar_register<uint32_t> serr{0x30};
+	inline constexpr arch::scalar_register<uint32_t> sact{0x34};
+	inline constexpr arch::scalar_register<uint32_t> ci{0x38};
+}
+
+// Shared by PxIS and PxIE.
+namespace pxis {
+	inline constexpr arch::field<uint32_t, bool> d2hRegisterFis{0, 1};
+	inline constexpr arch::field<uint32_t, bool> pioSetupFis{1, 1};
+	inline constexpr arch::field<uint32_t, bool> dmaSetupFis{2, 1};
+	inline constexpr arch::field<uint32_t, bool> setDeviceBitsFis{3, 1};
+	inline constexpr arch::field<uint32_t, bool> unknownFis{4, 1};
+	inline constexpr arch::field<uint32_t, bool> overflow{24, 1};
+	inline constexpr arch::field<uint32_t, bool> interfaceNonFatal{26, 1};
+	inline constexpr arch::field<uint32_t, bool> interfaceFatal{27, 1};
+	inline constexpr arch::field<uint32_t, bool> hostBusData{28, 1};
+	inline constexpr arch::field<uint32_t, bool> hostBusFatal{29, 1};
+	inline constexpr arch::field<uint32_t, bool> taskFileError{30, 1};
+}
+
+namespace pxcmd {
+	inline constexpr arch::field<uint32_t, bool> start{0, 1};
+	inline constexpr arch::field<uint32_t, bool> spinUpDevice{1, 1};
+	inline constexpr arch::field<uint32_t, bool> powerOnDevice{2, 1};
+	inline constexpr arch::field<uint32_t, bool> commandListOverride{3, 1};
+	inline constexpr arch::field<uint32_t, bool> fisReceiveEnable{4, 1};
+	inline constexpr arch::field<uint32_t, bool> fisReceiveRunning{14, 1};
+	inline constexpr arch::field<uint32_t, bool> commandListRunning{15, 1};
+}
+
+namespace pxtfd {
+	inline constexpr arch::field<uint32_t, uint8_t> status{0, 8};
+	inline constexpr arch::field<uint32_t, bool> err{0, 1};
+	inline constexpr arch::field<uint32_t, bool> drq{3, 1};
+	inline constexpr arch::field<uint32_t, bool> bsy{7, 1};
+	inline constexpr arch::field<uint32_t, uint8_t> error{8, 8};
+}
+
+namespace pxssts {
+	inline constexpr arch::field<uint32_t, uint8_t> detection{0, 4};
+}
+
+// Values of PxSSTS.DET.
+inline constexpr uint8_t detectionPresent = 3;
+
+// Values of PxSIG.
+inline constexpr uint32_t signatureAta = 0x00000101;
+inline constexpr uint32_t signatureAtapi = 0xEB140101;
+
+// --------------------------------------------------------
+// In-memory data structures
+// --------------------------------------------------------
+
+inline constexpr size_t maxCommandSlots = 32;
+
+namespace command_header {
+	inline constexpr arch::field<uint32_t, uint8_t> fisLength{0, 5}; // In dwords.
+	inline constexpr arch::field<uint32_t, bool> write{6, 1};
+	inline constexpr arch::field<uint32_t, uint16_t> prdtLength{16, 16};
+}
+
+struct CommandHeader {
+	arch::bit_variable<uint32_t> flags;
+	arch::scalar_variable<uint32_t> prdByteCount;
+	arch::scalar_variable<uint32_t> tableAddress;
+	arch::scalar_variable<uint32_t> tableAddressHigh;
+	uint32_t reserved[4];
+};
+static_assert(sizeof(CommandHeader) == 32);
+
+// The alignment is required by the HBA and ensures that the struct does not cross a page boundary.
+struct alignas(1024) CommandList {
+	CommandHeader slots[maxCommandSlots];
+};
+static_assert(sizeof(CommandList) == 1024);
+
+struct alignas(256) ReceivedFis {
+	uint8_t data[256];
+};
+
+// A single PRD can describe up to 4 MiB.
+inline constexpr size_t maxPrdBytes = size_t(1) << 22;
+
+struct PrdEntry {
+	arch::scalar_variable<uint32_t> address;
+	arch::scalar_variable<uint32_t> addressHigh;
+	uint32_t reserved;
+	arch::scalar_variable<uint32_t> byteCount; // Minus one; bit 31 requests an IRQ.
+};
+static_assert(sizeof(PrdEntry) == 16);
+
+// Chosen such that a CommandTable occupies exactly 1 KiB.
+inline constexpr size_t numPrdEntries = 56;
+
+// The alignment ensures that the struct does not cross a page boundary.
+struct alignas(1024) CommandTable {
+	uint8_t commandFis[64];
+	uint8_t atapiCommand[16];
+	uint8_t reserved[48];
+	PrdEntry prdt[numPrdEntries];
+};
+static_assert(sizeof(CommandTable) == 1024);
+
+// --------------------------------------------------------
+// FIS and ATA definitions
+// --------------------------------------------------------
+
+inline constexpr uint8_t fisTypeH2dRegister = 0x27;
+
+// Host-to-device register FIS.
+struct H2dRegisterFis {
+	uint8_t type;
+	uint8_t flags; // Bit 7: this FIS updates the command register.
+	uint8_t command;
+	uint8_t featureLow;
+	uint8_t lba0;
+	uint8_t lba1;
+	uint8_t lba2;
+	uint8_t device;
+	uint8_t lba3;
+	uint8_t lba4;
+	uint8_t lba5;
+	uint8_t featureHigh;
+	uint8_t countLow;
+	uint8_t countHigh;
+	uint8_t icc;
+	uint8_t control;
+	uint8_t reserved[4];
+};
+static_assert(sizeof(H2dRegisterFis) == 20);
+
+enum AtaCommand : uint8_t {
+	kCommandReadDma = 0xC8,
+	kCommandReadDmaExt = 0x25,
+	kCommandWriteDma = 0xCA,
+	kCommandWriteDmaExt = 0x35,
+	kCommandReadLogExt = 0x2F,
+	kCommandReadFpdmaQueued = 0x60,
+	kCommandWriteFpdmaQueued = 0x61,
+	kCommandIdentify = 0xEC
+};
+
+inline constexpr uint8_t kDeviceLba = 0x40;
+
+// Log address of the NCQ command error log.
+inline constexpr uint8_t kLogNcqCommandError = 0x10;
+
+#endif // AHCI_SPEC_HPP
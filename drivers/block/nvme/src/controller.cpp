@@ -0,0 +1,390 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <async/result.hpp>
+#include <hel.h>
+#include <hel-syscalls.h>
+#include <helix/ipc.hpp>
+#include <protocols/hw/client.hpp>
+#include <protocols/mbus/client.hpp>
+
+#include "nvme.hpp"
+
+namespace nvme {
+
+namespace {
+	constexpr bool logIrqs = false;
+
+	constexpr size_t adminQueueDepth = 32;
+	constexpr size_t maxIoQueueDepth = 1024;
+
+	// Limit transfers such that the PRPs of a command fit into a single PRP list.
+	constexpr size_t maxTransferSizeLimit = 1 << 20;
+
+	// Interrupt coalescing: raise an IRQ after this many completions
+	// or after irqCoalescingTime * 100us, whichever comes first.
+	constexpr uint32_t irqCoalescingThreshold = 8;
+	constexpr uint32_t irqCoalescingTime = 1;
+
+	// libblockfs keeps a single, global partition table per process.
+	// Hence, we can only hand one namespace (of any controller) to it.
+	bool blockfsDeviceTaken = false;
+
+	std::string readIdentifyString(const uint8_t *data, size_t length) {
+		std::string s{reinterpret_cast<const char *>(data), length};
+		auto end = s.find_last_not_of(' ');
+		s.resize((end == std::string::npos) ? 0 : end + 1);
+		return s;
+	}
+}
+
+async::result<void> sleepFor(uint64_t nanos) {
+	uint64_t tick;
+	HEL_CHECK(helGetClock(&tick));
+
+	helix::AwaitClock await_clock;
+	auto &&submit = helix::submitAwaitClock(&await_clock, tick + nanos,
+			helix::Dispatcher::global());
+	co_await submit.async_wait();
+	HEL_CHECK(await_clock.error());
+}
+
+// --------------------------------------------------------
+// Controller
+// --------------------------------------------------------
+
+Controller::Controller(protocols::hw::Device hw_device, helix::Mapping mapping,
+		helix::UniqueDescriptor mmio, std::vector<helix::UniqueDescriptor> msis,
+		helix::UniqueDescriptor irq)
+: _hwDevice{std::move(hw_device)}, _mapping{std::move(mapping)},
+		_mmio{std::move(mmio)}, _msis{std::move(msis)}, _irq{std::move(irq)},
+		_space{_mapping.get()}, _doorbells{_space.subspace(spec::doorbellBase)} {
+	auto capLow = _space.load(spec::regs::capLow);
+	auto capHigh = _space.load(spec::regs::capHigh);
+	_maxQueueEntries = (capLow & spec::cap_low::maxQueueEntries) + 1;
+	_timeout = (capLow & spec::cap_low::timeout) * uint64_t{500'000'000};
+	_doorbellStride = size_t{4} << (capHigh & spec::cap_high::doorbellStride);
+
+	// We always use 4 KiB pages.
+	assert(!(capHigh & spec::cap_high::minPageSize));
+}
+
+async::detached Controller::run() {
+	auto version = _space.load(spec::regs::vs);
+	printf("block/nvme: NVMe %u.%u, max queue entries: %lu, doorbell stride: %lu\n",
+			version >> 16, (version >> 8) & 0xFF, _maxQueueEntries, _doorbellStride);
+
+	co_await _hwDevice.enableBusmaster();
+	co_await _disable();
+
+	_adminQueue = std::make_unique<Queue>(this, 0,
+			std::min(adminQueueDepth, _maxQueueEntries), 0);
+	_space.store(spec::regs::aqa, ((_adminQueue->depth() - 1) << 16)
+			| (_adminQueue->depth() - 1));
+	_space.store(spec::regs::asqLow, _adminQueue->sqPhysical());
+	_space.store(spec::regs::asqHigh, _adminQueue->sqPhysical() >> 32);
+	_space.store(spec::regs::acqLow, _adminQueue->cqPhysical());
+	_space.store(spec::regs::acqHigh, _adminQueue->cqPhysical() >> 32);
+
+	co_await _enable();
+
+	if(_msis.empty()) {
+		co_await _hwDevice.enableBusIrq();
+		_handleIrqs();
+	}else{
+		for(unsigned int i = 0; i < _msis.size(); i++)
+			_handleMsis(i);
+	}
+
+	// Identify the controller.
+	arch::dma_buffer identify{&_memoryPool, pageSize};
+	spec::SubmissionEntry command{};
+	command.opcode = spec::kAdminIdentify;
+	command.cdw10 = spec::kIdentifyController;
+	co_await _adminCommand(command, identify.data(), pageSize);
+
+	auto data = reinterpret_cast<uint8_t *>(identify.data());
+	auto model = readIdentifyString(data + spec::identify_controller::modelNumber, 40);
+	auto serial = readIdentifyString(data + spec::identify_controller::serialNumber, 20);
+
+	// MDTS is a power of two in units of the minimum page size; zero means no limit.
+	auto mdts = data[spec::identify_controller::maxDataTransferSize];
+	_maxTransferSize = maxTransferSizeLimit;
+	if(mdts && (pageSize << mdts) < _maxTransferSize)
+		_maxTransferSize = pageSize << mdts;
+	printf("block/nvme: Model '%s', serial '%s', max transfer size: %lu KiB\n",
+			model.c_str(), serial.c_str(), _maxTransferSize >> 10);
+
+	co_await _setupIoQueues();
+	co_await _discoverNamespaces();
+}
+
+async::result<void> Controller::_disable() {
+	auto config = _space.load(spec::regs::cc);
+	if(config & spec::cc::enable)
+		_space.store(spec::regs::cc, config & ~spec::cc::enable);
+
+	for(uint64_t waited = 0; _space.load(spec::regs::csts) & spec::csts::ready;
+			waited += 10'000'000) {
+		if(waited > _timeout)
+			throw std::runtime_error("block/nvme: Timeout while disabling the controller");
+		co_await sleepFor(10'000'000);
+	}
+}
+
+async::result<void> Controller::_enable() {
+	_space.store(spec::regs::cc, spec::cc::enable(true)
+			| spec::cc::commandSet(0) | spec::cc::pageSize(0)
+			| spec::cc::sqEntrySize(6) | spec::cc::cqEntrySize(4));
+
+	for(uint64_t waited = 0; !(_space.load(spec::regs::csts) & spec::csts::ready);
+			waited += 10'000'000) {
+		if(_space.load(spec::regs::csts) & spec::csts::fatal)
+			throw std::runtime_error("block/nvme: Controller reported a fatal error");
+		if(waited > _timeout)
+			throw std::runtime_error("block/nvme: Timeout while enabling the controller");
+		co_await sleepFor(10'000'000);
+	}
+}
+
+async::result<uint32_t> Controller::_adminCommand(spec::SubmissionEntry command,
+		void *buffer, size_t length) {
+	Request request;
+	request.command = command;
+	request.buffer = buffer;
+	request.length = length;
+	_adminQueue->submit(&request);
+	co_await request.promise.async_get();
+	if(request.status) {
+		printf("block/nvme: Admin command 0x%x failed with status 0x%x\n",
+				command.opcode, request.status);
+		throw std::runtime_error("block/nvme: Admin command failed");
+	}
+	co_return request.result;
+}
+
+async::result<void> Controller::_setupIoQueues() {
+	// With MSI-X, vector 0 serves the admin queue and the I/O queues use the others.
+	unsigned int numVectors = std::max(_msis.size(), size_t{1});
+	unsigned int wanted = std::min(maxIoQueues, std::max(numVectors - 1, 1u));
+
+	// Both counts are zero-based.
+	spec::SubmissionEntry command{};
+	command.opcode = spec::kAdminSetFeatures;
+	command.cdw10 = spec::kFeatureNumQueues;
+	command.cdw11 = ((wanted - 1) << 16) | (wanted - 1);
+	auto allocated = co_await _adminCommand(command);
+	auto numQueues = std::min({wanted, (allocated & 0xFFFF) + 1, (allocated >> 16) + 1});
+
+	auto depth = std::min(maxIoQueueDepth, _maxQueueEntries);
+	for(unsigned int i = 1; i <= numQueues; i++) {
+		unsigned int vector = (numVectors > 1) ? 1 + (i - 1) % (numVectors - 1) : 0;
+		auto queue = std::make_unique<Queue>(this, i, depth, vector);
+
+		spec::SubmissionEntry createCq{};
+		createCq.opcode = spec::kAdminCreateCq;
+		createCq.prp1 = queue->cqPhysical();
+		createCq.cdw10 = ((depth - 1) << 16) | i;
+		createCq.cdw11 = (vector << 16) | spec::kCqIrqsEnabled
+				| spec::kQueuePhysicallyContiguous;
+		co_await _adminCommand(createCq);
+
+		spec::SubmissionEntry createSq{};
+		createSq.opcode = spec::kAdminCreateSq;
+		createSq.prp1 = queue->sqPhysical();
+		createSq.cdw10 = ((depth - 1) << 16) | i;
+		createSq.cdw11 = (i << 16) | spec::kQueuePhysicallyContiguous;
+		co_await _adminCommand(createSq);
+
+		_ioQueues.push_back(std::move(queue));
+	}
+	printf("block/nvme: Using %lu I/O queues with %lu entries and %u IRQ vectors\n",
+			_ioQueues.size(), depth, numVectors);
+
+	// Interrupt coalescing is optional; ignore failures.
+	spec::SubmissionEntry coalescing{};
+	coalescing.opcode = spec::kAdminSetFeatures;
+	coalescing.cdw10 = spec::kFeatureIrqCoalescing;
+	coalescing.cdw11 = (irqCoalescingTime << 8) | (irqCoalescingThreshold - 1);
+	Request request;
+	request.command = coalescing;
+	_adminQueue->submit(&request);
+	co_await request.promise.async_get();
+	if(request.status)
+		printf("block/nvme: Controller does not support interrupt coalescing\n");
+}
+
+async::result<void> Controller::_discoverNamespaces() {
+	arch::dma_buffer list{&_memoryPool, pageSize};
+	spec::SubmissionEntry command{};
+	command.opcode = spec::kAdminIdentify;
+	command.cdw10 = spec::kIdentifyActiveNamespaces;
+	co_await _adminCommand(command, list.data(), pageSize);
+
+	auto nsids = reinterpret_cast<uint32_t *>(list.data());
+	arch::dma_buffer identify{&_memoryPool, pageSize};
+	for(size_t i = 0; i < pageSize / sizeof(uint32_t) && nsids[i]; i++) {
+		spec::SubmissionEntry identifyNs{};
+		identifyNs.opcode = spec::kAdminIdentify;
+		identifyNs.nsid = nsids[i];
+		identifyNs.cdw10 = spec::kIdentifyNamespace;
+		co_await _adminCommand(identifyNs, identify.data(), pageSize);
+
+		auto data = reinterpret_cast<uint8_t *>(identify.data());
+		uint64_t numLbas;
+		memcpy(&numLbas, data + spec::identify_namespace::size, sizeof(uint64_t));
+		auto format = data[spec::identify_namespace::formattedLbaSize] & 0xF;
+		uint32_t lbaFormat;
+		memcpy(&lbaFormat, data + spec::identify_namespace::lbaFormats + 4 * format,
+				sizeof(uint32_t));
+		auto lbaSize = size_t{1} << ((lbaFormat >> 16) & 0xFF);
+		auto metadataSize = lbaFormat & 0xFFFF;
+		printf("block/nvme: Namespace %u: %lu blocks of %lu bytes\n",
+				nsids[i], numLbas, lbaSize);
+		if(metadataSize) {
+			printf("block/nvme: Ignoring namespace %u with metadata\n", nsids[i]);
+			continue;
+		}
+
+		if(blockfsDeviceTaken) {
+			printf("block/nvme: Ignoring namespace %u; only one namespace is supported\n",
+					nsids[i]);
+			continue;
+		}
+		blockfsDeviceTaken = true;
+
+		auto ns = std::make_unique<Namespace>(this, nsids[i], lbaSize, numLbas);
+		blockfs::runDevice(ns.get());
+		_namespaces.push_back(std::move(ns));
+	}
+}
+
+Queue *Controller::nextIoQueue() {
+	assert(!_ioQueues.empty());
+	auto queue = _ioQueues[_nextIoQueue].get();
+	_nextIoQueue = (_nextIoQueue + 1) % _ioQueues.size();
+	return queue;
+}
+
+async::detached Controller::_handleMsis(unsigned int vector) {
+	auto &irq = _msis[vector];
+
+	uint64_t sequence = 0;
+	while(true) {
+		auto await = co_await helix_ng::awaitEvent(irq, sequence);
+		HEL_CHECK(await.error());
+		sequence = await.sequence();
+		if(logIrqs)
+			std::cout << "block/nvme: MSI " << vector << " fired" << std::endl;
+
+		// MSIs are edge-triggered and not shared. Acknowledge them before processing
+		// the completion queues such that no completion is missed.
+		HEL_CHECK(helAcknowledgeIrq(irq.getHandle(), kHelAckAcknowledge, sequence));
+
+		if(!vector)
+			_adminQueue->processCompletions();
+		for(auto &queue : _ioQueues)
+			if(queue->vector() == vector)
+				queue->processCompletions();
+	}
+}
+
+async::detached Controller::_handleIrqs() {
+	uint64_t sequence = 0;
+	while(true) {
+		auto await = co_await helix_ng::awaitEvent(_irq, sequence);
+		HEL_CHECK(await.error());
+		sequence = await.sequence();
+		if(logIrqs)
+			std::cout << "block/nvme: IRQ fired" << std::endl;
+
+		// The controller deasserts INTx once all completion queues are drained.
+		bool any = _adminQueue->processCompletions();
+		for(auto &queue : _ioQueues)
+			any |= queue->processCompletions();
+
+		if(any) {
+			HEL_CHECK(helAcknowledgeIrq(_irq.getHandle(), kHelAckAcknowledge, sequence));
+		}else{
+			HEL_CHECK(helAcknowledgeIrq(_irq.getHandle(), kHelAckNack, sequence));
+		}
+	}
+}
+
+} // namespace nvme
+
+std::vector<std::unique_ptr<nvme::Controller>> globalControllers;
+
+// ------------------------------------------------------------------------
+// Freestanding discovery functions.
+// ------------------------------------------------------------------------
+
+async::detached bindController(mbus::Entity entity) {
+	protocols::hw::Device device(co_await entity.bind());
+	auto info = co_await device.getPciInfo();
+	assert(info.barInfo[0].ioType == protocols::hw::IoType::kIoTypeMemory);
+	auto bar = co_await device.accessBar(0);
+
+	// Try to get one MSI(-X) vector for the admin queue and one per I/O queue.
+	std::vector<helix::UniqueDescriptor> msis;
+	helix::UniqueDescriptor irq;
+	auto count = std::min(info.numMsis, 1 + nvme::maxIoQueues);
+	for(unsigned int i = 0; i < count; i++) {
+		auto msi = co_await device.accessMsi(i);
+		if(!msi)
+			break;
+		msis.push_back(std::move(msi));
+	}
+	if(msis.empty()) {
+		irq = co_await device.accessIrq();
+		printf("block/nvme: Using legacy IRQ\n");
+	}else{
+		printf("block/nvme: Using %lu MSI vectors\n", msis.size());
+	}
+
+	helix::Mapping mapping{bar, info.barInfo[0].offset, info.barInfo[0].length};
+
+	auto controller = std::make_unique<nvme::Controller>(std::move(device),
+			std::move(mapping), std::move(bar), std::move(msis), std::move(irq));
+	controller->run();
+	globalControllers.push_back(std::move(controller));
+}
+
+async::detached observeControllers() {
+	auto root = co_await mbus::Instance::global().getRoot();
+
+	auto filter = mbus::Conjunction({
+		mbus::EqualsFilter("pci-class", "01"),
+		mbus::EqualsFilter("pci-subclass", "08"),
+		mbus::EqualsFilter("pci-interface", "02")
+	});
+
+	auto handler = mbus::ObserverHandler{}
+	.withAttach([] (mbus::Entity entity, mbus::Properties) {
+		printf("block/nvme: Detected controller\n");
+		bindController(std::move(entity));
+	});
+
+	co_await root.linkObserver(std::move(filter), std::move(handler));
+}
+
+// --------------------------------------------------------
+// main() function
+// --------------------------------------------------------
+
+int main() {
+	printf("block/nvme: Starting driver\n");
+
+	{
+		async::queue_scope scope{helix::globalQueue()};
+		observeControllers();
+	}
+
+	async::run_forever(helix::globalQueue()->run_token(), helix::currentDispatcher);
+}
@@ -0,0 +1,66 @@
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <iostream>
+
+#include "nvme.hpp"
+
+namespace nvme {
+
+namespace {
+	constexpr bool logRequests = false;
+}
+
+Namespace::Namespace(Controller *controller, unsigned int nsid, size_t lba_size,
+		uint64_t num_lbas)
+: BlockDevice{lba_size}, _controller{controller}, _nsid{nsid}, _numLbas{num_lbas} { }
+
+async::result<void> Namespace::readSectors(uint64_t sector,
+		void *buffer, size_t num_sectors) {
+	return _transfer(spec::kIoRead, sector, buffer, num_sectors);
+}
+
+async::result<void> Namespace::writeSectors(uint64_t sector,
+		const void *buffer, size_t num_sectors) {
+	return _transfer(spec::kIoWrite, sector, const_cast<void *>(buffer), num_sectors);
+}
+
+async::result<void> Namespace::_transfer(uint8_t opcode, uint64_t sector,
+		void *buffer, size_t num_sectors) {
+	assert(sector + num_sectors <= _numLbas);
+	if(logRequests)
+		std::cout << "block/nvme: Namespace " << _nsid << ": "
+				<< (opcode == spec::kIoWrite ? "writing " : "reading ")
+				<< num_sectors << " sectors at " << sector << std::endl;
+
+	// Split the transfer into commands and submit them all at once. Consecutive
+	// commands go to different queues such that they are processed in parallel.
+	auto maxSectors = _controller->maxTransferSize() / sectorSize;
+	std::vector<std::unique_ptr<Request>> requests;
+	for(size_t progress = 0; progress < num_sectors; progress += maxSectors) {
+		auto chunk = std::min(num_sectors - progress, maxSectors);
+		auto request = std::make_unique<Request>();
+		request->command.opcode = opcode;
+		request->command.nsid = _nsid;
+		request->command.cdw10 = sector + progress;
+		request->command.cdw11 = (sector + progress) >> 32;
+		request->command.cdw12 = chunk - 1;
+		request->buffer = reinterpret_cast<char *>(buffer) + progress * sectorSize;
+		request->length = chunk * sectorSize;
+		_controller->nextIoQueue()->submit(request.get());
+		requests.push_back(std::move(request));
+	}
+
+	// Wait for all commands before checking for errors; the queues reference the requests.
+	for(auto &request : requests)
+		co_await request->promise.async_get();
+
+	for(auto &request : requests) {
+		if(request->status) {
+			printf("block/nvme: I/O command failed with status 0x%x\n", request->status);
+			throw std::runtime_error("block/nvme: I/O error");
+		}
+	}
+}
+
+} // namespace nvme
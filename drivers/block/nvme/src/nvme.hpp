@@ -0,0 +1,204 @@
+#ifndef NVME_NVME_HPP
+#define NVME_NVME_HPP
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <arch/dma_pool.hpp>
+#include <arch/mem_space.hpp>
+#include <async/result.hpp>
+#include <helix/ipc.hpp>
+#include <helix/memory.hpp>
+#include <protocols/hw/client.hpp>
+
+#include <blockfs.hpp>
+
+#include "spec.hpp"
+
+namespace nvme {
+
+inline constexpr size_t pageSize = 0x1000;
+
+// Number of I/O queue pairs that we try to allocate. Each pair gets its own
+// MSI-X vector if possible; the kernel distributes the vectors over the CPUs.
+inline constexpr unsigned int maxIoQueues = 4;
+
+// Suspends the calling coroutine for the given number of nanoseconds.
+async::result<void> sleepFor(uint64_t nanos);
+
+struct Controller;
+
+// --------------------------------------------------------
+// Request
+// --------------------------------------------------------
+
+struct Request {
+	// The command ID and the PRPs are filled in by Queue::submit().
+	spec::SubmissionEntry command{};
+	void *buffer = nullptr;
+	size_t length = 0;
+
+	// Valid after the promise is completed.
+	uint16_t status = 0;
+	uint32_t result = 0;
+	async::promise<void> promise;
+};
+
+// --------------------------------------------------------
+// Queue
+// --------------------------------------------------------
+
+// A submission queue together with its completion queue.
+struct Queue {
+	// The list of PRPs of a single command. Page alignment ensures that the list
+	// does not need to be chained.
+	struct alignas(pageSize) PrpList {
+		uint64_t entries[pageSize / sizeof(uint64_t)];
+	};
+
+	Queue(Controller *controller, unsigned int id, size_t depth, unsigned int vector);
+
+	Queue(const Queue &) = delete;
+
+	Queue &operator= (const Queue &) = delete;
+
+	unsigned int id() {
+		return _id;
+	}
+
+	size_t depth() {
+		return _depth;
+	}
+
+	unsigned int vector() {
+		return _vector;
+	}
+
+	uintptr_t sqPhysical();
+	uintptr_t cqPhysical();
+
+	// Issues the request immediately if a command ID is free; otherwise,
+	// the request is issued once a command completes.
+	void submit(Request *request);
+
+	// Retires all new completion entries. Returns false if there were none.
+	bool processCompletions();
+
+private:
+	void _issue(Request *request);
+	void _setupPrps(uint16_t cid, spec::SubmissionEntry &command, void *buffer, size_t length);
+
+	Controller *_controller;
+	unsigned int _id;
+	size_t _depth;
+	unsigned int _vector;
+
+	helix::Mapping _sqMapping;
+	helix::Mapping _cqMapping;
+	spec::SubmissionEntry *_sq;
+	spec::CompletionEntry *_cq;
+	arch::scalar_register<uint32_t> _sqTailDoorbell;
+	arch::scalar_register<uint32_t> _cqHeadDoorbell;
+
+	size_t _sqTail = 0;
+	size_t _cqHead = 0;
+	uint16_t _phase = 1;
+
+	// Indexed by command ID. At most depth - 1 commands can be outstanding
+	// since a full submission queue has one empty slot.
+	std::vector<Request *> _inFlight;
+	std::vector<uint16_t> _freeIds;
+	std::vector<arch::dma_object<PrpList>> _prpLists;
+	std::deque<Request *> _pendingQueue;
+};
+
+// --------------------------------------------------------
+// Namespace
+// --------------------------------------------------------
+
+struct Namespace final : blockfs::BlockDevice {
+	Namespace(Controller *controller, unsigned int nsid, size_t lba_size, uint64_t num_lbas);
+
+	async::result<void> readSectors(uint64_t sector, void *buffer,
+			size_t num_sectors) override;
+
+	async::result<void> writeSectors(uint64_t sector, const void *buffer,
+			size_t num_sectors) override;
+
+private:
+	async::result<void> _transfer(uint8_t opcode, uint64_t sector,
+			void *buffer, size_t num_sectors);
+
+	Controller *_controller;
+	unsigned int _nsid;
+	uint64_t _numLbas;
+};
+
+// --------------------------------------------------------
+// Controller
+// --------------------------------------------------------
+
+struct Controller {
+	Controller(protocols::hw::Device hw_device, helix::Mapping mapping,
+			helix::UniqueDescriptor mmio, std::vector<helix::UniqueDescriptor> msis,
+			helix::UniqueDescriptor irq);
+
+	async::detached run();
+
+	arch::mem_space doorbells() {
+		return _doorbells;
+	}
+
+	size_t doorbellStride() {
+		return _doorbellStride;
+	}
+
+	arch::os::contiguous_pool *memoryPool() {
+		return &_memoryPool;
+	}
+
+	size_t maxTransferSize() {
+		return _maxTransferSize;
+	}
+
+	// Distributes I/O over all I/O queues.
+	Queue *nextIoQueue();
+
+private:
+	async::result<void> _disable();
+	async::result<void> _enable();
+
+	// Submits a command to the admin queue and waits for it. Returns the result dword.
+	async::result<uint32_t> _adminCommand(spec::SubmissionEntry command,
+			void *buffer = nullptr, size_t length = 0);
+
+	async::result<void> _setupIoQueues();
+	async::result<void> _discoverNamespaces();
+
+	async::detached _handleMsis(unsigned int vector);
+	async::detached _handleIrqs();
+
+	protocols::hw::Device _hwDevice;
+	helix::Mapping _mapping;
+	helix::UniqueDescriptor _mmio;
+	std::vector<helix::UniqueDescriptor> _msis;
+	helix::UniqueDescriptor _irq;
+	arch::mem_space _space;
+	arch::mem_space _doorbells;
+	arch::os::contiguous_pool _memoryPool;
+
+	size_t _doorbellStride = 4;
+	size_t _maxQueueEntries = 2;
+	uint64_t _timeout = 0; // In nanoseconds.
+	size_t _maxTransferSize = 0;
+
+	std::unique_ptr<Queue> _adminQueue;
+	std::vector<std::unique_ptr<Queue>> _ioQueues;
+	size_t _nextIoQueue = 0;
+	std::vector<std::unique_ptr<Namespace>> _namespaces;
+};
+
+} // namespace nvme
+
+#endif // NVME_NVME_HPP
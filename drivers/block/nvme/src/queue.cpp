@@ -0,0 +1,148 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#include <hel.h>
+#include <hel-syscalls.h>
+
+#include "nvme.hpp"
+
+namespace nvme {
+
+namespace {
+	uintptr_t physicalOf(void *pointer) {
+		uintptr_t physical;
+		HEL_CHECK(helPointerPhysical(pointer, &physical));
+		return physical;
+	}
+
+	// Allocates physically contiguous memory for a submission or completion queue.
+	helix::Mapping allocateQueueMemory(size_t size) {
+		size = (size + pageSize - 1) & ~(pageSize - 1);
+		HelHandle handle;
+		HEL_CHECK(helAllocateMemory(size, kHelAllocContinuous, nullptr, &handle));
+		helix::UniqueDescriptor memory{handle};
+		helix::Mapping mapping{memory, 0, size};
+		memset(mapping.get(), 0, size);
+		return mapping;
+	}
+}
+
+Queue::Queue(Controller *controller, unsigned int id, size_t depth, unsigned int vector)
+: _controller{controller}, _id{id}, _depth{depth}, _vector{vector},
+		_sqMapping{allocateQueueMemory(depth * sizeof(spec::SubmissionEntry))},
+		_cqMapping{allocateQueueMemory(depth * sizeof(spec::CompletionEntry))},
+		_sq{reinterpret_cast<spec::SubmissionEntry *>(_sqMapping.get())},
+		_cq{reinterpret_cast<spec::CompletionEntry *>(_cqMapping.get())},
+		_sqTailDoorbell{static_cast<ptrdiff_t>(2 * id * controller->doorbellStride())},
+		_cqHeadDoorbell{static_cast<ptrdiff_t>((2 * id + 1) * controller->doorbellStride())},
+		_inFlight(depth - 1, nullptr), _prpLists(depth - 1) {
+	for(size_t i = 0; i < depth - 1; i++)
+		_freeIds.push_back(depth - 2 - i);
+}
+
+uintptr_t Queue::sqPhysical() {
+	return physicalOf(_sq);
+}
+
+uintptr_t Queue::cqPhysical() {
+	return physicalOf(_cq);
+}
+
+void Queue::submit(Request *request) {
+	if(_freeIds.empty()) {
+		_pendingQueue.push_back(request);
+		return;
+	}
+	_issue(request);
+}
+
+void Queue::_issue(Request *request) {
+	assert(!_freeIds.empty());
+	auto cid = _freeIds.back();
+	_freeIds.pop_back();
+	_inFlight[cid] = request;
+
+	auto command = request->command;
+	command.commandId = cid;
+	if(request->length)
+		_setupPrps(cid, command, request->buffer, request->length);
+	memcpy(&_sq[_sqTail], &command, sizeof(spec::SubmissionEntry));
+
+	_sqTail = (_sqTail + 1) % _depth;
+	_controller->doorbells().store(_sqTailDoorbell, _sqTail);
+}
+
+void Queue::_setupPrps(uint16_t cid, spec::SubmissionEntry &command,
+		void *buffer, size_t length) {
+	// PRP entries must be dword aligned.
+	assert(!(reinterpret_cast<uintptr_t>(buffer) & 3));
+	auto pointer = reinterpret_cast<char *>(buffer);
+
+	// The first PRP may point into the middle of a page; all others point to page starts.
+	auto misalign = reinterpret_cast<uintptr_t>(pointer) & (pageSize - 1);
+	auto first = std::min(length, pageSize - misalign);
+	command.prp1 = physicalOf(pointer);
+	command.prp2 = 0;
+	if(length == first)
+		return;
+
+	pointer += first;
+	length -= first;
+	if(length <= pageSize) {
+		command.prp2 = physicalOf(pointer);
+		return;
+	}
+
+	// More than two pages: PRP2 points to a list of the remaining pages.
+	auto &list = _prpLists[cid];
+	if(!list.data())
+		list = arch::dma_object<PrpList>{_controller->memoryPool()};
+	size_t n = 0;
+	for(size_t progress = 0; progress < length; progress += pageSize) {
+		assert(n < pageSize / sizeof(uint64_t));
+		list.data()->entries[n++] = physicalOf(pointer + progress);
+	}
+	command.prp2 = physicalOf(list.data());
+}
+
+bool Queue::processCompletions() {
+	bool any = false;
+	while(true) {
+		auto &entry = _cq[_cqHead];
+		auto status = entry.status.load();
+		if((status & 1) != _phase)
+			break;
+		any = true;
+
+		auto cid = entry.commandId.load();
+		assert(cid < _inFlight.size());
+		auto request = _inFlight[cid];
+		assert(request);
+		request->status = status >> 1;
+		request->result = entry.result.load();
+		_inFlight[cid] = nullptr;
+		_freeIds.push_back(cid);
+
+		_cqHead++;
+		if(_cqHead == _depth) {
+			_cqHead = 0;
+			_phase ^= 1;
+		}
+
+		// Issue pending requests before completing the current one since
+		// completion may resume the waiter, which might submit more requests.
+		if(!_pendingQueue.empty()) {
+			auto pending = _pendingQueue.front();
+			_pendingQueue.pop_front();
+			_issue(pending);
+		}
+		request->promise.set_value();
+	}
+
+	if(any)
+		_controller->doorbells().store(_cqHeadDoorbell, _cqHead);
+	return any;
+}
+
+} // namespace nvme
@@ -0,0 +1,140 @@
+#ifndef NVME_SPEC_HPP
+#define NVME_SPEC_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <arch/register.hpp>
+#include <arch/variable.hpp>
+
+namespace spec {
+
+// --------------------------------------------------------
+// Controller registers
+// --------------------------------------------------------
+
+namespace regs {
+	// CAP is a 64-bit register; we access it as two 32-bit halves.
+	inline constexpr arch::bit_register<uint32_t> capLow{0x00};
+	inline constexpr arch::bit_register<uint32_t> capHigh{0x04};
+	inline constexpr arch::scalar_register<uint32_t> vs{0x08};
+	inline constexpr arch::bit_register<uint32_t> cc{0x14};
+	inline constexpr arch::bit_register<uint32_t> csts{0x1C};
+	inline constexpr arch::scalar_register<uint32_t> aqa{0x24};
+	inline constexpr arch::scalar_register<uint32_t> asqLow{0x28};
+	inline constexpr arch::scalar_register<uint32_t> asqHigh{0x2C};
+	inline constexpr arch::scalar_register<uint32_t> acqLow{0x30};
+	inline constexpr arch::scalar_register<uint32_t> acqHigh{0x34};
+}
+
+namespace cap_low {
+	inline constexpr arch::field<uint32_t, uint16_t> maxQueueEntries{0, 16}; // Zero-based.
+	inline constexpr arch::field<uint32_t, uint8_t> timeout{24, 8}; // In units of 500ms.
+}
+
+namespace cap_high {
+	inline constexpr arch::field<uint32_t, uint8_t> doorbellStride{0, 4};
+	inline constexpr arch::field<uint32_t, uint8_t> minPageSize{16, 4};
+}
+
+namespace cc {
+	inline constexpr arch::field<uint32_t, bool> enable{0, 1};
+	inline constexpr arch::field<uint32_t, uint8_t> commandSet{4, 3};
+	inline constexpr arch::field<uint32_t, uint8_t> pageSize{7, 4};
+	inline constexpr arch::field<uint32_t, uint8_t> arbitration{11, 3};
+	inline constexpr arch::field<uint32_t, uint8_t> shutdown{14, 2};
+	inline constexpr arch::field<uint32_t, uint8_t> sqEntrySize{16, 4}; // Log2.
+	inline constexpr arch::field<uint32_t, uint8_t> cqEntrySize{20, 4}; // Log2.
+}
+
+namespace csts {
+	inline constexpr arch::field<uint32_t, bool> ready{0, 1};
+	inline constexpr arch::field<uint32_t, bool> fatal{1, 1};
+}
+
+// Doorbells start at this offset; their stride is (4 << CAP.DSTRD).
+inline constexpr ptrdiff_t doorbellBase = 0x1000;
+
+// --------------------------------------------------------
+// Queue entries
+// --------------------------------------------------------
+
+struct SubmissionEntry {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t commandId;
+	uint32_t nsid;
+	uint64_t reserved;
+	uint64_t metadata;
+	uint64_t prp1;
+	uint64_t prp2;
+	uint32_t cdw10;
+	uint32_t cdw11;
+	uint32_t cdw12;
+	uint32_t cdw13;
+	uint32_t cdw14;
+	uint32_t cdw15;
+};
+static_assert(sizeof(SubmissionEntry) == 64);
+
+struct CompletionEntry {
+	arch::scalar_variable<uint32_t> result;
+	arch::scalar_variable<uint32_t> reserved;
+	arch::scalar_variable<uint16_t> sqHead;
+	arch::scalar_variable<uint16_t> sqId;
+	arch::scalar_variable<uint16_t> commandId;
+	// Bit 0 is the phase tag, bits 1 to 15 are the status field.
+	arch::scalar_variable<uint16_t> status;
+};
+static_assert(sizeof(CompletionEntry) == 16);
+
+// --------------------------------------------------------
+// Commands
+// --------------------------------------------------------
+
+enum AdminOpcode : uint8_t {
+	kAdminCreateSq = 0x01,
+	kAdminCreateCq = 0x05,
+	kAdminIdentify = 0x06,
+	kAdminSetFeatures = 0x09
+};
+
+enum IoOpcode : uint8_t {
+	kIoWrite = 0x01,
+	kIoRead = 0x02
+};
+
+// Values of CDW10.CNS for Identify.
+enum IdentifyCns : uint32_t {
+	kIdentifyNamespace = 0x00,
+	kIdentifyController = 0x01,
+	kIdentifyActiveNamespaces = 0x02
+};
+
+// Feature identifiers for Set Features.
+enum FeatureId : uint32_t {
+	kFeatureNumQueues = 0x07,
+	kFeatureIrqCoalescing = 0x08
+};
+
+// Flags in CDW11 of Create I/O CQ and Create I/O SQ.
+inline constexpr uint32_t kQueuePhysicallyContiguous = 1;
+inline constexpr uint32_t kCqIrqsEnabled = 2;
+
+// Offsets into the Identify Controller data structure.
+namespace identify_controller {
+	inline constexpr size_t serialNumber = 4;
+	inline constexpr size_t modelNumber = 24;
+	inline constexpr size_t maxDataTransferSize = 77;
+}
+
+// Offsets into the Identify Namespace data structure.
+namespace identify_namespace {
+	inline constexpr size_t size = 0;
+	inline constexpr size_t formattedLbaSize = 26;
+	inline constexpr size_t lbaFormats = 128;
+}
+
+} // namespace spec
+
+#endif // NVME_SPEC_HPP
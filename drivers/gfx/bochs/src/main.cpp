@@ -383,7 +383,7 @@ uint32_t GfxDevice::FrameBuffer::getPixelPitch() {
 	return _pixelPitch;
 }
 
-void GfxDevice::FrameBuffer::notifyDirty() {
+void GfxDevice::FrameBuffer::notifyDirty(std::vector<drm_core::DamageRect>) {
 	
 }
 
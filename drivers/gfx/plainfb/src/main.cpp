@@ -17,9 +17,11 @@
 #include <protocols/fs/server.hpp>
 #include <protocols/hw/client.hpp>
 #include <protocols/mbus/client.hpp>
+#include <core/drm/blit.hpp>
 #include <core/drm/core.hpp>
 
 #include <libdrm/drm.h>
+#include <libdrm/drm_fourcc.h>
 #include <libdrm/drm_mode.h>
 
 #include "plainfb.hpp"
@@ -35,28 +37,30 @@ GfxDevice::GfxDevice(protocols::hw::Device hw_device,
 : _hwDevice{std::move(hw_device)},
 		_screenWidth{screen_width}, _screenHeight{screen_height},
 		_screenPitch{screen_pitch},_fbMapping{std::move(fb_mapping)} {
-	if((reinterpret_cast<uintptr_t>(fb_mapping.get()) & 15)) {
-		std::cout << "\e[31m" "gfx/plainfb: Hardware framebuffer is not aligned;"
-				" expect perfomance degradation!" "\e[39m" << std::endl;
-		_hardwareFbIsAligned = false;
-	}
+	std::cout << "gfx/plainfb: Using " << drm_core::blitImplementation()
+			<< " blitting kernels" << std::endl;
 }
 
 async::detached GfxDevice::initialize() { 
 	// Setup planes, encoders and CRTCs (i.e. the static entities).
 	auto plane = std::make_shared<Plane>(this);
-	_theCrtc = std::make_shared<Crtc>(this, plane);
+	_cursorPlane = std::make_shared<Plane>(this);
+	_theCrtc = std::make_shared<Crtc>(this, plane, _cursorPlane);
 	_theEncoder = std::make_shared<Encoder>(this);
 	
 	plane->setupWeakPtr(plane);
+	_cursorPlane->setupWeakPtr(_cursorPlane);
 	_theCrtc->setupWeakPtr(_theCrtc);
 	_theEncoder->setupWeakPtr(_theEncoder);
 
+	plane->attachProperty(fbDamageClipsProperty());
+
 	_theEncoder->setupPossibleCrtcs({_theCrtc.get()});
 	_theEncoder->setupPossibleClones({_theEncoder.get()});
 	_theEncoder->setCurrentCrtc(_theCrtc.get());
 
 	registerObject(plane.get());
+	registerObject(_cursorPlane.get());
 	registerObject(_theCrtc.get());
 	registerObject(_theEncoder.get());
 
@@ -91,13 +95,19 @@ std::unique_ptr<drm_core::Configuration> GfxDevice::createConfiguration() {
 std::shared_ptr<drm_core::FrameBuffer> GfxDevice::createFrameBuffer(std::shared_ptr<drm_core::BufferObject> base_bo,
 		uint32_t width, uint32_t height, uint32_t format, uint32_t pitch) {
 	auto bo = std::static_pointer_cast<GfxDevice::BufferObject>(base_bo);
-		
-	assert(pitch % 4 == 0);
-	
-	assert(pitch / 4 >= width);
+
+	auto info = drm_core::getFormatInfo(format);
+	assert(info);
+	assert(pitch / info->cpp >= width);
 	assert(bo->getSize() >= pitch * height);
 
-	auto fb = std::make_shared<FrameBuffer>(this, bo, pitch);
+	if(info->cpp != 4 && !drm_core::findConverter(DRM_FORMAT_XRGB8888, format)) {
+		std::cout << "\e[31m" "gfx/plainfb: Unsupported framebuffer format "
+				<< format << "\e[39m" << std::endl;
+		return nullptr;
+	}
+
+	auto fb = std::make_shared<FrameBuffer>(this, bo, format, pitch);
 	fb->setupWeakPtr(fb);
 	registerObject(fb.get());
 	return fb;
@@ -142,7 +152,37 @@ bool GfxDevice::Configuration::capture(std::vector<drm_core::Assignment> assignm
 	};
 
 	for(auto &assign : assignment) {
-		if(assign.property == _device->srcWProperty()) {
+		if(assign.object == _device->_cursorPlane) {
+			//TODO: check this outside of capure
+			assert(assign.property->validate(assign));
+
+			if(assign.property == _device->srcWProperty()) {
+				_cursorWidth = assign.intValue;
+				_cursorUpdate = true;
+			}else if(assign.property == _device->srcHProperty()) {
+				_cursorHeight = assign.intValue;
+				_cursorUpdate = true;
+			}else if(assign.property == _device->fbIdProperty()) {
+				_cursorFb = nullptr;
+				if(assign.objectValue) {
+					_cursorFb = std::static_pointer_cast<GfxDevice::FrameBuffer>(
+							assign.objectValue);
+					// The cursor is alpha-blended by _blit().
+					if(_cursorFb->getFormat() != DRM_FORMAT_ARGB8888)
+						return false;
+				}
+				_cursorUpdate = true;
+			}else if(assign.property == _device->crtcXProperty()) {
+				// Cursor positions can be negative.
+				_cursorX = static_cast<int32_t>(assign.intValue);
+				_cursorMove = true;
+			}else if(assign.property == _device->crtcYProperty()) {
+				_cursorY = static_cast<int32_t>(assign.intValue);
+				_cursorMove = true;
+			}else{
+				return false;
+			}
+		}else if(assign.property == _device->srcWProperty()) {
 			//TODO: check this outside of capure
 			assert(assign.property->validate(assign));
 			
@@ -167,6 +207,12 @@ bool GfxDevice::Configuration::capture(std::vector<drm_core::Assignment> assignm
 		
 			captureScanout();
 			_state->mode = assign.blobValue;
+		}else if(assign.property == _device->fbDamageClipsProperty()) {
+			//TODO: check this outside of capture.
+			assert(assign.property->validate(assign));
+
+			captureScanout();
+			_state->damage = drm_core::damageFromBlob(assign.blobValue.get());
 		}else{
 			return false;
 		}
@@ -200,6 +246,26 @@ void GfxDevice::Configuration::commit() {
 }
 
 async::detached GfxDevice::Configuration::_dispatch() {
+	// Both the old and the new cursor position need to be redrawn.
+	std::vector<drm_core::DamageRect> cursor_damage;
+	if(_cursorUpdate || _cursorMove) {
+		if(auto rect = _device->_cursorRect(); rect)
+			cursor_damage.push_back(*rect);
+
+		if(_cursorUpdate) {
+			_device->_cursorFb = _cursorFb;
+			_device->_cursorWidth = _cursorWidth;
+			_device->_cursorHeight = _cursorHeight;
+		}
+		if(_cursorMove) {
+			_device->_cursorX = _cursorX;
+			_device->_cursorY = _cursorY;
+		}
+
+		if(auto rect = _device->_cursorRect(); rect)
+			cursor_damage.push_back(*rect);
+	}
+
 	if(_state && _state->mode) {
 //		std::cout << "Swap to framebuffer " << _state[i]->fb->id()
 //				<< " " << _state[i]->width << "x" << _state[i]->height << std::endl;
@@ -212,30 +278,88 @@ async::detached GfxDevice::Configuration::_dispatch() {
 		auto bo = _state->fb->getBufferObject();
 		assert(bo->getWidth() == _device->_screenWidth);
 		assert(bo->getHeight() == _device->_screenHeight);
-		auto dest = reinterpret_cast<char *>(_device->_fbMapping.get());
-		auto src = reinterpret_cast<char *>(bo->accessMapping());
-
-		if(_state->fb->fastScanout()) {
-			for(unsigned int k = 0; k < bo->getHeight(); k++) {
-				drm_core::fastCopy16(dest, src, bo->getWidth() * 4);
-				dest += _device->_screenPitch;
-				src += _state->fb->getPitch();
-			}
-		}else{
-			for(unsigned int k = 0; k < bo->getHeight(); k++) {
-				memcpy(dest, src, bo->getWidth() * 4);
-				dest += _device->_screenPitch;
-				src += _state->fb->getPitch();
-			}
+
+		// Damage is relative to the FB that is already on screen;
+		// switching FBs always requires a full copy.
+		std::vector<drm_core::DamageRect> damage;
+		if(_state->damage && _state->fb == _device->_scanoutFb) {
+			damage = *_state->damage;
+			if(!damage.empty())
+				damage.insert(damage.end(), cursor_damage.begin(), cursor_damage.end());
 		}
+		_device->_scanoutFb = _state->fb;
+		_device->_blit(_state->fb, drm_core::clipDamage(damage,
+				bo->getWidth(), bo->getHeight()));
 	}else if(_state) {
 		assert(!_state->mode);
 		std::cout << "gfx/plainfb: Disable scanout" << std::endl;
+		_device->_scanoutFb = nullptr;
+	}else if(!cursor_damage.empty() && _device->_scanoutFb) {
+		auto bo = _device->_scanoutFb->getBufferObject();
+		_device->_blit(_device->_scanoutFb, drm_core::clipDamage(cursor_damage,
+				bo->getWidth(), bo->getHeight()));
 	}
 
 	complete();
 }
 
+std::optional<drm_core::DamageRect> GfxDevice::_cursorRect() {
+	if(!_cursorFb || _cursorWidth <= 0 || _cursorHeight <= 0)
+		return std::nullopt;
+	return drm_core::DamageRect{_cursorX, _cursorY,
+			_cursorX + _cursorWidth, _cursorY + _cursorHeight};
+}
+
+void GfxDevice::_blit(FrameBuffer *fb, const std::vector<drm_core::DamageRect> &damage) {
+	auto bo = fb->getBufferObject();
+	auto cpp = drm_core::getFormatInfo(fb->getFormat())->cpp;
+	auto convert = drm_core::findConverter(DRM_FORMAT_XRGB8888, fb->getFormat());
+	auto cursor = _cursorRect();
+
+	for(auto &rect : damage) {
+		size_t width = rect.x2 - rect.x1;
+
+		for(int y = rect.y1; y < rect.y2; y++) {
+			auto dest = reinterpret_cast<char *>(_fbMapping.get())
+					+ y * _screenPitch + rect.x1 * 4;
+			auto src = reinterpret_cast<char *>(bo->accessMapping())
+					+ y * fb->getPitch() + rect.x1 * cpp;
+
+			// Determine the part of this row that is covered by the cursor.
+			int cursor_x1 = 0;
+			int cursor_x2 = 0;
+			if(cursor && y >= cursor->y1 && y < cursor->y2) {
+				cursor_x1 = std::max(rect.x1, cursor->x1);
+				cursor_x2 = std::min(rect.x2, cursor->x2);
+			}
+
+			if(cursor_x1 >= cursor_x2) {
+				if(convert) {
+					convert(dest, src, width);
+				}else{
+					drm_core::blitCopy(dest, src, width * 4);
+				}
+				continue;
+			}
+
+			// Compose the row in cached memory since reading back the hardware FB is slow.
+			_rowBuffer.resize(width);
+			if(convert) {
+				convert(_rowBuffer.data(), src, width);
+			}else{
+				drm_core::blitCopy(_rowBuffer.data(), src, width * 4);
+			}
+
+			auto cursor_src = reinterpret_cast<char *>(
+					_cursorFb->getBufferObject()->accessMapping())
+					+ (y - cursor->y1) * _cursorFb->getPitch() + (cursor_x1 - cursor->x1) * 4;
+			drm_core::blendArgb8888(_rowBuffer.data() + (cursor_x1 - rect.x1), cursor_src,
+					cursor_x2 - cursor_x1);
+			drm_core::blitCopy(dest, _rowBuffer.data(), width * 4);
+		}
+	}
+}
+
 // ----------------------------------------------------------------
 // GfxDevice::Connector.
 // ----------------------------------------------------------------
@@ -257,9 +381,10 @@ GfxDevice::Encoder::Encoder(GfxDevice *device)
 // GfxDevice::Crtc.
 // ----------------------------------------------------------------
 
-GfxDevice::Crtc::Crtc(GfxDevice *device, std::shared_ptr<Plane> plane)
+GfxDevice::Crtc::Crtc(GfxDevice *device, std::shared_ptr<Plane> plane,
+		std::shared_ptr<Plane> cursor_plane)
 : drm_core::Crtc{device->allocator.allocate()},
-		_primaryPlane{std::move(plane)} {
+		_primaryPlane{std::move(plane)}, _cursorPlane{std::move(cursor_plane)} {
 	(void)device;
 }
 
@@ -267,34 +392,40 @@ drm_core::Plane *GfxDevice::Crtc::primaryPlane() {
 	return _primaryPlane.get();
 }
 
+drm_core::Plane *GfxDevice::Crtc::cursorPlane() {
+	return _cursorPlane.get();
+}
+
 // ----------------------------------------------------------------
 // GfxDevice::FrameBuffer.
 // ----------------------------------------------------------------
 
 GfxDevice::FrameBuffer::FrameBuffer(GfxDevice *device,
-		std::shared_ptr<GfxDevice::BufferObject> bo, size_t pitch)
+		std::shared_ptr<GfxDevice::BufferObject> bo, uint32_t format, size_t pitch)
 : drm_core::FrameBuffer{device->allocator.allocate()},
-		_device{device}, _bo{std::move(bo)}, _pitch{pitch} {
-	if(!_device->_hardwareFbIsAligned) {
-		_fastScanout = false;
-	}else if((reinterpret_cast<uintptr_t>(_bo->accessMapping()) & 15)
-			|| ((_bo->getWidth() * 4) & 15)) {
-		std::cout << "\e[31m" "gfx/plainfb: Framebuffer is not aligned!" "\e[39m" << std::endl;
-		_fastScanout = false;
-	}
+		_device{device}, _bo{std::move(bo)}, _format{format}, _pitch{pitch} { }
+
+GfxDevice::FrameBuffer::~FrameBuffer() {
+	if(_device->_scanoutFb == this)
+		_device->_scanoutFb = nullptr;
 }
 
 size_t GfxDevice::FrameBuffer::getPitch() {
 	return _pitch;
 }
 
+uint32_t GfxDevice::FrameBuffer::getFormat() {
+	return _format;
+}
+
 GfxDevice::BufferObject *GfxDevice::FrameBuffer::getBufferObject() {
 	return _bo.get();
 }
 
-void GfxDevice::FrameBuffer::notifyDirty() {
-	// TODO: Re-blit the FrameBuffer if it is currently displayed.
-	std::cout << "gfx/plainfb: notifyDirty() is not implemented correctly" << std::endl;
+void GfxDevice::FrameBuffer::notifyDirty(std::vector<drm_core::DamageRect> damage) {
+	if(_device->_scanoutFb != this)
+		return;
+	_device->_blit(this, drm_core::clipDamage(damage, _bo->getWidth(), _bo->getHeight()));
 }
 
 // ----------------------------------------------------------------
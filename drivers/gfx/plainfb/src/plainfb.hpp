@@ -24,6 +24,8 @@ struct GfxDevice final : drm_core::Device, std::enable_shared_from_this<GfxDevic
 		std::shared_ptr<drm_core::Blob> mode;
 		int width;
 		int height;
+		// Set if FB_DAMAGE_CLIPS was supplied; otherwise the full FB is copied.
+		std::optional<std::vector<drm_core::DamageRect>> damage;
 	};
 
 	struct Configuration : drm_core::Configuration {
@@ -39,6 +41,14 @@ struct GfxDevice final : drm_core::Device, std::enable_shared_from_this<GfxDevic
 	
 		GfxDevice *_device;
 		std::optional<ScanoutState> _state;
+
+		bool _cursorUpdate = false;
+		bool _cursorMove = false;
+		std::shared_ptr<GfxDevice::FrameBuffer> _cursorFb;
+		int _cursorWidth = 0;
+		int _cursorHeight = 0;
+		int _cursorX = 0;
+		int _cursorY = 0;
 	};
 
 	struct Plane : drm_core::Plane {
@@ -73,30 +83,33 @@ struct GfxDevice final : drm_core::Device, std::enable_shared_from_this<GfxDevic
 	};
 	
 	struct Crtc final : drm_core::Crtc {
-		Crtc(GfxDevice *device, std::shared_ptr<Plane> plane);
+		Crtc(GfxDevice *device, std::shared_ptr<Plane> plane,
+				std::shared_ptr<Plane> cursor_plane);
 		
 		drm_core::Plane *primaryPlane() override;
-		// cursorPlane
+		drm_core::Plane *cursorPlane() override;
 	
 	private:	
 		std::shared_ptr<Plane> _primaryPlane;
+		std::shared_ptr<Plane> _cursorPlane;
 	};
 
 	struct FrameBuffer final : drm_core::FrameBuffer {
 		FrameBuffer(GfxDevice *device, std::shared_ptr<GfxDevice::BufferObject> bo,
-				size_t pitch);
+				uint32_t format, size_t pitch);
+		~FrameBuffer();
 
 		size_t getPitch();
-		bool fastScanout() { return _fastScanout; }
+		uint32_t getFormat();
 
 		GfxDevice::BufferObject *getBufferObject();
-		void notifyDirty() override;
+		void notifyDirty(std::vector<drm_core::DamageRect> damage) override;
 
 	private:
 		GfxDevice *_device;
 		std::shared_ptr<GfxDevice::BufferObject> _bo;
+		uint32_t _format;
 		size_t _pitch;
-		bool _fastScanout = true;
 	};
 
 	GfxDevice(protocols::hw::Device hw_device,
@@ -115,18 +128,34 @@ struct GfxDevice final : drm_core::Device, std::enable_shared_from_this<GfxDevic
 	std::tuple<std::string, std::string, std::string> driverInfo() override;
 
 private:
+	std::optional<drm_core::DamageRect> _cursorRect();
+	void _blit(FrameBuffer *fb, const std::vector<drm_core::DamageRect> &damage);
+
 	protocols::hw::Device _hwDevice;
 	unsigned int _screenWidth;
 	unsigned int _screenHeight;
 	size_t _screenPitch;
 	helix::Mapping _fbMapping;
 
+	std::shared_ptr<Plane> _cursorPlane;
 	std::shared_ptr<Crtc> _theCrtc;
 	std::shared_ptr<Encoder> _theEncoder;
 	std::shared_ptr<Connector> _theConnector;
 
+	// FrameBuffer that is currently copied to the hardware framebuffer.
+	// Cleared when that FrameBuffer is destroyed.
+	FrameBuffer *_scanoutFb = nullptr;
+
+	// The cursor is composited in software during _blit().
+	// Keep a reference since the cursor FB is not owned by any drm_core::File.
+	std::shared_ptr<FrameBuffer> _cursorFb;
+	int _cursorWidth = 0;
+	int _cursorHeight = 0;
+	int _cursorX = 0;
+	int _cursorY = 0;
+	std::vector<uint32_t> _rowBuffer;
+
 	bool _claimedDevice = false;
-	bool _hardwareFbIsAligned = true;
 };
 
 #endif // DRIVERS_GFX_PLAINFB_PLAINFB_HPP
@@ -1,6 +1,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <algorithm>
 #include <deque>
 #include <optional>
 #include <functional>
@@ -28,6 +29,10 @@
 // Maps mbus IDs to device objects
 std::unordered_map<int64_t, std::shared_ptr<GfxDevice>> baseDeviceMap;
 
+namespace {
+	constexpr bool logCommits = false;
+}
+
 // ----------------------------------------------------------------
 // GfxDevice.
 // ----------------------------------------------------------------
@@ -83,6 +88,8 @@ async::detached GfxDevice::initialize() {
 		crtc->setupWeakPtr(crtc);
 		encoder->setupWeakPtr(encoder);
 
+		plane->attachProperty(fbDamageClipsProperty());
+
 		encoder->setupPossibleCrtcs({crtc.get()});
 		encoder->setupPossibleClones({encoder.get()});
 		encoder->setCurrentCrtc(crtc.get());
@@ -228,6 +235,13 @@ bool GfxDevice::Configuration::capture(std::vector<drm_core::Assignment> assignm
 			auto crtc = static_cast<Crtc *>(assign.object.get());
 			captureScanout(crtc->scanoutId());
 			_state[crtc->scanoutId()]->mode = assign.blobValue;
+		}else if(assign.property == _device->fbDamageClipsProperty()) {
+			//TODO: check this outside of capture.
+			assert(assign.property->validate(assign));
+
+			auto plane = static_cast<Plane *>(assign.object.get());
+			captureScanout(plane->scanoutId());
+			_state[plane->scanoutId()]->damage = drm_core::damageFromBlob(assign.blobValue.get());
 		}else{
 			return false;
 		}
@@ -269,31 +283,31 @@ void GfxDevice::Configuration::commit() {
 }
 
 async::detached GfxDevice::Configuration::_dispatch() {
+	uint64_t start;
+	HEL_CHECK(helGetClock(&start));
+
+	if(!_device->_claimedDevice) {
+		co_await _device->_transport->hwDevice().claimDevice();
+		_device->_claimedDevice = true;
+	}
+
+	// Commands for all scanouts are submitted together. Flushes go into a second batch
+	// that is only submitted once the transfers and scanout changes have completed.
+	CommandBatch updates{_device};
+	CommandBatch flushes{_device};
 	for(size_t i = 0; i < _state.size(); i++) {
 		if(!_state[i])
 			continue;
 
-		if(!_device->_claimedDevice) {
-			co_await _device->_transport->hwDevice().claimDevice();
-			_device->_claimedDevice = true;
-		}
-
 		if(!_state[i]->mode) {
 			std::cout << "gfx/virtio: Disable scanout" << std::endl;
 			spec::SetScanout scanout;
 			memset(&scanout, 0, sizeof(spec::SetScanout));
 			scanout.header.type = spec::cmd::setScanout;
+			scanout.scanoutId = i;
+			updates.push(scanout);
 
-			spec::Header scanout_result;
-			virtio_core::Chain scanout_chain;
-			co_await virtio_core::scatterGather(virtio_core::hostToDevice,
-					scanout_chain, _device->_controlQ,
-					arch::dma_buffer_view{nullptr, &scanout, sizeof(spec::SetScanout)});
-			co_await virtio_core::scatterGather(virtio_core::deviceToHost,
-					scanout_chain, _device->_controlQ,
-					arch::dma_buffer_view{nullptr, &scanout_result, sizeof(spec::Header)});
-			co_await AwaitableRequest{_device->_controlQ, scanout_chain.front()};
-
+			_device->_scanoutFbs[i] = nullptr;
 			continue;
 		}
 
@@ -302,69 +316,147 @@ async::detached GfxDevice::Configuration::_dispatch() {
 //		std::cout << "Swap to framebuffer " << _state[i]->fb->id()
 //				<< " " << _state[i]->width << "x" << _state[i]->height << std::endl;
 
+		// Damage is relative to the FB that is already on screen;
+		// switching FBs always requires a full transfer.
+		bool partial = _state[i]->damage && _state[i]->fb == _device->_scanoutFbs[i];
+		std::vector<drm_core::DamageRect> damage;
+		if(partial)
+			damage = *_state[i]->damage;
+		damage = drm_core::clipDamage(damage, _state[i]->width, _state[i]->height);
+
+		_pushTransfers(updates, _state[i]->fb->getBufferObject(), damage);
+
+		// Damage-only updates keep the current scanout resource.
+		if(!partial) {
+			spec::SetScanout scanout;
+			memset(&scanout, 0, sizeof(spec::SetScanout));
+			scanout.header.type = spec::cmd::setScanout;
+			scanout.rect.x = 0;
+			scanout.rect.y = 0;
+			scanout.rect.width = _state[i]->width;
+			scanout.rect.height = _state[i]->height;
+			scanout.scanoutId = i;
+			scanout.resourceId = _state[i]->fb->getBufferObject()->hardwareId();
+			updates.push(scanout);
+		}
+
+		_device->_scanoutFbs[i] = _state[i]->fb;
+
+		_pushFlushes(flushes, _state[i]->fb->getBufferObject(), damage);
+	}
+
+	auto num_commands = updates.size() + flushes.size();
+	if(co_await updates.submit()) {
+		co_await flushes.submit();
+	}else{
+		// We do not know which scanout resources are set; force full updates next time.
+		std::cout << "gfx/virtio: Commit failed, skipping flushes" << std::endl;
+		for(auto &fb : _device->_scanoutFbs)
+			fb = nullptr;
+	}
+
+	uint64_t end;
+	HEL_CHECK(helGetClock(&end));
+	auto latency = end - start;
+	_device->_numCommits++;
+	_device->_totalCommitLatency += latency;
+	_device->_maxCommitLatency = std::max(_device->_maxCommitLatency, latency);
+	if(logCommits)
+		std::cout << "gfx/virtio: Commit of " << num_commands << " commands took "
+				<< latency / 1000 << " us (average: "
+				<< _device->_totalCommitLatency / _device->_numCommits / 1000
+				<< " us, max: " << _device->_maxCommitLatency / 1000 << " us)" << std::endl;
+
+	complete();
+}
+
+void GfxDevice::_pushTransfers(CommandBatch &batch, BufferObject *bo,
+		const std::vector<drm_core::DamageRect> &damage) {
+	for(auto &rect : damage) {
 		spec::XferToHost2d xfer;
 		memset(&xfer, 0, sizeof(spec::XferToHost2d));
 		xfer.header.type = spec::cmd::xferToHost2d;
-		xfer.rect.x = 0;
-		xfer.rect.y = 0;
-		xfer.rect.width = _state[i]->width;
-		xfer.rect.height = _state[i]->height;
-		xfer.resourceId = _state[i]->fb->getBufferObject()->hardwareId();
-
-		spec::Header xfer_result;
-		virtio_core::Chain xfer_chain;
-		co_await virtio_core::scatterGather(virtio_core::hostToDevice,
-				xfer_chain, _device->_controlQ,
-				arch::dma_buffer_view{nullptr, &xfer, sizeof(spec::XferToHost2d)});
-		co_await virtio_core::scatterGather(virtio_core::deviceToHost,
-				xfer_chain, _device->_controlQ,
-				arch::dma_buffer_view{nullptr, &xfer_result, sizeof(spec::Header)});
-		co_await AwaitableRequest{_device->_controlQ, xfer_chain.front()};
-		assert(xfer_result.type == spec::resp::noData);
-
-		spec::SetScanout scanout;
-		memset(&scanout, 0, sizeof(spec::SetScanout));
-		scanout.header.type = spec::cmd::setScanout;
-		scanout.rect.x = 0;
-		scanout.rect.y = 0;
-		scanout.rect.width = _state[i]->width;
-		scanout.rect.height = _state[i]->height;
-		scanout.scanoutId = i;
-		scanout.resourceId = _state[i]->fb->getBufferObject()->hardwareId();
-
-		spec::Header scanout_result;
-		virtio_core::Chain scanout_chain;
-		co_await virtio_core::scatterGather(virtio_core::hostToDevice,
-				scanout_chain, _device->_controlQ,
-				arch::dma_buffer_view{nullptr, &scanout, sizeof(spec::SetScanout)});
-		co_await virtio_core::scatterGather(virtio_core::deviceToHost,
-				scanout_chain, _device->_controlQ,
-				arch::dma_buffer_view{nullptr, &scanout_result, sizeof(spec::Header)});
-		co_await AwaitableRequest{_device->_controlQ, scanout_chain.front()};
-		assert(scanout_result.type == spec::resp::noData);
+		xfer.rect.x = rect.x1;
+		xfer.rect.y = rect.y1;
+		xfer.rect.width = rect.x2 - rect.x1;
+		xfer.rect.height = rect.y2 - rect.y1;
+		// Dumb buffers are tightly packed, i.e., pitch == width * 4.
+		xfer.offset = (static_cast<uint64_t>(rect.y1) * bo->getWidth() + rect.x1) * 4;
+		xfer.resourceId = bo->hardwareId();
+		batch.push(xfer);
+	}
+}
 
+void GfxDevice::_pushFlushes(CommandBatch &batch, BufferObject *bo,
+		const std::vector<drm_core::DamageRect> &damage) {
+	for(auto &rect : damage) {
 		spec::ResourceFlush flush;
 		memset(&flush, 0, sizeof(spec::ResourceFlush));
 		flush.header.type = spec::cmd::resourceFlush;
-		flush.rect.x = 0;
-		flush.rect.y = 0;
-		flush.rect.width = _state[i]->width;
-		flush.rect.height = _state[i]->height;
-		flush.resourceId = _state[i]->fb->getBufferObject()->hardwareId();
-
-		spec::Header flush_result;
-		virtio_core::Chain flush_chain;
-		co_await virtio_core::scatterGather(virtio_core::hostToDevice,
-				flush_chain, _device->_controlQ,
-				arch::dma_buffer_view{nullptr, &flush, sizeof(spec::ResourceFlush)});
-		co_await virtio_core::scatterGather(virtio_core::deviceToHost,
-				flush_chain, _device->_controlQ,
-				arch::dma_buffer_view{nullptr, &flush_result, sizeof(spec::Header)});
-		co_await AwaitableRequest{_device->_controlQ, flush_chain.front()};
-		assert(flush_result.type == spec::resp::noData);
+		flush.rect.x = rect.x1;
+		flush.rect.y = rect.y1;
+		flush.rect.width = rect.x2 - rect.x1;
+		flush.rect.height = rect.y2 - rect.y1;
+		flush.resourceId = bo->hardwareId();
+		batch.push(flush);
 	}
+}
 
-	complete();
+// ----------------------------------------------------------------
+// GfxDevice::CommandBatch.
+// ----------------------------------------------------------------
+
+void GfxDevice::CommandBatch::Command::complete(virtio_core::Request *base) {
+	auto self = static_cast<Command *>(base);
+	auto batch = self->batch;
+	assert(batch->_inFlight);
+	if(!--batch->_inFlight)
+		batch->_doorbell.ring();
+}
+
+async::result<bool> GfxDevice::CommandBatch::submit() {
+	if(_commands.empty())
+		co_return true;
+
+	auto queue = _device->_controlQ;
+
+	// Each command occupies two descriptors. Chains that are posted but not yet
+	// announced to the device cannot complete, hence we notify the device
+	// at least every half queue to avoid starving scatterGather() of descriptors.
+	size_t perNotify = std::max(queue->numDescriptors() / 4, size_t{1});
+	size_t unannounced = 0;
+	for(auto &cmd : _commands) {
+		virtio_core::Chain chain;
+		co_await virtio_core::scatterGather(virtio_core::hostToDevice, chain, queue,
+				arch::dma_buffer_view{nullptr, cmd->buffer.data(), cmd->buffer.size()});
+		co_await virtio_core::scatterGather(virtio_core::deviceToHost, chain, queue,
+				arch::dma_buffer_view{nullptr, &cmd->result, sizeof(spec::Header)});
+
+		_inFlight++;
+		queue->postDescriptor(chain.front(), cmd.get(), &Command::complete);
+		if(++unannounced == perNotify) {
+			queue->notify();
+			unannounced = 0;
+		}
+	}
+	if(unannounced)
+		queue->notify();
+
+	while(_inFlight)
+		co_await _doorbell.async_wait();
+
+	bool success = true;
+	for(auto &cmd : _commands) {
+		if(cmd->result.type != spec::resp::noData) {
+			std::cout << "gfx/virtio: Command 0x" << std::hex
+					<< reinterpret_cast<spec::Header *>(cmd->buffer.data())->type
+					<< " failed with 0x" << cmd->result.type << std::dec << std::endl;
+			success = false;
+		}
+	}
+
+	_commands.clear();
+	co_return success;
 }
 
 // ----------------------------------------------------------------
@@ -414,48 +506,31 @@ GfxDevice::FrameBuffer::FrameBuffer(GfxDevice *device,
 	_device = device;
 }
 
+GfxDevice::FrameBuffer::~FrameBuffer() {
+	for(auto &fb : _device->_scanoutFbs)
+		if(fb == this)
+			fb = nullptr;
+}
+
 GfxDevice::BufferObject *GfxDevice::FrameBuffer::getBufferObject() {
 	return _bo.get();
 }
 
-void GfxDevice::FrameBuffer::notifyDirty() {
-	_xferAndFlush();
-}
-
-async::detached GfxDevice::FrameBuffer::_xferAndFlush() {
-	spec::XferToHost2d xfer;
-	memset(&xfer, 0, sizeof(spec::XferToHost2d));
-	xfer.header.type = spec::cmd::xferToHost2d;
-	xfer.rect.x = 0;
-	xfer.rect.y = 0;
-	xfer.rect.width = _bo->getWidth();
-	xfer.rect.height = _bo->getHeight();
-	xfer.resourceId = _bo->hardwareId();
-
-	spec::Header xfer_result;
-	virtio_core::Chain xfer_chain;
-	co_await virtio_core::scatterGather(virtio_core::hostToDevice, xfer_chain, _device->_controlQ,
-		arch::dma_buffer_view{nullptr, &xfer, sizeof(spec::XferToHost2d)});
-	co_await virtio_core::scatterGather(virtio_core::deviceToHost, xfer_chain, _device->_controlQ,
-		arch::dma_buffer_view{nullptr, &xfer_result, sizeof(spec::Header)});
-	co_await AwaitableRequest{_device->_controlQ, xfer_chain.front()};
-
-	spec::ResourceFlush flush;
-	memset(&flush, 0, sizeof(spec::ResourceFlush));
-	flush.header.type = spec::cmd::resourceFlush;
-	flush.rect.x = 0;
-	flush.rect.y = 0;
-	flush.rect.width = _bo->getWidth();
-	flush.rect.height = _bo->getHeight();
-	flush.resourceId = _bo->hardwareId();
-
-	spec::Header flush_result;
-	virtio_core::Chain flush_chain;
-	co_await virtio_core::scatterGather(virtio_core::hostToDevice, flush_chain, _device->_controlQ,
-		arch::dma_buffer_view{nullptr, &flush, sizeof(spec::ResourceFlush)});
-	co_await virtio_core::scatterGather(virtio_core::deviceToHost, flush_chain, _device->_controlQ,
-		arch::dma_buffer_view{nullptr, &flush_result, sizeof(spec::Header)});
-	co_await AwaitableRequest{_device->_controlQ, flush_chain.front()};
+void GfxDevice::FrameBuffer::notifyDirty(std::vector<drm_core::DamageRect> damage) {
+	_xferAndFlush(std::move(damage));
+}
+
+async::detached GfxDevice::FrameBuffer::_xferAndFlush(std::vector<drm_core::DamageRect> damage) {
+	damage = drm_core::clipDamage(damage, _bo->getWidth(), _bo->getHeight());
+
+	CommandBatch transfers{_device};
+	_pushTransfers(transfers, _bo.get(), damage);
+	if(!(co_await transfers.submit()))
+		co_return;
+
+	CommandBatch flushes{_device};
+	_pushFlushes(flushes, _bo.get(), damage);
+	co_await flushes.submit();
 }
 
 // ----------------------------------------------------------------
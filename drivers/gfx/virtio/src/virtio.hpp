@@ -1,9 +1,11 @@
 #ifndef DRIVERS_GFX_VIRTIO_VIRTIO_HPP
 #define DRIVERS_GFX_VIRTIO_VIRTIO_HPP
 
+#include <string.h>
 #include <queue>
 #include <map>
 #include <unordered_map>
+#include <vector>
 
 #include <arch/mem_space.hpp>
 #include <async/doorbell.hpp>
@@ -26,6 +28,49 @@ struct GfxDevice final : drm_core::Device, std::enable_shared_from_this<GfxDevic
 		std::shared_ptr<drm_core::Blob> mode;
 		int width;
 		int height;
+		// Set if FB_DAMAGE_CLIPS was supplied; otherwise the full FB is flushed.
+		std::optional<std::vector<drm_core::DamageRect>> damage;
+	};
+
+	// Collects control queue commands and submits them with a single notification.
+	// The batch completes once the device has responded to all of its commands
+	// (the buffers of the commands must stay alive until then, hence no fences are used).
+	struct CommandBatch {
+		CommandBatch(GfxDevice *device)
+		: _device{device} { };
+
+		CommandBatch(const CommandBatch &) = delete;
+		CommandBatch &operator= (const CommandBatch &) = delete;
+
+		template<typename C>
+		void push(const C &command) {
+			auto cmd = std::make_unique<Command>();
+			cmd->batch = this;
+			cmd->buffer.resize(sizeof(C));
+			memcpy(cmd->buffer.data(), &command, sizeof(C));
+			_commands.push_back(std::move(cmd));
+		}
+
+		size_t size() {
+			return _commands.size();
+		}
+
+		// Returns false if the device reported an error for any command.
+		async::result<bool> submit();
+
+	private:
+		struct Command : virtio_core::Request {
+			static void complete(virtio_core::Request *base);
+
+			CommandBatch *batch;
+			std::vector<char> buffer;
+			spec::Header result;
+		};
+
+		GfxDevice *_device;
+		std::vector<std::unique_ptr<Command>> _commands;
+		size_t _inFlight = 0;
+		async::doorbell _doorbell;
 	};
 
 	struct Configuration : drm_core::Configuration {
@@ -101,10 +146,11 @@ struct GfxDevice final : drm_core::Device, std::enable_shared_from_this<GfxDevic
 
 	struct FrameBuffer final : drm_core::FrameBuffer {
 		FrameBuffer(GfxDevice *device, std::shared_ptr<GfxDevice::BufferObject> bo);
+		~FrameBuffer();
 
 		GfxDevice::BufferObject *getBufferObject();
-		void notifyDirty() override;
-		async::detached _xferAndFlush();
+		void notifyDirty(std::vector<drm_core::DamageRect> damage) override;
+		async::detached _xferAndFlush(std::vector<drm_core::DamageRect> damage);
 
 	private:
 		std::shared_ptr<GfxDevice::BufferObject> _bo;
@@ -127,7 +173,15 @@ struct GfxDevice final : drm_core::Device, std::enable_shared_from_this<GfxDevic
 	std::tuple<std::string, std::string, std::string> driverInfo() override;
 
 private:
+	static void _pushTransfers(CommandBatch &batch, BufferObject *bo,
+			const std::vector<drm_core::DamageRect> &damage);
+	static void _pushFlushes(CommandBatch &batch, BufferObject *bo,
+			const std::vector<drm_core::DamageRect> &damage);
+
 	std::shared_ptr<Crtc> _theCrtcs[16];
+	// FrameBuffers that are currently set as scanout resources.
+	// Cleared when those FrameBuffers are destroyed.
+	FrameBuffer *_scanoutFbs[16] = {};
 	std::shared_ptr<Encoder> _theEncoders[16];
 	std::shared_ptr<Connector> _activeConnectors[16];
 
@@ -135,6 +189,10 @@ private:
 	virtio_core::Queue *_controlQ;
 	virtio_core::Queue *_cursorQ;
 	bool _claimedDevice;
+	// Commit latency statistics (in nanoseconds).
+	uint64_t _numCommits = 0;
+	uint64_t _totalCommitLatency = 0;
+	uint64_t _maxCommitLatency = 0;
 	id_allocator<uint32_t> _hwAllocator;
 };
 
@@ -18,6 +18,7 @@
 #include <protocols/hw/client.hpp>
 #include <protocols/mbus/client.hpp>
 #include <protocols/svrctl/server.hpp>
+#include <core/drm/blit.hpp>
 #include <core/drm/core.hpp>
 
 #include <libdrm/drm.h>
@@ -558,7 +559,7 @@ async::detached GfxDevice::Configuration::commitConfiguration() {
 
 	if (_fb) {
 		helix::Mapping user_fb{_fb->getBufferObject()->getMemory().first, 0, _fb->getBufferObject()->getSize()};
-		drm_core::fastCopy16(_device->_fbMapping.get(), user_fb.get(), _fb->getBufferObject()->getSize());
+		drm_core::blitCopy(_device->_fbMapping.get(), user_fb.get(), _fb->getBufferObject()->getSize());
 		int w = _device->readRegister(register_index::width),
 			h = _device->readRegister(register_index::height);
 
@@ -621,7 +622,7 @@ uint32_t GfxDevice::FrameBuffer::getPixelPitch() {
 	return _pixelPitch;
 }
 
-void GfxDevice::FrameBuffer::notifyDirty() {
+void GfxDevice::FrameBuffer::notifyDirty(std::vector<drm_core::DamageRect>) {
 
 }
 
@@ -83,7 +83,7 @@ struct GfxDevice final : drm_core::Device, std::enable_shared_from_this<GfxDevic
 
 		GfxDevice::BufferObject *getBufferObject();
 		uint32_t getPixelPitch();
-		void notifyDirty() override;
+		void notifyDirty(std::vector<drm_core::DamageRect> damage) override;
 
 	private:
 		std::shared_ptr<GfxDevice::BufferObject> _bo;
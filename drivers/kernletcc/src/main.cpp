@@ -2,6 +2,8 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <iostream>
+#include <string>
+#include <unordered_map>
 
 #include <async/jump.hpp>
 #include <helix/memory.hpp>
@@ -78,6 +80,46 @@ async::result<helix::UniqueDescriptor> upload(const void *elf, size_t size,
 	co_return pull_kernlet.descriptor();
 }
 
+// ----------------------------------------------------------------------------
+// Compilation.
+// ----------------------------------------------------------------------------
+
+// Kernlet objects that were already uploaded to the kernel, indexed by
+// their bind types and bytecode. Drivers re-bind the same kernlets on restart
+// and hot-plug; those requests do not need to compile and upload again.
+std::unordered_map<std::string, helix::UniqueDescriptor> uploadedKernlets;
+
+async::result<helix::BorrowedDescriptor> compileAndUpload(const uint8_t *code, size_t size,
+		std::vector<BindType> bind_types) {
+	std::string key;
+	for(auto bt : bind_types)
+		key.push_back(static_cast<char>(bt));
+	key.push_back('\0');
+	key.append(reinterpret_cast<const char *>(code), size);
+
+	if(auto it = uploadedKernlets.find(key); it != uploadedKernlets.end())
+		co_return it->second;
+
+	auto elf = compileFafnir(code, size, bind_types);
+
+	if(dumpHex) {
+		for(size_t i = 0; i < elf.size(); i++) {
+			printf("%02x", elf[i]);
+			if((i % 32) == 31)
+				putchar('\n');
+			else if((i % 8) == 7)
+				putchar(' ');
+		}
+		putchar('\n');
+	}
+
+	auto object = co_await upload(elf.data(), elf.size(), bind_types);
+
+	// Another request might have uploaded the same kernlet in the meantime.
+	auto [it, inserted] = uploadedKernlets.insert({std::move(key), std::move(object)});
+	co_return it->second;
+}
+
 // ----------------------------------------------------------------------------
 // kernletcc mbus interface.
 // ----------------------------------------------------------------------------
@@ -117,21 +159,9 @@ async::detached serveCompiler(helix::UniqueLane lane) {
 				bind_types.push_back(bt);
 			}
 
-			auto elf = compileFafnir(reinterpret_cast<const uint8_t *>(recv_code.data()),
-					recv_code.length(), bind_types);
-
-			if(dumpHex) {
-				for(size_t i = 0; i < elf.size(); i++) {
-					printf("%02x", elf[i]);
-					if((i % 32) == 31)
-						putchar('\n');
-					else if((i % 8) == 7)
-						putchar(' ');
-				}
-				putchar('\n');
-			}
-
-			auto object = co_await upload(elf.data(), elf.size(), bind_types);
+			auto object = co_await compileAndUpload(
+					reinterpret_cast<const uint8_t *>(recv_code.data()),
+					recv_code.length(), std::move(bind_types));
 
 			managarm::kernlet::SvrResponse resp;
 			resp.set_error(managarm::kernlet::Error::SUCCESS);
@@ -432,32 +432,32 @@ async::detached FileSystem::manageBlockBitmap(helix::UniqueDescriptor memory) {
 		co_await submit_manage.async_wait();
 		HEL_CHECK(manage.error());
 
-		auto bg_idx = manage.offset() >> blockPagesShift;
-		auto block = bgdt[bg_idx].blockBitmap;
-		assert(block);
-
 		assert(!(manage.offset() & ((1 << blockPagesShift) - 1))
 				&& "TODO: propery support multi-page blocks");
-		assert(manage.length() == (1 << blockPagesShift)
+		assert(!(manage.length() & ((1 << blockPagesShift) - 1))
 				&& "TODO: propery support multi-page blocks");
 
-		if(manage.type() == kHelManageInitialize) {
-			helix::Mapping bitmap_map{memory,
-					static_cast<ptrdiff_t>(manage.offset()), manage.length()};
-			co_await device->readSectors(block * sectorsPerBlock,
-					bitmap_map.get(), sectorsPerBlock);
-			HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageInitialize,
-					manage.offset(), manage.length()));
-		}else{
-			assert(manage.type() == kHelManageWriteback);
-
-			helix::Mapping bitmap_map{memory,
-					static_cast<ptrdiff_t>(manage.offset()), manage.length()};
-			co_await device->writeSectors(block * sectorsPerBlock,
-					bitmap_map.get(), sectorsPerBlock);
-			HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageWriteback,
-					manage.offset(), manage.length()));
+		// The kernel fuses requests for adjacent pages; each page belongs to another group.
+		helix::Mapping bitmap_map{memory,
+				static_cast<ptrdiff_t>(manage.offset()), manage.length()};
+		for(size_t progress = 0; progress < manage.length();
+				progress += size_t{1} << blockPagesShift) {
+			auto bg_idx = (manage.offset() + progress) >> blockPagesShift;
+			auto block = bgdt[bg_idx].blockBitmap;
+			assert(block);
+
+			auto pointer = reinterpret_cast<char *>(bitmap_map.get()) + progress;
+			if(manage.type() == kHelManageInitialize) {
+				co_await device->readSectors(block * sectorsPerBlock,
+						pointer, sectorsPerBlock);
+			}else{
+				assert(manage.type() == kHelManageWriteback);
+				co_await device->writeSectors(block * sectorsPerBlock,
+						pointer, sectorsPerBlock);
+			}
 		}
+		HEL_CHECK(helUpdateMemory(memory.getHandle(), manage.type(),
+				manage.offset(), manage.length()));
 	}
 }
 
@@ -469,32 +469,32 @@ async::detached FileSystem::manageInodeBitmap(helix::UniqueDescriptor memory) {
 		co_await submit_manage.async_wait();
 		HEL_CHECK(manage.error());
 
-		auto bg_idx = manage.offset() >> blockPagesShift;
-		auto block = bgdt[bg_idx].inodeBitmap;
-		assert(block);
-
 		assert(!(manage.offset() & ((1 << blockPagesShift) - 1))
 				&& "TODO: propery support multi-page blocks");
-		assert(manage.length() == (1 << blockPagesShift)
+		assert(!(manage.length() & ((1 << blockPagesShift) - 1))
 				&& "TODO: propery support multi-page blocks");
 
-		if(manage.type() == kHelManageInitialize) {
-			helix::Mapping bitmap_map{memory,
-					static_cast<ptrdiff_t>(manage.offset()), manage.length()};
-			co_await device->readSectors(block * sectorsPerBlock,
-					bitmap_map.get(), sectorsPerBlock);
-			HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageInitialize,
-					manage.offset(), manage.length()));
-		}else{
-			assert(manage.type() == kHelManageWriteback);
-
-			helix::Mapping bitmap_map{memory,
-					static_cast<ptrdiff_t>(manage.offset()), manage.length()};
-			co_await device->writeSectors(block * sectorsPerBlock,
-					bitmap_map.get(), sectorsPerBlock);
-			HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageWriteback,
-					manage.offset(), manage.length()));
+		// The kernel fuses requests for adjacent pages; each page belongs to another group.
+		helix::Mapping bitmap_map{memory,
+				static_cast<ptrdiff_t>(manage.offset()), manage.length()};
+		for(size_t progress = 0; progress < manage.length();
+				progress += size_t{1} << blockPagesShift) {
+			auto bg_idx = (manage.offset() + progress) >> blockPagesShift;
+			auto block = bgdt[bg_idx].inodeBitmap;
+			assert(block);
+
+			auto pointer = reinterpret_cast<char *>(bitmap_map.get()) + progress;
+			if(manage.type() == kHelManageInitialize) {
+				co_await device->readSectors(block * sectorsPerBlock,
+						pointer, sectorsPerBlock);
+			}else{
+				assert(manage.type() == kHelManageWriteback);
+				co_await device->writeSectors(block * sectorsPerBlock,
+						pointer, sectorsPerBlock);
+			}
 		}
+		HEL_CHECK(helUpdateMemory(memory.getHandle(), manage.type(),
+				manage.offset(), manage.length()));
 	}
 }
 
@@ -509,29 +509,32 @@ async::detached FileSystem::manageInodeTable(helix::UniqueDescriptor memory) {
 		// TODO: Make sure that we do not read/write past the end of the table.
 		assert(!((inodesPerGroup * inodeSize) & (blockSize - 1)));
 
-		// TODO: Use shifts instead of division.
-		auto bg_idx = manage.offset() / (inodesPerGroup * inodeSize);
-		auto bg_offset = manage.offset() % (inodesPerGroup * inodeSize);
-		auto block = bgdt[bg_idx].inodeTable;
-		assert(block);
-
-		if(manage.type() == kHelManageInitialize) {
-			helix::Mapping table_map{memory,
-					static_cast<ptrdiff_t>(manage.offset()), manage.length()};
-			co_await device->readSectors(block * sectorsPerBlock + bg_offset / 512,
-					table_map.get(), manage.length() / 512);
-			HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageInitialize,
-					manage.offset(), manage.length()));
-		}else{
-			assert(manage.type() == kHelManageWriteback);
-
-			helix::Mapping table_map{memory,
-					static_cast<ptrdiff_t>(manage.offset()), manage.length()};
-			co_await device->writeSectors(block * sectorsPerBlock + bg_offset / 512,
-					table_map.get(), manage.length() / 512);
-			HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageWriteback,
-					manage.offset(), manage.length()));
+		// Fused requests can span the tables of multiple groups.
+		helix::Mapping table_map{memory,
+				static_cast<ptrdiff_t>(manage.offset()), manage.length()};
+		size_t progress = 0;
+		while(progress < manage.length()) {
+			// TODO: Use shifts instead of division.
+			auto bg_idx = (manage.offset() + progress) / (inodesPerGroup * inodeSize);
+			auto bg_offset = (manage.offset() + progress) % (inodesPerGroup * inodeSize);
+			auto block = bgdt[bg_idx].inodeTable;
+			assert(block);
+
+			auto chunk = std::min(manage.length() - progress,
+					size_t{inodesPerGroup} * inodeSize - bg_offset);
+			auto pointer = reinterpret_cast<char *>(table_map.get()) + progress;
+			if(manage.type() == kHelManageInitialize) {
+				co_await device->readSectors(block * sectorsPerBlock + bg_offset / 512,
+						pointer, chunk / 512);
+			}else{
+				assert(manage.type() == kHelManageWriteback);
+				co_await device->writeSectors(block * sectorsPerBlock + bg_offset / 512,
+						pointer, chunk / 512);
+			}
+			progress += chunk;
 		}
+		HEL_CHECK(helUpdateMemory(memory.getHandle(), manage.type(),
+				manage.offset(), manage.length()));
 	}
 }
 
@@ -744,7 +747,7 @@ async::detached FileSystem::initiateInode(std::shared_ptr<Inode> inode) {
 
 	// Allocate a page cache for the file.
 	auto cache_size = (inode->fileSize() + 0xFFF) & ~size_t(0xFFF);
-	HEL_CHECK(helCreateManagedMemory(cache_size, kHelAllocBacked,
+	HEL_CHECK(helCreateManagedMemory(cache_size, kHelAllocBacked | kHelManagedReadahead,
 			&inode->backingMemory, &inode->frontalMemory));
 
 	if (inode->fileType == kTypeDirectory) {
@@ -823,63 +826,68 @@ async::detached FileSystem::manageIndirect(std::shared_ptr<Inode> inode,
 		co_await submit_manage.async_wait();
 		HEL_CHECK(manage.error());
 
-		uint32_t element = manage.offset() >> blockPagesShift;
-
-		uint32_t block;
-		if(order == 1) {
-			auto disk_inode = inode->diskInode();
-
-			switch(element) {
-			case 0: block = disk_inode->data.blocks.singleIndirect; break;
-			case 1: block = disk_inode->data.blocks.doubleIndirect; break;
-			case 2: block = disk_inode->data.blocks.tripleIndirect; break;
-			default:
-				assert(!"unexpected offset");
-				abort();
-			}
-		}else{
-			assert(order == 2);
-
-			auto indirect_frame = element >> (blockShift - 2);
-			auto indirect_index = element & ((1 << (blockShift - 2)) - 1);
-
-			helix::LockMemoryView lock_indirect;
-			auto &&submit_indirect = helix::submitLockMemoryView(inode->indirectOrder1,
-					&lock_indirect,
-					(1 + indirect_frame) << blockPagesShift, 1 << blockPagesShift,
-					helix::Dispatcher::global());
-			co_await submit_indirect.async_wait();
-			HEL_CHECK(lock_indirect.error());
-
-			helix::Mapping indirect_map{inode->indirectOrder1,
-					(1 + indirect_frame) << blockPagesShift, size_t{1} << blockPagesShift,
-					kHelMapProtRead | kHelMapDontRequireBacking};
-			block = reinterpret_cast<uint32_t *>(indirect_map.get())[indirect_index];
-		}
-
 		assert(!(manage.offset() & ((1 << blockPagesShift) - 1))
 				&& "TODO: propery support multi-page blocks");
-		assert(manage.length() == (1 << blockPagesShift)
+		assert(!(manage.length() & ((1 << blockPagesShift) - 1))
 				&& "TODO: propery support multi-page blocks");
 
-		if (manage.type() == kHelManageInitialize) {
-			helix::Mapping out_map{memory,
-					static_cast<ptrdiff_t>(manage.offset()), manage.length()};
-			co_await device->readSectors(block * sectorsPerBlock,
-					out_map.get(), sectorsPerBlock);
-			HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageInitialize,
-					manage.offset(), manage.length()));
-		} else {
-			assert(manage.type() == kHelManageWriteback);
+		// The kernel fuses requests for adjacent pages; each page caches another block.
+		helix::Mapping out_map{memory,
+				static_cast<ptrdiff_t>(manage.offset()), manage.length()};
+		for(size_t progress = 0; progress < manage.length();
+				progress += size_t{1} << blockPagesShift) {
+			uint32_t element = (manage.offset() + progress) >> blockPagesShift;
+
+			uint32_t block;
+			if(order == 1) {
+				auto disk_inode = inode->diskInode();
+
+				switch(element) {
+				case 0: block = disk_inode->data.blocks.singleIndirect; break;
+				case 1: block = disk_inode->data.blocks.doubleIndirect; break;
+				case 2: block = disk_inode->data.blocks.tripleIndirect; break;
+				default:
+					assert(!"unexpected offset");
+					abort();
+				}
+			}else{
+				assert(order == 2);
 
-			helix::Mapping out_map{memory,
-					static_cast<ptrdiff_t>(manage.offset()), manage.length()};
-			co_await device->writeSectors(block * sectorsPerBlock,
-					out_map.get(), sectorsPerBlock);
-			HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageWriteback,
-					manage.offset(), manage.length()));
+				auto indirect_frame = element >> (blockShift - 2);
+				auto indirect_index = element & ((1 << (blockShift - 2)) - 1);
+
+				helix::LockMemoryView lock_indirect;
+				auto &&submit_indirect = helix::submitLockMemoryView(inode->indirectOrder1,
+						&lock_indirect,
+						(1 + indirect_frame) << blockPagesShift, 1 << blockPagesShift,
+						helix::Dispatcher::global());
+				co_await submit_indirect.async_wait();
+				HEL_CHECK(lock_indirect.error());
 
+				helix::Mapping indirect_map{inode->indirectOrder1,
+						(1 + indirect_frame) << blockPagesShift, size_t{1} << blockPagesShift,
+						kHelMapProtRead | kHelMapDontRequireBacking};
+				block = reinterpret_cast<uint32_t *>(indirect_map.get())[indirect_index];
+			}
+
+			auto pointer = reinterpret_cast<char *>(out_map.get()) + progress;
+			if (manage.type() == kHelManageInitialize) {
+				// Fused requests can include indirection blocks that are not allocated yet.
+				if(!block) {
+					memset(pointer, 0, size_t{1} << blockPagesShift);
+					continue;
+				}
+				co_await device->readSectors(block * sectorsPerBlock,
+						pointer, sectorsPerBlock);
+			} else {
+				assert(manage.type() == kHelManageWriteback);
+				assert(block);
+				co_await device->writeSectors(block * sectorsPerBlock,
+						pointer, sectorsPerBlock);
+			}
 		}
+		HEL_CHECK(helUpdateMemory(memory.getHandle(), manage.type(),
+				manage.offset(), manage.length()));
 	}
 }
 
@@ -1268,6 +1276,52 @@ async::result<void> FileSystem::truncate(Inode *inode, size_t size) {
 	co_return;
 }
 
+async::result<void> FileSystem::fsync(Inode *inode) {
+	co_await inode->readyJump.async_wait();
+
+	// Directories are mapped permanently; push their dirty bits to the page cache first.
+	if(inode->fileMapping) {
+		auto syncFile = co_await helix_ng::synchronizeSpace(
+				helix::BorrowedDescriptor{kHelNullHandle},
+				inode->fileMapping.get(), inode->fileMapping.size());
+		HEL_CHECK(syncFile.error());
+	}
+
+	auto cacheSize = (inode->fileSize() + 0xFFF) & ~size_t(0xFFF);
+	if(cacheSize) {
+		auto writebackFile = co_await helix_ng::writebackMemory(
+				helix::BorrowedDescriptor{inode->frontalMemory}, 0, cacheSize);
+		HEL_CHECK(writebackFile.error());
+	}
+
+	// Write back the blocks that map the file contents.
+	auto writebackOrder1 = co_await helix_ng::writebackMemory(inode->indirectOrder1,
+			0, size_t{3} << blockPagesShift);
+	HEL_CHECK(writebackOrder1.error());
+	auto writebackOrder2 = co_await helix_ng::writebackMemory(inode->indirectOrder2,
+			0, (blockSize / 4) << blockPagesShift);
+	HEL_CHECK(writebackOrder2.error());
+
+	// Write back the inode itself.
+	auto syncInode = co_await helix_ng::synchronizeSpace(
+			helix::BorrowedDescriptor{kHelNullHandle},
+			inode->diskMapping.get(), inodeSize);
+	HEL_CHECK(syncInode.error());
+
+	auto inodeAddress = (inode->number - 1) * inodeSize;
+	auto writebackInode = co_await helix_ng::writebackMemory(inodeTable,
+			inodeAddress & ~(pageSize - 1), pageSize);
+	HEL_CHECK(writebackInode.error());
+
+	// Allocations of the inode and its blocks are recorded in the bitmaps.
+	auto writebackBlockBitmap = co_await helix_ng::writebackMemory(blockBitmap,
+			0, size_t{numBlockGroups} << blockPagesShift);
+	HEL_CHECK(writebackBlockBitmap.error());
+	auto writebackInodeBitmap = co_await helix_ng::writebackMemory(inodeBitmap,
+			0, size_t{numBlockGroups} << blockPagesShift);
+	HEL_CHECK(writebackInodeBitmap.error());
+}
+
 async::result<void> FileSystem::writebackBgdt() {
 	auto bgdt_offset = (2048 + blockSize - 1) & ~size_t(blockSize - 1);
 	co_await device->writeSectors((bgdt_offset >> blockShift) * sectorsPerBlock,
@@ -278,6 +278,9 @@ struct FileSystem {
 
 	async::result<void> truncate(Inode *inode, size_t size);
 
+	// Writes back the contents and the metadata of the inode.
+	async::result<void> fsync(Inode *inode);
+
 	async::result<void> writebackBgdt();
 
 	BlockDevice *device;
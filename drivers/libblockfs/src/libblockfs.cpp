@@ -133,13 +133,14 @@ async::result<protocols::fs::ReadResult> pread(void *object, int64_t offset, con
 	co_return chunk_size;
 }
 
-async::result<void> write(void *object, const char *,
+async::result<frg::expected<protocols::fs::Error>> write(void *object, const char *,
 		const void *buffer, size_t length) {
 	assert(length);
 
 	auto self = static_cast<ext2fs::OpenFile *>(object);
 	co_await self->inode->fs.write(self->inode.get(), self->offset, buffer, length);
 	self->offset += length;
+	co_return {};
 }
 
 async::result<helix::BorrowedDescriptor>
@@ -161,6 +162,12 @@ truncate(void *object, size_t size) {
 	co_return co_await self->inode->fs.truncate(self->inode.get(), size);
 }
 
+async::result<void>
+fsync(void *object) {
+	auto self = static_cast<ext2fs::OpenFile *>(object);
+	co_await self->inode->fs.fsync(self->inode.get());
+}
+
 async::result<int> getFileFlags(void *) {
 	std::cout << "libblockfs: getFileFlags is stubbed" << std::endl;
     co_return 0;
@@ -197,6 +204,7 @@ constexpr protocols::fs::FileOperations fileOperations {
 	.readEntries  = &readEntries,
 	.accessMemory = &accessMemory,
 	.truncate     = &truncate,
+	.fsync        = &fsync,
 	.flock        = &flock,
 	.poll         = &poll,
 	.getFileFlags = &getFileFlags,
@@ -46,7 +46,7 @@ struct File {
 	static async::result<protocols::fs::ReadResult>
 	read(void *object, const char *, void *buffer, size_t length);
 
-	static async::result<void>
+	static async::result<frg::expected<protocols::fs::Error, size_t>>
 	write(void *object, const char *, const void *buffer, size_t length);
 
 	static async::result<protocols::fs::PollResult>
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <functional>
 #include <iostream>
 
 #include "console.hpp"
@@ -30,6 +31,26 @@ async::result<helix::UniqueLane> enumerateKerncfgByteRing(const char *purpose) {
 	co_return co_await p->async_get();
 }
 
+// Invokes the handler for each kerncfg byte ring with the given purpose.
+async::result<void> observeKerncfgByteRings(const char *purpose,
+		std::function<void(helix::UniqueLane, mbus::Properties)> handler) {
+	auto root = co_await mbus::Instance::global().getRoot();
+
+	auto filter = mbus::Conjunction({
+		mbus::EqualsFilter("class", "kerncfg-byte-ring"),
+		mbus::EqualsFilter("purpose", purpose)
+	});
+
+	auto observer = mbus::ObserverHandler{}
+	.withAttach([handler] (mbus::Entity entity,
+			mbus::Properties properties) -> async::detached {
+		std::cout << "virtio-console: Found kerncfg" << std::endl;
+		handler(helix::UniqueLane(co_await entity.bind()), std::move(properties));
+	});
+
+	co_await root.linkObserver(std::move(filter), std::move(observer));
+}
+
 async::result<std::tuple<size_t, uint64_t, uint64_t>>
 getKerncfgByteRingPart(helix::BorrowedLane lane,
 		arch::dma_buffer_view chunk, uint64_t dequeue, uint64_t watermark) {
@@ -108,8 +129,55 @@ async::detached Device::runDevice() {
 		}
 	};
 
+	// There is one profile (resp. trace) ring per CPU. Chunks are prefixed by a header
+	// such that tools/analyze-profile.py (resp. tools/analyze-trace.py) can demultiplex the stream.
+	auto dumpPerCpuRing = [this] (helix::UniqueLane lane, uint32_t magic,
+			uint32_t cpu) -> async::result<void> {
+		constexpr size_t watermark = 1024;
+
+		struct ChunkHeader {
+			uint32_t magic;
+			uint32_t cpu;
+			uint64_t size;
+		};
+		static_assert(sizeof(ChunkHeader) == 16);
+
+		uint64_t dequeue = 0;
+
+		arch::dma_object<ChunkHeader> header{&dmaPool_};
+		arch::dma_buffer chunkBuffer{&dmaPool_, 1 << 16};
+
+		while (true) {
+			auto [size, newDequeue, enqueue] = co_await getKerncfgByteRingPart(
+					lane, chunkBuffer, dequeue, watermark);
+			if (!size)
+				continue;
+			dequeue = newDequeue;
+
+			header->magic = magic;
+			header->cpu = cpu;
+			header->size = size;
+
+			virtio_core::Chain chain;
+			chain.append(co_await txQueue_->obtainDescriptor());
+			chain.setupBuffer(virtio_core::hostToDevice, header.view_buffer());
+			chain.append(co_await txQueue_->obtainDescriptor());
+			chain.setupBuffer(virtio_core::hostToDevice, chunkBuffer.subview(0, size));
+			co_await txQueue_->submitDescriptor(chain.front());
+		}
+	};
+
 	async::detach(dumpKerncfgRing("heap-trace", 1024 * 1024));
-	async::detach(dumpKerncfgRing("kernel-profile", 1024));
+	async::detach(observeKerncfgByteRings("kernel-profile",
+			[=] (helix::UniqueLane lane, mbus::Properties properties) {
+		auto cpu = std::stoi(std::get<mbus::StringItem>(properties.at("cpu")).value);
+		async::detach(dumpPerCpuRing(std::move(lane), 0x464F5250, cpu)); // "PROF".
+	}));
+	async::detach(observeKerncfgByteRings("kernel-trace",
+			[=] (helix::UniqueLane lane, mbus::Properties properties) {
+		auto cpu = std::stoi(std::get<mbus::StringItem>(properties.at("cpu")).value);
+		async::detach(dumpPerCpuRing(std::move(lane), 0x43415254, cpu)); // "TRAC".
+	}));
 	co_return;
 }
 
@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <deque>
 #include <experimental/optional>
 #include <iostream>
@@ -22,16 +23,33 @@ namespace {
 
 	// I own a USB key that does not support the READ6 command. ~AvdG
 	constexpr bool enableRead6 = false;
+
+	// Adjacent requests are merged into a single SCSI command.
+	constexpr bool enableMerging = true;
+
+	// Limit of READ(10)/WRITE(10); larger requests are split.
+	constexpr size_t maxTransferSectors = 0xFFFF;
+
+	// Number of commands that can be in flight on a UAS device.
+	constexpr size_t maxUasTags = 16;
 }
 
-async::detached StorageDevice::run(int config_num, int intf_num) {
+async::detached StorageDevice::run(int config_num, int intf_num, int intf_alternative,
+		Transport transport) {
 	auto descriptor = co_await _usbDevice.configurationDescriptor();
 
 	std::experimental::optional<int> in_endp_number;
 	std::experimental::optional<int> out_endp_number;
+	// UAS identifies its pipes by Pipe Usage descriptors that follow the endpoints.
+	std::experimental::optional<int> uas_pipes[5];
 	
 	walkConfiguration(descriptor, [&] (int type, size_t length, void *p, const auto &info) {
+		if(info.interfaceNumber != intf_num || info.interfaceAlternative != intf_alternative)
+			return;
+
 		if(type == descriptor_type::endpoint) {
+			auto desc = reinterpret_cast<EndpointDescriptor *>(p);
+			_maxPacketSize = std::max(_maxPacketSize, size_t{desc->maxPacketSize & 0x7FFu});
 			if(info.endpointIn.value()) {
 				in_endp_number = info.endpointNumber.value();
 			}else if(!info.endpointIn.value()) {
@@ -39,6 +57,10 @@ async::detached StorageDevice::run(int config_num, int intf_num) {
 			}else {
 				throw std::runtime_error("Illegal endpoint!\n");
 			}
+		}else if(type == uas::kDescriptorPipeUsage) {
+			auto desc = reinterpret_cast<uas::PipeUsageDescriptor *>(p);
+			if(desc->pipeId >= uas::kPipeCommand && desc->pipeId <= uas::kPipeDataOut)
+				uas_pipes[desc->pipeId] = info.endpointNumber.value();
 		}else{
 			if(logEnumeration)
 				printf("block-usb: Unexpected descriptor type: %d!\n", type);
@@ -49,82 +71,176 @@ async::detached StorageDevice::run(int config_num, int intf_num) {
 		std::cout << "block-usb: Setting up configuration" << std::endl;
 	
 	auto config = co_await _usbDevice.useConfiguration(config_num);
-	auto intf = co_await config.useInterface(intf_num, 0);
-	auto endp_in = co_await intf.getEndpoint(PipeType::in, in_endp_number.value());
-	auto endp_out = co_await intf.getEndpoint(PipeType::out, out_endp_number.value());
+	auto intf = co_await config.useInterface(intf_num, intf_alternative);
+
+	if(transport == Transport::uas) {
+		for(int pipe = uas::kPipeCommand; pipe <= uas::kPipeDataOut; pipe++)
+			if(!uas_pipes[pipe])
+				throw std::runtime_error("block-usb: UAS interface lacks pipe usage descriptors");
+
+		auto cmd_endp = co_await intf.getEndpoint(PipeType::out,
+				uas_pipes[uas::kPipeCommand].value());
+		auto status_endp = co_await intf.getEndpoint(PipeType::in,
+				uas_pipes[uas::kPipeStatus].value());
+		auto data_in_endp = co_await intf.getEndpoint(PipeType::in,
+				uas_pipes[uas::kPipeDataIn].value());
+		auto data_out_endp = co_await intf.getEndpoint(PipeType::out,
+				uas_pipes[uas::kPipeDataOut].value());
+
+		if(logSteps)
+			std::cout << "block-usb: UAS device is ready" << std::endl;
+		_runUas(std::move(cmd_endp), std::move(status_endp),
+				std::move(data_in_endp), std::move(data_out_endp));
+	}else{
+		auto endp_in = co_await intf.getEndpoint(PipeType::in, in_endp_number.value());
+		auto endp_out = co_await intf.getEndpoint(PipeType::out, out_endp_number.value());
+
+		if(logSteps)
+			std::cout << "block-usb: Device is ready" << std::endl;
+		_runBulkOnly(std::move(endp_in), std::move(endp_out));
+	}
+}
 
-	if(logSteps)
-		std::cout << "block-usb: Device is ready" << std::endl;
+// Turns the requests at the front of the queue into a single command.
+// Adjacent requests of the same direction are merged; requests that exceed
+// maxTransferSectors are split across multiple commands.
+std::unique_ptr<StorageDevice::Command> StorageDevice::_takeCommand() {
+	assert(!_queue.empty());
+	auto command = std::make_unique<Command>();
+	command->isWrite = _queue.front().isWrite;
+	command->sector = _queue.front().sector + _queue.front().issuedSectors;
+
+	while(true) {
+		auto req = &_queue.front();
+		assert(req->numSectors);
+		auto chunk = std::min(req->numSectors - req->issuedSectors,
+				maxTransferSectors - command->numSectors);
+		command->buffers.push_back(arch::dma_buffer_view{nullptr,
+				static_cast<char *>(req->buffer) + req->issuedSectors * 512, chunk * 512});
+		command->requests.push_back(req);
+		command->numSectors += chunk;
+		req->issuedSectors += chunk;
+		req->outstandingCommands++;
+
+		if(req->issuedSectors < req->numSectors)
+			break;
+		_queue.pop_front();
+
+		// Data of the next request goes into a separate bulk transfer. The device
+		// sends full packets, so the previous transfer must end on a packet boundary.
+		if(_queue.empty() || !enableMerging)
+			break;
+		auto next = &_queue.front();
+		if(next->isWrite != command->isWrite
+				|| next->sector != command->sector + command->numSectors
+				|| command->numSectors == maxTransferSectors
+				|| (chunk * 512) % _maxPacketSize)
+			break;
+		if(logRequests)
+			std::cout << "block-usb: Merging request at sector " << next->sector << std::endl;
+	}
+
+	return command;
+}
+
+void StorageDevice::_completeCommand(Command *command) {
+	for(auto req : command->requests) {
+		assert(req->outstandingCommands);
+		if(--req->outstandingCommands || req->issuedSectors < req->numSectors)
+			continue;
+		req->promise.set_value();
+		delete req;
+	}
+}
+
+size_t StorageDevice::_buildCdb(Command *command, uint8_t *cdb) {
+	auto sector = command->sector;
+	auto count = command->numSectors;
+	assert(count && count <= maxTransferSectors);
+
+	if(!command->isWrite && enableRead6 && sector <= 0x1FFFFF && count <= 0xFF) {
+		scsi::Read6 read;
+		memset(&read, 0, sizeof(scsi::Read6));
+		read.opCode = 0x08;
+		read.lba[0] = sector >> 16;
+		read.lba[1] = (sector >> 8) & 0xFF;
+		read.lba[2] = sector & 0xFF;
+		read.transferLength = count;
+
+		memcpy(cdb, &read, sizeof(scsi::Read6));
+		return sizeof(scsi::Read6);
+	}else if(sector + count <= 0xFFFFFFFF) {
+		// READ(10) and WRITE(10) share the same layout.
+		scsi::Read10 rw;
+		memset(&rw, 0, sizeof(scsi::Read10));
+		rw.opCode = command->isWrite ? 0x2A : 0x28;
+		rw.lba[0] = sector >> 24;
+		rw.lba[1] = (sector >> 16) & 0xFF;
+		rw.lba[2] = (sector >> 8) & 0xFF;
+		rw.lba[3] = sector & 0xFF;
+		rw.transferLength[0] = count >> 8;
+		rw.transferLength[1] = count & 0xFF;
+
+		memcpy(cdb, &rw, sizeof(scsi::Read10));
+		return sizeof(scsi::Read10);
+	}else{
+		// READ(16) and WRITE(16) share the same layout.
+		scsi::Read16 rw;
+		memset(&rw, 0, sizeof(scsi::Read16));
+		rw.opCode = command->isWrite ? 0x8A : 0x88;
+		for(int i = 0; i < 8; i++)
+			rw.lba[i] = (sector >> (56 - i * 8)) & 0xFF;
+		for(int i = 0; i < 4; i++)
+			rw.transferLength[i] = (count >> (24 - i * 8)) & 0xFF;
+
+		memcpy(cdb, &rw, sizeof(scsi::Read16));
+		return sizeof(scsi::Read16);
+	}
+}
+
+async::result<void> StorageDevice::_transferData(Command *command,
+		Endpoint &endp_in, Endpoint &endp_out) {
+	// TODO: Respect USB device DMA requirements.
+	for(auto buffer : command->buffers) {
+		if(!command->isWrite) {
+			BulkTransfer data_info{XferFlags::kXferToHost, buffer};
+			// TODO: We want this to be lazy but that only works if can ensure that
+			// the next transaction is also posted to the queue.
+//			data_info.lazyNotification = true;
+			co_await endp_in.transfer(data_info);
+		}else{
+			co_await endp_out.transfer(BulkTransfer{XferFlags::kXferToDevice, buffer});
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Bulk-Only Transport.
+// ----------------------------------------------------------------------------
+
+async::detached StorageDevice::_runBulkOnly(Endpoint endp_in, Endpoint endp_out) {
+	uint32_t next_tag = 1;
 
 	while(true) {
 		if(!_queue.empty()) {
-			auto req = &_queue.front();
+			auto command = _takeCommand();
 			
 			if(logRequests)
-				std::cout << "block-usb: Reading " << req->numSectors << " sectors" << std::endl;
-			assert(req->numSectors);
-			assert(req->numSectors <= 0xFFFF);
+				std::cout << "block-usb: " << (command->isWrite ? "Writing " : "Reading ")
+						<< command->numSectors << " sectors" << std::endl;
 
 			CommandBlockWrapper cbw;
 			memset(&cbw, 0, sizeof(CommandBlockWrapper));
 			cbw.signature = Signatures::kSignCbw;
-			cbw.tag = 1;
-			cbw.transferLength = req->numSectors * 512;
-			if(!req->isWrite) {
+			cbw.tag = next_tag++;
+			cbw.transferLength = command->numSectors * 512;
+			if(!command->isWrite) {
 				cbw.flags = 0x80; // Direction: Device-to-Host.
 			}else{
 				cbw.flags = 0; // Direction: Host-to-Device.
 			}
 			cbw.lun = 0;
-
-			if(!req->isWrite) {
-				if(enableRead6 && req->sector <= 0x1FFFFF && req->numSectors <= 0xFF) {
-					scsi::Read6 command;
-					memset(&command, 0, sizeof(scsi::Read6));
-					command.opCode = 0x08;
-					command.lba[0] = req->sector >> 16;
-					command.lba[1] = (req->sector >> 8) & 0xFF;
-					command.lba[2] = req->sector & 0xFF;
-					command.transferLength = req->numSectors;
-
-					cbw.cmdLength = sizeof(scsi::Read6);
-					memcpy(cbw.cmdData, &command, sizeof(scsi::Read6));
-				}else if(req->sector <= 0xFFFFFFFF) {
-					scsi::Read10 command;
-					memset(&command, 0, sizeof(scsi::Read10));
-					command.opCode = 0x28;
-					command.lba[0] = req->sector >> 24;
-					command.lba[1] = (req->sector >> 16) & 0xFF;
-					command.lba[2] = (req->sector >> 8) & 0xFF;
-					command.lba[3] = req->sector & 0xFF;
-					command.transferLength[0] = req->numSectors >> 8;
-					command.transferLength[1] = req->numSectors & 0xFF;
-
-					cbw.cmdLength = sizeof(scsi::Read10);
-					memcpy(cbw.cmdData, &command, sizeof(scsi::Read10));
-				}else{
-					throw std::logic_error("USB storage does not currently support high LBAs!");
-				}
-			}else{
-				if(req->sector <= 0xFFFFFFFF) {
-					scsi::Write10 command;
-					memset(&command, 0, sizeof(scsi::Write10));
-					command.opCode = 0x2A;
-					command.lba[0] = req->sector >> 24;
-					command.lba[1] = (req->sector >> 16) & 0xFF;
-					command.lba[2] = (req->sector >> 8) & 0xFF;
-					command.lba[3] = req->sector & 0xFF;
-					command.transferLength[0] = req->numSectors >> 8;
-					command.transferLength[1] = req->numSectors & 0xFF;
-
-					cbw.cmdLength = sizeof(scsi::Write10);
-					memcpy(cbw.cmdData, &command, sizeof(scsi::Write10));
-				}else{
-					throw std::logic_error("USB storage does not currently support high LBAs!");
-				}
-			}
-
-			// TODO: Respect USB device DMA requirements.
+			cbw.cmdLength = _buildCdb(command.get(), cbw.cmdData);
 
 			// TODO: Ideally, we want to post the IN-transfer first.
 			// We do this to try to avoid unnecessary IRQs
@@ -138,18 +254,7 @@ async::detached StorageDevice::run(int config_num, int intf_num) {
 			
 			if(logSteps)
 				std::cout << "block-usb: Waiting for data" << std::endl;
-			if(!req->isWrite) {
-				BulkTransfer data_info{XferFlags::kXferToHost,
-						arch::dma_buffer_view{nullptr, req->buffer, req->numSectors * 512}};
-				// TODO: We want this to be lazy but that only works if can ensure that
-				// the next transaction is also posted to the queue.
-	//			data_info.lazyNotification = true;
-				auto data_xfer = endp_in.transfer(data_info);
-				co_await std::move(data_xfer);
-			}else{
-				co_await endp_out.transfer(BulkTransfer{XferFlags::kXferToDevice,
-						arch::dma_buffer_view{nullptr, req->buffer, req->numSectors * 512}});
-			}
+			co_await _transferData(command.get(), endp_in, endp_out);
 
 			if(logSteps)
 				std::cout << "block-usb: Waiting for CSW" << std::endl;
@@ -160,7 +265,7 @@ async::detached StorageDevice::run(int config_num, int intf_num) {
 			if(logSteps)
 				std::cout << "block-usb: Request complete" << std::endl;
 			assert(csw.signature == Signatures::kSignCsw);
-			assert(csw.tag == 1);
+			assert(csw.tag == cbw.tag);
 			assert(!csw.dataResidue);
 			if(csw.status) {
 				std::cout << "block-usb: Error status 0x"
@@ -169,15 +274,110 @@ async::detached StorageDevice::run(int config_num, int intf_num) {
 				throw std::runtime_error("block-usb: Giving up");
 			}
 
-			req->promise.set_value();
-			_queue.pop_front();
-			delete req;
+			_completeCommand(command.get());
 		}else{
 			co_await _doorbell.async_wait();
 		}
 	}
 }
 
+// ----------------------------------------------------------------------------
+// USB Attached SCSI.
+// ----------------------------------------------------------------------------
+
+// We do not support bulk streams (yet). Without streams, the device announces
+// each data phase with a READ READY or WRITE READY IU on the status pipe;
+// this allows multiple tagged commands to be in flight at the same time.
+
+async::detached StorageDevice::_runUas(Endpoint cmd_endp, Endpoint status_endp,
+		Endpoint data_in_endp, Endpoint data_out_endp) {
+	_uasCommands.resize(maxUasTags);
+	_runUasStatus(std::move(status_endp), std::move(data_in_endp), std::move(data_out_endp));
+
+	while(true) {
+		if(_queue.empty()) {
+			co_await _doorbell.async_wait();
+			continue;
+		}
+		if(_uasInFlight == maxUasTags) {
+			co_await _uasTagBell.async_wait();
+			continue;
+		}
+
+		size_t slot = 0;
+		while(_uasCommands[slot])
+			slot++;
+		uint16_t tag = slot + 1;
+
+		auto command = _takeCommand();
+		if(logRequests)
+			std::cout << "block-usb: " << (command->isWrite ? "Writing " : "Reading ")
+					<< command->numSectors << " sectors with tag " << tag << std::endl;
+
+		uas::CommandIu iu;
+		memset(&iu, 0, sizeof(uas::CommandIu));
+		iu.header.id = uas::kIuCommand;
+		iu.header.tag[0] = tag >> 8;
+		iu.header.tag[1] = tag & 0xFF;
+		_buildCdb(command.get(), iu.cdb);
+
+		// The command must be registered before the device can refer to its tag.
+		_uasCommands[slot] = std::move(command);
+		_uasInFlight++;
+
+		if(logSteps)
+			std::cout << "block-usb: Sending command IU" << std::endl;
+		co_await cmd_endp.transfer(BulkTransfer{XferFlags::kXferToDevice,
+				arch::dma_buffer_view{nullptr, &iu, sizeof(uas::CommandIu)}});
+	}
+}
+
+async::detached StorageDevice::_runUasStatus(Endpoint status_endp,
+		Endpoint data_in_endp, Endpoint data_out_endp) {
+	while(true) {
+		uas::StatusIu iu;
+		memset(&iu, 0, sizeof(uas::StatusIu));
+		BulkTransfer status_info{XferFlags::kXferToHost,
+				arch::dma_buffer_view{nullptr, &iu, sizeof(uas::StatusIu)}};
+		status_info.allowShortPackets = true;
+		co_await status_endp.transfer(status_info);
+
+		uint16_t tag = (iu.header.tag[0] << 8) | iu.header.tag[1];
+		if(!tag || tag > maxUasTags || !_uasCommands[tag - 1]) {
+			std::cout << "block-usb: UAS device reported unknown tag " << tag << std::endl;
+			throw std::runtime_error("block-usb: Giving up");
+		}
+		auto command = _uasCommands[tag - 1].get();
+
+		if(iu.header.id == uas::kIuReadReady || iu.header.id == uas::kIuWriteReady) {
+			if(logSteps)
+				std::cout << "block-usb: Data phase of tag " << tag << std::endl;
+			assert(command->isWrite == (iu.header.id == uas::kIuWriteReady));
+			co_await _transferData(command, data_in_endp, data_out_endp);
+		}else if(iu.header.id == uas::kIuSense) {
+			if(iu.sense.status) {
+				std::cout << "block-usb: Error status 0x"
+						<< std::hex << (unsigned int)iu.sense.status
+						<< ", sense key 0x" << (iu.sense.senseData[2] & 0xF) << std::dec
+						<< " in sense IU" << std::endl;
+				throw std::runtime_error("block-usb: Giving up");
+			}
+
+			if(logSteps)
+				std::cout << "block-usb: Tag " << tag << " complete" << std::endl;
+			_completeCommand(command);
+			_uasCommands[tag - 1] = nullptr;
+			_uasInFlight--;
+			_uasTagBell.ring();
+		}else{
+			std::cout << "block-usb: Unexpected UAS IU 0x" << std::hex
+					<< (unsigned int)iu.header.id << std::dec
+					<< " for tag " << tag << std::endl;
+			throw std::runtime_error("block-usb: Giving up");
+		}
+	}
+}
+
 async::result<void> StorageDevice::readSectors(uint64_t sector,
 		void *buffer, size_t numSectors) {
 	auto req = new Request{false, sector, buffer, numSectors};
@@ -202,9 +402,10 @@ async::detached bindDevice(mbus::Entity entity) {
 	
 	std::experimental::optional<int> config_number;
 	std::experimental::optional<int> intf_number;
-	std::experimental::optional<int> intf_class;
-	std::experimental::optional<int> intf_subclass;
-	std::experimental::optional<int> intf_protocol;
+	std::experimental::optional<int> bot_alternative;
+	std::experimental::optional<int> uas_alternative;
+	// Set if the UAS alternative uses bulk streams, i.e., on SuperSpeed.
+	bool uas_streams = false;
 	
 	if(logEnumeration)
 		std::cout << "block-usb: Getting configuration descriptor" << std::endl;
@@ -215,7 +416,7 @@ async::detached bindDevice(mbus::Entity entity) {
 			assert(!config_number);
 			config_number = info.configNumber.value();
 		}else if(type == descriptor_type::interface) {
-			if(intf_number) {
+			if(intf_number && intf_number.value() != info.interfaceNumber.value()) {
 				std::cout << "block-usb: Ignoring interface "
 						<< info.interfaceNumber.value() << std::endl;
 				return;
@@ -225,31 +426,52 @@ async::detached bindDevice(mbus::Entity entity) {
 						<< ", alternative: " << info.interfaceAlternative.value() << std::endl;
 			intf_number = info.interfaceNumber.value();
 			
-			assert(!intf_class);
-			assert(!intf_subclass);
-			assert(!intf_protocol);
 			auto desc = (InterfaceDescriptor *)p;
-			intf_class = desc->interfaceClass;
-			intf_subclass = desc->interfaceSubClass;
-			intf_protocol = desc->interfaceProtocoll;
+			if(logEnumeration)
+				std::cout << "block-usb: Interface class: 0x" << std::hex
+						<< (int)desc->interfaceClass
+						<< ", subclass: 0x" << (int)desc->interfaceSubClass
+						<< ", protocol: 0x" << (int)desc->interfaceProtocoll
+						<< std::dec << std::endl;
+			if(desc->interfaceClass != 0x08 || desc->interfaceSubClass != 0x06)
+				return;
+			if(desc->interfaceProtocoll == 0x50 && !bot_alternative)
+				bot_alternative = info.interfaceAlternative.value();
+			if(desc->interfaceProtocoll == 0x62 && !uas_alternative)
+				uas_alternative = info.interfaceAlternative.value();
+		}else if(type == uas::kDescriptorSsEndpointCompanion) {
+			if(!uas_alternative
+					|| info.interfaceNumber.value() != intf_number.value()
+					|| info.interfaceAlternative.value() != uas_alternative.value()
+					|| info.endpointType.value() != EndpointType::bulk)
+				return;
+			auto desc = reinterpret_cast<uas::SsEndpointCompanionDescriptor *>(p);
+			if(desc->attributes & 0x1F)
+				uas_streams = true;
 		}
 	});
 
-	if(logEnumeration)
-		std::cout << "block-usb: Device class: 0x" << std::hex << intf_class.value()
-				<< ", subclass: 0x" << intf_subclass.value()
-				<< ", protocol: 0x" << intf_protocol.value()
-				<< std::dec << std::endl;
-	if(intf_class.value() != 0x08
-			|| intf_subclass.value() != 0x06
-			|| intf_protocol.value() != 0x50)
+	if(uas_alternative && uas_streams) {
+		std::cout << "block-usb: UAS requires bulk streams, which are not supported"
+				<< std::endl;
+		uas_alternative = std::experimental::nullopt;
+	}
+
+	if(!uas_alternative && !bot_alternative)
 		co_return;
 
 	if(logEnumeration)
 		std::cout << "block-usb: Detected USB device" << std::endl;
 
 	auto storage_device = new StorageDevice(device);
-	storage_device->run(config_number.value(), intf_number.value());
+	if(uas_alternative) {
+		std::cout << "block-usb: Using UAS" << std::endl;
+		storage_device->run(config_number.value(), intf_number.value(),
+				uas_alternative.value(), Transport::uas);
+	}else{
+		storage_device->run(config_number.value(), intf_number.value(),
+				bot_alternative.value(), Transport::bulkOnly);
+	}
 	blockfs::runDevice(storage_device);
 }
 
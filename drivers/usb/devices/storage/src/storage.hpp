@@ -1,4 +1,8 @@
 
+#include <memory>
+#include <vector>
+
+#include <arch/dma_structs.hpp>
 #include <async/doorbell.hpp>
 #include <async/result.hpp>
 #include <blockfs.hpp>
@@ -28,6 +32,87 @@ struct [[ gnu::packed ]] CommandStatusWrapper {
 };
 static_assert(sizeof(CommandStatusWrapper) == 13);
 
+// USB Attached SCSI information units. Multi-byte fields are big-endian.
+namespace uas {
+
+enum IuId {
+	kIuCommand = 0x01,
+	kIuSense = 0x03,
+	kIuResponse = 0x04,
+	kIuReadReady = 0x06,
+	kIuWriteReady = 0x07
+};
+
+// Pipe IDs from the Pipe Usage descriptor.
+enum PipeId {
+	kPipeCommand = 1,
+	kPipeStatus = 2,
+	kPipeDataIn = 3,
+	kPipeDataOut = 4
+};
+
+inline constexpr int kDescriptorPipeUsage = 0x24;
+inline constexpr int kDescriptorSsEndpointCompanion = 0x30;
+
+struct [[ gnu::packed ]] PipeUsageDescriptor {
+	uint8_t length;
+	uint8_t descriptorType;
+	uint8_t pipeId;
+	uint8_t reserved;
+};
+
+struct [[ gnu::packed ]] SsEndpointCompanionDescriptor {
+	uint8_t length;
+	uint8_t descriptorType;
+	uint8_t maxBurst;
+	uint8_t attributes;
+	uint16_t bytesPerInterval;
+};
+
+struct [[ gnu::packed ]] IuHeader {
+	uint8_t id;
+	uint8_t reserved;
+	uint8_t tag[2];
+};
+static_assert(sizeof(IuHeader) == 4);
+
+struct [[ gnu::packed ]] CommandIu {
+	IuHeader header;
+	uint8_t attributes;
+	uint8_t reserved;
+	uint8_t addCdbLength;
+	uint8_t reserved2;
+	uint8_t lun[8];
+	uint8_t cdb[16];
+};
+static_assert(sizeof(CommandIu) == 32);
+
+struct [[ gnu::packed ]] SenseIu {
+	IuHeader header;
+	uint8_t statusQualifier[2];
+	uint8_t status;
+	uint8_t reserved[7];
+	uint8_t senseLength[2];
+	uint8_t senseData[48];
+};
+static_assert(sizeof(SenseIu) == 64);
+
+struct [[ gnu::packed ]] ResponseIu {
+	IuHeader header;
+	uint8_t additionalInfo[3];
+	uint8_t responseCode;
+};
+static_assert(sizeof(ResponseIu) == 8);
+
+// Any IU that the device sends on the status pipe.
+union StatusIu {
+	IuHeader header;
+	SenseIu sense;
+	ResponseIu response;
+};
+
+} // namespace uas
+
 namespace scsi {
 
 struct Read6 {
@@ -75,6 +160,17 @@ struct Read16 {
 	uint8_t grpNumber;
 	uint8_t control;
 };
+static_assert(sizeof(Read16) == 16);
+
+struct Write16 {
+	uint8_t opCode;
+	uint8_t options;
+	uint8_t lba[8];
+	uint8_t transferLength[4];
+	uint8_t grpNumber;
+	uint8_t control;
+};
+static_assert(sizeof(Write16) == 16);
 
 struct Read32 {
 	uint8_t opCode;
@@ -94,11 +190,17 @@ struct Read32 {
 
 } // namespace scsi
 
+enum class Transport {
+	bulkOnly,
+	uas
+};
+
 struct StorageDevice : blockfs::BlockDevice {
 	StorageDevice(Device usb_device) 
 	: blockfs::BlockDevice(512), _usbDevice(std::move(usb_device)) { }
 
-	async::detached run(int config_num, int intf_num);
+	async::detached run(int config_num, int intf_num, int intf_alternative,
+			Transport transport);
 
 	async::result<void> readSectors(uint64_t sector,
 			void *buffer, size_t numSectors) override;
@@ -115,12 +217,45 @@ private:
 		uint64_t sector;
 		void *buffer;
 		size_t numSectors;
+		// Number of sectors that were already turned into commands.
+		size_t issuedSectors = 0;
+		// Number of commands that carry parts of this request and did not complete yet.
+		unsigned int outstandingCommands = 0;
 		async::promise<void> promise;
 		boost::intrusive::list_member_hook<> requestHook;
 	};
 
+	// A single SCSI command. It covers a contiguous range of sectors
+	// that can span multiple (merged) requests or a part of a (split) request.
+	struct Command {
+		bool isWrite;
+		uint64_t sector;
+		size_t numSectors = 0;
+		std::vector<arch::dma_buffer_view> buffers;
+		std::vector<Request *> requests;
+	};
+
+	std::unique_ptr<Command> _takeCommand();
+	void _completeCommand(Command *command);
+	size_t _buildCdb(Command *command, uint8_t *cdb);
+
+	async::result<void> _transferData(Command *command, Endpoint &endp_in, Endpoint &endp_out);
+	async::detached _runBulkOnly(Endpoint endp_in, Endpoint endp_out);
+	async::detached _runUas(Endpoint cmd_endp, Endpoint status_endp,
+			Endpoint data_in_endp, Endpoint data_out_endp);
+	async::detached _runUasStatus(Endpoint status_endp,
+			Endpoint data_in_endp, Endpoint data_out_endp);
+
 	Device _usbDevice;
 	async::doorbell _doorbell;
+	// Largest max. packet size of the data endpoints. Requests are only merged
+	// if the buffer boundary falls onto a packet boundary.
+	size_t _maxPacketSize = 512;
+
+	// Commands that are in flight on a UAS device, indexed by tag - 1.
+	std::vector<std::unique_ptr<Command>> _uasCommands;
+	size_t _uasInFlight = 0;
+	async::doorbell _uasTagBell;
 
 	boost::intrusive::list<
 		Request,
@@ -131,4 +266,3 @@ private:
 		>
 	> _queue;
 };
-
@@ -152,6 +152,15 @@ extern inline __attribute__ (( always_inline )) HelError helCreateSpace(HelHandl
 	return error;
 };
 
+extern inline __attribute__ (( always_inline )) HelError helForkSpace(HelHandle spaceHandle,
+		struct HelForkedView *views, size_t numViews, HelHandle *forkedHandle) {
+	HelWord handle_word;
+	HelError error = helSyscall3_1(kHelCallForkSpace, (HelWord)spaceHandle,
+			(HelWord)views, (HelWord)numViews, &handle_word);
+	*forkedHandle = (HelHandle)handle_word;
+	return error;
+};
+
 extern inline __attribute__ (( always_inline )) HelError helCreateVirtualizedSpace(HelHandle *handle) {
 	HelWord handle_word;
 	HelError error = helSyscall0_1(kHelCallCreateVirtualizedSpace, &handle_word);
@@ -265,6 +274,12 @@ extern inline __attribute__ (( always_inline )) HelError helLoadahead(HelHandle
 	return helSyscall3(kHelCallLoadahead, (HelWord)handle, (HelWord)offset, (HelWord)length);
 };
 
+extern inline __attribute__ (( always_inline )) HelError helSubmitWritebackMemory(HelHandle handle,
+		uintptr_t offset, size_t length, HelHandle queue, uintptr_t context) {
+	return helSyscall5(kHelCallSubmitWritebackMemory, (HelWord)handle, (HelWord)offset,
+			(HelWord)length, (HelWord)queue, (HelWord)context);
+};
+
 extern inline __attribute__ (( always_inline )) HelError helCreateThread(HelHandle universe,
 		HelHandle address_space, HelAbi abi, void *ip, void *sp, uint32_t flags,
 		HelHandle *handle) {
@@ -368,6 +383,16 @@ extern inline __attribute__ (( always_inline )) HelError helFutexWake(int *point
 	return helSyscall1(kHelCallFutexWake, (HelWord)pointer);
 };
 
+extern inline __attribute__ (( always_inline )) HelError helSharedFutexWait(int *pointer,
+		int expected, int64_t deadline) {
+	return helSyscall3(kHelCallSharedFutexWait, (HelWord)pointer, (HelWord)expected,
+			(HelWord)deadline);
+};
+
+extern inline __attribute__ (( always_inline )) HelError helSharedFutexWake(int *pointer) {
+	return helSyscall1(kHelCallSharedFutexWake, (HelWord)pointer);
+};
+
 extern inline __attribute__ (( always_inline )) HelError helCreateOneshotEvent(HelHandle *handle) {
 	HelWord handle_word;
 	HelError error = helSyscall0_1(kHelCallCreateOneshotEvent, &handle_word);
@@ -16,7 +16,7 @@
 
 enum {
 	// largest system call number plus 1
-	kHelNumCalls = 102,
+	kHelNumCalls = 106,
 
 	kHelCallLog = 1,
 	kHelCallPanic = 10,
@@ -39,6 +39,7 @@ enum {
 	kHelCallCreateSliceView = 88,
 	kHelCallForkMemory = 40,
 	kHelCallCreateSpace = 27,
+	kHelCallForkSpace = 104,
 	kHelCallCreateIndirectMemory = 45,
 	kHelCallAlterMemoryIndirection = 52,
 	kHelCallMapMemory = 44,
@@ -53,6 +54,7 @@ enum {
 	kHelCallUpdateMemory = 47,
 	kHelCallSubmitLockMemoryView = 48,
 	kHelCallLoadahead = 49,
+	kHelCallSubmitWritebackMemory = 105,
 	kHelCallCreateVirtualizedSpace = 50,
 
 	kHelCallCreateThread = 67,
@@ -78,6 +80,8 @@ enum {
 
 	kHelCallFutexWait = 73,
 	kHelCallFutexWake = 71,
+	kHelCallSharedFutexWait = 102,
+	kHelCallSharedFutexWake = 103,
 
 	kHelCallCreateOneshotEvent = 96,
 	kHelCallCreateBitsetEvent = 97,
@@ -237,10 +241,24 @@ enum HelAllocFlags {
 	kHelAllocBacked = 2
 };
 
+enum HelManagedFlags {
+	//! Read ahead of sequential accesses. Only useful for file data.
+	kHelManagedReadahead = 8
+};
+
 struct HelAllocRestrictions {
 	int addressBits;
 };
 
+//! Mapping whose memory object is returned by ::helForkSpace.
+struct HelForkedView {
+	//! Address inside of the mapping. Filled in by the caller.
+	void *pointer;
+	//! Handle to the memory object that backs the mapping in the forked space.
+	//! Filled in by the kernel; kHelNullHandle if no mapping contains @p pointer.
+	HelHandle handle;
+};
+
 enum HelManageRequests {
 	kHelManageInitialize = 1,
 	kHelManageWriteback = 2
@@ -251,7 +269,8 @@ enum HelMapFlags {
 	kHelMapProtRead = 256,
 	kHelMapProtWrite = 512,
 	kHelMapProtExecute = 1024,
-	kHelMapDontRequireBacking = 128
+	kHelMapDontRequireBacking = 128,
+	kHelMapDontInherit = 2048
 };
 
 enum HelThreadFlags {
@@ -540,6 +559,8 @@ HEL_C_LINKAGE HelError helResizeMemory(HelHandle handle, size_t newSize);
 //! @param[in] size
 //!    	Size of the memory object in bytes.
 //!    	Must be aligned to the system's page size.
+//! @param[in] flags
+//!    	Flags from ::HelManagedFlags.
 //! @param[out] backingHandle
 //!    	Handle to the new memory object (for management)
 //! @param[out] frontalHandle
@@ -550,6 +571,7 @@ HEL_C_LINKAGE HelError helCreateManagedMemory(size_t size, uint32_t flags,
 //! Creates memory object that obtains its memory by copy-on-write from another memory object.
 //! @param[in] memory
 //!    	Handle to the source memory object.
+//!    	Can be specified as @p kHelNullHandle to create zero-filled memory.
 //! @param[in] offset
 //!    	Offset in byte relative to @p memory.
 //! @param[in] size
@@ -601,12 +623,35 @@ HEL_C_LINKAGE HelError helCreateSliceView(HelHandle bundle, uintptr_t offset, si
 //!    	Handle to the new (i.e., forked) memory object.
 HEL_C_LINKAGE HelError helForkMemory(HelHandle handle, HelHandle *forkedHandle);
 
+//! Copies an address space using copy-on-write.
+//!
+//! All mappings are copied to the same addresses in the new address space,
+//! except for mappings created with ::kHelMapDontInherit.
+//! Mappings of memory objects created by ::helCopyOnWrite map forked memory objects
+//! (see ::helForkMemory); all other mappings share their memory object.
+//! Protection flags are preserved.
+//! @param[in] spaceHandle
+//!     Handle to the address space that is forked.
+//!     Can be specified as @p kHelNullHandle to fork the current address space.
+//! @param[in,out] views
+//!     Array of mappings whose memory objects (in the new address space)
+//!     are returned to the caller. Can be @p NULL if @p numViews is zero.
+//! @param[in] numViews
+//!     Number of elements of @p views.
+//! @param[out] forkedHandle
+//!     Handle to the new address space.
+HEL_C_LINKAGE HelError helForkSpace(HelHandle spaceHandle,
+		struct HelForkedView *views, size_t numViews, HelHandle *forkedHandle);
+
 //! Creates a virtual address space that threads can run in.
 //! @param[out] handle
 //!     Handle to the new address space.
 HEL_C_LINKAGE HelError helCreateSpace(HelHandle *handle);
 
 //! Maps memory objects into an address space.
+//!
+//! Fails with ::kHelErrNoMemory if the requested range is not free
+//! (or if no free range is large enough).
 //! @param[in] memoryHandle
 //!     Handle to the memory object.
 //! @param[in] spaceHandle
@@ -628,6 +673,10 @@ HEL_C_LINKAGE HelError helMapMemory(HelHandle memoryHandle, HelHandle spaceHandl
 
 //! Changes protection attributes of a memory mapping.
 //!
+//! The range may cover parts of mappings and multiple adjacent mappings;
+//! mappings are split at the boundaries of the range.
+//! Fails with ::kHelErrIllegalArgs if the range is empty or not page aligned.
+//!
 //! This is an asynchronous operation.
 //! @param[in] spaceHandle
 //!     Handle to the address space containing @p pointer.
@@ -662,6 +711,10 @@ HEL_C_LINKAGE HelError helSubmitSynchronizeSpace(HelHandle spaceHandle,
 
 //! Unmaps memory from an address space.
 //!
+//! The range may cover parts of mappings and multiple mappings;
+//! mappings are split at the boundaries of the range.
+//! Fails with ::kHelErrIllegalArgs if the range is empty or not page aligned.
+//!
 //! @param[in] spaceHandle
 //!     Handle to the address space containing @p pointer.
 //! @param[in] pointer
@@ -727,6 +780,22 @@ HEL_C_LINKAGE HelError helSubmitLockMemoryView(HelHandle handle, uintptr_t offse
 //!     Length of the memory range that is preloaded.
 HEL_C_LINKAGE HelError helLoadahead(HelHandle handle, uintptr_t offset, size_t length);
 
+//! Writes back dirty pages of a managed memory object.
+//!
+//! Completes once all pages of the range that were dirty at the time of the call
+//! have been written back by the manager of the memory object (see ::helSubmitManageMemory).
+//! For memory objects that are not managed, this completes immediately.
+//! @param[in] handle
+//!     Handle to the memory object.
+//!     Can be specified as @p kHelNullHandle to write back all managed memory;
+//!     @p offset and @p length are ignored in this case.
+//! @param[in] offset
+//!     Offset in bytes, relative to @p handle. Must be page-aligned.
+//! @param[in] length
+//!     Length of the memory range that is written back. Must be page-aligned.
+HEL_C_LINKAGE HelError helSubmitWritebackMemory(HelHandle handle, uintptr_t offset, size_t length,
+		HelHandle queue, uintptr_t context);
+
 HEL_C_LINKAGE HelError helCreateVirtualizedSpace(HelHandle *handle);
 
 //! @}
@@ -894,6 +963,26 @@ HEL_C_LINKAGE HelError helFutexWait(int *pointer, int expected, int64_t deadline
 //!     Pointer that identifies the futex.
 HEL_C_LINKAGE HelError helFutexWake(int *pointer);
 
+//! Waits on a shared futex.
+//!
+//! In contrast to ::helFutexWait, shared futexes are identified by the
+//! memory object (and offset) that backs @pointer. Hence, they can
+//! be used to synchronize threads in different address spaces that
+//! map the same memory.
+//! @param[in] pointer
+//!     Pointer that identifies the futex. Must be aligned to 4 bytes.
+//! @param[in] expected
+//!     Expected value of the futex. This function does nothing when the
+//!     futex pointed to by @pointer matches this value.
+//! @param[in] deadline
+//!     Timeout (in absolute monotone time, see ::helGetClock).
+HEL_C_LINKAGE HelError helSharedFutexWait(int *pointer, int expected, int64_t deadline);
+
+//! Wakes up all waiters of a shared futex.
+//! @param[in] pointer
+//!     Pointer that identifies the futex. Must be aligned to 4 bytes.
+HEL_C_LINKAGE HelError helSharedFutexWake(int *pointer);
+
 //! @}
 //! @name Event Handling
 //! @{
@@ -1081,6 +1081,45 @@ inline WriteMemoryOperation writeMemory(helix::BorrowedDescriptor descriptor,
 	return {descriptor, address, length, buffer};
 }
 
+// --------------------------------------------------------------------
+// WritebackMemory
+// --------------------------------------------------------------------
+
+struct [[nodiscard]] WritebackMemoryOperation : private Context {
+	WritebackMemoryOperation(helix::BorrowedDescriptor descriptor,
+			uintptr_t offset, size_t length) {
+		auto context = static_cast<Context *>(this);
+		HEL_CHECK(helSubmitWritebackMemory(descriptor.getHandle(),
+				offset, length,
+				Dispatcher::global().acquire(),
+				reinterpret_cast<uintptr_t>(context)));
+	}
+
+	WritebackMemoryOperation(const WritebackMemoryOperation &) = delete;
+
+	WritebackMemoryOperation &operator= (const WritebackMemoryOperation &) = delete;
+
+	auto operator co_await() {
+		using async::operator co_await;
+		return operator co_await(promise_.async_get());
+	}
+
+private:
+	void complete(ElementHandle element) override {
+		SynchronizeSpaceResult result;
+		void *ptr = element.data();
+		result.parse(ptr, element);
+		promise_.set_value(std::move(result));
+	}
+
+	async::promise<SynchronizeSpaceResult> promise_;
+};
+
+inline WritebackMemoryOperation writebackMemory(helix::BorrowedDescriptor descriptor,
+		uintptr_t offset, size_t length) {
+	return {descriptor, offset, length};
+}
+
 // --------------------------------------------------------------------
 // AwaitEvent
 // --------------------------------------------------------------------
@@ -57,6 +57,14 @@ inline void xsave(uint8_t* area, uint64_t rfbm){
 	asm volatile("xsave %0" : : "m"(*area), "a"(low), "d"(high) : "memory");
 }
 
+inline void xsaveopt(uint8_t* area, uint64_t rfbm){
+	assert(!((uintptr_t)area & 0x3F));
+
+	uintptr_t low = rfbm & 0xFFFFFFFF;
+	uintptr_t high = (rfbm >> 32) & 0xFFFFFFFF;
+	asm volatile("xsaveopt %0" : : "m"(*area), "a"(low), "d"(high) : "memory");
+}
+
 inline void xrstor(uint8_t* area, uint64_t rfbm){
 	assert(!((uintptr_t)area & 0x3F));
 
@@ -65,6 +73,15 @@ inline void xrstor(uint8_t* area, uint64_t rfbm){
 	asm volatile("xrstor %0" : : "m"(*area), "a"(low), "d"(high) : "memory");
 }
 
+inline void monitor(const void *address) {
+	asm volatile ("monitor" : : "a"(address), "c"(0), "d"(0) : "memory");
+}
+
+// Bit 0 of extensions makes pending IRQs break out of MWAIT even if IRQs are disabled.
+inline void mwait(uint32_t hints, uint32_t extensions) {
+	asm volatile ("mwait" : : "a"(hints), "c"(extensions) : "memory");
+}
+
 inline void wrmsr(uint32_t index, uint64_t value) {
 	uint32_t low = value;
 	uint32_t high = value >> 32;
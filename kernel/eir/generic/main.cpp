@@ -413,6 +413,8 @@ EirInfo *generateInfo(const char *cmdline){
 			info_ptr->debugFlags |= eirDebugBochs;
 		}else if(token == "kernel-profile") {
 			info_ptr->debugFlags |= eirDebugKernelProfile;
+		}else if(token == "kernel-trace") {
+			info_ptr->debugFlags |= eirDebugKernelTrace;
 		}
 		l = s;
 	}
@@ -7,6 +7,7 @@ static const uint64_t eirSignatureValue = 0x68692C2074686F72;
 static const uint32_t eirDebugSerial = 1;
 static const uint32_t eirDebugBochs = 2;
 static const uint32_t eirDebugKernelProfile = 16;
+static const uint32_t eirDebugKernelTrace = 32;
 
 typedef uint64_t EirPtr;
 typedef uint64_t EirSize;
@@ -1,5 +1,6 @@
 #include <thor-internal/arch/ints.hpp>
 #include <thor-internal/debug.hpp>
+#include <thor-internal/irq.hpp>
 #include <assert.h>
 
 namespace thor {
@@ -10,4 +11,11 @@ void sendPingIpi(int id) {
 	thor::infoLogger() << "sendPingIpi is unimplemented" << frg::endlog;
 }
 
+frg::optional<MsiMessage> allocateMsiVector(IrqPin *pin, int cpu) {
+	thor::infoLogger() << "allocateMsiVector is unimplemented" << frg::endlog;
+	return frg::null_opt;
+}
+
+void acknowledgeMsi() { assert(!"Not implemented"); }
+
 }
@@ -4,6 +4,8 @@
 #include <thor-internal/kasan.hpp>
 #include <thor-internal/main.hpp>
 #include <thor-internal/physical.hpp>
+#include <thor-internal/profile.hpp>
+#include <thor-internal/trace.hpp>
 
 namespace thor {
 
@@ -146,11 +148,7 @@ void saveExecutor(Executor *executor, FaultImageAccessor accessor) {
 	executor->general()->clientFs = common::x86::rdmsr(common::x86::kMsrIndexFsBase);
 	executor->general()->clientGs = common::x86::rdmsr(common::x86::kMsrIndexKernelGsBase);
 
-	if(getCpuData()->haveXsave){
-		common::x86::xsave((uint8_t*)executor->_fxState(), ~0);
-	} else {
-		asm volatile ("fxsaveq %0" : : "m" (*executor->_fxState()));
-	}
+	saveExtendedState(executor);
 }
 
 void saveExecutor(Executor *executor, IrqImageAccessor accessor) {
@@ -180,11 +178,7 @@ void saveExecutor(Executor *executor, IrqImageAccessor accessor) {
 	executor->general()->clientGs = common::x86::rdmsr(common::x86::kMsrIndexKernelGsBase);
 
 
-	if(getCpuData()->haveXsave){
-		common::x86::xsave((uint8_t*)executor->_fxState(), ~0);
-	}else{
-		asm volatile ("fxsaveq %0" : : "m" (*executor->_fxState()));
-	}
+	saveExtendedState(executor);
 }
 
 void saveExecutor(Executor *executor, SyscallImageAccessor accessor) {
@@ -213,7 +207,19 @@ void saveExecutor(Executor *executor, SyscallImageAccessor accessor) {
 	executor->general()->clientFs = common::x86::rdmsr(common::x86::kMsrIndexFsBase);
 	executor->general()->clientGs = common::x86::rdmsr(common::x86::kMsrIndexKernelGsBase);
 
-	if(getCpuData()->haveXsave){
+	saveExtendedState(executor);
+}
+
+void saveExtendedState(Executor *executor) {
+	if(!executor->hasExtendedState())
+		return;
+
+	auto cpuData = getCpuData();
+	if(cpuData->haveXsaveopt){
+		// xsaveopt skips components that are in their initial configuration
+		// or that were not modified since the last xrstor from the same area.
+		common::x86::xsaveopt((uint8_t*)executor->_fxState(), ~0);
+	}else if(cpuData->haveXsave){
 		common::x86::xsave((uint8_t*)executor->_fxState(), ~0);
 	}else{
 		asm volatile ("fxsaveq %0" : : "m" (*executor->_fxState()));
@@ -265,10 +271,20 @@ extern "C" [[ noreturn ]] void _restoreExecutorRegisters(void *pointer);
 	common::x86::wrmsr(common::x86::kMsrIndexFsBase, executor->general()->clientFs);
 	common::x86::wrmsr(common::x86::kMsrIndexKernelGsBase, executor->general()->clientGs);
 
-	if(getCpuData()->haveXsave){
-		common::x86::xrstor((uint8_t*)executor->_fxState(), ~0);
-	}else{
-		asm volatile ("fxrstorq %0" : : "m" (*executor->_fxState()));
+	// Kernel-only executors never touch the FPU/SIMD registers. Hence, we can keep the
+	// state of the last user executor loaded while they run. In particular,
+	// switching from a thread to a fiber and back again does not need an xrstor.
+	auto cpuData = getCpuData();
+	if(executor->hasExtendedState()
+			&& (executor->_extendedStateCpu != cpuData
+				|| executor->_extendedStateGeneration != cpuData->extendedStateGeneration)) {
+		if(cpuData->haveXsave){
+			common::x86::xrstor((uint8_t*)executor->_fxState(), ~0);
+		}else{
+			asm volatile ("fxrstorq %0" : : "m" (*executor->_fxState()));
+		}
+		executor->_extendedStateCpu = cpuData;
+		executor->_extendedStateGeneration = ++cpuData->extendedStateGeneration;
 	}
 
 	uint16_t cs = executor->general()->cs;
@@ -582,8 +598,6 @@ void initializeThisProcessor() {
 		cr4 |= uint32_t(1) << 18; // Enable XSAVE and x{get, set}bv
 		asm volatile ("mov %0, %%cr4" : : "r" (cr4));
 
-		auto xsave_cpuid = common::x86::cpuid(0xD);
-
 		uint64_t xcr0 = 0;
 		xcr0 |= (uint64_t(1) << 0); // Enable saving of x87 feature set
 		xcr0 |= (uint64_t(1) << 1); // Enable saving of SSE feature set
@@ -606,12 +620,26 @@ void initializeThisProcessor() {
 
 		common::x86::wrxcr(0, xcr0);
 
-		cpu_data->xsaveRegionSize = xsave_cpuid[2];
+		// EBX reports the size that is required for the features enabled in XCR0.
+		cpu_data->xsaveRegionSize = common::x86::cpuid(0xD)[1];
 		cpu_data->haveXsave = true;
+
+		if(common::x86::cpuid(0xD, 1)[0] & (uint32_t(1) << 0)) {
+			infoLogger() << "\e[37mthor: CPU supports XSAVEOPT\e[39m" << frg::endlog;
+			cpu_data->haveXsaveopt = true;
+		}
 	}else{
 		infoLogger() << "\e[37mthor: CPU does not support XSAVE!\e[39m" << frg::endlog;
 	}
 
+	// MWAIT is used by the scheduler to poll for wakeups when the CPU is idle.
+	if((common::x86::cpuid(0x1)[2] & (uint32_t(1) << 3))
+			&& common::x86::cpuid(0)[0] >= 5
+			&& (common::x86::cpuid(0x5)[2] & 3) == 3) {
+		infoLogger() << "\e[37mthor: CPU supports MWAIT\e[39m" << frg::endlog;
+		cpu_data->haveMwait = true;
+	}
+
 	// Enable the SMAP extension.
 	if(common::x86::cpuid(0x07)[1] & (uint32_t(1) << 20)) {
 		infoLogger() << "\e[37mthor: CPU supports SMAP\e[39m" << frg::endlog;
@@ -752,6 +780,8 @@ void secondaryMain(StatusBlock *statusBlock) {
 	__atomic_store_n(&statusBlock->targetStage, 2, __ATOMIC_RELEASE);
 
 	infoLogger() << "Hello world from CPU #" << getLocalApicId() << frg::endlog;
+	initializeProfileForThisCpu();
+	initializeTraceForThisCpu();
 	localScheduler()->update();
 	localScheduler()->reschedule();
 	localScheduler()->commit();
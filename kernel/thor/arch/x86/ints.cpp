@@ -420,6 +420,8 @@ extern "C" void onPlatformPreemption(IrqImageAccessor image) {
 	assert(!irqMutex().nesting());
 	disableUserAccess();
 
+	// Threads that are woken up by timers are picked up by handlePreemption().
+	localScheduler()->expectUpdate();
 	LocalApicContext::handleTimerIrq();
 
 	getCpuData()->heartbeat.fetch_add(1, std::memory_order_relaxed);
@@ -431,6 +433,8 @@ extern "C" void onPlatformPreemption(IrqImageAccessor image) {
 
 extern "C" void onPlatformSyscall(SyscallImageAccessor image) {
 	assert(!irqMutex().nesting());
+	// Wakeups of threads on this CPU are handled at the end of handleSyscall().
+	localScheduler()->expectUpdate();
 	enableInts();
 	// TODO: User-access should already be disabled here.
 	disableUserAccess();
@@ -494,6 +498,67 @@ extern "C" void onPlatformWork() {
 	disableInts();
 }
 
+namespace {
+
+void recordProfileSample(NmiImageAccessor image) {
+	auto cpuData = getCpuData();
+
+	struct {
+		ProfileSampleHeader header;
+		uintptr_t frames[maxProfileFrames];
+	} sample;
+	sample.header.magic = profileSampleMagic;
+	sample.header.cpu = cpuData->cpuIndex;
+	sample.header.threadId = 0;
+
+	uint64_t cr3;
+	asm volatile ("mov %%cr3, %0" : "=r"(cr3));
+	sample.header.spaceId = cr3 & 0x000FFFFFFFFFF000;
+
+	// activeExecutor is only meaningful if we interrupted a thread
+	// (and not a kernel fiber or the idle loop).
+	auto cs = *image.cs();
+	bool inUser = cs == kSelClientUserCode;
+	if(inUser || cs == kSelExecutorSyscallCode || cs == kSelExecutorFaultCode) {
+		// Thread IDs are embedded into the thread's credentials.
+		memcpy(&sample.header.threadId, cpuData->activeExecutor->credentials() + 8,
+				sizeof(uint64_t));
+	}
+
+	// Follow the frame pointer chain of the interrupted stack. We do not cross from
+	// kernel stacks into user stacks (or vice versa) and we never fault.
+	size_t n = 0;
+	sample.frames[n++] = *image.ip();
+	uintptr_t sp = *image.sp();
+	uintptr_t fp = *image.bp();
+	while(n < maxProfileFrames) {
+		if(!fp || (fp & (sizeof(uintptr_t) - 1)) || fp < sp)
+			break;
+		if(inHigherHalf(fp) == inUser)
+			break;
+		if(!inUser && fp - *image.sp() >= UniqueKernelStack::kSize)
+			break;
+
+		// Frame layout: saved frame pointer, followed by the return address.
+		// Since fp is aligned, both words are on the same page.
+		uintptr_t frame[2];
+		if(!readActiveSpaceNoFault(fp, frame, sizeof(frame)))
+			break;
+		if(!frame[1])
+			break;
+		sample.frames[n++] = frame[1];
+
+		sp = fp + sizeof(frame);
+		fp = frame[0];
+	}
+	sample.header.numFrames = n;
+
+	cpuData->localProfileRing->enqueue(&sample,
+			sizeof(ProfileSampleHeader) + n * sizeof(uintptr_t));
+}
+
+} // anonymous namespace
+
 extern "C" void onPlatformNmi(NmiImageAccessor image) {
 	// If we interrupted user space or a kernel stub, we might need to update GS.
 	auto gs = common::x86::rdmsr(common::x86::kMsrIndexGsBase);
@@ -505,13 +570,11 @@ extern "C" void onPlatformNmi(NmiImageAccessor image) {
 	bool explained = false;
 	auto pmcMechanism = cpuData->profileMechanism.load(std::memory_order_acquire);
 	if(pmcMechanism == ProfileMechanism::intelPmc && checkIntelPmcOverflow()) {
-		uintptr_t ip = *image.ip();
-		cpuData->localProfileRing->enqueue(&ip, sizeof(uintptr_t));
+		recordProfileSample(image);
 		setIntelPmc();
 		explained = true;
 	}else if(pmcMechanism == ProfileMechanism::amdPmc && checkAmdPmcOverflow()) {
-		uintptr_t ip = *image.ip();
-		cpuData->localProfileRing->enqueue(&ip, sizeof(uintptr_t));
+		recordProfileSample(image);
 		setAmdPmc();
 		explained = true;
 	}
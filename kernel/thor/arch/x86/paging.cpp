@@ -81,6 +81,48 @@ enum {
 
 namespace thor {
 
+bool readActiveSpaceNoFault(VirtualAddr address, void *buffer, size_t size) {
+	assert((address & (kPageSize - 1)) + size <= kPageSize);
+
+	// Non-canonical addresses cannot be mapped.
+	if(static_cast<uint64_t>(static_cast<int64_t>(address << 16) >> 16) != address)
+		return false;
+
+	uint64_t cr3;
+	asm volatile ("mov %%cr3, %0" : "=r"(cr3));
+
+	// Walk from the PML4 down; PDPTs and PDs can map 1 GiB and 2 MiB pages.
+	PhysicalAddr table = cr3 & kPageAddress;
+	for(int level = 3; level >= 0; level--) {
+		auto index = (address >> (12 + 9 * level)) & 0x1FF;
+		PageAccessor accessor{table};
+		auto entry = reinterpret_cast<arch::scalar_variable<uint64_t> *>(
+				accessor.get())[index].load();
+		if(!(entry & kPagePresent))
+			return false;
+
+		bool leaf = !level || ((level == 1 || level == 2) && (entry & kPagePat));
+		if(leaf) {
+			// Do not touch uncached (i.e., potentially MMIO) mappings.
+			if(entry & (kPagePwt | kPagePcd))
+				return false;
+			size_t pageSize = size_t{1} << (12 + 9 * level);
+			auto frame = entry & kPageAddress & ~static_cast<uint64_t>(pageSize - 1);
+			PhysicalAddr physical = frame + (address & (pageSize - 1));
+			PageAccessor data{physical & ~static_cast<PhysicalAddr>(kPageSize - 1)};
+			memcpy(buffer, reinterpret_cast<char *>(data.get())
+					+ (physical & (kPageSize - 1)), size);
+			return true;
+		}
+		table = entry & kPageAddress;
+	}
+	__builtin_unreachable();
+}
+
+} // namespace thor
+
+namespace thor {
+
 // --------------------------------------------------------
 
 PageContext::PageContext()
@@ -472,6 +472,9 @@ IrqPin *getGlobalSystemIrq(size_t n) {
 // TODO: Replace this by proper IRQ allocation.
 extern frg::manual_box<IrqSlot> globalIrqSlots[64];
 
+// Protects the allocation of IrqSlots (both global and per-CPU ones).
+frg::ticket_spinlock irqSlotAllocationMutex;
+
 inline constexpr arch::scalar_register<uint32_t> apicIndex(0x00);
 inline constexpr arch::scalar_register<uint32_t> apicData(0x10);
 
@@ -570,6 +573,7 @@ namespace {
 		}
 
 		// Allocate an IRQ vector for the I/O APIC pin.
+		auto lock = frg::guard(&irqSlotAllocationMutex);
 		if(_vector == -1)
 			for(int i = 0; i < 64; i++) {
 				if(!globalIrqSlots[i]->isAvailable())
@@ -667,6 +671,57 @@ void setupIoApic(int apic_id, int gsi_base, PhysicalAddr address) {
 	}));
 }
 
+// --------------------------------------------------------
+// MSI management
+// --------------------------------------------------------
+
+frg::optional<MsiMessage> allocateMsiVector(IrqPin *pin, int cpu) {
+	// MSIs are delivered to the local APIC; the legacy PIC cannot handle them.
+	if(picModel != kModelApic)
+		return frg::null_opt;
+
+	auto cpuData = getCpuData(cpu);
+	// Without interrupt remapping, MSIs can only target 8-bit APIC IDs.
+	if(cpuData->localApicId > 0xFF)
+		return frg::null_opt;
+
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&irqSlotAllocationMutex);
+
+	// I/O APIC pins are delivered to APIC ID 0 and use the global slots.
+	// MSIs that target that CPU need to share those slots; all other CPUs
+	// have their own set of vectors.
+	auto slot = [&] (int i) -> IrqSlot * {
+		if(!cpuData->localApicId)
+			return globalIrqSlots[i].get();
+		auto localSlots = cpuData->localIrqSlots.load(std::memory_order_relaxed);
+		if(!localSlots) {
+			localSlots = frg::construct_n<IrqSlot>(*kernelAlloc, 64);
+			cpuData->localIrqSlots.store(localSlots, std::memory_order_release);
+		}
+		return &localSlots[i];
+	};
+
+	for(int i = 0; i < 64; i++) {
+		if(!slot(i)->isAvailable())
+			continue;
+		infoLogger() << "thor: Allocating IRQ slot " << i << " of CPU " << cpu
+				<< " to " << pin->name() << frg::endlog;
+		slot(i)->link(pin);
+
+		MsiMessage message;
+		message.address = 0xFEE0'0000 | (static_cast<uint64_t>(cpuData->localApicId) << 12);
+		message.data = 64 + i; // Fixed delivery mode, edge-triggered.
+		return message;
+	}
+
+	return frg::null_opt;
+}
+
+void acknowledgeMsi() {
+	picBase.store(lApicEoi, 0);
+}
+
 // --------------------------------------------------------
 // Legacy PIC management
 // --------------------------------------------------------
@@ -69,6 +69,7 @@ enum {
 };
 
 struct Executor;
+struct PlatformCpuData;
 
 struct Continuation {
 	void *sp;
@@ -281,6 +282,8 @@ struct NmiImageAccessor {
 	}
 
 	Word *ip() { return &_frame()->rip; }
+	Word *sp() { return &_frame()->rsp; }
+	Word *bp() { return &_frame()->rbp; }
 	Word *cs() { return &_frame()->cs; }
 	Word *rflags() { return &_frame()->rflags; }
 
@@ -391,6 +394,12 @@ struct Executor {
 		return _syscallStack;
 	}
 
+	// Kernel-only executors (i.e., fibers) do not have any FPU/SIMD state
+	// since thor itself is compiled without SSE.
+	bool hasExtendedState() {
+		return _syscallStack;
+	}
+
 	// FIXME: remove or refactor the rdi / rflags accessors
 	// as they are platform specific and need to be abstracted here
 	Word *rflags() { return &general()->rflags; }
@@ -496,6 +505,12 @@ private:
 	char *_pointer;
 	void *_syscallStack;
 	common::x86::Tss64 *_tss;
+
+	// CPU that last loaded the FPU/SIMD state of this executor and the value of its
+	// extendedStateGeneration at that point. If both still match, the registers
+	// of that CPU still hold our state and restoreExecutor() can skip the xrstor.
+	PlatformCpuData *_extendedStateCpu = nullptr;
+	uint64_t _extendedStateGeneration = 0;
 };
 
 void saveExecutor(Executor *executor, FaultImageAccessor accessor);
@@ -568,10 +583,16 @@ struct PlatformCpuData : public AssemblyCpuData {
 	bool haveSmap;
 	bool havePcids;
 	bool haveXsave;
+	bool haveXsaveopt = false;
 	bool haveTscDeadline;
+	// MONITOR/MWAIT with IRQs as break events (even if IRQs are disabled).
+	bool haveMwait = false;
 	uint32_t profileFlags = 0;
 	size_t xsaveRegionSize;
 
+	// Incremented whenever restoreExecutor() loads the FPU/SIMD registers.
+	uint64_t extendedStateGeneration = 0;
+
 	LocalApicContext apicContext;
 
 	// TODO: This is not really arch-specific!
@@ -623,6 +644,9 @@ void initializeThisProcessor();
 
 void bootSecondary(unsigned int apic_id);
 
+// Saves the FPU/SIMD registers of the current CPU to the executor's state area.
+void saveExtendedState(Executor *executor);
+
 template<typename F>
 void forkExecutor(F functor, Executor *executor) {
 	auto delegate = [] (void *p) {
@@ -630,11 +654,7 @@ void forkExecutor(F functor, Executor *executor) {
 		(*fp)();
 	};
 
-	if(getPlatformCpuData()->haveXsave) {
-		common::x86::xsave((uint8_t*)executor->_fxState(), ~0);
-	} else {
-		asm volatile ("fxsaveq %0" : : "m" (*executor->_fxState()));
-	}
+	saveExtendedState(executor);
 
 	doForkExecutor(executor, delegate, &functor);
 }
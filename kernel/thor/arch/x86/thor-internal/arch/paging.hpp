@@ -94,6 +94,11 @@ void poisonPhysicalAccess(PhysicalAddr physical);
 // Deny write access to the physical mapping.
 void poisonPhysicalWriteAccess(PhysicalAddr physical);
 
+// Reads memory of the currently active address space by walking the page tables
+// without taking any locks. Never faults; returns false if the memory is not mapped.
+// This is intended for the NMI handler. The range must not cross a page boundary.
+bool readActiveSpaceNoFault(VirtualAddr address, void *buffer, size_t size);
+
 struct PageSpace;
 struct PageBinding;
 
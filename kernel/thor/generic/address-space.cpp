@@ -381,7 +381,10 @@ bool VirtualSpace::map(smarter::borrowed_ptr<MemorySlice> slice,
 		}else{
 			actualAddress = _allocate(length, flags);
 		}
-		assert(actualAddress);
+		if(!actualAddress) {
+			node->nodeResult_.emplace(Error::noMemory);
+			return true;
+		}
 
 	//	infoLogger() << "Creating new mapping at " << (void *)actualAddress
 	//			<< ", length: " << (void *)length << frg::endlog;
@@ -413,6 +416,8 @@ bool VirtualSpace::map(smarter::borrowed_ptr<MemorySlice> slice,
 
 		if(flags & kMapDontRequireBacking)
 			mappingFlags |= MappingFlags::dontRequireBacking;
+		if(flags & kMapDontInherit)
+			mappingFlags |= MappingFlags::dontInherit;
 
 		auto mapping = smarter::allocate_shared<Mapping>(Allocator{},
 				length, static_cast<MappingFlags>(mappingFlags),
@@ -469,6 +474,9 @@ bool VirtualSpace::map(smarter::borrowed_ptr<MemorySlice> slice,
 
 bool VirtualSpace::protect(VirtualAddr address, size_t length,
 		uint32_t flags, AddressProtectNode *node) {
+	assert(!(address % kPageSize));
+	assert(!(length % kPageSize));
+
 	std::underlying_type_t<MappingFlags> mappingFlags = 0;
 
 	// TODO: The upgrading mechanism needs to be arch-specific:
@@ -493,46 +501,46 @@ bool VirtualSpace::protect(VirtualAddr address, size_t length,
 		assert(!(flags & mask));
 	}
 
-	auto irq_lock = frg::guard(&irqMutex());
-	auto space_guard = frg::guard(&_mutex);
-
-	auto mapping = _findMapping(address);
-	assert(mapping);
+	{
+		auto irq_lock = frg::guard(&irqMutex());
+		auto space_guard = frg::guard(&_mutex);
 
-	// TODO: Allow shrinking of the mapping.
-	assert(mapping->address == address);
-	assert(mapping->length == length);
-	mapping->protect(static_cast<MappingFlags>(mappingFlags));
+		// Mappings that are only partially protected are split first.
+		_splitMappingAt(address);
+		_splitMappingAt(address + length);
 
-	assert(mapping->state == MappingState::active);
+		for(auto mapping = _findMappingFrom(address);
+				mapping && mapping->address < address + length;
+				mapping = MappingTree::successor(mapping)) {
+			assert(mapping->state == MappingState::active);
+			mapping->protect(static_cast<MappingFlags>(mappingFlags));
 
-	uint32_t pageFlags = 0;
-	if((mapping->flags & MappingFlags::permissionMask) & MappingFlags::protWrite)
-		pageFlags |= page_access::write;
-	if((mapping->flags & MappingFlags::permissionMask) & MappingFlags::protExecute)
-		pageFlags |= page_access::execute;
-	// TODO: Allow inaccessible mappings.
-	assert((mapping->flags & MappingFlags::permissionMask) & MappingFlags::protRead);
+			uint32_t pageFlags = 0;
+			if((mapping->flags & MappingFlags::permissionMask) & MappingFlags::protWrite)
+				pageFlags |= page_access::write;
+			if((mapping->flags & MappingFlags::permissionMask) & MappingFlags::protExecute)
+				pageFlags |= page_access::execute;
+			// TODO: Allow inaccessible mappings.
+			assert((mapping->flags & MappingFlags::permissionMask) & MappingFlags::protRead);
 
-	{
-		// Synchronize with the eviction loop.
-		auto irqLock = frg::guard(&irqMutex());
-		auto lock = frg::guard(&mapping->evictMutex);
+			// Synchronize with the eviction loop.
+			auto lock = frg::guard(&mapping->evictMutex);
 
-		for(size_t progress = 0; progress < mapping->length; progress += kPageSize) {
-			auto physicalRange = mapping->view->peekRange(mapping->viewOffset + progress);
+			for(size_t progress = 0; progress < mapping->length; progress += kPageSize) {
+				auto physicalRange = mapping->view->peekRange(mapping->viewOffset + progress);
 
-			VirtualAddr vaddr = mapping->address + progress;
-			auto status = _ops->unmapSingle4k(vaddr);
-			if(!(status & page_status::present))
-				continue;
-			if(status & page_status::dirty)
-				mapping->view->markDirty(mapping->viewOffset + progress, kPageSize);
-			if(physicalRange.get<0>() != PhysicalAddr(-1)) {
-				_ops->mapSingle4k(vaddr, physicalRange.get<0>(),
-						pageFlags, physicalRange.get<1>());
-			}else{
-				_residuentSize -= kPageSize;
+				VirtualAddr vaddr = mapping->address + progress;
+				auto status = _ops->unmapSingle4k(vaddr);
+				if(!(status & page_status::present))
+					continue;
+				if(status & page_status::dirty)
+					mapping->view->markDirty(mapping->viewOffset + progress, kPageSize);
+				if(physicalRange.get<0>() != PhysicalAddr(-1)) {
+					_ops->mapSingle4k(vaddr, physicalRange.get<0>(),
+							pageFlags, physicalRange.get<1>());
+				}else{
+					_residuentSize -= kPageSize;
+				}
 			}
 		}
 	}
@@ -546,52 +554,47 @@ bool VirtualSpace::protect(VirtualAddr address, size_t length,
 }
 
 bool VirtualSpace::unmap(VirtualAddr address, size_t length, AddressUnmapNode *node) {
-	smarter::shared_ptr<Mapping> mapping;
+	assert(!(address % kPageSize));
+	assert(!(length % kPageSize));
+
+	// Mappings in the range; they are removed from the mapping tree immediately
+	// but the address range is only released after the shootdown.
+	frg::vector<Mapping *, KernelAlloc> mappings{*kernelAlloc};
 	{
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&_mutex);
 
-		mapping = _findMapping(address);
-		assert(mapping);
+		// Mappings that are only partially unmapped are split first.
+		_splitMappingAt(address);
+		_splitMappingAt(address + length);
 
-		// TODO: Allow shrinking of the mapping.
-		assert(mapping->address == address);
-		assert(mapping->length == length);
+		for(auto mapping = _findMappingFrom(address);
+				mapping && mapping->address < address + length;
+				mapping = MappingTree::successor(mapping))
+			mappings.push_back(mapping);
 
-		assert(mapping->state == MappingState::active);
-		mapping->state = MappingState::zombie;
+		for(auto mapping : mappings) {
+			assert(mapping->state == MappingState::active);
+			mapping->state = MappingState::zombie;
+			_mappings.remove(mapping);
+		}
 	}
+	if(mappings.empty())
+		return true;
 
 	// Mark pages as dirty and unmap without holding a lock.
-	for(size_t progress = 0; progress < mapping->length; progress += kPageSize) {
-		VirtualAddr vaddr = mapping->address + progress;
-		auto status = _ops->unmapSingle4k(vaddr);
-		if(!(status & page_status::present))
-			continue;
-		if(status & page_status::dirty)
-			mapping->view->markDirty(mapping->viewOffset + progress, kPageSize);
-		_residuentSize -= kPageSize;
+	for(auto mapping : mappings) {
+		for(size_t progress = 0; progress < mapping->length; progress += kPageSize) {
+			VirtualAddr vaddr = mapping->address + progress;
+			auto status = _ops->unmapSingle4k(vaddr);
+			if(!(status & page_status::present))
+				continue;
+			if(status & page_status::dirty)
+				mapping->view->markDirty(mapping->viewOffset + progress, kPageSize);
+			_residuentSize -= kPageSize;
+		}
 	}
 
-	static constexpr auto deleteMapping = [] (VirtualSpace *space, Mapping *mapping) {
-		space->_mappings.remove(mapping);
-
-		assert(mapping->state == MappingState::zombie);
-		mapping->state = MappingState::retired;
-
-		if(mapping->view->canEvictMemory())
-			mapping->cancelEviction.cancel();
-
-		// TODO: It would be less ugly to run this in a non-detached way.
-		auto cleanUpObserver = [] (Mapping *mapping) -> coroutine<void> {
-			if(mapping->view->canEvictMemory())
-				co_await mapping->evictionDoneEvent.wait();
-			mapping->view->removeObserver(&mapping->observer);
-			mapping->selfPtr.ctr()->decrement();
-		};
-		async::detach_with_allocator(*kernelAlloc, cleanUpObserver(mapping));
-	};
-
 	static constexpr auto closeHole = [] (VirtualSpace *space, VirtualAddr address, size_t length) {
 		// Find the holes that preceede/succeede mapping.
 		Hole *pre;
@@ -653,12 +656,24 @@ bool VirtualSpace::unmap(VirtualAddr address, size_t length, AddressUnmapNode *n
 		}
 	};
 
-	async::detach_with_allocator(*kernelAlloc,
-			async::transform(_ops->shootdown(address, length), [=] () {
-		deleteMapping(this, mapping.get());
-		closeHole(this, address, length);
+	async::detach_with_allocator(*kernelAlloc, [] (VirtualSpace *self,
+			VirtualAddr address, size_t length,
+			frg::vector<Mapping *, KernelAlloc> mappings,
+			AddressUnmapNode *node) -> coroutine<void> {
+		co_await self->_ops->shootdown(address, length);
+
+		{
+			auto irqLock = frg::guard(&irqMutex());
+			auto lock = frg::guard(&self->_mutex);
+
+			for(auto mapping : mappings)
+				closeHole(self, mapping->address, mapping->length);
+		}
+
+		for(auto mapping : mappings)
+			self->_retireMapping(mapping);
 		node->complete();
-	}));
+	}(this, address, length, std::move(mappings), node));
 
 	return false;
 }
@@ -756,6 +771,23 @@ VirtualSpace::handleFault(VirtualAddr address, uint32_t faultFlags,
 	return {};
 }
 
+frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> VirtualSpace::inheritedMappings() {
+	frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> mappings{*kernelAlloc};
+
+	auto irq_lock = frg::guard(&irqMutex());
+	auto space_guard = frg::guard(&_mutex);
+
+	for(auto mapping = _mappings.first(); mapping; mapping = MappingTree::successor(mapping)) {
+		if(mapping->state != MappingState::active)
+			continue;
+		if(mapping->flags & MappingFlags::dontInherit)
+			continue;
+		mappings.push_back(mapping->selfPtr.lock());
+	}
+
+	return mappings;
+}
+
 smarter::shared_ptr<Mapping> VirtualSpace::_findMapping(VirtualAddr address) {
 	auto current = _mappings.get_root();
 	while(current) {
@@ -773,6 +805,74 @@ smarter::shared_ptr<Mapping> VirtualSpace::_findMapping(VirtualAddr address) {
 	return nullptr;
 }
 
+Mapping *VirtualSpace::_findMappingFrom(VirtualAddr address) {
+	Mapping *result = nullptr;
+	auto current = _mappings.get_root();
+	while(current) {
+		if(address >= current->address + current->length) {
+			current = MappingTree::get_right(current);
+		}else{
+			result = current;
+			current = MappingTree::get_left(current);
+		}
+	}
+
+	return result;
+}
+
+void VirtualSpace::_splitMappingAt(VirtualAddr address) {
+	// Mappings cannot be split inside of pages; syscalls reject such addresses.
+	assert(!(address % kPageSize));
+	auto mapping = _findMapping(address);
+	if(!mapping || mapping->address == address)
+		return;
+	assert(mapping->state == MappingState::active);
+
+	auto installPart = [&] (VirtualAddr partAddress, size_t partLength) {
+		auto part = smarter::allocate_shared<Mapping>(Allocator{},
+				partLength, mapping->flags, mapping->slice,
+				mapping->viewOffset + (partAddress - mapping->address));
+		part->selfPtr = part;
+
+		part->tie(selfPtr.lock(), partAddress);
+		part->state = MappingState::active;
+
+		part->view->addObserver(&part->observer);
+
+		if(part->view->canEvictMemory())
+			async::detach_with_allocator(*kernelAlloc, part->runEvictionLoop());
+
+		_mappings.insert(part.get());
+		part.release(); // VirtualSpace owns one reference.
+	};
+
+	// The page table entries are taken over by the new mappings since both
+	// parts map the same pages of the same view.
+	_mappings.remove(mapping.get());
+	installPart(mapping->address, address - mapping->address);
+	installPart(address, mapping->address + mapping->length - address);
+
+	mapping->state = MappingState::zombie;
+	_retireMapping(mapping.get());
+}
+
+void VirtualSpace::_retireMapping(Mapping *mapping) {
+	assert(mapping->state == MappingState::zombie);
+	mapping->state = MappingState::retired;
+
+	if(mapping->view->canEvictMemory())
+		mapping->cancelEviction.cancel();
+
+	// TODO: It would be less ugly to run this in a non-detached way.
+	auto cleanUpObserver = [] (Mapping *mapping) -> coroutine<void> {
+		if(mapping->view->canEvictMemory())
+			co_await mapping->evictionDoneEvent.wait();
+		mapping->view->removeObserver(&mapping->observer);
+		mapping->selfPtr.ctr()->decrement();
+	};
+	async::detach_with_allocator(*kernelAlloc, cleanUpObserver(mapping));
+}
+
 VirtualAddr VirtualSpace::_allocate(size_t length, MapFlags flags) {
 	assert(length > 0);
 	assert((length % kPageSize) == 0);
@@ -833,8 +933,9 @@ VirtualAddr VirtualSpace::_allocateAt(VirtualAddr address, size_t length) {
 
 	auto current = _holes.get_root();
 	while(true) {
-		// TODO: Otherwise, this method fails.
-		assert(current);
+		// The address is not part of a hole.
+		if(!current)
+			return 0;
 
 		if(address < current->address()) {
 			current = HoleTree::get_left(current);
@@ -847,6 +948,10 @@ VirtualAddr VirtualSpace::_allocateAt(VirtualAddr address, size_t length) {
 		}
 	}
 
+	// The range overlaps a mapping.
+	if(address + length > current->address() + current->length())
+		return 0;
+
 	_splitHole(current, address - current->address(), length);
 	return address;
 }
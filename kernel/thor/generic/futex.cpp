@@ -0,0 +1,21 @@
+#include <frg/manual_box.hpp>
+#include <thor-internal/futex.hpp>
+#include <thor-internal/main.hpp>
+
+namespace thor {
+
+namespace {
+	frg::manual_box<Futex> globalFutexRealm;
+}
+
+static initgraph::Task initFutexRealmTask{&basicInitEngine, "generic.init-futex-realm",
+	[] {
+		globalFutexRealm.initialize();
+	}
+};
+
+Futex &getGlobalFutexRealm() {
+	return *globalFutexRealm;
+}
+
+} // namespace thor
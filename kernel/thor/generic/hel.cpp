@@ -12,6 +12,7 @@
 #include <thor-internal/random.hpp>
 #include <thor-internal/thread.hpp>
 #include <thor-internal/timer.hpp>
+#include <thor-internal/trace.hpp>
 #ifdef __x86_64__
 #include <thor-internal/arch/debug.hpp>
 #include <thor-internal/arch/ept.hpp>
@@ -382,13 +383,13 @@ HelError helResizeMemory(HelHandle handle, size_t newSize) {
 
 HelError helCreateManagedMemory(size_t size, uint32_t flags,
 		HelHandle *backing_handle, HelHandle *frontal_handle) {
-	(void)flags;
 	assert(!(size & (kPageSize - 1)));
 
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
 
-	auto managed = smarter::allocate_shared<ManagedSpace>(*kernelAlloc, size);
+	auto managed = smarter::allocate_shared<ManagedSpace>(*kernelAlloc, size,
+			flags & kHelManagedReadahead);
 	auto backing_memory = smarter::allocate_shared<BackingMemory>(*kernelAlloc, managed);
 	auto frontal_memory = smarter::allocate_shared<FrontalMemory>(*kernelAlloc, std::move(managed));
 
@@ -410,8 +411,9 @@ HelError helCopyOnWrite(HelHandle memoryHandle,
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
 
+	// Without a memory object, the CoW memory is zero-filled.
 	smarter::shared_ptr<MemoryView> view;
-	{
+	if(memoryHandle != kHelNullHandle) {
 		auto irq_lock = frg::guard(&irqMutex());
 		Universe::Guard universe_guard(this_universe->lock);
 
@@ -579,6 +581,134 @@ HelError helForkMemory(HelHandle handle, HelHandle *forkedHandle) {
 	return kHelErrNone;
 }
 
+HelError helForkSpace(HelHandle handle, HelForkedView *views, size_t numViews,
+		HelHandle *forkedHandle) {
+	auto this_thread = getCurrentThread();
+	auto this_universe = this_thread->getUniverse();
+
+	smarter::shared_ptr<AddressSpace, BindableHandle> space;
+	{
+		auto irq_lock = frg::guard(&irqMutex());
+		Universe::Guard universe_guard(this_universe->lock);
+
+		if(handle == kHelNullHandle) {
+			space = this_thread->getAddressSpace().lock();
+		}else{
+			auto spaceWrapper = this_universe->getDescriptor(universe_guard, handle);
+			if(!spaceWrapper)
+				return kHelErrNoDescriptor;
+			if(!spaceWrapper->is<AddressSpaceDescriptor>())
+				return kHelErrBadDescriptor;
+			space = spaceWrapper->get<AddressSpaceDescriptor>().space;
+		}
+	}
+
+	auto forkedSpace = AddressSpace::create();
+
+	// Memory objects that are mapped more than once are only forked once,
+	// such that the mappings in the forked space share memory as in the original space.
+	struct ForkedObject {
+		MemoryView *original;
+		smarter::shared_ptr<MemoryView> forked;
+	};
+	frg::vector<ForkedObject, KernelAlloc> forkedObjects{*kernelAlloc};
+
+	auto mappings = space->inheritedMappings();
+	for(auto &mapping : mappings) {
+		auto slice = mapping->slice;
+
+		smarter::shared_ptr<MemoryView> forkedView;
+		for(auto &object : forkedObjects) {
+			if(object.original == mapping->view.get()) {
+				forkedView = object.forked;
+				break;
+			}
+		}
+		if(!forkedView) {
+			auto [error, view] = Thread::asyncBlockCurrent(mapping->view->fork());
+			if(error == Error::success) {
+				forkedView = view;
+				forkedObjects.push_back({mapping->view.get(), std::move(view)});
+			}else{
+				assert(error == Error::illegalObject);
+			}
+		}
+		if(forkedView)
+			slice = smarter::allocate_shared<MemorySlice>(*kernelAlloc,
+					std::move(forkedView), slice->offset(), slice->length());
+
+		uint32_t mapFlags = AddressSpace::kMapFixed;
+		if(mapping->flags & MappingFlags::protRead)
+			mapFlags |= AddressSpace::kMapProtRead;
+		if(mapping->flags & MappingFlags::protWrite)
+			mapFlags |= AddressSpace::kMapProtWrite;
+		if(mapping->flags & MappingFlags::protExecute)
+			mapFlags |= AddressSpace::kMapProtExecute;
+		if(mapping->flags & MappingFlags::dontRequireBacking)
+			mapFlags |= AddressSpace::kMapDontRequireBacking;
+
+		auto mapResult = Thread::asyncBlockCurrent(forkedSpace->map(slice,
+				mapping->address, mapping->viewOffset - slice->offset(),
+				mapping->length, mapFlags));
+		assert(mapResult);
+	}
+
+	// Look up the memory objects that back the requested mappings in the forked space.
+	frg::vector<HelForkedView, KernelAlloc> forkedViews{*kernelAlloc};
+	frg::vector<smarter::shared_ptr<MemoryView>, KernelAlloc> viewObjects{*kernelAlloc};
+	for(size_t i = 0; i < numViews; i++) {
+		HelForkedView view;
+		if(!readUserObject(views + i, view))
+			return kHelErrFault;
+
+		// Callers may track finer boundaries than the kernel's mappings
+		// (e.g., after growing an area in place), hence accept any address inside a mapping.
+		auto address = reinterpret_cast<VirtualAddr>(view.pointer);
+		auto mapping = forkedSpace->getMapping(address);
+		if(mapping) {
+			viewObjects.push_back(mapping->view);
+		}else{
+			viewObjects.push_back(nullptr);
+		}
+		forkedViews.push_back(view);
+	}
+
+	{
+		auto irq_lock = frg::guard(&irqMutex());
+		Universe::Guard universe_guard(this_universe->lock);
+
+		for(size_t i = 0; i < numViews; i++) {
+			if(viewObjects[i]) {
+				forkedViews[i].handle = this_universe->attachDescriptor(universe_guard,
+						MemoryViewDescriptor(std::move(viewObjects[i])));
+			}else{
+				forkedViews[i].handle = kHelNullHandle;
+			}
+		}
+
+		*forkedHandle = this_universe->attachDescriptor(universe_guard,
+				AddressSpaceDescriptor(std::move(forkedSpace)));
+	}
+
+	for(size_t i = 0; i < numViews; i++) {
+		if(writeUserObject(views + i, forkedViews[i]))
+			continue;
+
+		// Userspace never learns about the handles; drop them again.
+		auto irq_lock = frg::guard(&irqMutex());
+		Universe::Guard universe_guard(this_universe->lock);
+
+		for(size_t j = 0; j < numViews; j++) {
+			if(forkedViews[j].handle != kHelNullHandle)
+				this_universe->detachDescriptor(universe_guard, forkedViews[j].handle);
+		}
+		this_universe->detachDescriptor(universe_guard, *forkedHandle);
+		return kHelErrFault;
+	}
+
+	return kHelErrNone;
+}
+
 HelError helCreateSpace(HelHandle *handle) {
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
@@ -709,6 +839,8 @@ HelError helMapMemory(HelHandle memory_handle, HelHandle space_handle,
 
 	if(flags & kHelMapDontRequireBacking)
 		map_flags |= AddressSpace::kMapDontRequireBacking;
+	if(flags & kHelMapDontInherit)
+		map_flags |= AddressSpace::kMapDontInherit;
 
 	smarter::shared_ptr<MemorySlice> slice;
 	smarter::shared_ptr<AddressSpace, BindableHandle> space;
@@ -761,6 +893,8 @@ HelError helMapMemory(HelHandle memory_handle, HelHandle space_handle,
 	}
 
 	if(!mapResult) {
+		if(mapResult.error() == Error::noMemory)
+			return kHelErrNoMemory;
 		assert(mapResult.error() == Error::bufferTooSmall);
 		return kHelErrBufferTooSmall;
 	}
@@ -775,6 +909,11 @@ HelError helSubmitProtectMemory(HelHandle space_handle,
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
 
+	auto address = reinterpret_cast<VirtualAddr>(pointer);
+	if((address & (kPageSize - 1)) || (length & (kPageSize - 1))
+			|| !length || address + length < address)
+		return kHelErrIllegalArgs;
+
 	uint32_t protectFlags = 0;
 	if(flags & kHelMapProtRead)
 		protectFlags |= AddressSpace::kMapProtRead;
@@ -833,6 +972,11 @@ HelError helUnmapMemory(HelHandle space_handle, void *pointer, size_t length) {
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
 
+	auto address = reinterpret_cast<VirtualAddr>(pointer);
+	if((address & (kPageSize - 1)) || (length & (kPageSize - 1))
+			|| !length || address + length < address)
+		return kHelErrIllegalArgs;
+
 	smarter::shared_ptr<AddressSpace, BindableHandle> space;
 	{
 		auto irq_lock = frg::guard(&irqMutex());
@@ -1126,6 +1270,11 @@ HelError helSubmitWriteMemory(HelHandle handle, uintptr_t address,
 			}
 		}
 
+		// Give the writeback a chance to catch up if too much memory is dirty.
+		// Writes to other memory (e.g., anonymous memory) do not produce dirty pages.
+		if(view->needsWriteback())
+			co_await throttleDirtyMemory();
+
 		HelSimpleResult helResult{translateError(error)};
 		QueueSource ipcSource{&helResult, sizeof(HelSimpleResult), nullptr};
 		co_await queue->submit(&ipcSource, context);
@@ -1425,6 +1574,59 @@ HelError helLoadahead(HelHandle handle, uintptr_t offset, size_t length) {
 	return kHelErrNone;
 }
 
+HelError helSubmitWritebackMemory(HelHandle handle, uintptr_t offset, size_t length,
+		HelHandle queueHandle, uintptr_t context) {
+	auto thisThread = getCurrentThread();
+	auto thisUniverse = thisThread->getUniverse();
+
+	if((offset % kPageSize) || (length % kPageSize))
+		return kHelErrIllegalArgs;
+
+	smarter::shared_ptr<MemoryView> memory;
+	smarter::shared_ptr<IpcQueue> queue;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		Universe::Guard universeGuard(thisUniverse->lock);
+
+		if(handle != kHelNullHandle) {
+			auto memoryWrapper = thisUniverse->getDescriptor(universeGuard, handle);
+			if(!memoryWrapper)
+				return kHelErrNoDescriptor;
+			if(!memoryWrapper->is<MemoryViewDescriptor>())
+				return kHelErrBadDescriptor;
+			memory = memoryWrapper->get<MemoryViewDescriptor>().memory;
+		}
+
+		auto queueWrapper = thisUniverse->getDescriptor(universeGuard, queueHandle);
+		if(!queueWrapper)
+			return kHelErrNoDescriptor;
+		if(!queueWrapper->is<QueueDescriptor>())
+			return kHelErrBadDescriptor;
+		queue = queueWrapper->get<QueueDescriptor>().queue;
+	}
+
+	if(memory && offset + length > memory->getLength())
+		return kHelErrOutOfBounds;
+
+	async::detach_with_allocator(*kernelAlloc, [] (smarter::shared_ptr<MemoryView> memory,
+			uintptr_t offset, size_t length,
+			smarter::shared_ptr<IpcQueue> queue, uintptr_t context) -> coroutine<void> {
+		Error error = Error::success;
+		if(memory) {
+			error = co_await memory->submitInitiateLoad(ManageRequest::writeback,
+					offset, length);
+		}else{
+			co_await writebackAllMemory();
+		}
+
+		HelSimpleResult helResult{translateError(error)};
+		QueueSource ipcSource{&helResult, sizeof(HelSimpleResult), nullptr};
+		co_await queue->submit(&ipcSource, context);
+	}(std::move(memory), offset, length, std::move(queue), context));
+
+	return kHelErrNone;
+}
+
 std::atomic<unsigned int> globalNextCpu = 0;
 
 HelError helCreateThread(HelHandle universe_handle, HelHandle space_handle,
@@ -1976,6 +2178,8 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
 
+	trace(traceIpc, TraceEvent::ipcSubmit, context, count);
+
 	// TODO: check userspace page access rights
 
 	LaneHandle lane;
@@ -2340,10 +2544,13 @@ HelError helFutexWait(int *pointer, int expected, int64_t deadline) {
 		return expected == v;
 	};
 
-	if(deadline < 0) {
-		if(deadline != -1)
-			return kHelErrIllegalArgs;
+	if(deadline < -1)
+		return kHelErrIllegalArgs;
 
+	trace(traceFutex, TraceEvent::futexWaitBegin, traceThreadId(thisThread.get()),
+			reinterpret_cast<uintptr_t>(pointer));
+
+	if(deadline < 0) {
 		Thread::asyncBlockCurrent(
 			space->futexSpace.wait(reinterpret_cast<uintptr_t>(pointer), condition)
 		);
@@ -2361,6 +2568,8 @@ HelError helFutexWait(int *pointer, int expected, int64_t deadline) {
 		);
 	}
 
+	trace(traceFutex, TraceEvent::futexWaitEnd, traceThreadId(thisThread.get()),
+			reinterpret_cast<uintptr_t>(pointer));
 	return kHelErrNone;
 }
 
@@ -2368,6 +2577,9 @@ HelError helFutexWake(int *pointer) {
 	auto this_thread = getCurrentThread();
 	auto space = this_thread->getAddressSpace();
 
+	trace(traceFutex, TraceEvent::futexWake, traceThreadId(this_thread.get()),
+			reinterpret_cast<uintptr_t>(pointer));
+
 	{
 		// TODO: Support physical (i.e. non-private) futexes.
 		space->futexSpace.wake(VirtualAddr(pointer));
@@ -2376,6 +2588,91 @@ HelError helFutexWake(int *pointer) {
 	return kHelErrNone;
 }
 
+namespace {
+	// Determines the identity of a shared futex from the memory object that backs it.
+	// The mapping is returned to keep the memory object alive while waiting.
+	HelError resolveSharedFutex(AddressSpace *space, int *pointer,
+			smarter::shared_ptr<Mapping> &mapping, FutexAddress &address) {
+		auto virtualAddress = reinterpret_cast<VirtualAddr>(pointer);
+		if(virtualAddress & (sizeof(int) - 1))
+			return kHelErrIllegalArgs;
+
+		mapping = space->getMapping(virtualAddress);
+		if(!mapping)
+			return kHelErrFault;
+
+		auto identity = mapping->view->getAddressIdentity(mapping->viewOffset
+				+ (virtualAddress - mapping->address));
+		if(!identity)
+			return kHelErrIllegalArgs;
+		address = FutexAddress{identity.value().object, identity.value().offset};
+		return kHelErrNone;
+	}
+}
+
+HelError helSharedFutexWait(int *pointer, int expected, int64_t deadline) {
+	auto thisThread = getCurrentThread();
+	auto space = thisThread->getAddressSpace();
+
+	smarter::shared_ptr<Mapping> mapping;
+	FutexAddress address{0};
+	if(auto error = resolveSharedFutex(space.get(), pointer, mapping, address); error)
+		return error;
+
+	auto condition = [&] () -> bool {
+		enableUserAccess();
+		unsigned int v;
+		auto e = doAtomicUserLoad(&v, reinterpret_cast<unsigned int *>(pointer));
+		disableUserAccess();
+		if(e)
+			return false;
+		return expected == v;
+	};
+
+	if(deadline < -1)
+		return kHelErrIllegalArgs;
+
+	trace(traceFutex, TraceEvent::futexWaitBegin, traceThreadId(thisThread.get()),
+			reinterpret_cast<uintptr_t>(pointer));
+
+	if(deadline < 0) {
+		Thread::asyncBlockCurrent(
+			getGlobalFutexRealm().wait(address, condition)
+		);
+	}else{
+		Thread::asyncBlockCurrent(
+			async::race_and_cancel(
+				[&] (async::cancellation_token cancellation) {
+					return getGlobalFutexRealm().wait(address, condition, cancellation);
+				},
+				[=] (async::cancellation_token cancellation) {
+					return generalTimerEngine()->sleep(deadline, cancellation);
+				}
+			)
+		);
+	}
+
+	trace(traceFutex, TraceEvent::futexWaitEnd, traceThreadId(thisThread.get()),
+			reinterpret_cast<uintptr_t>(pointer));
+	return kHelErrNone;
+}
+
+HelError helSharedFutexWake(int *pointer) {
+	auto thisThread = getCurrentThread();
+	auto space = thisThread->getAddressSpace();
+
+	smarter::shared_ptr<Mapping> mapping;
+	FutexAddress address{0};
+	if(auto error = resolveSharedFutex(space.get(), pointer, mapping, address); error)
+		return error;
+
+	trace(traceFutex, TraceEvent::futexWake, traceThreadId(thisThread.get()),
+			reinterpret_cast<uintptr_t>(pointer));
+	getGlobalFutexRealm().wake(address);
+
+	return kHelErrNone;
+}
+
 HelError helCreateOneshotEvent(HelHandle *handle) {
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
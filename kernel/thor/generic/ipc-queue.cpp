@@ -4,6 +4,7 @@
 #include <frg/container_of.hpp>
 #include <thor-internal/core.hpp>
 #include <thor-internal/ipc-queue.hpp>
+#include <thor-internal/trace.hpp>
 
 namespace thor {
 
@@ -35,6 +36,8 @@ void IpcQueue::setupChunk(size_t index, smarter::shared_ptr<AddressSpace, Bindab
 }
 
 void IpcQueue::submit(IpcNode *node) {
+	trace(traceIpc, TraceEvent::ipcComplete, node->_context);
+
 	{
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&_mutex);
@@ -163,7 +163,9 @@ void IrqPin::raise() {
 	}
 
 	// If the IRQ is already masked, we're encountering a hardware race.
-	assert(!_maskState);
+	// Edge-triggered IRQs (in particular MSIs, which are masked at the device)
+	// can still arrive shortly after they are masked; this is harmless.
+	assert(!_maskState || _strategy == IrqStrategy::justEoi);
 
 	auto already_in_service = _inService;
 	_raiseSequence++;
@@ -290,6 +292,33 @@ void IrqPin::_updateMask() {
 	}
 }
 
+// --------------------------------------------------------
+// MsiPin
+// --------------------------------------------------------
+
+MsiPin::MsiPin(frg::string<KernelAlloc> name)
+: IrqPin{std::move(name)} { }
+
+bool MsiPin::allocateVector(int cpu) {
+	assert(_cpu == -1);
+	auto message = allocateMsiVector(this, cpu);
+	if(!message)
+		return false;
+	_cpu = cpu;
+	_message = *message;
+	return true;
+}
+
+IrqStrategy MsiPin::program(TriggerMode mode, Polarity) {
+	assert(_cpu != -1);
+	assert(mode == TriggerMode::edge);
+	return IrqStrategy::justEoi;
+}
+
+void MsiPin::sendEoi() {
+	acknowledgeMsi();
+}
+
 // --------------------------------------------------------
 // IrqObject
 // --------------------------------------------------------
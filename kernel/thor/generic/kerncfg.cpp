@@ -6,6 +6,7 @@
 #include <thor-internal/kerncfg.hpp>
 #include <thor-internal/profile.hpp>
 #include <thor-internal/timer.hpp>
+#include <thor-internal/trace.hpp>
 
 #include "kerncfg.frigg_pb.hpp"
 #include "mbus.frigg_pb.hpp"
@@ -45,6 +46,23 @@ coroutine<Error> handleReq(LaneHandle boundLane) {
 		memcpy(cmdlineBuffer.data(), kernelCommandLine->data(), kernelCommandLine->size());
 		auto cmdlineError = co_await SendBufferSender{lane, std::move(cmdlineBuffer)};
 		assert(cmdlineError == Error::success && "Unexpected mbus transaction");
+	}else if(req.req_type() == managarm::kerncfg::CntReqType::GET_TRACE_MASK
+			|| req.req_type() == managarm::kerncfg::CntReqType::SET_TRACE_MASK) {
+		managarm::kerncfg::SvrResponse<KernelAlloc> resp(*kernelAlloc);
+		if(req.req_type() == managarm::kerncfg::CntReqType::SET_TRACE_MASK
+				&& !setTraceMask(req.trace_mask())) {
+			resp.set_error(managarm::kerncfg::Error::ILLEGAL_REQUEST);
+		}else{
+			resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			resp.set_trace_mask(traceMask.load(std::memory_order_relaxed));
+		}
+
+		frg::string<KernelAlloc> ser(*kernelAlloc);
+		resp.SerializeToString(&ser);
+		frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, ser.size()};
+		memcpy(respBuffer.data(), ser.data(), ser.size());
+		auto respError = co_await SendBufferSender{lane, std::move(respBuffer)};
+		assert(respError == Error::success && "Unexpected mbus transaction");
 	}else{
 		managarm::kerncfg::SvrResponse<KernelAlloc> resp(*kernelAlloc);
 		resp.set_error(managarm::kerncfg::Error::ILLEGAL_REQUEST);
@@ -159,8 +177,9 @@ coroutine<void> createObject(LaneHandle mbusLane) {
 		co_await handleBind(objectLane);
 }
 
+// If cpu is non-negative, the ring is tagged with the CPU that it belongs to.
 coroutine<void> createByteRingObject(LogRingBuffer *ringBuffer,
-		LaneHandle mbusLane, const char *purpose) {
+		LaneHandle mbusLane, const char *purpose, int cpu = -1) {
 	auto [offerError, lane] = co_await OfferSender{mbusLane};
 	assert(offerError == Error::success && "Unexpected mbus transaction");
 
@@ -179,6 +198,13 @@ coroutine<void> createByteRingObject(LogRingBuffer *ringBuffer,
 	req.set_parent_id(1);
 	req.add_properties(std::move(cls_prop));
 	req.add_properties(std::move(purpose_prop));
+	if(cpu >= 0) {
+		managarm::mbus::Property<KernelAlloc> cpu_prop(*kernelAlloc);
+		cpu_prop.set_name(frg::string<KernelAlloc>(*kernelAlloc, "cpu"));
+		auto &cpu_item = cpu_prop.mutable_item().mutable_string_item();
+		cpu_item.set_value(frg::to_allocated_string(*kernelAlloc, cpu));
+		req.add_properties(std::move(cpu_prop));
+	}
 
 	frg::string<KernelAlloc> ser(*kernelAlloc);
 	req.SerializeToString(&ser);
@@ -291,9 +317,21 @@ void initializeKerncfg() {
 				createByteRingObject(allocLog.get(), *mbusClient, "heap-trace"));
 #endif
 
-		if(wantKernelProfile)
+		// All CPUs are up at this point.
+		for(int cpu = 0; cpu < getCpuCount(); cpu++) {
+			if(!getProfileRing(cpu))
+				continue;
 			async::detach_with_allocator(*kernelAlloc,
-					createByteRingObject(getGlobalProfileRing(), *mbusClient, "kernel-profile"));
+					createByteRingObject(getProfileRing(cpu), *mbusClient,
+							"kernel-profile", cpu));
+		}
+		for(int cpu = 0; cpu < getCpuCount(); cpu++) {
+			if(!getTraceRing(cpu))
+				continue;
+			async::detach_with_allocator(*kernelAlloc,
+					createByteRingObject(getTraceRing(cpu), *mbusClient,
+							"kernel-trace", cpu));
+		}
 	});
 }
 
@@ -24,6 +24,7 @@ namespace thor {
 namespace {
 	constexpr bool logBinding = false;
 	constexpr bool logIo = false;
+	constexpr bool logReuse = false;
 }
 
 extern frg::manual_box<LaneHandle> mbusClient;
@@ -352,6 +353,83 @@ smarter::shared_ptr<KernletObject> processElfDso(const char *buffer,
 	return smarter::allocate_shared<KernletObject>(*kernelAlloc, entry, bind_types);
 }
 
+// Drivers upload the same kernlets whenever they (re-)bind IRQ automation.
+// Since loading a kernlet allocates kernel memory that is never freed,
+// we reuse the KernletObject if the ELF image and the bind types are identical.
+struct LoadedKernlet {
+	LoadedKernlet()
+	: elf{*kernelAlloc}, bindTypes{*kernelAlloc} { }
+
+	uint64_t hash;
+	frg::vector<char, KernelAlloc> elf;
+	frg::vector<KernletParameterType, KernelAlloc> bindTypes;
+	smarter::shared_ptr<KernletObject> object;
+};
+
+frg::manual_box<frg::vector<LoadedKernlet, KernelAlloc>> loadedKernlets;
+frg::ticket_spinlock loadedKernletsMutex;
+
+uint64_t hashElfDso(const char *buffer, size_t size) {
+	// FNV-1a.
+	uint64_t h = 0xcbf29ce484222325;
+	for(size_t i = 0; i < size; i++) {
+		h ^= static_cast<uint8_t>(buffer[i]);
+		h *= 0x100000001b3;
+	}
+	return h;
+}
+
+smarter::shared_ptr<KernletObject> loadKernlet(const char *buffer, size_t size,
+		const frg::vector<KernletParameterType, KernelAlloc> &bind_types) {
+	auto hash = hashElfDso(buffer, size);
+
+	auto matches = [&] (const LoadedKernlet &loaded) {
+		if(loaded.hash != hash || loaded.elf.size() != size
+				|| loaded.bindTypes.size() != bind_types.size())
+			return false;
+		for(size_t i = 0; i < bind_types.size(); i++)
+			if(loaded.bindTypes[i] != bind_types[i])
+				return false;
+		return !memcmp(loaded.elf.data(), buffer, size);
+	};
+
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&loadedKernletsMutex);
+
+		for(const auto &loaded : *loadedKernlets) {
+			if(!matches(loaded))
+				continue;
+			if(logReuse)
+				infoLogger() << "thor: Reusing loaded kernlet" << frg::endlog;
+			return loaded.object;
+		}
+	}
+
+	auto object = processElfDso(buffer, bind_types);
+
+	LoadedKernlet loaded;
+	loaded.hash = hash;
+	loaded.elf.resize(size);
+	memcpy(loaded.elf.data(), buffer, size);
+	for(auto type : bind_types)
+		loaded.bindTypes.push_back(type);
+	loaded.object = object;
+
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&loadedKernletsMutex);
+
+		// Prefer the object that some other request might have loaded concurrently.
+		for(const auto &other : *loadedKernlets) {
+			if(matches(other))
+				return other.object;
+		}
+		loadedKernlets->push_back(std::move(loaded));
+	}
+	return object;
+}
+
 coroutine<Error> handleReq(LaneHandle boundLane) {
 	auto [acceptError, lane] = co_await AcceptSender{boundLane};
 	if(acceptError != Error::success)
@@ -384,7 +462,8 @@ coroutine<Error> handleReq(LaneHandle boundLane) {
 		auto [elfError, elfBuffer] = co_await RecvBufferSender{lane};
 		if(elfError != Error::success)
 			co_return elfError;
-		auto kernlet = processElfDso(reinterpret_cast<char *>(elfBuffer.data()), bind_types);
+		auto kernlet = loadKernlet(reinterpret_cast<char *>(elfBuffer.data()),
+				elfBuffer.size(), bind_types);
 
 		managarm::kernlet::SvrResponse<KernelAlloc> resp(*kernelAlloc);
 		resp.set_error(managarm::kernlet::Error::SUCCESS);
@@ -502,6 +581,8 @@ coroutine<void> handleBind(LaneHandle objectLane) {
 } // anonymous namespace
 
 void initializeKernletCtl() {
+	loadedKernlets.initialize(*kernelAlloc);
+
 	// Create a fiber to manage requests to the kernletctl mbus object.
 	KernelFiber::run([=] {
 		async::detach_with_allocator(*kernelAlloc, createObject(*mbusClient));
@@ -17,6 +17,7 @@
 #include <thor-internal/profile.hpp>
 #include <thor-internal/random.hpp>
 #include <thor-internal/servers.hpp>
+#include <thor-internal/trace.hpp>
 #ifdef __x86_64__
 #include <thor-internal/arch/ept.hpp>
 #endif
@@ -125,6 +126,7 @@ extern "C" void thorMain() {
 
 	initializeRandom();
 	initializeReclaim();
+	initializeWriteback();
 
 	if(logInitialization)
 		infoLogger() << "thor: Bootstrap processor initialized successfully."
@@ -137,6 +139,9 @@ extern "C" void thorMain() {
 	if(thorBootInfoPtr->debugFlags & eirDebugKernelProfile)
 		wantKernelProfile = true;
 	initializeProfile();
+	if(thorBootInfoPtr->debugFlags & eirDebugKernelTrace)
+		wantKernelTrace = true;
+	initializeTrace();
 
 	KernelFiber::run([=] () mutable {
 		// Complete the system initialization.
@@ -368,6 +373,9 @@ void handlePageFault(FaultImageAccessor image, uintptr_t address) {
 	if(*image.code() & kPfInstruction)
 		flags |= AddressSpace::kFaultExecute;
 
+	trace(tracePageFault, TraceEvent::pageFaultBegin,
+			traceThreadId(this_thread.get()), address);
+
 	bool handled = false;
 	if(image.inKernelDomain() && !image.allowUserPages()) {
 		infoLogger() << "\e[31mthor: SMAP fault.\e[39m" << frg::endlog;
@@ -376,6 +384,9 @@ void handlePageFault(FaultImageAccessor image, uintptr_t address) {
 				WorkQueue::localQueue()->take()));
 	}
 
+	trace(tracePageFault, TraceEvent::pageFaultEnd,
+			traceThreadId(this_thread.get()), handled);
+
 	if(handled)
 		return;
 
@@ -473,7 +484,18 @@ void handleIrq(IrqImageAccessor image, int number) {
 	if(logEveryIrq)
 		infoLogger() << "thor: IRQ slot #" << number << frg::endlog;
 
-	globalIrqSlots[number]->raise();
+	// Threads that are woken up by the IRQ are picked up by the update() below.
+	if(!noScheduleOnIrq)
+		localScheduler()->expectUpdate();
+
+	trace(traceIrq, TraceEvent::irqEnter, number);
+	auto localSlots = cpuData->localIrqSlots.load(std::memory_order_acquire);
+	if(localSlots && !localSlots[number].isAvailable()) {
+		localSlots[number].raise();
+	}else{
+		globalIrqSlots[number]->raise();
+	}
+	trace(traceIrq, TraceEvent::irqExit, number);
 
 	// Inject IRQ timing entropy into the PRNG accumulator.
 	// Since we track the sequence number per CPU, we also include the CPU number.
@@ -670,6 +692,12 @@ void handleSyscall(SyscallImageAccessor image) {
 		*image.error() = helCreateSpace(&handle);
 		*image.out0() = handle;
 	} break;
+	case kHelCallForkSpace: {
+		HelHandle forkedHandle;
+		*image.error() = helForkSpace((HelHandle)arg0, (HelForkedView *)arg1,
+				(size_t)arg2, &forkedHandle);
+		*image.out0() = forkedHandle;
+	} break;
 	case kHelCallMapMemory: {
 		void *actual_pointer;
 		*image.error() = helMapMemory((HelHandle)arg0, (HelHandle)arg1,
@@ -722,6 +750,10 @@ void handleSyscall(SyscallImageAccessor image) {
 	case kHelCallLoadahead: {
 		*image.error() = helLoadahead((HelHandle)arg0, (uintptr_t)arg1, (size_t)arg2);
 	} break;
+	case kHelCallSubmitWritebackMemory: {
+		*image.error() = helSubmitWritebackMemory((HelHandle)arg0, (uintptr_t)arg1, (size_t)arg2,
+				(HelHandle)arg3, (uintptr_t)arg4);
+	} break;
 	case kHelCallCreateVirtualizedSpace: {
 		HelHandle handle;
 		*image.error() = helCreateVirtualizedSpace(&handle);
@@ -815,6 +847,12 @@ void handleSyscall(SyscallImageAccessor image) {
 	case kHelCallFutexWake: {
 		*image.error() = helFutexWake((int *)arg0);
 	} break;
+	case kHelCallSharedFutexWait: {
+		*image.error() = helSharedFutexWait((int *)arg0, (int)arg1, (int64_t)arg2);
+	} break;
+	case kHelCallSharedFutexWake: {
+		*image.error() = helSharedFutexWake((int *)arg0);
+	} break;
 
 	case kHelCallCreateOneshotEvent: {
 		HelHandle handle;
@@ -877,6 +915,20 @@ void handleSyscall(SyscallImageAccessor image) {
 
 	Thread::raiseSignals(image);
 
+	// If the syscall woke up threads on this CPU, resume() did not send a ping IPI.
+	// Check whether we need to reschedule now.
+	{
+		StatelessIrqLock irqLock;
+		if(localScheduler()->cancelExpectedUpdate()) {
+			localScheduler()->update();
+			if(localScheduler()->wantReschedule()) {
+				Thread::deferCurrent(image);
+			}else{
+				localScheduler()->commit();
+			}
+		}
+	}
+
 //	infoLogger() << "exit syscall" << frg::endlog;
 }
 
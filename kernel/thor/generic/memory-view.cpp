@@ -1,3 +1,4 @@
+#include <async/oneshot-event.hpp>
 #include <thor-internal/coroutine.hpp>
 #include <thor-internal/fiber.hpp>
 #include <thor-internal/memory-view.hpp>
@@ -9,6 +10,8 @@ namespace thor {
 namespace {
 	constexpr bool logUsage = false;
 	constexpr bool logUncaching = false;
+	constexpr bool logReadahead = false;
+	constexpr bool logWriteback = false;
 	constexpr bool tortureUncaching = false;
 
 	// The following flags are debugging options to debug the correctness of various components.
@@ -173,6 +176,170 @@ void initializeReclaim() {
 	earlyFibers->push(globalReclaimer->createReclaimFiber());
 }
 
+// --------------------------------------------------------
+// Writeback implementation.
+// --------------------------------------------------------
+
+namespace {
+	// The flusher runs every writebackInterval and writes back all spaces
+	// whose dirty pages are older than writebackExpiry (in nanoseconds).
+	constexpr uint64_t writebackInterval = 1'000'000'000;
+	constexpr uint64_t writebackExpiry = 5'000'000'000;
+
+	// Spaces with at least this many dirty pages are written back immediately.
+	constexpr size_t spaceDirtyThreshold = 256;
+
+	// Maximal size of a single writeback request (in pages).
+	constexpr size_t maxWritebackPages = 256;
+
+	// Number of dirty pages over all ManagedSpaces.
+	std::atomic<size_t> globalDirtyPages{0};
+
+	// If more pages are dirty, all dirty pages are written back.
+	size_t backgroundDirtyThreshold() {
+		return physicalAllocator->numTotalPages() / 10;
+	}
+
+	// If more pages are dirty, writers are throttled.
+	size_t throttleDirtyThreshold() {
+		return physicalAllocator->numTotalPages() / 5;
+	}
+}
+
+struct WritebackScheduler {
+	// Must be called with the space's mutex held.
+	void addSpace(ManagedSpace *space) {
+		auto lock = frg::guard(&_mutex);
+
+		if(space->_inDirtyList)
+			return;
+		space->_inDirtyList = true;
+		_dirtySpaces.push_back(space);
+	}
+
+	// Issues writeback for all spaces that are due.
+	// If all is true, all dirty pages are written back.
+	void flushSpaces(bool all) {
+		auto spaces = dirtySpaces();
+
+		auto now = systemClockSource()->currentNanos();
+		if(globalDirtyPages.load(std::memory_order_relaxed) >= backgroundDirtyThreshold())
+			all = true;
+
+		for(auto space : spaces) {
+			ManageList pending;
+			{
+				auto irqLock = frg::guard(&irqMutex());
+				auto spaceLock = frg::guard(&space->mutex);
+
+				if(!space->_numDirtyPages) {
+					auto lock = frg::guard(&_mutex);
+					assert(space->_inDirtyList);
+					space->_inDirtyList = false;
+					_dirtySpaces.erase(_dirtySpaces.iterator_to(space));
+					continue;
+				}
+
+				if(all || now - space->_dirtySince >= writebackExpiry)
+					space->_flushing = true;
+				space->_progressManagement(pending);
+			}
+
+			while(!pending.empty()) {
+				auto node = pending.pop_front();
+				node->complete();
+			}
+		}
+	}
+
+	frg::vector<ManagedSpace *, KernelAlloc> dirtySpaces() {
+		frg::vector<ManagedSpace *, KernelAlloc> spaces{*kernelAlloc};
+
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		for(auto space : _dirtySpaces)
+			spaces.push_back(space);
+		return spaces;
+	}
+
+	KernelFiber *createFlushFiber() {
+		return KernelFiber::post([=] {
+			while(true) {
+				if(logWriteback)
+					infoLogger() << "thor: "
+							<< globalDirtyPages.load(std::memory_order_relaxed) * (kPageSize / 1024)
+							<< " KiB of dirty pages" << frg::endlog;
+
+				flushSpaces(false);
+				KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(writebackInterval));
+			}
+		});
+	}
+
+	// Raised whenever writeback completes.
+	async::recurring_event writebackEvent;
+
+private:
+	frg::ticket_spinlock _mutex;
+
+	frg::intrusive_list<
+		ManagedSpace,
+		frg::locate_member<
+			ManagedSpace,
+			frg::default_list_hook<ManagedSpace>,
+			&ManagedSpace::dirtyListHook
+		>
+	> _dirtySpaces;
+};
+
+frg::manual_box<WritebackScheduler> globalWriteback;
+
+void initializeWriteback() {
+	globalWriteback.initialize();
+	earlyFibers->push(globalWriteback->createFlushFiber());
+}
+
+coroutine<void> writebackAllMemory() {
+	auto spaces = globalWriteback->dirtySpaces();
+
+	// Start the writeback of all spaces before waiting for any of them.
+	globalWriteback->flushSpaces(true);
+
+	for(auto space : spaces) {
+		struct Closure {
+			Worklet worklet;
+			MonitorNode node;
+			async::oneshot_event doneEvent;
+		} closure;
+
+		closure.worklet.setup([] (Worklet *base) {
+			auto closure = frg::container_of(base, &Closure::worklet);
+			closure->doneEvent.raise();
+		}, WorkQueue::generalQueue());
+
+		size_t length;
+		{
+			auto irqLock = frg::guard(&irqMutex());
+			auto lock = frg::guard(&space->mutex);
+
+			length = space->numPages << kPageShift;
+		}
+		closure.node.setup(ManageRequest::writeback, 0, length, &closure.worklet);
+		space->submitWriteback(&closure.node);
+		co_await closure.doneEvent.wait();
+	}
+}
+
+coroutine<void> throttleDirtyMemory() {
+	while(globalDirtyPages.load(std::memory_order_relaxed) >= throttleDirtyThreshold()) {
+		globalWriteback->flushSpaces(true);
+		co_await globalWriteback->writebackEvent.async_wait_if([] () -> bool {
+			return globalDirtyPages.load(std::memory_order_relaxed) >= throttleDirtyThreshold();
+		});
+	}
+}
+
 // --------------------------------------------------------
 // MemoryView.
 // --------------------------------------------------------
@@ -382,8 +549,25 @@ size_t AllocatedMemory::getLength() {
 // ManagedSpace
 // --------------------------------------------------------
 
-ManagedSpace::ManagedSpace(size_t length)
-: pages{*kernelAlloc}, numPages{length >> kPageShift} {
+namespace {
+	// Size of the readahead window after the first sequential fetch and its maximal size
+	// (in pages). The window doubles on each sequential fetch that triggers readahead.
+	constexpr size_t readaheadInitialPages = 4;
+	constexpr size_t readaheadMaxPages = 32;
+
+	// Statistics about readahead (over all ManagedSpaces).
+	// Number of pages that were requested by readahead.
+	std::atomic<uint64_t> numReadaheadPages{0};
+	// Number of fetches of pages that were requested by readahead.
+	std::atomic<uint64_t> numReadaheadHits{0};
+	// Number of fetches that had to request the page themselves.
+	std::atomic<uint64_t> numReadaheadMisses{0};
+	// Number of pages that were requested by readahead but evicted before being fetched.
+	std::atomic<uint64_t> numReadaheadWasted{0};
+}
+
+ManagedSpace::ManagedSpace(size_t length, bool readahead)
+: pages{*kernelAlloc}, numPages{length >> kPageShift}, _readaheadEnabled{readahead} {
 	assert(!(length & (kPageSize - 1)));
 }
 
@@ -424,6 +608,10 @@ bool ManagedSpace::uncachePage(CachePage *page, ReclaimNode *continuation) {
 			infoLogger() << "\e[33mEvicting physical page\e[39m" << frg::endlog;
 		assert(pit->physical != PhysicalAddr(-1));
 		physicalAllocator->free(pit->physical, kPageSize);
+		if(pit->readahead) {
+			numReadaheadWasted.fetch_add(1, std::memory_order_relaxed);
+			pit->readahead = false;
+		}
 		pit->loadState = kStateMissing;
 		pit->physical = PhysicalAddr(-1);
 		continuation->complete();
@@ -513,35 +701,78 @@ void ManagedSpace::submitMonitor(MonitorNode *node) {
 	_progressMonitors();
 }
 
+void ManagedSpace::submitWriteback(MonitorNode *node) {
+	ManageList pending;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&mutex);
+
+		// Dirty pages are written back while the monitor is pending.
+		node->generation = ++_writebackGeneration;
+		_numWritebackMonitors++;
+		_progressManagement(pending);
+	}
+
+	submitMonitor(node);
+
+	while(!pending.empty()) {
+		auto node = pending.pop_front();
+		node->complete();
+	}
+}
+
 void ManagedSpace::_progressManagement(ManageList &pending) {
 	// For now, we prefer writeback to initialization.
 	// "Proper" priorization should probably be done in the userspace driver
 	// (we do not want to store per-page priorities here).
 
-	while(!_writebackList.empty() && !_managementQueue.empty()) {
-		auto page = _writebackList.front();
-		auto index = page->identity;
+	// Dirty pages are only written back once they are due (see WritebackScheduler)
+	// or once the space has accumulated many of them; this yields larger requests.
+	bool writebackDue = _flushing || _numWritebackMonitors
+			|| _numDirtyPages >= spaceDirtyThreshold;
+	while(writebackDue && !_writebackList.empty() && !_managementQueue.empty()) {
+		auto index = _writebackList.front()->identity;
+
+		// Pages beyond the end of the space were truncated and do not need writeback.
+		if(index >= numPages) {
+			auto page = _writebackList.pop_front();
+			auto managedPage = frg::container_of(page, &ManagedPage::cachePage);
+			assert(managedPage->loadState == kStateWantWriteback);
+			managedPage->loadState = kStatePresent;
+			if(!managedPage->lockCount)
+				globalReclaimer->addPage(&managedPage->cachePage);
+			_noteCleanPage();
+			continue;
+		}
 
-		// Fuse the request with adjacent pages in the list.
-		ptrdiff_t count = 0;
-		while(!_writebackList.empty()) {
-			auto fuse_cache_page = _writebackList.front();
-			auto fuse_index = fuse_cache_page->identity;
-			auto fuse_managed_page = frg::container_of(fuse_cache_page, &ManagedPage::cachePage);
-			if(fuse_index != index + count)
-				break;
-			assert(fuse_managed_page->loadState == kStateWantWriteback);
-			fuse_managed_page->loadState = kStateWriteback;
+		auto isWantWriteback = [&] (size_t fuseIndex) -> bool {
+			auto fusePage = pages.find(fuseIndex);
+			return fusePage && fusePage->loadState == kStateWantWriteback;
+		};
+
+		// Fuse the request with adjacent dirty pages (regardless of their order in the list).
+		auto first = index;
+		while(first > 0 && index - first + 1 < maxWritebackPages && isWantWriteback(first - 1))
+			first--;
+
+		size_t count = 0;
+		while(count < maxWritebackPages && first + count < numPages
+				&& isWantWriteback(first + count)) {
+			auto fuseManagedPage = pages.find(first + count);
+			fuseManagedPage->loadState = kStateWriteback;
+			fuseManagedPage->writebackGeneration = _writebackGeneration;
+			_writebackList.erase(_writebackList.iterator_to(&fuseManagedPage->cachePage));
 			count++;
-			_writebackList.pop_front();
 		}
 		assert(count);
 
 		auto node = _managementQueue.pop_front();
 		node->setup(Error::success, ManageRequest::writeback,
-				index << kPageShift, count << kPageShift);
+				first << kPageShift, count << kPageShift);
 		pending.push_back(node);
 	}
+	if(_writebackList.empty() && !_numWritebackMonitors)
+		_flushing = false;
 
 	while(!_initializationList.empty() && !_managementQueue.empty()) {
 		auto page = _initializationList.front();
@@ -569,12 +800,87 @@ void ManagedSpace::_progressManagement(ManageList &pending) {
 	}
 }
 
+void ManagedSpace::_noteDirtyPage() {
+	if(!_numDirtyPages++) {
+		_dirtySince = systemClockSource()->currentNanos();
+		globalWriteback->addSpace(this);
+	}
+	globalDirtyPages.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ManagedSpace::_noteCleanPage() {
+	assert(_numDirtyPages);
+	_numDirtyPages--;
+	globalDirtyPages.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ManagedSpace::_readahead(size_t index) {
+	if(!_readaheadEnabled)
+		return;
+
+	if(index + 1 == _sequentialNext) {
+		// Repeated fetch of the same page (e.g., from multiple mappings).
+		return;
+	}else if(index == _sequentialNext) {
+		if(!_readaheadWindow)
+			_readaheadWindow = readaheadInitialPages;
+	}else{
+		_readaheadWindow = 0;
+		_readaheadEnd = 0;
+	}
+	_sequentialNext = index + 1;
+	if(!_readaheadWindow)
+		return;
+
+	// Only issue more readahead once the reader has consumed half of the window.
+	// This keeps the requests to the backing memory large.
+	if(_readaheadEnd > index + _readaheadWindow / 2)
+		return;
+
+	auto start = frg::max(_readaheadEnd, index + 1);
+	auto end = frg::min(index + 1 + _readaheadWindow, numPages);
+	for(size_t ra = start; ra < end; ra++) {
+		auto [pit, wasInserted] = pages.find_or_insert(ra, this, ra);
+		assert(pit);
+		if(pit->loadState != kStateMissing)
+			continue;
+		pit->loadState = kStateWantInitialization;
+		pit->readahead = true;
+		_initializationList.push_back(&pit->cachePage);
+		numReadaheadPages.fetch_add(1, std::memory_order_relaxed);
+	}
+	if(end > _readaheadEnd)
+		_readaheadEnd = end;
+
+	_readaheadWindow = frg::min(2 * _readaheadWindow, readaheadMaxPages);
+
+	if(logReadahead)
+		infoLogger() << "thor: Readahead of pages " << start << " to " << end
+				<< "; " << numReadaheadHits.load(std::memory_order_relaxed) << " hits, "
+				<< numReadaheadMisses.load(std::memory_order_relaxed) << " misses, "
+				<< numReadaheadWasted.load(std::memory_order_relaxed) << " of "
+				<< numReadaheadPages.load(std::memory_order_relaxed) << " pages wasted"
+				<< frg::endlog;
+}
+
 void ManagedSpace::_progressMonitors() {
 	// TODO: Accelerate this by storing the monitors in a RB tree ordered by their progress.
 	auto progressNode = [&] (MonitorNode *node) -> bool {
 		while(node->progress < node->length) {
 			size_t index = (node->offset + node->progress) >> kPageShift;
 			auto pit = pages.find(index);
+			if(node->type == ManageRequest::writeback) {
+				// Pages that were never loaded are clean. Dirty pages are done once
+				// a writeback that started after the request has completed.
+				if(pit && (pit->loadState == kStateWantWriteback
+						|| pit->loadState == kStateWriteback
+						|| pit->loadState == kStateAnotherWriteback)
+						&& pit->cleanGeneration < node->generation)
+					return false;
+				node->progress += kPageSize;
+				continue;
+			}
+
 			assert(pit);
 			if(pit->loadState == kStateWantInitialization
 					|| pit->loadState == kStateInitialization)
@@ -593,9 +899,12 @@ void ManagedSpace::_progressMonitors() {
 	for(auto it = _monitorQueue.begin(); it != _monitorQueue.end(); ) {
 		auto it_copy = it;
 		auto node = *it++;
-		assert(node->type == ManageRequest::initialize);
+		assert(node->type == ManageRequest::initialize
+				|| node->type == ManageRequest::writeback);
 		if(progressNode(node)) {
 			_monitorQueue.erase(it_copy);
+			if(node->type == ManageRequest::writeback)
+				_numWritebackMonitors--;
 			node->setup(Error::success);
 			node->complete();
 		}
@@ -702,50 +1011,58 @@ Error BackingMemory::updateRange(ManageRequest type, size_t offset, size_t lengt
 	assert((offset % kPageSize) == 0);
 	assert((length % kPageSize) == 0);
 
-	auto irq_lock = frg::guard(&irqMutex());
-	auto lock = frg::guard(&_managed->mutex);
-	assert((offset + length) / kPageSize <= _managed->numPages);
-
-/*	assert(length == kPageSize);
-	auto inspect = (unsigned char *)physicalToVirtual(_managed->physicalPages[offset / kPageSize]);
-	auto log = infoLogger() << "dump";
-	for(size_t b = 0; b < kPageSize; b += 16) {
-		log << frg::hex_fmt(offset + b) << "   ";
-		for(size_t i = 0; i < 16; i++)
-			log << " " << frg::hex_fmt(inspect[b + i]);
-		log << "\n";
-	}
-	log << frg::endlog;*/
-
-	if(type == ManageRequest::initialize) {
-		for(size_t pg = 0; pg < length; pg += kPageSize) {
-			size_t index = (offset + pg) / kPageSize;
-			auto pit = _managed->pages.find(index);
-			assert(pit);
-			assert(pit->loadState == ManagedSpace::kStateInitialization);
-			pit->loadState = ManagedSpace::kStatePresent;
-			if(!pit->lockCount)
-				globalReclaimer->addPage(&pit->cachePage);
+	{
+		auto irq_lock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_managed->mutex);
+		assert((offset + length) / kPageSize <= _managed->numPages);
+
+/*		assert(length == kPageSize);
+		auto inspect = (unsigned char *)physicalToVirtual(_managed->physicalPages[offset / kPageSize]);
+		auto log = infoLogger() << "dump";
+		for(size_t b = 0; b < kPageSize; b += 16) {
+			log << frg::hex_fmt(offset + b) << "   ";
+			for(size_t i = 0; i < 16; i++)
+				log << " " << frg::hex_fmt(inspect[b + i]);
+			log << "\n";
 		}
-	}else{
-		for(size_t pg = 0; pg < length; pg += kPageSize) {
-			size_t index = (offset + pg) / kPageSize;
-			auto pit = _managed->pages.find(index);
-			assert(pit);
-
-			if(pit->loadState == ManagedSpace::kStateWriteback) {
+		log << frg::endlog;*/
+
+		if(type == ManageRequest::initialize) {
+			for(size_t pg = 0; pg < length; pg += kPageSize) {
+				size_t index = (offset + pg) / kPageSize;
+				auto pit = _managed->pages.find(index);
+				assert(pit);
+				assert(pit->loadState == ManagedSpace::kStateInitialization);
 				pit->loadState = ManagedSpace::kStatePresent;
 				if(!pit->lockCount)
 					globalReclaimer->addPage(&pit->cachePage);
-			}else{
-				assert(pit->loadState == ManagedSpace::kStateAnotherWriteback);
-				pit->loadState = ManagedSpace::kStateWantWriteback;
-				_managed->_writebackList.push_back(&pit->cachePage);
+			}
+		}else{
+			for(size_t pg = 0; pg < length; pg += kPageSize) {
+				size_t index = (offset + pg) / kPageSize;
+				auto pit = _managed->pages.find(index);
+				assert(pit);
+				pit->cleanGeneration = pit->writebackGeneration;
+
+				if(pit->loadState == ManagedSpace::kStateWriteback) {
+					pit->loadState = ManagedSpace::kStatePresent;
+					if(!pit->lockCount)
+						globalReclaimer->addPage(&pit->cachePage);
+					_managed->_noteCleanPage();
+				}else{
+					assert(pit->loadState == ManagedSpace::kStateAnotherWriteback);
+					pit->loadState = ManagedSpace::kStateWantWriteback;
+					_managed->_writebackList.push_back(&pit->cachePage);
+				}
 			}
 		}
+
+		_managed->_progressMonitors();
 	}
 
-	_managed->_progressMonitors();
+	// Wake up throttled writers.
+	if(type == ManageRequest::writeback)
+		globalWriteback->writebackEvent.raise();
 
 	return Error::success;
 }
@@ -795,6 +1112,11 @@ bool FrontalMemory::fetchRange(uintptr_t offset,
 		// Try the fast-paths first.
 		auto [pit, wasInserted] = _managed->pages.find_or_insert(index, _managed.get(), index);
 		assert(pit);
+		if(pit->readahead) {
+			numReadaheadHits.fetch_add(1, std::memory_order_relaxed);
+			pit->readahead = false;
+		}
+
 		if(pit->loadState == ManagedSpace::kStatePresent
 				|| pit->loadState == ManagedSpace::kStateWantWriteback
 				|| pit->loadState == ManagedSpace::kStateWriteback
@@ -812,6 +1134,16 @@ bool FrontalMemory::fetchRange(uintptr_t offset,
 				globalReclaimer->addPage(&pit->cachePage);
 			}
 
+			_managed->_readahead(index);
+			_managed->_progressManagement(pending);
+			lock.unlock();
+			irq_lock.unlock();
+
+			while(!pending.empty()) {
+				auto manage = pending.pop_front();
+				manage->complete();
+			}
+
 			completeFetch(node, Error::success,
 					physical + misalign, kPageSize - misalign, CachingMode::null);
 			return true;
@@ -830,9 +1162,12 @@ bool FrontalMemory::fetchRange(uintptr_t offset,
 
 		// We have to take the slow-path, i.e., perform the fetch asynchronously.
 		if(pit->loadState == ManagedSpace::kStateMissing) {
+			numReadaheadMisses.fetch_add(1, std::memory_order_relaxed);
 			pit->loadState = ManagedSpace::kStateWantInitialization;
 			_managed->_initializationList.push_back(&pit->cachePage);
 		}
+		// Queue readahead after the requested page such that the requests are fused.
+		_managed->_readahead(index);
 		_managed->_progressManagement(pending);
 
 		// TODO: Do not allocate memory here; use pre-allocated nodes instead.
@@ -909,10 +1244,12 @@ void FrontalMemory::markDirty(uintptr_t offset, size_t size) {
 				if(!pit->lockCount)
 					globalReclaimer->removePage(&pit->cachePage);
 				_managed->_writebackList.push_back(&pit->cachePage);
+				_managed->_noteDirtyPage();
 			}else if(pit->loadState == ManagedSpace::kStateEvicting) {
 				pit->loadState = ManagedSpace::kStateWantWriteback;
 				assert(!pit->lockCount);
 				_managed->_writebackList.push_back(&pit->cachePage);
+				_managed->_noteDirtyPage();
 			}else if(pit->loadState == ManagedSpace::kStateWriteback) {
 				pit->loadState = ManagedSpace::kStateAnotherWriteback;
 			}else{
@@ -935,7 +1272,16 @@ size_t FrontalMemory::getLength() {
 	return _managed->numPages << kPageShift;
 }
 
+bool FrontalMemory::needsWriteback() {
+	return true;
+}
+
 void FrontalMemory::submitInitiateLoad(MonitorNode *node) {
+	if(node->type == ManageRequest::writeback) {
+		_managed->submitWriteback(node);
+		return;
+	}
+
 	ManageList pending;
 	{
 		// TODO: This assumes that we want to load the range (which might not be true).
@@ -1273,10 +1619,14 @@ bool CopyOnWriteMemory::asyncLockRange(uintptr_t offset, size_t size,
 				chain = chain->_superChain;
 			}
 
-			// Copy from the root view.
+			// Copy from the root view. Without a root view, the memory is zero-filled.
 			if(!chain) {
-				co_await copyFromView(view.get(), pageOffset & ~(kPageSize - 1),
-						accessor.get(), kPageSize, wq);
+				if(view) {
+					co_await copyFromView(view.get(), pageOffset & ~(kPageSize - 1),
+							accessor.get(), kPageSize, wq);
+				}else{
+					memset(accessor.get(), 0, kPageSize);
+				}
 			}
 
 			// To make CoW unobservable, we first need to evict the page here.
@@ -1407,10 +1757,14 @@ bool CopyOnWriteMemory::fetchRange(uintptr_t offset,
 			chain = chain->_superChain;
 		}
 
-		// Copy from the root view.
+		// Copy from the root view. Without a root view, the memory is zero-filled.
 		if(!chain) {
-			co_await copyFromView(view.get(), pageOffset & ~(kPageSize - 1),
-					accessor.get(), kPageSize, wq);
+			if(view) {
+				co_await copyFromView(view.get(), pageOffset & ~(kPageSize - 1),
+						accessor.get(), kPageSize, wq);
+			}else{
+				memset(accessor.get(), 0, kPageSize);
+			}
 		}
 
 		// To make CoW unobservable, we first need to evict the page here.
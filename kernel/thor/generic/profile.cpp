@@ -9,7 +9,12 @@
 namespace thor {
 
 bool wantKernelProfile = false;
-frg::manual_box<LogRingBuffer> globalProfileRing;
+
+namespace {
+	constexpr size_t profileRingSize = 1 << 20;
+
+	bool profileEnabled = false;
+}
 
 void initializeProfile() {
 #ifdef __x86_64__
@@ -23,11 +28,30 @@ void initializeProfile() {
 		return;
 	}
 
-	void *profileMemory = kernelAlloc->allocate(1 << 20);
-	globalProfileRing.initialize(reinterpret_cast<uintptr_t>(profileMemory), 1 << 20);
+	profileEnabled = true;
+	initializeProfileForThisCpu();
+#endif
+}
 
-	// Dump the per-CPU profiling data to the global ring buffer.
-	// TODO: Start one such fiber per CPU.
+void initializeProfileForThisCpu() {
+#ifdef __x86_64__
+	if(!profileEnabled)
+		return;
+
+	auto cpuData = getCpuData();
+	if(!(cpuData->profileFlags & PlatformCpuData::profileIntelSupported)
+			&& !(cpuData->profileFlags & PlatformCpuData::profileAmdSupported)) {
+		infoLogger() << "\e[31m" "thor: CPU " << cpuData->cpuIndex
+				<< " does not support profiling" "\e[39m" << frg::endlog;
+		return;
+	}
+
+	void *profileMemory = kernelAlloc->allocate(profileRingSize);
+	cpuData->profileRing = frg::construct<LogRingBuffer>(*kernelAlloc,
+			reinterpret_cast<uintptr_t>(profileMemory), profileRingSize);
+
+	// Dump the per-CPU profiling data to this CPU's ring buffer.
+	// The fiber is associated with the local scheduler, i.e., it runs on this CPU.
 	KernelFiber::run([=] {
 		getCpuData()->localProfileRing = frg::construct<SingleContextRecordRing>(*kernelAlloc);
 
@@ -43,27 +67,29 @@ void initializeProfile() {
 			setAmdPmc();
 		}
 
+		constexpr size_t maxSampleSize = sizeof(ProfileSampleHeader)
+				+ maxProfileFrames * sizeof(uintptr_t);
+
 		uint64_t deqPtr = 0;
 		while(true) {
-			char buffer[128];
+			char buffer[maxSampleSize];
 			auto [success, newPtr, size] = getCpuData()->localProfileRing->dequeueAt(
-					deqPtr, buffer, 128);
+					deqPtr, buffer, maxSampleSize);
 			deqPtr = newPtr;
 			if(!success) {
 				KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(1'000'000));
 				continue;
 			}
-			assert(size);
-			assert(size < 128);
-			for(size_t i = 0; i < size; ++i)
-				globalProfileRing->enqueue(buffer[i]);
+			assert(size >= sizeof(ProfileSampleHeader));
+			assert(size <= maxSampleSize);
+			getCpuData()->profileRing->enqueue(buffer, size);
 		}
 	});
 #endif
 }
 
-LogRingBuffer *getGlobalProfileRing() {
-	return globalProfileRing.get();
+LogRingBuffer *getProfileRing(int cpu) {
+	return getCpuData(cpu)->profileRing;
 }
 
 } // namespace thor
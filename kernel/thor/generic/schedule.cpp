@@ -5,6 +5,7 @@
 #include <thor-internal/core.hpp>
 #include <thor-internal/schedule.hpp>
 #include <thor-internal/timer.hpp>
+#include <thor-internal/trace.hpp>
 #ifdef __x86_64__
 #include <thor-internal/arch/hpet.hpp>
 #endif
@@ -17,11 +18,16 @@ namespace {
 	constexpr bool logUpdates = false;
 	constexpr bool logIdle = false;
 	constexpr bool logTimeSlice = false;
+	constexpr bool logWakeups = false;
 
 	constexpr bool disablePreemption = false;
 
 	// Minimum length of a preemption time slice in ns.
 	constexpr int64_t sliceGranularity = 10'000'000;
+
+	// Time in ns that idle CPUs without MWAIT poll for wakeups before they halt.
+	// Note that IRQs are disabled while polling.
+	constexpr uint64_t idlePollTime = 20'000;
 }
 
 int ScheduleEntity::orderPriority(const ScheduleEntity *a, const ScheduleEntity *b) {
@@ -82,6 +88,7 @@ void Scheduler::resume(ScheduleEntity *entity) {
 	assert(self);
 	assert(entity != self->_current);
 	bool wasEmpty;
+	bool deferred = false;
 	{
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&self->_mutex);
@@ -90,15 +97,38 @@ void Scheduler::resume(ScheduleEntity *entity) {
 
 		wasEmpty = self->_pendingList.empty();
 		self->_pendingList.push_back(entity);
-	}
 
-	if(wasEmpty) {
-		if(self == &getCpuData()->scheduler) {
-			sendPingIpi(self->_cpuContext->cpuIndex);
-		}else{
-			sendPingIpi(self->_cpuContext->cpuIndex);
+		// If the entity belongs to this CPU and we are going to call update() anyway,
+		// there is no need to interrupt ourselves.
+		if(self == &getCpuData()->scheduler && self->_updateExpected) {
+			self->_wakeupDeferred = true;
+			deferred = true;
 		}
 	}
+
+	// This needs to be sequentially consistent with the store to _idlePolling in _pollIdle():
+	// either we see that the CPU polls, or the CPU sees the increment.
+	self->_pendingSeq.fetch_add(1, std::memory_order_seq_cst);
+
+	if(!wasEmpty)
+		return;
+
+	uint64_t n;
+	if(deferred) {
+		n = self->numLocalWakeups.fetch_add(1, std::memory_order_relaxed);
+	}else if(self->_idlePolling.load(std::memory_order_seq_cst)) {
+		n = self->numPolledWakeups.fetch_add(1, std::memory_order_relaxed);
+	}else{
+		self->numPingIpis.fetch_add(1, std::memory_order_relaxed);
+		sendPingIpi(self->_cpuContext->cpuIndex);
+		return;
+	}
+
+	if(logWakeups && !(n & 0xFFF))
+		infoLogger() << "thor: CPU " << self->_cpuContext->cpuIndex << " avoided "
+				<< self->numLocalWakeups.load(std::memory_order_relaxed) << " local and "
+				<< self->numPolledWakeups.load(std::memory_order_relaxed) << " polled wakeup IPIs, sent "
+				<< self->numPingIpis.load(std::memory_order_relaxed) << " IPIs" << frg::endlog;
 }
 
 void Scheduler::suspendCurrent() {
@@ -158,6 +188,10 @@ void Scheduler::update() {
 	auto now = systemClockSource()->currentNanos();
 	auto deltaTime = now - _refClock;
 	_refClock = now;
+
+	// We are going to process all pending entities; see expectUpdate().
+	_updateExpected = false;
+	_wakeupDeferred = false;
 	if(n)
 		_systemProgress += deltaTime * fixedInverse(n);
 
@@ -237,6 +271,7 @@ void Scheduler::commit() {
 		_current = _scheduled;
 		_scheduled = nullptr;
 		_sliceClock = _refClock;
+		trace(traceSched, TraceEvent::schedSwitch, reinterpret_cast<uintptr_t>(_current));
 	}else{
 		assert(!_scheduled);
 	}
@@ -248,17 +283,65 @@ void Scheduler::commit() {
 }
 
 void Scheduler::invoke() {
-	if(!_current) {
+	while(!_current) {
 		if(logIdle)
 			infoLogger() << "System is idle" << frg::endlog;
-		suspendSelf();
-	}else{
-		_current->invoke();
+		if(!_pollIdle())
+			suspendSelf();
+
+		// Entities became pending while we were polling (without a ping IPI).
+		update();
+		reschedule();
+		commit();
 	}
+	_current->invoke();
 	panicLogger() << "Return from scheduling invocation" << frg::endlog;
 	__builtin_unreachable();
 }
 
+// Returns true if entities became pending. Otherwise, the caller should halt the CPU.
+bool Scheduler::_pollIdle() {
+	assert(!intsAreEnabled());
+
+#ifdef __x86_64__
+	auto seq = _pendingSeq.load(std::memory_order_seq_cst);
+	_idlePolling.store(true, std::memory_order_seq_cst);
+
+	// resume() might have pushed an entity after update() emptied _pendingList
+	// but before we took the snapshot above; it may have seen _idlePolling set
+	// and skipped the IPI. Entities that are pushed after this check
+	// increment _pendingSeq after we took the snapshot.
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		if(!_pendingList.empty()) {
+			_idlePolling.store(false, std::memory_order_seq_cst);
+			return true;
+		}
+	}
+
+	if(getCpuData()->haveMwait) {
+		// MWAIT returns on writes to _pendingSeq but also if an IRQ is pending.
+		// In the latter case, we halt such that the IRQ is delivered.
+		common::x86::monitor(&_pendingSeq);
+		if(_pendingSeq.load(std::memory_order_relaxed) == seq)
+			common::x86::mwait(0, 1);
+	}else{
+		auto deadline = systemClockSource()->currentNanos() + idlePollTime;
+		while(_pendingSeq.load(std::memory_order_relaxed) == seq
+				&& systemClockSource()->currentNanos() < deadline)
+			pause();
+	}
+
+	// Re-check after clearing the flag as resume() might have seen it set.
+	_idlePolling.store(false, std::memory_order_seq_cst);
+	return _pendingSeq.load(std::memory_order_seq_cst) != seq;
+#else
+	return false;
+#endif
+}
+
 void Scheduler::_unschedule() {
 	assert(_current);
 
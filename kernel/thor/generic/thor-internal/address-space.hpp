@@ -153,7 +153,8 @@ enum MappingFlags : uint32_t {
 	protWrite = 0x20,
 	protExecute = 0x40,
 
-	dontRequireBacking = 0x100
+	dontRequireBacking = 0x100,
+	dontInherit = 0x200
 };
 
 struct TouchVirtualResult {
@@ -516,6 +517,7 @@ public:
 		kMapProtExecute = 0x20,
 		kMapPopulate = 0x200,
 		kMapDontRequireBacking = 0x400,
+		kMapDontInherit = 0x800,
 	};
 
 	enum FaultFlags : uint32_t {
@@ -546,6 +548,10 @@ public:
 	frg::optional<bool> handleFault(VirtualAddr address, uint32_t flags,
 			smarter::shared_ptr<WorkQueue> wq, FaultNode *node);
 
+	// Returns all active mappings that are inherited by forked spaces
+	// (i.e., mappings that are not marked as dontInherit), ordered by address.
+	frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> inheritedMappings();
+
 	size_t rss() {
 		return _residuentSize;
 	}
@@ -851,6 +857,16 @@ private:
 
 	smarter::shared_ptr<Mapping> _findMapping(VirtualAddr address);
 
+	// Returns the first mapping that ends after the given address.
+	Mapping *_findMappingFrom(VirtualAddr address);
+
+	// Splits the mapping that contains the given address (if any),
+	// such that a mapping starts at the address.
+	void _splitMappingAt(VirtualAddr address);
+
+	// Releases a mapping that was already removed from the mapping tree.
+	void _retireMapping(Mapping *mapping);
+
 	// Splits some memory range from a hole mapping.
 	void _splitHole(Hole *hole, VirtualAddr offset, VirtualAddr length);
 
@@ -1133,5 +1149,13 @@ private:
 };
 
 void initializeReclaim();
+void initializeWriteback();
+
+// Suspends the caller while too much managed memory is dirty.
+// Writers call this to give the writeback a chance to catch up.
+coroutine<void> throttleDirtyMemory();
+
+// Writes back all dirty pages of managed memory.
+coroutine<void> writebackAllMemory();
 
 } // namespace thor
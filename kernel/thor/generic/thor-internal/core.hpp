@@ -26,6 +26,7 @@ struct IoSpace;
 
 struct WorkQueue;
 struct KernelFiber;
+struct IrqSlot;
 
 // TODO: For now, this class is empty but it will be required for QST.
 struct ExecutorContext {
@@ -62,10 +63,21 @@ struct CpuData : public PlatformCpuData {
 	smarter::shared_ptr<WorkQueue> generalWorkQueue;
 	std::atomic<uint64_t> heartbeat;
 
+	// Interrupt vectors that are private to this CPU (e.g., MSIs that target this CPU).
+	// Allocated on first use. Vectors that are not linked here are raised via globalIrqSlots.
+	std::atomic<IrqSlot *> localIrqSlots{nullptr};
+
 	unsigned int irqEntropySeq = 0;
 	std::atomic<ProfileMechanism> profileMechanism{};
 	// TODO: This should be a unique_ptr instead.
 	SingleContextRecordRing *localProfileRing = nullptr;
+	// Samples are drained from localProfileRing into this ring, which is exposed via kerncfg.
+	LogRingBuffer *profileRing = nullptr;
+
+	// Tracepoints write to localTraceRing (with IRQs disabled).
+	SingleContextRecordRing *localTraceRing = nullptr;
+	// Records are drained from localTraceRing into this ring, which is exposed via kerncfg.
+	LogRingBuffer *traceRing = nullptr;
 };
 
 CpuData *getCpuData(size_t k);
@@ -14,6 +14,30 @@ namespace thor {
 
 struct Futex;
 
+// Identifies a futex word. Private futexes are identified by their virtual address
+// (with object = 0), shared futexes by the memory object that backs them
+// (see AddressIdentity) and the offset into that object.
+struct FutexAddress {
+	FutexAddress(uintptr_t address)
+	: object{0}, offset{address} { }
+
+	FutexAddress(void *object, uintptr_t offset)
+	: object{reinterpret_cast<uintptr_t>(object)}, offset{offset} { }
+
+	bool operator== (const FutexAddress &other) const {
+		return object == other.object && offset == other.offset;
+	}
+
+	uintptr_t object;
+	uintptr_t offset;
+};
+
+struct FutexAddressHash {
+	unsigned int operator() (const FutexAddress &address) const {
+		return frg::hash<uintptr_t>{}(address.offset ^ (address.object >> 4));
+	}
+};
+
 enum class FutexState {
 	none,
 	waiting,
@@ -34,7 +58,7 @@ private:
 	void onCancel();
 
 	Futex *_futex = nullptr;
-	uintptr_t _address;
+	FutexAddress _address{0};
 	async::cancellation_token _cancellation;
 	FutexState _state = FutexState::none;
 	bool _wasCancelled = false;
@@ -45,10 +69,10 @@ private:
 struct Futex {
 	friend struct FutexNode;
 
-	using Address = uintptr_t;
+	using Address = FutexAddress;
 
 	Futex()
-	: _slots{frg::hash<Address>{}, *kernelAlloc} { }
+	: _slots{FutexAddressHash{}, *kernelAlloc} { }
 
 	bool empty() {
 		return _slots.empty();
@@ -243,7 +267,7 @@ private:
 	frg::hash_map<
 		Address,
 		Slot,
-		frg::hash<Address>,
+		FutexAddressHash,
 		KernelAlloc
 	> _slots;
 };
@@ -253,4 +277,8 @@ inline void FutexNode::onCancel() {
 	_futex->cancel(this);
 }
 
+// Futex realm for shared futexes, i.e., futexes that are identified by their
+// backing memory object instead of their virtual address.
+Futex &getGlobalFutexRealm();
+
 } // namespace thor
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <frg/list.hpp>
+#include <frg/optional.hpp>
 #include <frg/string.hpp>
 #include <thor-internal/error.hpp>
 #include <thor-internal/kernel_heap.hpp>
@@ -220,6 +221,52 @@ private:
 
 // ----------------------------------------------------------------------------
 
+// Address and data that a device writes to trigger a message signaled interrupt.
+struct MsiMessage {
+	uint64_t address;
+	uint32_t data;
+};
+
+// Represents a message signaled interrupt (e.g., PCI MSI or MSI-X).
+// MSIs are edge-triggered and never shared between devices. The interrupt controller
+// cannot mask MSIs; hence, bus drivers derive from this class to mask them at the device.
+struct MsiPin : IrqPin {
+	MsiPin(frg::string<KernelAlloc> name);
+
+	// Links this pin to a free interrupt vector of the given CPU.
+	// Returns false if the CPU has no free vectors left.
+	bool allocateVector(int cpu);
+
+	int cpu() {
+		return _cpu;
+	}
+
+	// Only valid after allocateVector() succeeded.
+	MsiMessage message() {
+		return _message;
+	}
+
+protected:
+	IrqStrategy program(TriggerMode mode, Polarity polarity) override;
+
+	void sendEoi() override;
+
+private:
+	int _cpu = -1;
+	MsiMessage _message{};
+};
+
+// The following functions are implemented by the architecture-specific code.
+
+// Links the pin to a free interrupt vector of the given CPU.
+// Returns the message that triggers the vector.
+frg::optional<MsiMessage> allocateMsiVector(IrqPin *pin, int cpu);
+
+// Sends an end-of-interrupt signal for an MSI to the current CPU's interrupt controller.
+void acknowledgeMsi();
+
+// ----------------------------------------------------------------------------
+
 // This class implements the user-visible part of IRQ handling.
 struct IrqObject final : IrqSink {
 	IrqObject(frg::string<KernelAlloc> name);
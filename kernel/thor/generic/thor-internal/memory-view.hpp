@@ -140,6 +140,8 @@ public:
 
 	// Current progress in bytes.
 	size_t progress;
+	// For writeback: writeback generation of the space at the time of the request.
+	uint64_t generation;
 };
 
 using InitiateList = frg::intrusive_list<
@@ -341,6 +343,11 @@ public:
 	// Marks a range of pages as dirty.
 	virtual void markDirty(uintptr_t offset, size_t size) = 0;
 
+	// Returns true if writes produce dirty pages that the writeback has to clean.
+	virtual bool needsWriteback() {
+		return false;
+	}
+
 	virtual void submitManage(ManageNode *handle);
 
 	// TODO: InitiateLoad does more or less the same as fetchRange(). Remove it.
@@ -992,10 +999,16 @@ struct ManagedSpace : CacheBundle {
 		PhysicalAddr physical = PhysicalAddr(-1);
 		LoadState loadState = kStateMissing;
 		unsigned int lockCount = 0;
+		// True if the page was requested by readahead and not fetched since.
+		bool readahead = false;
+		// Writeback generation at the start of the current (resp. last) writeback.
+		// All writes before that generation are on disk once the writeback completes.
+		uint64_t writebackGeneration = 0;
+		uint64_t cleanGeneration = 0;
 		CachePage cachePage;
 	};
 
-	ManagedSpace(size_t length);
+	ManagedSpace(size_t length, bool readahead);
 	~ManagedSpace();
 
 	bool uncachePage(CachePage *page, ReclaimNode *node) override;
@@ -1007,9 +1020,20 @@ struct ManagedSpace : CacheBundle {
 
 	void submitManagement(ManageNode *node);
 	void submitMonitor(MonitorNode *node);
+	// Completes the node once all pages in its range that are currently dirty are written back.
+	void submitWriteback(MonitorNode *node);
 	void _progressManagement(ManageList &pending);
 	void _progressMonitors();
 
+	// Called for each fetch of the given page. Detects sequential access and
+	// queues pages ahead of the reader for initialization.
+	void _readahead(size_t index);
+
+	// Dirty page accounting for the writeback scheduler.
+	// Called when a page enters or leaves the set of dirty pages.
+	void _noteDirtyPage();
+	void _noteCleanPage();
+
 	frg::ticket_spinlock mutex;
 
 	frg::rcu_radixtree<ManagedPage, KernelAlloc> pages;
@@ -1038,6 +1062,29 @@ struct ManagedSpace : CacheBundle {
 
 	ManageList _managementQueue;
 	InitiateList _monitorQueue;
+
+	// Readahead is only useful for sequentially read data (see kHelManagedReadahead).
+	bool _readaheadEnabled;
+	// State of the sequential access detection (in pages).
+	size_t _sequentialNext = 0;
+	size_t _readaheadWindow = 0;
+	size_t _readaheadEnd = 0;
+
+	// Number of pages that are waiting for writeback or that are being written back.
+	size_t _numDirtyPages = 0;
+	// Time at which _numDirtyPages became non-zero.
+	uint64_t _dirtySince = 0;
+	// If set, all dirty pages are written back regardless of thresholds.
+	bool _flushing = false;
+	// Number of monitors in _monitorQueue that wait for writeback.
+	size_t _numWritebackMonitors = 0;
+	// Incremented by each writeback request. Writeback monitors only wait for writes
+	// that happened before their request, such that continuous writers do not starve them.
+	uint64_t _writebackGeneration = 0;
+
+	// Protected by the writeback scheduler's mutex.
+	bool _inDirtyList = false;
+	frg::default_list_hook<ManagedSpace> dirtyListHook;
 };
 
 struct BackingMemory final : MemoryView {
@@ -1080,6 +1127,7 @@ public:
 	frg::tuple<PhysicalAddr, CachingMode> peekRange(uintptr_t offset) override;
 	bool fetchRange(uintptr_t offset, smarter::shared_ptr<WorkQueue> wq, FetchNode *node) override;
 	void markDirty(uintptr_t offset, size_t size) override;
+	bool needsWriteback() override;
 	void submitInitiateLoad(MonitorNode *initiate) override;
 
 private:
@@ -6,7 +6,27 @@ namespace thor {
 
 extern bool wantKernelProfile;
 
+inline constexpr uint32_t profileSampleMagic = 0x4C504D53; // "SMPL" in little endian.
+inline constexpr size_t maxProfileFrames = 32;
+
+// Each sample in the profile rings consists of this header, followed by
+// numFrames return addresses. The first one is the interrupted IP.
+// Keep this in sync with tools/analyze-profile.py.
+struct ProfileSampleHeader {
+	uint32_t magic;
+	uint16_t cpu;
+	uint16_t numFrames;
+	// ID of the interrupted thread (or zero if no thread was running).
+	uint64_t threadId;
+	// Identifies the address space (i.e., the physical address of its page table root).
+	uint64_t spaceId;
+};
+static_assert(sizeof(ProfileSampleHeader) == 24);
+
+// Called on the BSP once the scheduler is available.
 void initializeProfile();
-LogRingBuffer *getGlobalProfileRing();
+// Starts sampling on the current CPU. Called by the BSP and by each AP after booting.
+void initializeProfileForThisCpu();
+LogRingBuffer *getProfileRing(int cpu);
 
 } // namespace thor
@@ -23,6 +23,24 @@ struct LogRingBuffer {
 		enqueue_++;
 	}
 
+	void enqueue(const void *data, size_t size) {
+		auto irqLock = frg::guard(&thor::irqMutex());
+		auto lock = frg::guard(&mutex_);
+		auto p = reinterpret_cast<const char *>(data);
+		size_t i = 0;
+		while (i < size) {
+			size_t writeSize = frg::min(
+				size_ - (enqueue_ & (size_ - 1)),
+				size - i
+			);
+
+			memcpy(stor_ + (enqueue_ & (size_ - 1)), p + i, writeSize);
+
+			i += writeSize;
+			enqueue_ += writeSize;
+		}
+	}
+
 	frg::tuple<uint64_t, size_t>
 	dequeueInto(void *buffer, size_t dequeue, size_t size) {
 		auto irqLock = frg::guard(&thor::irqMutex());
@@ -2,6 +2,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <atomic>
 
 #include <frg/list.hpp>
 #include <frg/pairing_heap.hpp>
@@ -102,10 +103,34 @@ public:
 	void commit();
 	[[noreturn]] void invoke();
 
+	// Announces that this CPU will call update() before it leaves the kernel
+	// (e.g., at the end of an IRQ or a syscall). Until then, resume() does not need to
+	// send ping IPIs for entities of this CPU. Must be called with IRQs disabled.
+	void expectUpdate() {
+		_updateExpected = true;
+	}
+
+	// Ends the window opened by expectUpdate(). Returns true if resume() skipped
+	// ping IPIs in the meantime; the caller must then call update() (and reschedule).
+	// Must be called with IRQs disabled.
+	bool cancelExpectedUpdate() {
+		_updateExpected = false;
+		return _wakeupDeferred;
+	}
+
+	// Statistics about resume().
+	std::atomic<uint64_t> numPingIpis{0};
+	// Number of resume() calls that avoided the ping IPI since the entity's CPU calls update() soon.
+	std::atomic<uint64_t> numLocalWakeups{0};
+	// Number of resume() calls that avoided the ping IPI since the entity's CPU was polling.
+	std::atomic<uint64_t> numPolledWakeups{0};
+
 private:
 	void _unschedule();
 	void _schedule();
 
+	bool _pollIdle();
+
 private:
 	void _updatePreemption();
 
@@ -133,6 +158,10 @@ private:
 
 	bool _needPreemptionUpdate = false;
 
+	// See expectUpdate(). Only accessed by the CPU that owns this scheduler.
+	bool _updateExpected = false;
+	bool _wakeupDeferred = false;
+
 	// The last tick at which the scheduler's state (i.e. progress) was updated.
 	// In our model this is the time point at which slice T started.
 	uint64_t _refClock = 0;
@@ -151,6 +180,13 @@ private:
 	// Note that _mutex *only* protects _pendingList and nothing more!
 	frg::ticket_spinlock _mutex;
 
+	// Incremented whenever an entity is added to _pendingList.
+	// Idle CPUs poll (or MWAIT on) this word instead of halting.
+	std::atomic<uint64_t> _pendingSeq{0};
+
+	// True while this CPU polls _pendingSeq. resume() does not send ping IPIs to such CPUs.
+	std::atomic<bool> _idlePolling{false};
+
 	frg::intrusive_list<
 		ScheduleEntity,
 		frg::locate_member<
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+
+#include <thor-internal/ring-buffer.hpp>
+
+namespace thor {
+
+struct Thread;
+
+extern bool wantKernelTrace;
+
+// Categories of tracepoints. Each category can be enabled at runtime through traceMask.
+// Keep this in sync with tools/analyze-trace.py.
+inline constexpr uint32_t traceSched = 1;
+inline constexpr uint32_t traceIpc = 2;
+inline constexpr uint32_t tracePageFault = 4;
+inline constexpr uint32_t traceFutex = 8;
+inline constexpr uint32_t traceIrq = 16;
+inline constexpr uint32_t traceAll = 0x1F;
+
+enum class TraceEvent : uint16_t {
+	null,
+	// arg0: entity that is switched to (or zero if the CPU becomes idle).
+	schedSwitch,
+	// arg0: context of the submission, arg1: number of actions.
+	ipcSubmit,
+	// arg0: context of the submission.
+	ipcComplete,
+	// arg0: thread ID, arg1: faulting address.
+	pageFaultBegin,
+	// arg0: thread ID, arg1: whether the fault was handled.
+	pageFaultEnd,
+	// arg0: thread ID, arg1: futex address.
+	futexWaitBegin,
+	// arg0: thread ID, arg1: futex address.
+	futexWaitEnd,
+	// arg0: thread ID, arg1: futex address.
+	futexWake,
+	// arg0: IRQ number.
+	irqEnter,
+	// arg0: IRQ number.
+	irqExit
+};
+
+inline constexpr uint32_t traceRecordMagic = 0x45435254; // "TRCE" in little endian.
+
+// Records in the trace rings have a fixed size.
+// Keep this in sync with tools/analyze-trace.py.
+struct TraceRecord {
+	uint32_t magic;
+	uint16_t cpu;
+	TraceEvent event;
+	// Value of the system clock in ns.
+	uint64_t timestamp;
+	uint64_t arg0;
+	uint64_t arg1;
+};
+static_assert(sizeof(TraceRecord) == 32);
+
+// Mask of enabled trace categories. Zero unless tracing is requested on the command line;
+// can be changed at runtime through kerncfg.
+extern std::atomic<uint32_t> traceMask;
+
+inline bool traceEnabled(uint32_t category) {
+	return traceMask.load(std::memory_order_relaxed) & category;
+}
+
+// Appends a record to the current CPU's trace ring. Safe to call from IRQ context.
+void emitTrace(TraceEvent event, uint64_t arg0, uint64_t arg1);
+
+// Tracepoints should use this function; it is cheap if the category is disabled.
+inline void trace(uint32_t category, TraceEvent event, uint64_t arg0 = 0, uint64_t arg1 = 0) {
+	if(traceEnabled(category)) [[unlikely]]
+		emitTrace(event, arg0, arg1);
+}
+
+// Returns the ID that identifies the thread in trace records.
+uint64_t traceThreadId(Thread *thread);
+
+// Called on the BSP once the scheduler is available.
+void initializeTrace();
+// Sets up the trace ring of the current CPU. Called by the BSP and by each AP after booting.
+void initializeTraceForThisCpu();
+LogRingBuffer *getTraceRing(int cpu);
+
+// Returns false if tracing is not available.
+bool setTraceMask(uint32_t mask);
+
+} // namespace thor
@@ -146,6 +146,30 @@ void Thread::deferCurrent(IrqImageAccessor image) {
 	}, image, std::move(lock));
 }
 
+void Thread::deferCurrent(SyscallImageAccessor image) {
+	auto this_thread = getCurrentThread();
+	StatelessIrqLock irq_lock;
+	auto lock = frg::guard(&this_thread->_mutex);
+	
+	if(logRunStates)
+		infoLogger() << "thor: " << (void *)this_thread.get()
+				<< " is deferred" << frg::endlog;
+
+	assert(this_thread->_runState == kRunActive);
+	this_thread->_runState = kRunDeferred;
+	saveExecutor(&this_thread->_executor, image);
+	getCpuData()->scheduler.update();
+	getCpuData()->scheduler.reschedule();
+	this_thread->_uninvoke();
+
+	runDetached([] (Continuation cont, SyscallImageAccessor image, frg::unique_lock<Mutex> lock) {
+		scrubStack(image, cont);
+		lock.unlock();
+		localScheduler()->commit();
+		localScheduler()->invoke();
+	}, image, std::move(lock));
+}
+
 void Thread::suspendCurrent(IrqImageAccessor image) {
 	auto this_thread = getCurrentThread();
 	StatelessIrqLock irq_lock;
@@ -0,0 +1,99 @@
+#include <string.h>
+
+#include <thor-internal/fiber.hpp>
+#include <thor-internal/thread.hpp>
+#include <thor-internal/timer.hpp>
+#include <thor-internal/trace.hpp>
+
+namespace thor {
+
+bool wantKernelTrace = false;
+std::atomic<uint32_t> traceMask{0};
+
+namespace {
+	constexpr size_t traceRingSize = 1 << 20;
+
+	bool traceAvailable = false;
+}
+
+void emitTrace(TraceEvent event, uint64_t arg0, uint64_t arg1) {
+	// Disabling IRQs makes the current CPU the only context that writes to the ring.
+	StatelessIrqLock irqLock;
+
+	auto cpuData = getCpuData();
+	if(!cpuData->localTraceRing)
+		return;
+
+	TraceRecord record;
+	record.magic = traceRecordMagic;
+	record.cpu = cpuData->cpuIndex;
+	record.event = event;
+	record.timestamp = systemClockSource()->currentNanos();
+	record.arg0 = arg0;
+	record.arg1 = arg1;
+	cpuData->localTraceRing->enqueue(&record, sizeof(TraceRecord));
+}
+
+uint64_t traceThreadId(Thread *thread) {
+	// Thread IDs are embedded into the thread's credentials.
+	uint64_t id;
+	memcpy(&id, thread->credentials() + 8, sizeof(uint64_t));
+	return id;
+}
+
+void initializeTrace() {
+	if(!wantKernelTrace)
+		return;
+
+	traceAvailable = true;
+	initializeTraceForThisCpu();
+	traceMask.store(traceAll, std::memory_order_relaxed);
+	infoLogger() << "thor: Kernel tracing is enabled" << frg::endlog;
+}
+
+void initializeTraceForThisCpu() {
+	if(!traceAvailable)
+		return;
+
+	auto cpuData = getCpuData();
+	void *traceMemory = kernelAlloc->allocate(traceRingSize);
+	cpuData->traceRing = frg::construct<LogRingBuffer>(*kernelAlloc,
+			reinterpret_cast<uintptr_t>(traceMemory), traceRingSize);
+
+	// Drain the per-CPU records into this CPU's ring buffer.
+	// The fiber is associated with the local scheduler, i.e., it runs on this CPU.
+	KernelFiber::run([=] {
+		auto localRing = frg::construct<SingleContextRecordRing>(*kernelAlloc);
+		{
+			StatelessIrqLock irqLock;
+			getCpuData()->localTraceRing = localRing;
+		}
+
+		uint64_t deqPtr = 0;
+		while(true) {
+			TraceRecord record;
+			auto [success, newPtr, size] = localRing->dequeueAt(
+					deqPtr, &record, sizeof(TraceRecord));
+			deqPtr = newPtr;
+			if(!success) {
+				KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(1'000'000));
+				continue;
+			}
+			assert(size == sizeof(TraceRecord));
+			getCpuData()->traceRing->enqueue(&record, size);
+		}
+	});
+}
+
+LogRingBuffer *getTraceRing(int cpu) {
+	return getCpuData(cpu)->traceRing;
+}
+
+bool setTraceMask(uint32_t mask) {
+	if(!traceAvailable)
+		return false;
+	traceMask.store(mask & traceAll, std::memory_order_relaxed);
+	return true;
+}
+
+} // namespace thor
@@ -63,6 +63,8 @@ namespace {
 				resp.add_bars(std::move(msg));
 			}
 
+			resp.set_num_msis(device->numMsis);
+
 			frg::string<KernelAlloc> ser(*kernelAlloc);
 			resp.SerializeToString(&ser);
 			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, ser.size()};
@@ -117,6 +119,46 @@ namespace {
 			// TODO: improve error handling here.
 			assert(respError == Error::success);
 
+			auto descError = co_await PushDescriptorSender{conversation, IrqDescriptor{object}};
+			// TODO: improve error handling here.
+			assert(descError == Error::success);
+		}else if(req.req_type() == managarm::hw::CntReqType::ACCESS_MSI) {
+			managarm::hw::SvrResponse<KernelAlloc> resp(*kernelAlloc);
+
+			MsiPin *pin = nullptr;
+			if(req.index() < 0 || static_cast<unsigned int>(req.index()) >= device->numMsis) {
+				resp.set_error(managarm::hw::Errors::OUT_OF_BOUNDS);
+			}else{
+				pin = accessMsi(device.get(), req.index(), req.cpu());
+				if(pin) {
+					resp.set_error(managarm::hw::Errors::SUCCESS);
+				}else{
+					resp.set_error(managarm::hw::Errors::RESOURCE_EXHAUSTED);
+				}
+			}
+
+			frg::string<KernelAlloc> ser(*kernelAlloc);
+			resp.SerializeToString(&ser);
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, ser.size()};
+			memcpy(respBuffer.data(), ser.data(), ser.size());
+			auto respError = co_await SendBufferSender{conversation, std::move(respBuffer)};
+			// TODO: improve error handling here.
+			assert(respError == Error::success);
+
+			if(!pin)
+				co_return true;
+
+			// Repeated requests for the same vector return the same object;
+			// attaching another sink would deliver each IRQ to multiple objects.
+			auto &object = device->msiObjects[req.index()];
+			if(!object) {
+				object = smarter::allocate_shared<IrqObject>(*kernelAlloc, pin->name());
+				IrqPin::attachSink(pin, object.get());
+				// Configuring the pin unmasks the vector at the device. This only happens
+				// after the sink is attached, such that we do not miss the first IRQ.
+				pin->configure({TriggerMode::edge, Polarity::high});
+			}
+
 			auto descError = co_await PushDescriptorSender{conversation, IrqDescriptor{object}};
 			// TODO: improve error handling here.
 			assert(descError == Error::success);
@@ -565,6 +607,8 @@ void checkPciFunction(PciBus *bus, uint32_t slot, uint32_t function) {
 			}
 		}
 
+		discoverMsis(device.get());
+
 		// Determine the BARs
 		for(int i = 0; i < 6; i++) {
 			uint32_t offset = kPciRegularBar0 + i * 4;
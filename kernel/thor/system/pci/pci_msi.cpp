@@ -0,0 +1,231 @@
+#include <atomic>
+#include <thor-internal/arch/paging.hpp>
+#include <thor-internal/debug.hpp>
+#include <thor-internal/kernel_heap.hpp>
+#include <thor-internal/main.hpp>
+#include <thor-internal/pci/pci.hpp>
+
+namespace thor {
+namespace pci {
+
+namespace {
+	// Fields of the MSI capability.
+	constexpr ptrdiff_t msiControl = 2;
+	constexpr ptrdiff_t msiAddressLow = 4;
+	constexpr ptrdiff_t msiAddressHigh = 8; // Only present for 64-bit capable functions.
+	constexpr ptrdiff_t msiData32 = 8;
+	constexpr ptrdiff_t msiData64 = 12;
+
+	constexpr uint16_t msiEnable = 0x0001;
+	constexpr uint16_t msiMultipleMessageEnable = 0x0070;
+	constexpr uint16_t msi64Bit = 0x0080;
+
+	// Fields of the MSI-X capability.
+	constexpr ptrdiff_t msixControl = 2;
+	constexpr ptrdiff_t msixTableLocation = 4;
+
+	constexpr uint16_t msixTableSize = 0x07FF;
+	constexpr uint16_t msixFunctionMask = 0x4000;
+	constexpr uint16_t msixEnable = 0x8000;
+
+	// Fields of MSI-X table entries.
+	constexpr size_t msixEntrySize = 16;
+	constexpr ptrdiff_t msixEntryAddressLow = 0;
+	constexpr ptrdiff_t msixEntryAddressHigh = 4;
+	constexpr ptrdiff_t msixEntryData = 8;
+	constexpr ptrdiff_t msixEntryVectorControl = 12;
+
+	constexpr uint32_t msixVectorMasked = 1;
+
+	arch::scalar_register<uint32_t> msixRegister(unsigned int index, ptrdiff_t field) {
+		return arch::scalar_register<uint32_t>{
+				static_cast<ptrdiff_t>(index * msixEntrySize) + field};
+	}
+
+	// Used to distribute MSIs over all CPUs if the driver does not request a specific CPU.
+	std::atomic<unsigned int> nextMsiCpu{0};
+
+	frg::string<KernelAlloc> buildName(PciDevice *device, unsigned int index) {
+		return frg::string<KernelAlloc>{*kernelAlloc, "pci-msi."}
+				+ frg::to_allocated_string(*kernelAlloc, device->bus)
+				+ frg::string<KernelAlloc>{*kernelAlloc, "-"}
+				+ frg::to_allocated_string(*kernelAlloc, device->slot)
+				+ frg::string<KernelAlloc>{*kernelAlloc, "-"}
+				+ frg::to_allocated_string(*kernelAlloc, device->function)
+				+ frg::string<KernelAlloc>{*kernelAlloc, "."}
+				+ frg::to_allocated_string(*kernelAlloc, index);
+	}
+
+	struct PciMsiPin final : MsiPin {
+		PciMsiPin(PciDevice *device, unsigned int index)
+		: MsiPin{buildName(device, index)}, _device{device}, _index{index} { }
+
+	protected:
+		IrqStrategy program(TriggerMode mode, Polarity polarity) override;
+
+		void mask() override;
+		void unmask() override;
+
+	private:
+		PciDevice *_device;
+		unsigned int _index;
+	};
+
+	IrqStrategy PciMsiPin::program(TriggerMode mode, Polarity polarity) {
+		auto strategy = MsiPin::program(mode, polarity);
+		auto msg = message();
+
+		if(_device->msixOffset) {
+			// The entry stays masked until the message is written.
+			_device->msixTable.store(msixRegister(_index, msixEntryAddressLow),
+					static_cast<uint32_t>(msg.address));
+			_device->msixTable.store(msixRegister(_index, msixEntryAddressHigh),
+					static_cast<uint32_t>(msg.address >> 32));
+			_device->msixTable.store(msixRegister(_index, msixEntryData), msg.data);
+			_device->msixTable.store(msixRegister(_index, msixEntryVectorControl), 0);
+		}else{
+			assert(!_index);
+			auto control = readPciHalf(_device->bus, _device->slot, _device->function,
+					_device->msiOffset + msiControl);
+			writePciWord(_device->bus, _device->slot, _device->function,
+					_device->msiOffset + msiAddressLow, static_cast<uint32_t>(msg.address));
+			if(control & msi64Bit) {
+				writePciWord(_device->bus, _device->slot, _device->function,
+						_device->msiOffset + msiAddressHigh,
+						static_cast<uint32_t>(msg.address >> 32));
+				writePciHalf(_device->bus, _device->slot, _device->function,
+						_device->msiOffset + msiData64, msg.data);
+			}else{
+				writePciHalf(_device->bus, _device->slot, _device->function,
+						_device->msiOffset + msiData32, msg.data);
+			}
+		}
+
+		return strategy;
+	}
+
+	// Plain MSIs are not masked: that would require configuration space accesses from
+	// IRQ context. Since MSIs are edge-triggered, IrqPin coalesces them anyway.
+
+	void PciMsiPin::mask() {
+		if(_device->msixOffset)
+			_device->msixTable.store(msixRegister(_index, msixEntryVectorControl),
+					msixVectorMasked);
+	}
+
+	void PciMsiPin::unmask() {
+		if(_device->msixOffset)
+			_device->msixTable.store(msixRegister(_index, msixEntryVectorControl), 0);
+	}
+
+	// Maps the MSI-X table into kernel space and masks all of its entries.
+	void setupMsixTable(PciDevice *device) {
+		auto location = readPciWord(device->bus, device->slot, device->function,
+				device->msixOffset + msixTableLocation);
+		auto bir = location & 7;
+		auto offset = location & ~uint32_t{7};
+		assert(device->bars[bir].type == PciDevice::kBarMemory);
+
+		auto physical = device->bars[bir].address + offset;
+		auto misalign = physical & (kPageSize - 1);
+		auto size = (misalign + device->numMsis * msixEntrySize + (kPageSize - 1))
+				& ~(kPageSize - 1);
+		auto window = KernelVirtualMemory::global().allocate(size);
+		for(size_t pg = 0; pg < size; pg += kPageSize)
+			KernelPageSpace::global().mapSingle4k(reinterpret_cast<VirtualAddr>(window) + pg,
+					(physical & ~(kPageSize - 1)) + pg, page_access::write, CachingMode::null);
+		device->msixTable = arch::mem_space{reinterpret_cast<char *>(window) + misalign};
+
+		for(unsigned int i = 0; i < device->numMsis; i++)
+			device->msixTable.store(msixRegister(i, msixEntryVectorControl), msixVectorMasked);
+	}
+
+	// Switches the device from INTx to MSI (or MSI-X). All vectors remain masked
+	// until they are configured.
+	void enableMsis(PciDevice *device) {
+		auto command = readPciHalf(device->bus, device->slot, device->function, kPciCommand);
+		writePciHalf(device->bus, device->slot, device->function,
+				kPciCommand, command | 0x400);
+
+		if(device->msixOffset) {
+			setupMsixTable(device);
+
+			auto control = readPciHalf(device->bus, device->slot, device->function,
+					device->msixOffset + msixControl);
+			writePciHalf(device->bus, device->slot, device->function,
+					device->msixOffset + msixControl,
+					(control | msixEnable) & ~msixFunctionMask);
+			infoLogger() << "thor: Enabled MSI-X for PCI device "
+					<< device->bus << "." << device->slot << "." << device->function
+					<< frg::endlog;
+		}else{
+			assert(device->msiOffset);
+			auto control = readPciHalf(device->bus, device->slot, device->function,
+					device->msiOffset + msiControl);
+			// We only support a single MSI vector.
+			writePciHalf(device->bus, device->slot, device->function,
+					device->msiOffset + msiControl,
+					(control | msiEnable) & ~msiMultipleMessageEnable);
+			infoLogger() << "thor: Enabled MSI for PCI device "
+					<< device->bus << "." << device->slot << "." << device->function
+					<< frg::endlog;
+		}
+
+		device->msis.resize(device->numMsis);
+		device->msiObjects.resize(device->numMsis);
+		for(unsigned int i = 0; i < device->numMsis; i++)
+			device->msis[i] = nullptr;
+		device->msisEnabled = true;
+	}
+}
+
+void discoverMsis(PciDevice *device) {
+	for(size_t i = 0; i < device->caps.size(); i++) {
+		if(device->caps[i].type == 0x05) {
+			device->msiOffset = device->caps[i].offset;
+		}else if(device->caps[i].type == 0x11) {
+			device->msixOffset = device->caps[i].offset;
+		}
+	}
+
+	if(device->msixOffset) {
+		auto control = readPciHalf(device->bus, device->slot, device->function,
+				device->msixOffset + msixControl);
+		device->numMsis = (control & msixTableSize) + 1;
+		infoLogger() << "            Supports " << device->numMsis
+				<< " MSI-X vectors" << frg::endlog;
+	}else if(device->msiOffset) {
+		device->numMsis = 1;
+	}
+}
+
+MsiPin *accessMsi(PciDevice *device, unsigned int index, int cpu) {
+	assert(index < device->numMsis);
+
+	if(device->msisEnabled && device->msis[index])
+		return device->msis[index];
+
+	// Allocate the vector before touching the device; if that fails, the device keeps using INTx.
+	auto pin = frg::construct<PciMsiPin>(*kernelAlloc, device, index);
+	bool success = false;
+	if(cpu >= 0 && cpu < getCpuCount()) {
+		success = pin->allocateVector(cpu);
+	}else{
+		auto start = nextMsiCpu.fetch_add(1, std::memory_order_relaxed);
+		for(int i = 0; i < getCpuCount() && !success; i++)
+			success = pin->allocateVector((start + i) % getCpuCount());
+	}
+	if(!success) {
+		infoLogger() << "\e[31m" "thor: Could not allocate interrupt vector for "
+				<< pin->name() << "\e[39m" << frg::endlog;
+		frg::destruct(*kernelAlloc, pin);
+		return nullptr;
+	}
+
+	if(!device->msisEnabled)
+		enableMsis(device);
+	device->msis[index] = pin;
+	return pin;
+}
+
+} } // namespace thor::pci
@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <arch/mem_space.hpp>
 #include <frg/vector.hpp>
 #include <thor-internal/framebuffer/fb.hpp>
 #include <thor-internal/irq.hpp>
@@ -129,7 +130,7 @@ struct PciDevice : PciEntity {
 	: PciEntity{parentBus_, bus, slot, function}, mbusId(0),
 			vendor(vendor), deviceId(device_id), revision(revision),
 			classCode(class_code), subClass(sub_class), interface(interface), subsystemVendor(subsystem_vendor), subsystemDevice(subsystem_device),
-			interrupt(nullptr), caps(*kernelAlloc),
+			interrupt(nullptr), caps(*kernelAlloc), msis(*kernelAlloc), msiObjects(*kernelAlloc),
 			associatedFrameBuffer(nullptr), associatedScreen(nullptr) { }
 	
 	// mbus object ID of the device
@@ -155,6 +156,21 @@ struct PciDevice : PciEntity {
 
 	frg::vector<Capability, KernelAlloc> caps;
 
+	// MSI and MSI-X support (see pci_msi.cpp).
+	// Offsets of the capabilities in configuration space (or zero if not present).
+	ptrdiff_t msiOffset = 0;
+	ptrdiff_t msixOffset = 0;
+	// Number of vectors that can be obtained via accessMsi().
+	unsigned int numMsis = 0;
+	// Set once the device is switched from INTx to MSI (or MSI-X).
+	bool msisEnabled = false;
+	// Kernel mapping of the MSI-X table.
+	arch::mem_space msixTable;
+	// Allocated vectors, indexed by vector number (entries can be nullptr).
+	frg::vector<MsiPin *, KernelAlloc> msis;
+	// IRQ objects that are attached to the vectors, handed out by ACCESS_MSI.
+	frg::vector<smarter::shared_ptr<IrqObject>, KernelAlloc> msiObjects;
+
 	// Device attachments.
 	FbInfo *associatedFrameBuffer;
 	BootScreen *associatedScreen;
@@ -188,6 +204,15 @@ extern frg::manual_box<frg::vector<smarter::shared_ptr<PciDevice>, KernelAlloc>>
 
 void enumerateSystemBusses();
 
+// Determines the MSI and MSI-X capabilities of a device during discovery.
+void discoverMsis(PciDevice *device);
+
+// Returns the IRQ of the given MSI (or MSI-X) vector of the device.
+// The first call switches the device from INTx to MSIs.
+// If cpu is negative, the vector is assigned to a CPU in round-robin fashion.
+// Returns nullptr if no interrupt vector could be allocated.
+MsiPin *accessMsi(PciDevice *device, unsigned int index, int cpu);
+
 void runAllDevices();
 
 void addToEnumerationQueue(PciBus *bus);
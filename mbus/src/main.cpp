@@ -5,6 +5,8 @@
 #include <string.h>
 #include <sys/auxv.h>
 #include <algorithm>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <unordered_map>
@@ -63,15 +65,8 @@ struct Group final : Entity {
 		return _children;
 	}
 
-	void linkObserver(std::shared_ptr<Observer> observer) {
-		_observers.insert(std::move(observer));
-	}
-
-	void processAttach(std::shared_ptr<Entity> entity);
-
 private:
 	std::unordered_set<std::shared_ptr<Entity>> _children;
-	std::unordered_set<std::shared_ptr<Observer>> _observers;
 };
 
 struct Object final : Entity {
@@ -149,16 +144,33 @@ private:
 };
 
 struct Observer {
-	explicit Observer(AnyFilter filter, helix::UniqueLane lane)
-	: _filter(std::move(filter)), _lane(std::move(lane)) { }
+	explicit Observer(std::shared_ptr<Group> group, AnyFilter filter, helix::UniqueLane lane)
+	: _group(std::move(group)), _filter(std::move(filter)), _lane(std::move(lane)) { }
 
-	async::detached traverse(std::shared_ptr<Entity> root);
+	const AnyFilter &getFilter() const {
+		return _filter;
+	}
 
-	async::detached onAttach(std::shared_ptr<Entity> entity);
+	// Returns true if the entity is in the observed subtree and matches the filter.
+	bool observes(const Entity *entity) const;
+
+	// Sends attach events for all existing entities that are observed.
+	void traverse();
+
+	void onAttach(std::shared_ptr<Entity> entity);
 
 private:
+	void _startFlush();
+	async::detached _flushAttaches();
+
+	std::shared_ptr<Group> _group;
 	AnyFilter _filter;
 	helix::UniqueLane _lane;
+
+	// Entities that still need to be sent to the client.
+	// Attach events are sent in batches by _flushAttaches().
+	std::deque<std::shared_ptr<Entity>> _pendingAttaches;
+	bool _flushing = false;
 };
 
 static bool matchesFilter(const Entity *entity, const AnyFilter &filter) {
@@ -177,15 +189,153 @@ static bool matchesFilter(const Entity *entity, const AnyFilter &filter) {
 		throw std::runtime_error("Unexpected filter");
 	}
 }
-	
-void Group::processAttach(std::shared_ptr<Entity> entity) {
-	for(auto &observer_ptr : _observers)
-		observer_ptr->onAttach(entity);
+
+// --------------------------------------------------------
+// Entity and observer indices
+// --------------------------------------------------------
+
+// Identifies a (property name, property value) pair.
+struct PropertyKey {
+	std::string name;
+	std::string value;
+
+	bool operator== (const PropertyKey &other) const {
+		return name == other.name && value == other.value;
+	}
+};
+
+struct PropertyKeyHash {
+	size_t operator() (const PropertyKey &key) const {
+		auto h = std::hash<std::string>{}(key.name);
+		return h ^ (std::hash<std::string>{}(key.value) + 0x9e3779b9 + (h << 6) + (h >> 2));
+	}
+};
+
+std::unordered_map<int64_t, std::shared_ptr<Entity>> allEntities;
+int64_t nextEntityId = 1;
+
+// Inverted index from properties to the entities that have them.
+std::unordered_map<PropertyKey, std::vector<std::shared_ptr<Entity>>,
+		PropertyKeyHash> entitiesByProperty;
+
+// Each observer whose filter contains an EqualsFilter (possibly inside conjunctions)
+// is indexed by the property of one such EqualsFilter. All other observers
+// need to be checked against all new entities.
+std::unordered_map<PropertyKey, std::vector<std::shared_ptr<Observer>>,
+		PropertyKeyHash> observersByProperty;
+std::vector<std::shared_ptr<Observer>> unindexedObservers;
+
+std::shared_ptr<Entity> getEntityById(int64_t id) {
+	auto it = allEntities.find(id);
+	if(it == allEntities.end())
+		return nullptr;
+	return it->second;
+}
+
+void indexEntity(std::shared_ptr<Entity> entity) {
+	for(auto &kv : entity->getProperties())
+		entitiesByProperty[PropertyKey{kv.first, kv.second}].push_back(entity);
+	allEntities.insert({ entity->getId(), std::move(entity) });
+}
+
+// Returns an EqualsFilter that all entities matching the filter must satisfy.
+// Returns nullptr if there is no such filter.
+static const EqualsFilter *findIndexOperand(const AnyFilter &filter) {
+	if(auto real = std::get_if<EqualsFilter>(&filter); real) {
+		return real;
+	}else if(auto real = std::get_if<Conjunction>(&filter); real) {
+		for(auto &operand : real->getOperands()) {
+			if(auto equals = findIndexOperand(operand); equals)
+				return equals;
+		}
+		return nullptr;
+	}else{
+		throw std::runtime_error("Unexpected filter");
+	}
 }
 
-async::detached Observer::traverse(std::shared_ptr<Entity> root) {
+// Returns a superset of the entities that match the filter by intersecting
+// (i.e., picking the smallest of) the posting lists of its EqualsFilters.
+// Returns nullptr if the filter cannot be resolved through the index.
+static const std::vector<std::shared_ptr<Entity>> *findCandidates(const AnyFilter &filter) {
+	static const std::vector<std::shared_ptr<Entity>> noEntities;
+
+	if(auto real = std::get_if<EqualsFilter>(&filter); real) {
+		auto it = entitiesByProperty.find(PropertyKey{real->getProperty(), real->getValue()});
+		if(it == entitiesByProperty.end())
+			return &noEntities;
+		return &it->second;
+	}else if(auto real = std::get_if<Conjunction>(&filter); real) {
+		const std::vector<std::shared_ptr<Entity>> *best = nullptr;
+		for(auto &operand : real->getOperands()) {
+			auto candidates = findCandidates(operand);
+			if(candidates && (!best || candidates->size() < best->size()))
+				best = candidates;
+		}
+		return best;
+	}else{
+		throw std::runtime_error("Unexpected filter");
+	}
+}
+
+void linkObserver(std::shared_ptr<Observer> observer) {
+	if(auto equals = findIndexOperand(observer->getFilter()); equals) {
+		observersByProperty[PropertyKey{equals->getProperty(), equals->getValue()}]
+				.push_back(std::move(observer));
+	}else{
+		unindexedObservers.push_back(std::move(observer));
+	}
+}
+
+// Issues attach events for all observers that observe the new entity.
+void processAttach(std::shared_ptr<Entity> entity) {
+	// Each observer is indexed by a single property, so it is found at most once.
+	for(auto &kv : entity->getProperties()) {
+		auto it = observersByProperty.find(PropertyKey{kv.first, kv.second});
+		if(it == observersByProperty.end())
+			continue;
+		for(auto &observer : it->second)
+			observer->onAttach(entity);
+	}
+
+	for(auto &observer : unindexedObservers)
+		observer->onAttach(entity);
+}
+
+// --------------------------------------------------------
+// Observer
+// --------------------------------------------------------
+
+// Maximal size of a batch of attach events. Clients receive batches into
+// buffers of 16 KiB; only a single entity with excessive properties may exceed this.
+constexpr size_t maxAttachBatchSize = 8192;
+
+bool Observer::observes(const Entity *entity) const {
+	if(!matchesFilter(entity, _filter))
+		return false;
+
+	// Check that the entity is in the subtree of the group.
+	if(entity == _group.get())
+		return true;
+	for(auto current = entity->getParent(); current; current = current->getParent()) {
+		if(current == _group)
+			return true;
+	}
+	return false;
+}
+
+void Observer::traverse() {
+	if(auto candidates = findCandidates(_filter); candidates) {
+		for(auto &entity : *candidates) {
+			if(observes(entity.get()))
+				_pendingAttaches.push_back(entity);
+		}
+		_startFlush();
+		return;
+	}
+
 	std::queue<std::shared_ptr<Entity>> entities;
-	entities.push(root);
+	entities.push(_group);
 	while(!entities.empty()) {
 		std::shared_ptr<Entity> entity = entities.front();
 		entities.pop();
@@ -195,18 +345,52 @@ async::detached Observer::traverse(std::shared_ptr<Entity> root) {
 				entities.push(std::move(child));
 		}
 
-		if(!matchesFilter(entity.get(), _filter)) 
-			continue;
-		
+		if(matchesFilter(entity.get(), _filter))
+			_pendingAttaches.push_back(std::move(entity));
+	}
+	_startFlush();
+}
+
+void Observer::onAttach(std::shared_ptr<Entity> entity) {
+	if(!observes(entity.get()))
+		return;
+	// If a batch is in flight, the entity is sent with the next batch.
+	_pendingAttaches.push_back(std::move(entity));
+	_startFlush();
+}
+
+void Observer::_startFlush() {
+	if(!_pendingAttaches.empty() && !_flushing) {
+		_flushing = true;
+		_flushAttaches();
+	}
+}
+
+async::detached Observer::_flushAttaches() {
+	while(!_pendingAttaches.empty()) {
 		helix::SendBuffer send_req;
 
 		managarm::mbus::SvrRequest req;
-		req.set_req_type(managarm::mbus::SvrReqType::ATTACH);
-		req.set_id(entity->getId());
-		for(auto kv : entity->getProperties()) {
-			auto entry = req.add_properties();
-			entry->set_name(kv.first);
-			entry->mutable_item()->mutable_string_item()->set_value(kv.second);
+		req.set_req_type(managarm::mbus::SvrReqType::ATTACH_BATCH);
+		size_t size = 0;
+		while(!_pendingAttaches.empty()) {
+			auto &entity = _pendingAttaches.front();
+
+			managarm::mbus::AttachedEntity msg;
+			msg.set_id(entity->getId());
+			for(auto kv : entity->getProperties()) {
+				auto entry = msg.add_properties();
+				entry->set_name(kv.first);
+				entry->mutable_item()->mutable_string_item()->set_value(kv.second);
+			}
+
+			// Account for the tag and length of the embedded message.
+			auto entrySize = msg.ByteSizeLong() + 8;
+			if(req.entities_size() && size + entrySize > maxAttachBatchSize)
+				break;
+			*req.add_entities() = std::move(msg);
+			size += entrySize;
+			_pendingAttaches.pop_front();
 		}
 
 		auto ser = req.SerializeAsString();
@@ -215,38 +399,7 @@ async::detached Observer::traverse(std::shared_ptr<Entity> root) {
 		co_await transmit.async_wait();
 		HEL_CHECK(send_req.error());
 	}
-}
-
-async::detached Observer::onAttach(std::shared_ptr<Entity> entity) {
-	if(!matchesFilter(entity.get(), _filter)) 
-		co_return;
-	
-	helix::SendBuffer send_req;
-
-	managarm::mbus::SvrRequest req;
-	req.set_req_type(managarm::mbus::SvrReqType::ATTACH);
-	req.set_id(entity->getId());
-	for(auto kv : entity->getProperties()) {
-		auto entry = req.add_properties();
-		entry->set_name(kv.first);
-		entry->mutable_item()->mutable_string_item()->set_value(kv.second);
-	}
-
-	auto ser = req.SerializeAsString();
-	auto &&transmit = helix::submitAsync(_lane, helix::Dispatcher::global(),
-			helix::action(&send_req, ser.data(), ser.size()));
-	co_await transmit.async_wait();
-	HEL_CHECK(send_req.error());
-}
-
-std::unordered_map<int64_t, std::shared_ptr<Entity>> allEntities;
-int64_t nextEntityId = 1;
-
-std::shared_ptr<Entity> getEntityById(int64_t id) {
-	auto it = allEntities.find(id);
-	if(it == allEntities.end())
-		return nullptr;
-	return it->second;
+	_flushing = false;
 }
 
 static AnyFilter decodeFilter(const managarm::mbus::AnyFilter &proto_filter) {
@@ -352,16 +505,12 @@ async::detached serve(helix::UniqueLane lane) {
 			std::tie(local_lane, remote_lane) = helix::createStream();
 			auto child = std::make_shared<Object>(nextEntityId++,
 					group, std::move(properties), std::move(local_lane));
-			allEntities.insert({ child->getId(), child });
+			indexEntity(child);
 
 			group->addChild(child);
 
 			// issue 'attach' events for all observers linked to parents of the entity.
-			std::shared_ptr<Group> current = group;
-			while(current) {
-				current->processAttach(child);
-				current = current->getParent();
-			}
+			processAttach(child);
 
 			managarm::mbus::SvrResponse resp;
 			resp.set_error(managarm::mbus::Error::SUCCESS);
@@ -397,11 +546,11 @@ async::detached serve(helix::UniqueLane lane) {
 
 			helix::UniqueLane local_lane, remote_lane;
 			std::tie(local_lane, remote_lane) = helix::createStream();
-			auto observer = std::make_shared<Observer>(decodeFilter(req.filter()),
+			auto observer = std::make_shared<Observer>(group, decodeFilter(req.filter()),
 					std::move(local_lane));
-			group->linkObserver(observer);
+			linkObserver(observer);
 
-			observer->traverse(parent);
+			observer->traverse();
 
 			managarm::mbus::SvrResponse resp;
 			resp.set_error(managarm::mbus::Error::SUCCESS);
@@ -461,7 +610,7 @@ int main() {
 
 	auto root = std::make_shared<Group>(nextEntityId++, std::weak_ptr<Group>(),
 			std::unordered_map<std::string, std::string>());
-	allEntities.insert({ root->getId(), root });
+	indexEntity(root);
 
 	unsigned long xpipe;
 	if(peekauxval(AT_XPIPE, &xpipe))
@@ -26,12 +26,25 @@ private:
 	static constexpr State statePolling = 2;
 	static constexpr State statePending = 4;
 
-	struct Item : boost::intrusive::list_base_hook<> {
+	// Items of files that support PollObservers are pushed onto the pending queue
+	// by the file itself. For all other files, we watch the file via poll().
+	struct Item : PollObserver, boost::intrusive::list_base_hook<> {
 		Item(smarter::shared_ptr<OpenFile> epoll, Process *process,
 				smarter::shared_ptr<File> file, int mask, uint64_t cookie)
 		: epoll{epoll}, state{stateActive}, process{process},
 				file{std::move(file)}, eventMask{mask}, cookie{cookie} { }
 
+		void pollEdges(int edges) override {
+			assert(state & stateActive);
+			if(disabled || !(edges & (eventMask | EPOLLERR | EPOLLHUP)))
+				return;
+			if(logEpoll)
+				std::cout << "posix.epoll \e[1;34m" << epoll->structName() << "\e[0m"
+						<< ": Item \e[1;34m" << file->structName()
+						<< "\e[0m becomes pending due to edges " << edges << std::endl;
+			epoll->_markPending(this);
+		}
+
 		smarter::shared_ptr<OpenFile> epoll;
 		State state;
 
@@ -41,10 +54,50 @@ private:
 		int eventMask;
 		uint64_t cookie;
 
+		// True if the item is registered as PollObserver of the file.
+		bool observing = false;
+
+		// EPOLLONESHOT items are disabled after they are reported until they are modified.
+		bool disabled = false;
+
 		async::cancellation_event cancelPoll;
 		expected<PollResult> pollFuture;
 	};
 
+	void _markPending(Item *item) {
+		if(item->state & statePending)
+			return;
+		item->state |= statePending;
+
+		_pendingQueue.push_back(*item);
+		_currentSeq++;
+		_statusBell.ring();
+		notifyPollObservers(EPOLLIN);
+	}
+
+	// Stops watching an item that is no longer active (or whose file was closed).
+	void _unobserve(Item *item) {
+		if(item->observing) {
+			item->file->removePollObserver(item);
+			item->observing = false;
+		}
+		if(item->state & statePolling)
+			item->cancelPoll.cancel();
+	}
+
+	// Waits for the next edge after sequence. Observed items need no action here.
+	void _watch(Item *item, uint64_t sequence) {
+		if(item->observing || (item->state & statePolling))
+			return;
+		item->state |= statePolling;
+
+		item->cancelPoll.reset();
+		item->pollFuture = item->file->poll(item->process, sequence, item->cancelPoll);
+		item->pollFuture.then([item] {
+			_awaitPoll(item);
+		});
+	}
+
 	static void _awaitPoll(Item *item) {
 		assert(item->state & statePolling);
 		auto self = item->epoll.get();
@@ -53,22 +106,18 @@ private:
 		assert(item->pollFuture.ready());
 		auto result_or_error = std::move(item->pollFuture.value());
 		item->pollFuture = expected<PollResult>{};
+		item->state &= ~statePolling;
 
 		// Discard non-active and closed items.
 		if(!(item->state & stateActive)) {
-			item->state &= ~statePolling;
-			// TODO: We might have polling + pending items in the future.
-			assert(!item->state);
-			delete item;
+			if(!item->state)
+				delete item;
 			return;
 		}
 
 		auto error = std::get_if<Error>(&result_or_error);
 		if(error) {
 			assert(*error == Error::fileClosed);
-			item->state &= ~statePolling;
-			if(!item->state)
-				delete item;
 			return;
 		}
 
@@ -76,6 +125,8 @@ private:
 		// This is the correct behavior for edge-triggered items.
 		// Level-triggered items stay pending until the event disappears.
 		auto result = std::get<PollResult>(result_or_error);
+		if(item->disabled)
+			return;
 		if(std::get<1>(result) & (item->eventMask | EPOLLERR | EPOLLHUP)) {
 			if(logEpoll)
 				std::cout << "posix.epoll \e[1;34m" << item->epoll->structName() << "\e[0m"
@@ -84,14 +135,7 @@ private:
 
 			// Note that we stop watching once an item becomes pending.
 			// We do this as we have to poll() again anyway before we report the item.
-			item->state &= ~statePolling;
-			if(!(item->state & statePending)) {
-				item->state |= statePending;
-
-				self->_pendingQueue.push_back(*item);
-				self->_currentSeq++;
-				self->_statusBell.ring();
-			}
+			self->_markPending(item);
 		}else{
 			// Here, we assume that the lambda does not execute on the current stack.
 			// TODO: Use some callback queueing mechanism to ensure this.
@@ -101,15 +145,17 @@ private:
 						<< "\e[0m still not pending after poll()."
 						<< " Mask is " << item->eventMask << ", while edges are "
 						<< std::get<1>(result) << std::endl;
-			item->cancelPoll.reset();
-			item->pollFuture = item->file->poll(item->process, std::get<0>(result),
-					item->cancelPoll);
-			item->pollFuture.then([item] {
-				_awaitPoll(item);
-			});
+			self->_watch(item, std::get<0>(result));
 		}
 	}
 
+	// Drops a pending item from the pending state (after it was dequeued).
+	void _retire(Item *item) {
+		item->state &= ~statePending;
+		if(!item->state)
+			delete item;
+	}
+
 public:
 	~OpenFile() {
 		// Nothing to do here.
@@ -123,13 +169,12 @@ public:
 		assert(_fileMap.find(file.get()) == _fileMap.end());
 		auto item = new Item{smarter::static_pointer_cast<OpenFile>(weakFile().lock()),
 				process, std::move(file), mask, cookie};
-		item->state |= statePending;
+		item->observing = item->file->addPollObserver(item);
 
 		_fileMap.insert({item->file.get(), item});
 
-		_pendingQueue.push_back(*item);
-		_currentSeq++;
-		_statusBell.ring();
+		// Check the current status of the file before waiting for edges.
+		_markPending(item);
 	}
 
 	void modifyItem(File *file, int mask, uint64_t cookie) {
@@ -143,16 +188,11 @@ public:
 
 		item->eventMask = mask;
 		item->cookie = cookie;
+		item->disabled = false;
 		item->cancelPoll.cancel();
 
 		// Mark the item as pending.
-		if(!(item->state & statePending)) {
-			item->state |= statePending;
-
-			_pendingQueue.push_back(*item);
-			_currentSeq++;
-			_statusBell.ring();
-		}
+		_markPending(item);
 	}
 
 	void deleteItem(File *file) {
@@ -164,7 +204,7 @@ public:
 		auto item = it->second;
 		assert(item->state & stateActive);
 
-		item->cancelPoll.cancel();
+		_unobserve(item);
 
 		_fileMap.erase(it);
 		item->state &= ~stateActive;
@@ -189,6 +229,7 @@ public:
 			// TODO: Stop waiting in this case.
 			assert(isOpen());
 
+			// Only items on the pending queue are checked; idle items cost nothing here.
 			while(!_pendingQueue.empty()) {
 				auto item = &_pendingQueue.front();
 				_pendingQueue.pop_front();
@@ -200,18 +241,24 @@ public:
 						std::cout << "posix.epoll \e[1;34m" << structName() << "\e[0m: Discarding"
 								" inactive item \e[1;34m" << item->file->structName() << "\e[0m"
 								<< std::endl;
-					item->state &= ~statePending;
-					if(!item->state)
-						delete item;
+					_retire(item);
 					continue;
 				}
 
 				if(logEpoll)
 					std::cout << "posix.epoll \e[1;34m" << structName() << "\e[0m: Checking item "
 							<< "\e[1;34m" << item->file->structName() << "\e[0m" << std::endl;
-				auto result_or_error = co_await item->file->checkStatus(item->process);
+				std::variant<Error, PollResult> result_or_error{Error::fileClosed};
+				if(item->file->isOpen())
+					result_or_error = co_await item->file->checkStatus(item->process);
+
+				// The item might have been deleted or disabled while we were waiting.
+				if(!(item->state & stateActive) || item->disabled) {
+					_retire(item);
+					continue;
+				}
 
-				// Discard closed items.
+				// Discard closed items. They stay in _fileMap until they are deleted.
 				auto error = std::get_if<Error>(&result_or_error);
 				if(error) {
 					assert(*error == Error::fileClosed);
@@ -219,9 +266,8 @@ public:
 						std::cout << "posix.epoll \e[1;34m" << structName() << "\e[0m: Discarding"
 								" closed item \e[1;34m" << item->file->structName() << "\e[0m"
 								<< std::endl;
-					item->state &= ~statePending;
-					if(!item->state)
-						delete item;
+					_unobserve(item);
+					_retire(item);
 					continue;
 				}
 
@@ -233,27 +279,27 @@ public:
 							<< " is active" << std::endl;
 
 				// Abort early (i.e before requeuing) if the item is not pending.
+				// Once an item is not pending anymore, we continue watching it.
 				auto status = std::get<2>(result) & (item->eventMask | EPOLLERR | EPOLLHUP);
 				if(!status) {
 					item->state &= ~statePending;
-					if(!(item->state & statePolling)) {
-						item->state |= statePolling;
-
-						// Once an item is not pending anymore, we continue watching it.
-						item->cancelPoll.reset();
-						item->pollFuture = item->file->poll(item->process, std::get<0>(result),
-								item->cancelPoll);
-						item->pollFuture.then([item] {
-							_awaitPoll(item);
-						});
-					}
+					_watch(item, std::get<0>(result));
 					continue;
 				}
 
-				// We have to increment the sequence again as concurrent waiters
-				// might have seen an empty _pendingQueue.
-				// TODO: Edge-triggered watches should not be requeued here.
-				repoll_queue.push_back(*item);
+				if(item->eventMask & EPOLLONESHOT) {
+					// Stay silent until the item is modified.
+					item->disabled = true;
+					item->state &= ~statePending;
+				}else if(item->eventMask & EPOLLET) {
+					// Edge-triggered items are only reported again after the next edge.
+					item->state &= ~statePending;
+					_watch(item, std::get<0>(result));
+				}else{
+					// We have to increment the sequence again as concurrent waiters
+					// might have seen an empty _pendingQueue.
+					repoll_queue.push_back(*item);
+				}
 
 				assert(k < max_events);
 				memset(events + k, 0, sizeof(struct epoll_event));
@@ -285,6 +331,7 @@ public:
 			_pendingQueue.splice(_pendingQueue.end(), repoll_queue);
 			_currentSeq++;
 			_statusBell.ring();
+			notifyPollObservers(EPOLLIN);
 		}
 
 		if(logEpoll)
@@ -307,8 +354,7 @@ public:
 			it = _fileMap.erase(it);
 			item->state &= ~stateActive;
 
-			if(item->state & statePolling)
-				item->cancelPoll.cancel();
+			_unobserve(item);
 
 			if(item->state & statePending) {
 				auto qit = _pendingQueue.iterator_to(*item);
@@ -352,7 +398,9 @@ public:
 	}
 
 	OpenFile()
-	: File{StructName::get("epoll"), File::defaultPipeLikeSeek}, _currentSeq{1} { }
+	: File{StructName::get("epoll"), File::defaultPipeLikeSeek}, _currentSeq{1} {
+		enablePollObservers();
+	}
 
 private:
 	helix::UniqueLane _passthrough;
@@ -17,7 +17,9 @@ namespace {
 struct OpenFile : File {
 	OpenFile(unsigned int initval, bool nonBlock)
 	: File{StructName::get("eventfd")}, _currentSeq{1}, _readableSeq{0},
-		_writeableSeq{0}, _counter{initval}, _nonBlock{nonBlock} { }
+		_writeableSeq{0}, _counter{initval}, _nonBlock{nonBlock} {
+		enablePollObservers();
+	}
 
 	~OpenFile() {
 	}
@@ -40,6 +42,7 @@ struct OpenFile : File {
 				_counter = 0;
 				_writeableSeq = ++_currentSeq;
 				_doorbell.ring();
+				notifyPollObservers(EPOLLOUT);
 				co_return 8;
 			}
 
@@ -70,6 +73,7 @@ struct OpenFile : File {
 
 		_readableSeq = ++_currentSeq;
 		_doorbell.ring();
+		notifyPollObservers(EPOLLIN);
 		co_return {};
 	}
 
@@ -227,6 +227,31 @@ public:
 		co_return;
 	}
 
+	async::result<void> fsync() override {
+		managarm::fs::CntRequest req;
+		req.set_req_type(managarm::fs::CntReqType::PT_FSYNC);
+
+		auto ser = req.SerializeAsString();
+		auto [offer, send_req, recv_resp]
+				= co_await helix_ng::exchangeMsgs(getPassthroughLane(),
+			helix_ng::offer(
+				helix_ng::sendBuffer(ser.data(), ser.size()),
+				helix_ng::recvInline()
+			)
+		);
+		HEL_CHECK(offer.error());
+		HEL_CHECK(send_req.error());
+		HEL_CHECK(recv_resp.error());
+
+		managarm::fs::SvrResponse resp;
+		resp.ParseFromArray(recv_resp.data(), recv_resp.length());
+		// Servers without fsync support have nothing to write back.
+		if(resp.error() == managarm::fs::Errors::ILLEGAL_OPERATION_TARGET)
+			co_return;
+		assert(resp.error() == managarm::fs::Errors::SUCCESS);
+		co_return;
+	}
+
 private:
 	helix::UniqueLane _control;
 	protocols::fs::File _file;
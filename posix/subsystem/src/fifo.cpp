@@ -1,9 +1,11 @@
 
+#include <fcntl.h>
+#include <limits.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <iostream>
-#include <deque>
 #include <map>
+#include <vector>
 
 #include <async/doorbell.hpp>
 #include <helix/ipc.hpp>
@@ -17,35 +19,162 @@ namespace {
 
 constexpr bool logFifos = false;
 
-struct Packet {
-	// The actual octet data that the packet consists of.
-	std::vector<char> buffer;
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ 1031
+#endif
+#ifndef F_GETPIPE_SZ
+#define F_GETPIPE_SZ 1032
+#endif
 
-	size_t offset = 0;
-};
+#ifndef PIPE_BUF
+#define PIPE_BUF 4096
+#endif
+
+// Writes of at most PIPE_BUF bytes are never interleaved with other writes.
+constexpr size_t atomicWriteSize = PIPE_BUF;
+// Capacities are always powers of two; this matches Linux' defaults.
+constexpr size_t defaultCapacity = 16 * 4096;
+constexpr size_t maxCapacity = 1024 * 1024;
 
 struct Channel {
 	Channel()
-	: writerCount{0}, readerCount{0} { }
+	: writerCount{0}, readerCount{0}, ring(defaultCapacity) { }
 
 	// Status management for poll().
 	async::doorbell statusBell;
-	// Start at currentSeq = 1 since the pipe is always writable.
+	// Start at currentSeq = 1 since the pipe is initially writable.
 	uint64_t currentSeq = 1;
 	uint64_t noWriterSeq = 0;
 	uint64_t noReaderSeq = 0;
 	uint64_t inSeq = 0;
+	uint64_t outSeq = 1;
 	int writerCount;
 	int readerCount;
 
 	async::doorbell readerPresent;
 	async::doorbell writerPresent;
 
-	// The actual queue of this pipe.
-	std::deque<Packet> packetQueue;
+	size_t capacity() {
+		return ring.size();
+	}
+
+	size_t bytesQueued() {
+		return tail - head;
+	}
+
+	size_t bytesFree() {
+		return capacity() - bytesQueued();
+	}
+
+	// Appends data to the ring. The caller ensures that there is enough space.
+	void push(const void *data, size_t length) {
+		assert(length <= bytesFree());
+		auto p = reinterpret_cast<const char *>(data);
+		size_t offset = tail & (capacity() - 1);
+		size_t chunk = std::min(length, capacity() - offset);
+		memcpy(ring.data() + offset, p, chunk);
+		memcpy(ring.data(), p + chunk, length - chunk);
+		tail += length;
+	}
+
+	// Removes data from the ring. The caller ensures that enough data is queued.
+	void pop(void *data, size_t length) {
+		assert(length <= bytesQueued());
+		auto p = reinterpret_cast<char *>(data);
+		size_t offset = head & (capacity() - 1);
+		size_t chunk = std::min(length, capacity() - offset);
+		memcpy(p, ring.data() + offset, chunk);
+		memcpy(p + chunk, ring.data(), length - chunk);
+		head += length;
+	}
+
+	// Changes the capacity of the ring while preserving its contents.
+	void resize(size_t newCapacity) {
+		assert(newCapacity >= bytesQueued());
+		std::vector<char> newRing(newCapacity);
+		size_t length = bytesQueued();
+		pop(newRing.data(), length);
+		ring = std::move(newRing);
+		head = 0;
+		tail = length;
+	}
+
+	// The actual data of this pipe. head and tail are free-running byte counters;
+	// the ring's size is a power of two such that they can be masked.
+	std::vector<char> ring;
+	size_t head = 0;
+	size_t tail = 0;
 };
 
-struct ReaderFile : File {
+// Implements F_SETPIPE_SZ. Sizes are rounded up to a power of two of at least one page.
+// Like Linux, fails with EPERM above the maximal size and with EBUSY if the pipe
+// cannot be resized without losing data.
+protocols::fs::Error resizeChannel(Channel &channel, int value) {
+	if(value < 0)
+		return protocols::fs::Error::illegalArguments;
+	if(static_cast<size_t>(value) > maxCapacity)
+		return protocols::fs::Error::insufficientPermissions;
+
+	size_t capacity = 4096;
+	while(capacity < static_cast<size_t>(value))
+		capacity <<= 1;
+	if(capacity == channel.capacity())
+		return protocols::fs::Error::none;
+	if(capacity < channel.bytesQueued())
+		return protocols::fs::Error::resourceBusy;
+
+	channel.resize(capacity);
+	if(channel.bytesFree() >= atomicWriteSize)
+		channel.outSeq = ++channel.currentSeq;
+	channel.statusBell.ring();
+	return protocols::fs::Error::none;
+}
+
+// Operations that are common to both ends of the pipe.
+struct PipeFile : File {
+	PipeFile(StructName structName, std::shared_ptr<MountView> mount,
+			std::shared_ptr<FsLink> link, bool nonBlock)
+	: File{structName, mount, link, File::defaultPipeLikeSeek}, nonBlock_{nonBlock} { }
+
+	async::result<int> getOption(int option) override {
+		assert(option == F_GETPIPE_SZ);
+		co_return _channel->capacity();
+	}
+
+	async::result<protocols::fs::Error> setOption(int option, int value) override {
+		assert(option == F_SETPIPE_SZ);
+		co_return resizeChannel(*_channel, value);
+	}
+
+	async::result<void> setFileFlags(int flags) override {
+		if(flags & ~O_NONBLOCK) {
+			std::cout << "posix: setFileFlags on fifo \e[1;34m" << structName()
+					<< "\e[0m called with unknown flags" << std::endl;
+			co_return;
+		}
+		nonBlock_ = flags & O_NONBLOCK;
+		co_return;
+	}
+
+	async::result<int> getFileFlags() override {
+		if(nonBlock_)
+			co_return O_NONBLOCK;
+		co_return 0;
+	}
+
+	helix::BorrowedDescriptor getPassthroughLane() override {
+		return _passthrough;
+	}
+
+protected:
+	helix::UniqueLane _passthrough;
+
+	std::shared_ptr<Channel> _channel;
+
+	bool nonBlock_;
+};
+
+struct ReaderFile : PipeFile {
 public:
 	static void serve(smarter::shared_ptr<ReaderFile> file) {
 //TODO:		assert(!file->_passthrough);
@@ -56,8 +185,9 @@ public:
 				smarter::shared_ptr<File>{file}, &File::fileOperations));
 	}
 
-	ReaderFile(std::shared_ptr<MountView> mount, std::shared_ptr<FsLink> link)
-	: File{StructName::get("fifo.read"), mount, link, File::defaultPipeLikeSeek} { }
+	ReaderFile(std::shared_ptr<MountView> mount, std::shared_ptr<FsLink> link,
+			bool nonBlock = false)
+	: PipeFile{StructName::get("fifo.read"), mount, link, nonBlock} { }
 
 	void connectChannel(std::shared_ptr<Channel> channel) {
 		assert(!_channel);
@@ -80,22 +210,27 @@ public:
 		if(!maxLength)
 			co_return 0;
 
-		while(_channel->packetQueue.empty() && _channel->writerCount)
+		if(!_channel->bytesQueued() && _channel->writerCount && nonBlock_) {
+			if(logFifos)
+				std::cout << "posix: Pipe read would block" << std::endl;
+			co_return Error::wouldBlock;
+		}
+
+		while(!_channel->bytesQueued() && _channel->writerCount)
 			co_await _channel->statusBell.async_wait();
 
-		if(_channel->packetQueue.empty()) {
+		if(!_channel->bytesQueued()) {
 			assert(!_channel->writerCount);
 			co_return 0;
 		}
 
-		// TODO: Truncate packets (for SOCK_DGRAM) here.
-		auto packet = &_channel->packetQueue.front();
-		size_t chunk = std::min(packet->buffer.size() - packet->offset, maxLength);
+		// Drain as much as possible, even if that spans multiple writes.
+		size_t chunk = std::min(_channel->bytesQueued(), maxLength);
 		assert(chunk); // Otherwise we return above since !maxLength.
-		memcpy(data, packet->buffer.data() + packet->offset, chunk);
-		packet->offset += chunk;
-		if(packet->offset == packet->buffer.size())
-			_channel->packetQueue.pop_front();
+		_channel->pop(data, chunk);
+		if(_channel->bytesFree() >= atomicWriteSize)
+			_channel->outSeq = ++_channel->currentSeq;
+		_channel->statusBell.ring(); // Wake up blocked writers.
 		co_return chunk;
 	}
 
@@ -119,23 +254,14 @@ public:
 		int events = 0;
 		if(!_channel->writerCount)
 			events |= EPOLLHUP;
-		if(!_channel->packetQueue.empty())
+		if(_channel->bytesQueued())
 			events |= EPOLLIN;
 
 		co_return PollResult(_channel->currentSeq, edges, events);
 	}
-
-	helix::BorrowedDescriptor getPassthroughLane() override {
-		return _passthrough;
-	}
-
-private:
-	helix::UniqueLane _passthrough;
-
-	std::shared_ptr<Channel> _channel;
 };
 
-struct WriterFile : File {
+struct WriterFile : PipeFile {
 public:
 	static void serve(smarter::shared_ptr<WriterFile> file) {
 //TODO:		assert(!file->_passthrough);
@@ -146,8 +272,9 @@ public:
 				smarter::shared_ptr<File>{file}, &File::fileOperations));
 	}
 
-	WriterFile(std::shared_ptr<MountView> mount, std::shared_ptr<FsLink> link)
-	: File{StructName::get("fifo.write"), mount, link, File::defaultPipeLikeSeek} { }
+	WriterFile(std::shared_ptr<MountView> mount, std::shared_ptr<FsLink> link,
+			bool nonBlock = false)
+	: PipeFile{StructName::get("fifo.write"), mount, link, nonBlock} { }
 
 	void connectChannel(std::shared_ptr<Channel> channel) {
 		assert(!_channel);
@@ -165,17 +292,41 @@ public:
 		_channel = nullptr;
 	}
 
-	async::result<frg::expected<Error>>
-	writeAll(Process *process, const void *data, size_t maxLength) override {
-		Packet packet;
-		packet.buffer.resize(maxLength);
-		memcpy(packet.buffer.data(), data, maxLength);
-		packet.offset = 0;
-
-		_channel->packetQueue.push_back(std::move(packet));
-		_channel->inSeq = ++_channel->currentSeq;
-		_channel->statusBell.ring();
-		co_return {};
+	async::result<frg::expected<Error, size_t>>
+	writeSome(Process *, const void *data, size_t length) override {
+		if(logFifos)
+			std::cout << "posix: Write to pipe " << this << std::endl;
+		auto p = reinterpret_cast<const char *>(data);
+
+		// Small writes are atomic: wait until they fit into the ring as a whole.
+		// Larger writes are split into chunks whenever space becomes available.
+		size_t required = (length <= atomicWriteSize) ? length : 1;
+
+		if(_channel->readerCount && _channel->bytesFree() < required && nonBlock_) {
+			if(logFifos)
+				std::cout << "posix: Pipe write would block" << std::endl;
+			co_return Error::wouldBlock;
+		}
+
+		// Non-blocking writes larger than PIPE_BUF return a short count
+		// once they made progress and the ring is full.
+		size_t progress = 0;
+		while(progress < length) {
+			if(progress && nonBlock_ && _channel->bytesFree() < required)
+				break;
+			while(_channel->readerCount && _channel->bytesFree() < required)
+				co_await _channel->statusBell.async_wait();
+
+			if(!_channel->readerCount)
+				co_return Error::brokenPipe;
+
+			size_t chunk = std::min(_channel->bytesFree(), length - progress);
+			_channel->push(p + progress, chunk);
+			_channel->inSeq = ++_channel->currentSeq;
+			_channel->statusBell.ring(); // Wake up blocked readers.
+			progress += chunk;
+		}
+		co_return progress;
 	}
 
 	expected<PollResult> poll(Process *, uint64_t pastSeq,
@@ -189,25 +340,20 @@ public:
 		if(cancellation.is_cancellation_requested())
 			std::cout << "\e[33mposix: fifo::poll() cancellation is untested\e[39m" << std::endl;
 
-		int edges = EPOLLOUT;
+		int edges = 0;
 		if(_channel->noReaderSeq > pastSeq)
 			edges |= EPOLLERR;
+		if(_channel->outSeq > pastSeq)
+			edges |= EPOLLOUT;
 
-		int events = EPOLLOUT;
+		int events = 0;
 		if(!_channel->readerCount)
 			events |= EPOLLERR;
+		if(_channel->bytesFree() >= atomicWriteSize)
+			events |= EPOLLOUT;
 
 		co_return PollResult(_channel->currentSeq, edges, events);
 	}
-
-	helix::BorrowedDescriptor getPassthroughLane() override {
-		return _passthrough;
-	}
-
-private:
-	helix::UniqueLane _passthrough;
-
-	std::shared_ptr<Channel> _channel;
 };
 
 } // anonymous namespace
@@ -235,7 +381,8 @@ openNamedChannel(std::shared_ptr<MountView> mount, std::shared_ptr<FsLink> link,
 	if (flags & semanticRead) {
 		assert(!(flags & semanticWrite));
 
-		auto r_file = smarter::make_shared<ReaderFile>(mount, link);
+		auto r_file = smarter::make_shared<ReaderFile>(mount, link,
+				flags & semanticNonBlock);
 		r_file->setupWeakFile(r_file);
 		r_file->connectChannel(channel);
 
@@ -250,7 +397,8 @@ openNamedChannel(std::shared_ptr<MountView> mount, std::shared_ptr<FsLink> link,
 		assert(flags & semanticWrite);
 		assert(!(flags & semanticRead));
 
-		auto w_file = smarter::make_shared<WriterFile>(mount, link);
+		auto w_file = smarter::make_shared<WriterFile>(mount, link,
+				flags & semanticNonBlock);
 		w_file->setupWeakFile(w_file);
 		w_file->connectChannel(channel);
 
@@ -264,11 +412,11 @@ openNamedChannel(std::shared_ptr<MountView> mount, std::shared_ptr<FsLink> link,
 	}
 }
 
-std::array<smarter::shared_ptr<File, FileHandle>, 2> createPair() {
+std::array<smarter::shared_ptr<File, FileHandle>, 2> createPair(bool nonBlock) {
 	auto link = SpecialLink::makeSpecialLink(VfsType::fifo, 0777);
 	auto channel = std::make_shared<Channel>();
-	auto r_file = smarter::make_shared<ReaderFile>(nullptr, link);
-	auto w_file = smarter::make_shared<WriterFile>(nullptr, link);
+	auto r_file = smarter::make_shared<ReaderFile>(nullptr, link, nonBlock);
+	auto w_file = smarter::make_shared<WriterFile>(nullptr, link, nonBlock);
 	r_file->setupWeakFile(r_file);
 	w_file->setupWeakFile(w_file);
 	r_file->connectChannel(channel);
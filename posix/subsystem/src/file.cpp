@@ -75,12 +75,25 @@ File::ptRead(void *object, const char *credentials,
 	}
 }
 
-async::result<void> File::ptWrite(void *object, const char *credentials,
-		const void *buffer, size_t length) {
+async::result<frg::expected<protocols::fs::Error, size_t>> File::ptWrite(void *object,
+		const char *credentials, const void *buffer, size_t length) {
 	auto self = static_cast<File *>(object);
 	auto process = findProcessWithCredentials(credentials);
-	auto result = co_await self->writeAll(process.get(), buffer, length);
-	assert(result || "Unexpected error from writeAll()");
+	auto result = co_await self->writeSome(process.get(), buffer, length);
+	if(!result) {
+		switch(result.error()) {
+		case Error::illegalOperationTarget:
+			co_return protocols::fs::Error::illegalArguments;
+		case Error::wouldBlock:
+			co_return protocols::fs::Error::wouldBlock;
+		case Error::brokenPipe:
+			co_return protocols::fs::Error::brokenPipe;
+		default:
+			assert(!"Unexpected error from writeSome()");
+			__builtin_unreachable();
+		}
+	}
+	co_return result.value();
 }
 
 async::result<ReadEntriesResult> File::ptReadEntries(void *object) {
@@ -93,6 +106,11 @@ async::result<void> File::ptTruncate(void *object, size_t size) {
 	return self->truncate(size);
 }
 
+async::result<void> File::ptFsync(void *object) {
+	auto self = static_cast<File *>(object);
+	return self->fsync();
+}
+
 async::result<void> File::ptAllocate(void *object,
 		int64_t offset, size_t size) {
 	auto self = static_cast<File *>(object);
@@ -104,7 +122,7 @@ async::result<int> File::ptGetOption(void *object, int option) {
 	return self->getOption(option);
 }
 
-async::result<void> File::ptSetOption(void *object, int option, int value) {
+async::result<protocols::fs::Error> File::ptSetOption(void *object, int option, int value) {
 	auto self = static_cast<File *>(object);
 	return self->setOption(option, value);
 }
@@ -245,6 +263,14 @@ async::result<frg::expected<Error>> File::writeAll(Process *, const void *, size
 	throw std::runtime_error("posix: Object has no File::writeAll()");
 }
 
+async::result<frg::expected<Error, size_t>>
+File::writeSome(Process *process, const void *data, size_t length) {
+	auto result = co_await writeAll(process, data, length);
+	if(!result)
+		co_return result.error();
+	co_return length;
+}
+
 async::result<ReadEntriesResult> File::readEntries() {
 	throw std::runtime_error("posix: Object has no File::readEntries()");
 }
@@ -269,6 +295,11 @@ async::result<void> File::truncate(size_t) {
 	throw std::runtime_error("posix: Object has no File::truncate()");
 }
 
+async::result<void> File::fsync() {
+	// Files that are not backed by storage have nothing to write back.
+	co_return;
+}
+
 async::result<void> File::allocate(int64_t, size_t) {
 	throw std::runtime_error("posix: Object has no File::allocate()");
 }
@@ -295,13 +326,30 @@ expected<PollResult> File::checkStatus(Process *process) {
 	return poll(process, 0, async::cancellation_token{});
 }
 
+bool File::addPollObserver(PollObserver *observer) {
+	if(!_pollObservable)
+		return false;
+	_pollObservers.push_back(*observer);
+	return true;
+}
+
+void File::removePollObserver(PollObserver *observer) {
+	assert(_pollObservable);
+	_pollObservers.erase(_pollObservers.iterator_to(*observer));
+}
+
+void File::notifyPollObservers(int edges) {
+	for(auto &observer : _pollObservers)
+		observer.pollEdges(edges);
+}
+
 async::result<int> File::getOption(int) {
 	std::cout << "posix \e[1;34m" << structName()
 			<< "\e[0m: Object does not implement getOption()" << std::endl;
 	throw std::runtime_error("posix: Object has no File::getOption()");
 }
 
-async::result<void> File::setOption(int, int) {
+async::result<protocols::fs::Error> File::setOption(int, int) {
 	std::cout << "posix \e[1;34m" << structName()
 			<< "\e[0m: Object does not implement setOption()" << std::endl;
 	throw std::runtime_error("posix: Object has no File::setOption()");
@@ -3,9 +3,11 @@
 
 #include <variant>
 #include <string.h> // for hel.h
+#include <sys/epoll.h>
 #include <vector>
 
 #include <async/result.hpp>
+#include <boost/intrusive/list.hpp>
 #include <boost/intrusive/rbtree.hpp>
 #include <frg/expected.hpp>
 #include <hel.h>
@@ -74,6 +76,17 @@ using PollResult = std::tuple<uint64_t, int, int>;
 
 using AcceptResult = smarter::shared_ptr<File, FileHandle>;
 
+// Receives the poll() edges of a file as they happen (see File::addPollObserver()).
+struct PollObserver {
+	// Called synchronously by the file; must not re-enter the file.
+	virtual void pollEdges(int edges) = 0;
+
+	boost::intrusive::list_member_hook<> pollObserverHook;
+
+protected:
+	~PollObserver() = default;
+};
+
 struct DisposeFileHandle { };
 
 struct File : private smarter::crtp_counter<File, DisposeFileHandle> {
@@ -102,7 +115,7 @@ public:
 	static async::result<protocols::fs::ReadResult>
 	ptRead(void *object, const char *credentials, void *buffer, size_t length);
 
-	static async::result<void>
+	static async::result<frg::expected<protocols::fs::Error, size_t>>
 	ptWrite(void *object, const char *credentials, const void *buffer, size_t length);
 
 	static async::result<protocols::fs::ReadEntriesResult>
@@ -111,13 +124,16 @@ public:
 	static async::result<void>
 	ptTruncate(void *object, size_t size);
 
+	static async::result<void>
+	ptFsync(void *object);
+
 	static async::result<void>
 	ptAllocate(void *object, int64_t offset, size_t size);
 
 	static async::result<int>
 	ptGetOption(void *object, int option);
 
-	static async::result<void>
+	static async::result<protocols::fs::Error>
 	ptSetOption(void *object, int option, int value);
 
 	static async::result<protocols::fs::Error>
@@ -168,6 +184,7 @@ public:
 		.write = &ptWrite,
 		.readEntries = &ptReadEntries,
 		.truncate = &ptTruncate,
+		.fsync = &ptFsync,
 		.fallocate = &ptAllocate,
 		.ioctl = &ptIoctl,
 		.getOption = &ptGetOption,
@@ -227,6 +244,9 @@ private:
 	void dispose(DisposeFileHandle) {
 		_isOpen = false;
 		handleClose();
+
+		// Observers see closed files as hung up; poll() reports Error::fileClosed.
+		notifyPollObservers(EPOLLHUP);
 	}
 
 public:
@@ -259,6 +279,11 @@ public:
 	virtual async::result<frg::expected<Error>>
 	writeAll(Process *process, const void *data, size_t length);
 
+	// Like writeAll() but may return early (e.g., for non-blocking files).
+	// Returns the number of bytes that were written. Defaults to writeAll().
+	virtual async::result<frg::expected<Error, size_t>>
+	writeSome(Process *process, const void *data, size_t length);
+
 	virtual FutureMaybe<ReadEntriesResult> readEntries();
 
 	virtual async::result<protocols::fs::RecvResult>
@@ -274,6 +299,9 @@ public:
 
 	virtual async::result<void> truncate(size_t size);
 
+	// Writes dirty data of the file back to its storage.
+	virtual async::result<void> fsync();
+
 	virtual async::result<void> allocate(int64_t offset, size_t size);
 
 	// poll() uses a sequence number mechansim for synchronization.
@@ -287,8 +315,23 @@ public:
 	// Like poll, but only checks the current state. Does not return edges.
 	virtual expected<PollResult> checkStatus(Process *);
 
+	// Registers an observer that is notified of every edge that poll() would report.
+	// Returns false if the file does not support observers; callers have to poll() instead.
+	bool addPollObserver(PollObserver *observer);
+	void removePollObserver(PollObserver *observer);
+
+protected:
+	// Files that call notifyPollObservers() on every edge enable observers in their constructor.
+	void enablePollObservers() {
+		_pollObservable = true;
+	}
+
+	void notifyPollObservers(int edges);
+
+public:
+
 	virtual async::result<int> getOption(int option);
-	virtual async::result<void> setOption(int option, int value);
+	virtual async::result<protocols::fs::Error> setOption(int option, int value);
 
 	virtual async::result<frg::expected<Error, AcceptResult>> accept(Process *process);
 
@@ -323,6 +366,16 @@ private:
 	DefaultOps _defaultOps;
 
 	bool _isOpen;
+
+	bool _pollObservable = false;
+	boost::intrusive::list<
+		PollObserver,
+		boost::intrusive::member_hook<
+			PollObserver,
+			boost::intrusive::list_member_hook<>,
+			&PollObserver::pollObserverHook
+		>
+	> _pollObservers;
 };
 
 #endif // POSIX_SUBSYSTEM_FILE_HPP
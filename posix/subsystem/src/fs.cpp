@@ -32,21 +32,37 @@ std::shared_ptr<FsLink> FsNode::treeLink() {
 	throw std::runtime_error("treeLink() is not implemented for this FsNode");
 }
 
-void FsNode::addObserver(std::shared_ptr<FsObserver> observer) {
+void FsNode::addObserver(std::shared_ptr<FsObserver> observer, uint32_t events) {
 	if(!(_defaultOps & defaultSupportsObservers))
 		std::cout << "\e[31m" "posix: FsNode does not support observers" "\e[39m" << std::endl;
 
-	// TODO: For increased efficiency, Observers could be stored in an intrusive list.
 	auto borrowed = observer.get();
-	auto [it, inserted] = _observers.insert({borrowed, std::move(observer)});
+	auto [it, inserted] = _observers.insert({borrowed, ObserverEntry{std::move(observer), events}});
 	(void)it;
 	assert(inserted); // Registering observers twice is an error.
+	_observedEvents |= events;
+}
+
+void FsNode::updateObserver(FsObserver *observer, uint32_t events) {
+	auto it = _observers.find(observer);
+	assert(it != _observers.end());
+	it->second.events = events;
+	_updateObservedEvents();
 }
 
 void FsNode::removeObserver(FsObserver *observer) {
 	auto it = _observers.find(observer);
 	assert(it != _observers.end());
 	_observers.erase(it);
+	_updateObservedEvents();
+}
+
+void FsNode::_updateObservedEvents() {
+	_observedEvents = 0;
+	for(const auto &[borrowed, entry] : _observers) {
+		_observedEvents |= entry.events;
+		(void)borrowed;
+	}
 }
 
 async::result<frg::expected<Error, std::shared_ptr<FsLink>>> FsNode::getLink(std::string) {
@@ -126,9 +142,17 @@ async::result<frg::expected<Error, std::shared_ptr<FsLink>>> FsNode::mksocket(st
 
 void FsNode::notifyObservers(uint32_t events, const std::string &name, uint32_t cookie) {
 	assert(_defaultOps & defaultSupportsObservers);
-	for(const auto &[borrowed, observer] : _observers) {
-		borrowed->observeNotification(events, name, cookie);
-		(void)observer;
+	if(!(events & _observedEvents))
+		return;
+
+	// Observers may remove themselves (or others) while they are notified.
+	std::vector<std::shared_ptr<FsObserver>> observers;
+	for(const auto &[borrowed, entry] : _observers) {
+		if(entry.events & events)
+			observers.push_back(entry.observer);
+		(void)borrowed;
 	}
+	for(const auto &observer : observers)
+		observer->observeNotification(events, name, cookie);
 }
 
@@ -76,6 +76,7 @@ protected:
 
 public:
 	static constexpr uint32_t deleteEvent = 1;
+	static constexpr uint32_t createEvent = 2;
 
 	virtual void observeNotification(uint32_t events,
 			const std::string &name, uint32_t cookie) = 0;
@@ -119,7 +120,10 @@ public:
 	// that links this directory from its parent.
 	virtual std::shared_ptr<FsLink> treeLink();
 
-	virtual void addObserver(std::shared_ptr<FsObserver> observer);
+	// Observers are only notified of the given events.
+	virtual void addObserver(std::shared_ptr<FsObserver> observer, uint32_t events);
+
+	virtual void updateObserver(FsObserver *observer, uint32_t events);
 
 	virtual void removeObserver(FsObserver *observer);
 
@@ -181,8 +185,17 @@ private:
 	FsSuperblock *_superblock;
 	DefaultOps _defaultOps;
 
+	struct ObserverEntry {
+		std::shared_ptr<FsObserver> observer;
+		uint32_t events;
+	};
+
+	void _updateObservedEvents();
+
 	// Observers, for example for inotify.
-	std::unordered_map<FsObserver *, std::shared_ptr<FsObserver>> _observers;
+	std::unordered_map<FsObserver *, ObserverEntry> _observers;
+	// Union of the events of all observers. Allows us to skip notifications quickly.
+	uint32_t _observedEvents = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -1,7 +1,10 @@
+#include <limits.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/inotify.h>
+#include <algorithm>
 #include <iostream>
+#include <map>
 
 #include <async/doorbell.hpp>
 #include <helix/ipc.hpp>
@@ -14,32 +17,54 @@ namespace inotify {
 
 namespace {
 
+bool logInotify = false;
+
+// Size of the per-instance event queue (in bytes). Must be a power of two.
+// Events are stored in the ring in the same format that read() returns.
+constexpr size_t ringCapacity = 64 * 1024;
+
+// Watch mask bits that we support.
+constexpr uint32_t supportedMask = IN_CREATE | IN_DELETE | IN_ONESHOT | IN_MASK_ADD;
+
+uint32_t observedEventsOf(uint32_t mask) {
+	uint32_t events = 0;
+	if(mask & IN_CREATE)
+		events |= FsObserver::createEvent;
+	if(mask & IN_DELETE)
+		events |= FsObserver::deleteEvent;
+	return events;
+}
+
+// Names are padded with null bytes to keep events aligned.
+size_t paddedNameLength(const std::string &name) {
+	if(name.empty())
+		return 0;
+	return (name.size() + sizeof(inotify_event)) & ~(sizeof(inotify_event) - 1);
+}
+
 struct OpenFile : File {
 public:
-	struct Packet {
-		int descriptor;
-		uint32_t events;
-		std::string name;
-		uint32_t cookie;
-	};
-
 	struct Watch final : FsObserver {
-		Watch(OpenFile *file_, int descriptor, uint32_t mask)
-		: file{file_}, descriptor{descriptor}, mask{mask} { }
+		Watch(OpenFile *file_, std::shared_ptr<FsNode> node, int descriptor, uint32_t mask)
+		: file{file_}, node{std::move(node)}, descriptor{descriptor}, mask{mask} { }
 
 		void observeNotification(uint32_t events,
 				const std::string &name, uint32_t cookie) override {
 			uint32_t inotifyEvents = 0;
+			if(events & FsObserver::createEvent)
+				inotifyEvents |= IN_CREATE;
 			if(events & FsObserver::deleteEvent)
 				inotifyEvents |= IN_DELETE;
 			if(!(inotifyEvents & mask))
 				return;
-			file->_queue.push_back(Packet{descriptor, inotifyEvents & mask, name, cookie});
-			file->_inSeq = ++file->_currentSeq;
-			file->_statusBell.ring();
+			file->_postEvent(descriptor, inotifyEvents & mask, name, cookie);
+
+			if(mask & IN_ONESHOT)
+				file->_removeWatch(descriptor);
 		}
 
 		OpenFile *file;
+		std::shared_ptr<FsNode> node;
 		int descriptor;
 		uint32_t mask;
 	};
@@ -52,33 +77,46 @@ public:
 	}
 
 	OpenFile()
-	: File{StructName::get("inotify")} { }
+	: File{StructName::get("inotify")}, _ring(ringCapacity) {
+		enablePollObservers();
+	}
 
-	~OpenFile() {
-		// TODO: Properly keep track of watches.
-		std::cout << "\e[31m" "posix: Destruction of inotify leaks watches" "\e[39m" << std::endl;
+	void handleClose() override {
+		// Nodes keep references to their watches; break them up.
+		for(auto &[descriptor, watch] : _watches) {
+			watch->node->removeObserver(watch.get());
+			(void)descriptor;
+		}
+		_watches.clear();
+		_watchesByNode.clear();
+		_statusBell.ring();
 	}
 
 	async::result<frg::expected<Error, size_t>>
 	readSome(Process *, void *data, size_t maxLength) override {
-		// TODO: As an optimization, we could return multiple events at the same time.
-		Packet packet = std::move(_queue.front());
-		_queue.pop_front();
+		while(_head == _tail) {
+			if(!isOpen())
+				co_return Error::fileClosed;
+			co_await _statusBell.async_wait();
+		}
 
-		if(maxLength < sizeof(inotify_event) + packet.name.size() + 1)
-			co_return Error::illegalArguments;
+		// Return as many complete events as fit into the buffer.
+		auto p = reinterpret_cast<char *>(data);
+		size_t progress = 0;
+		while(_head != _tail) {
+			inotify_event e;
+			_copyOut(_head, &e, sizeof(inotify_event));
+			auto size = sizeof(inotify_event) + e.len;
+			if(progress + size > maxLength)
+				break;
+			_copyOut(_head, p + progress, size);
+			_head += size;
+			progress += size;
+		}
 
-		inotify_event e;
-		memset(&e, 0, sizeof(inotify_event));
-		e.wd = packet.descriptor;
-		e.mask = packet.events;
-		e.cookie = packet.cookie;
-		e.len = packet.name.size();
-
-		memcpy(data, &e, sizeof(inotify_event));
-		memcpy(reinterpret_cast<char *>(data) + sizeof(inotify_event),
-				packet.name.c_str(), packet.name.size() + 1);
-		co_return sizeof(inotify_event) + packet.name.size() + 1;
+		if(!progress)
+			co_return Error::illegalArguments;
+		co_return progress;
 	}
 
 	expected<PollResult> poll(Process *, uint64_t sequence, async::cancellation_token cancellation) override {
@@ -94,7 +132,7 @@ public:
 			edges |= EPOLLIN;
 
 		int events = 0;
-		if(!_queue.empty())
+		if(_head != _tail)
 			events |= EPOLLIN;
 
 		co_return PollResult(_currentSeq, edges, events);
@@ -105,18 +143,133 @@ public:
 	}
 
 	int addWatch(std::shared_ptr<FsNode> node, uint32_t mask) {
-		// TODO: Coalesce watch descriptors for the same inode.
-		if(mask & ~(IN_DELETE))
+		if(mask & ~supportedMask)
 			std::cout << "posix: inotify mask " << mask << " is partially ignored" << std::endl;
+
+		// Watches for the same node share their descriptor.
+		if(auto it = _watchesByNode.find(node.get()); it != _watchesByNode.end()) {
+			auto watch = it->second;
+			if(mask & IN_MASK_ADD)
+				watch->mask |= mask & ~IN_MASK_ADD;
+			else
+				watch->mask = mask;
+			node->updateObserver(watch.get(), observedEventsOf(watch->mask));
+			return watch->descriptor;
+		}
+
 		auto descriptor = _nextDescriptor++;
-		auto watch = std::make_shared<Watch>(this, descriptor, mask);
-		node->addObserver(watch);
+		auto watch = std::make_shared<Watch>(this, node, descriptor, mask & ~IN_MASK_ADD);
+		node->addObserver(watch, observedEventsOf(watch->mask));
+		_watches.insert({descriptor, watch});
+		_watchesByNode.insert({node.get(), watch});
 		return descriptor;
 	}
 
+	bool removeWatch(int descriptor) {
+		if(_watches.find(descriptor) == _watches.end())
+			return false;
+		_removeWatch(descriptor);
+		return true;
+	}
+
 private:
+	void _removeWatch(int descriptor) {
+		auto it = _watches.find(descriptor);
+		assert(it != _watches.end());
+		auto watch = it->second;
+		watch->node->removeObserver(watch.get());
+		_watchesByNode.erase(watch->node.get());
+		_watches.erase(it);
+
+		_postEvent(descriptor, IN_IGNORED, {}, 0);
+	}
+
+	void _postEvent(int descriptor, uint32_t mask, const std::string &name, uint32_t cookie) {
+		if(logInotify)
+			std::cout << "posix: inotify event " << mask << " on watch " << descriptor
+					<< " for '" << name << "'" << std::endl;
+
+		// Like Linux, coalesce identical consecutive events that have not been read yet.
+		if(_head != _tail && _isLastEvent(descriptor, mask, name, cookie))
+			return;
+
+		// Keep space for an IN_Q_OVERFLOW event that replaces all events that do not fit.
+		auto size = sizeof(inotify_event) + paddedNameLength(name);
+		if(_tail - _head + size + sizeof(inotify_event) > ringCapacity) {
+			if(mask == IN_Q_OVERFLOW)
+				assert(_tail - _head + size <= ringCapacity);
+			else
+				return _postEvent(-1, IN_Q_OVERFLOW, {}, 0);
+		}
+
+		inotify_event e;
+		memset(&e, 0, sizeof(inotify_event));
+		e.wd = descriptor;
+		e.mask = mask;
+		e.cookie = cookie;
+		e.len = paddedNameLength(name);
+
+		_lastEvent = _tail;
+		_copyIn(_tail, &e, sizeof(inotify_event));
+		_tail += sizeof(inotify_event);
+		if(e.len) {
+			char padded[NAME_MAX + sizeof(inotify_event)];
+			assert(e.len <= sizeof(padded));
+			memset(padded, 0, e.len);
+			memcpy(padded, name.data(), name.size());
+			_copyIn(_tail, padded, e.len);
+			_tail += e.len;
+		}
+
+		_inSeq = ++_currentSeq;
+		_statusBell.ring();
+		notifyPollObservers(EPOLLIN);
+	}
+
+	bool _isLastEvent(int descriptor, uint32_t mask, const std::string &name, uint32_t cookie) {
+		if(_lastEvent < _head)
+			return false;
+
+		inotify_event e;
+		_copyOut(_lastEvent, &e, sizeof(inotify_event));
+		if(e.wd != descriptor || e.mask != mask || e.cookie != cookie
+				|| e.len != paddedNameLength(name))
+			return false;
+
+		char padded[NAME_MAX + sizeof(inotify_event)];
+		assert(e.len <= sizeof(padded));
+		_copyOut(_lastEvent + sizeof(inotify_event), padded, e.len);
+		return !e.len || !strncmp(padded, name.c_str(), e.len);
+	}
+
+	// Offsets into the ring grow monotonically; they are wrapped on access.
+	void _copyIn(uint64_t offset, const void *data, size_t size) {
+		auto p = reinterpret_cast<const char *>(data);
+		auto wrapped = offset & (ringCapacity - 1);
+		auto chunk = std::min(size, ringCapacity - wrapped);
+		memcpy(_ring.data() + wrapped, p, chunk);
+		memcpy(_ring.data(), p + chunk, size - chunk);
+	}
+
+	void _copyOut(uint64_t offset, void *data, size_t size) {
+		auto p = reinterpret_cast<char *>(data);
+		auto wrapped = offset & (ringCapacity - 1);
+		auto chunk = std::min(size, ringCapacity - wrapped);
+		memcpy(p, _ring.data() + wrapped, chunk);
+		memcpy(p + chunk, _ring.data(), size - chunk);
+	}
+
 	helix::UniqueLane _passthrough;
-	std::deque<Packet> _queue;
+
+	std::vector<char> _ring;
+	uint64_t _head = 0;
+	uint64_t _tail = 0;
+	// Offset of the most recently queued event (for coalescing).
+	uint64_t _lastEvent = 0;
+
+	// Watches indexed by descriptor and by node.
+	std::map<int, std::shared_ptr<Watch>> _watches;
+	std::unordered_map<FsNode *, std::shared_ptr<Watch>> _watchesByNode;
 
 	// TODO: Use a proper ID allocator to allocate watch descriptor IDs.
 	int _nextDescriptor = 1;
@@ -136,8 +289,18 @@ smarter::shared_ptr<File, FileHandle> createFile() {
 }
 
 int addWatch(File *base, std::shared_ptr<FsNode> node, uint32_t mask) {
-	auto file = static_cast<OpenFile *>(base);
+	// Clients can pass arbitrary file descriptors.
+	auto file = dynamic_cast<OpenFile *>(base);
+	if(!file)
+		return -1;
 	return file->addWatch(std::move(node), mask);
 }
 
+bool removeWatch(File *base, int descriptor) {
+	auto file = dynamic_cast<OpenFile *>(base);
+	if(!file)
+		return false;
+	return file->removeWatch(descriptor);
+}
+
 } // namespace inotify
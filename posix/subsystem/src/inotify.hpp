@@ -4,7 +4,10 @@
 namespace inotify {
 
 smarter::shared_ptr<File, FileHandle> createFile();
+// Returns -1 if the file is not an inotify instance.
 int addWatch(File *file, std::shared_ptr<FsNode> node, uint32_t mask);
+// Returns false if the file is not an inotify instance or if the watch descriptor is invalid.
+bool removeWatch(File *file, int descriptor);
 
 } // namespace inotify
 
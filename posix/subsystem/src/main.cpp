@@ -171,12 +171,8 @@ async::detached observeThread(std::shared_ptr<Process> self,
 			HEL_CHECK(helLoadRegisters(thread.getHandle(), kHelRegsGeneral, &gprs));
 			size_t size = gprs[5];
 
-			// TODO: this is a waste of memory. Use some always-zero memory instead.
-			HelHandle handle;
-			HEL_CHECK(helAllocateMemory(size, 0, nullptr, &handle));
-
 			void *address = co_await self->vmContext()->mapFile(0,
-					helix::UniqueDescriptor{handle}, nullptr,
+					helix::UniqueDescriptor{}, nullptr,
 					0, size, true, kHelMapProtRead | kHelMapProtWrite);
 
 			gprs[4] = kHelErrNone;
@@ -187,9 +183,9 @@ async::detached observeThread(std::shared_ptr<Process> self,
 			uintptr_t gprs[15];
 			HEL_CHECK(helLoadRegisters(thread.getHandle(), kHelRegsGeneral, &gprs));
 
-			self->vmContext()->unmapFile(reinterpret_cast<void *>(gprs[5]), gprs[3]);
+			auto error = self->vmContext()->unmapFile(reinterpret_cast<void *>(gprs[5]), gprs[3]);
 
-			gprs[4] = kHelErrNone;
+			gprs[4] = (error == Error::success) ? kHelErrNone : kHelErrIllegalArgs;
 			gprs[5] = 0;
 			HEL_CHECK(helStoreRegisters(thread.getHandle(), kHelRegsGeneral, &gprs));
 			HEL_CHECK(helResume(thread.getHandle()));
@@ -218,6 +214,16 @@ async::detached observeThread(std::shared_ptr<Process> self,
 			gprs[4] = kHelErrNone;
 			HEL_CHECK(helStoreRegisters(thread.getHandle(), kHelRegsGeneral, &gprs));
 			HEL_CHECK(helResume(thread.getHandle()));
+		}else if(observe.observation() == kHelObserveSuperCall
+				+ protocols::posix::superGetProcessInfoPage) {
+			if(logRequests)
+				std::cout << "posix: GET_PROCESS_INFO_PAGE supercall" << std::endl;
+			uintptr_t gprs[15];
+			HEL_CHECK(helLoadRegisters(thread.getHandle(), kHelRegsGeneral, &gprs));
+			gprs[4] = kHelErrNone;
+			gprs[5] = reinterpret_cast<uintptr_t>(self->clientInfoPage());
+			HEL_CHECK(helStoreRegisters(thread.getHandle(), kHelRegsGeneral, &gprs));
+			HEL_CHECK(helResume(thread.getHandle()));
 		}else if(observe.observation() == kHelObserveSuperCall + 2) {
 			if(logRequests)
 				std::cout << "posix: fork supercall" << std::endl;
@@ -356,6 +362,7 @@ async::detached observeThread(std::shared_ptr<Process> self,
 			}else{
 				assert(!mode);
 			}
+			self->updatePendingSignals();
 
 			gprs[kHelRegRdi] = 0;
 			gprs[kHelRegRsi] = former;
@@ -377,6 +384,7 @@ async::detached observeThread(std::shared_ptr<Process> self,
 			auto active = self->signalContext()->fetchSignal(~self->signalMask());
 			if(active)
 				co_await self->signalContext()->raiseContext(active, self.get());
+			self->updatePendingSignals();
 			if(auto e = helResume(thread.getHandle()); e) {
 				if(e == kHelErrThreadTerminated)
 					continue;
@@ -427,6 +435,7 @@ async::detached observeThread(std::shared_ptr<Process> self,
 				if(active)
 					co_await self->signalContext()->raiseContext(active, self.get());
 			}
+			self->updatePendingSignals();
 			if(auto e = helResume(thread.getHandle()); e) {
 				if(e == kHelErrThreadTerminated)
 					continue;
@@ -439,6 +448,7 @@ async::detached observeThread(std::shared_ptr<Process> self,
 				if(active)
 					co_await self->signalContext()->raiseContext(active, self.get());
 			}
+			self->updatePendingSignals();
 			if(auto e = helResume(thread.getHandle()); e) {
 				if(e == kHelErrThreadTerminated)
 					continue;
@@ -637,6 +647,32 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 			resp.set_error(managarm::posix::Errors::SUCCESS);
 			resp.set_pid(self->getParent()->pid());
 
+			auto [send_resp] = co_await helix_ng::exchangeMsgs(
+					conversation,
+					helix_ng::sendBragiHeadOnly(resp, frg::stl_allocator{})
+				);
+
+			HEL_CHECK(send_resp.error());
+		}else if(preamble.id() == managarm::posix::SyncRequest::message_id) {
+			auto req = bragi::parse_head_only<managarm::posix::SyncRequest>(recv_head);
+
+			if (!req) {
+				std::cout << "posix: Rejecting request due to decoding failure" << std::endl;
+				break;
+			}
+
+			if(logRequests)
+				std::cout << "posix: SYNC" << std::endl;
+
+			// Passing a null handle writes back all managed memory, i.e., the page caches
+			// of all file systems. Servers write back their metadata through the same path.
+			auto writeback = co_await helix_ng::writebackMemory(
+					helix::BorrowedDescriptor{kHelNullHandle}, 0, 0);
+			HEL_CHECK(writeback.error());
+
+			managarm::posix::SvrResponse resp;
+			resp.set_error(managarm::posix::Errors::SUCCESS);
+
 			auto [send_resp] = co_await helix_ng::exchangeMsgs(
 					conversation,
 					helix_ng::sendBragiHeadOnly(resp, frg::stl_allocator{})
@@ -681,6 +717,7 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 			} else if(err == Error::illegalArguments) {
 				co_await sendErrorResponse(managarm::posix::Errors::ILLEGAL_ARGUMENTS);
 			} else {
+				self->updateInfoPage();
 				co_await sendErrorResponse(managarm::posix::Errors::SUCCESS);
 			}
 		}else if(preamble.id() == managarm::posix::GetEuidRequest::message_id) {
@@ -721,6 +758,7 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 			} else if(err == Error::illegalArguments) {
 				co_await sendErrorResponse(managarm::posix::Errors::ILLEGAL_ARGUMENTS);
 			} else {
+				self->updateInfoPage();
 				co_await sendErrorResponse(managarm::posix::Errors::SUCCESS);
 			}
 		}else if(preamble.id() == managarm::posix::GetGidRequest::message_id) {
@@ -782,6 +820,7 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 			} else if(err == Error::illegalArguments) {
 				co_await sendErrorResponse(managarm::posix::Errors::ILLEGAL_ARGUMENTS);
 			} else {
+				self->updateInfoPage();
 				co_await sendErrorResponse(managarm::posix::Errors::SUCCESS);
 			}
 		}else if(preamble.id() == managarm::posix::SetEgidRequest::message_id) {
@@ -801,6 +840,7 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 			} else if(err == Error::illegalArguments) {
 				co_await sendErrorResponse(managarm::posix::Errors::ILLEGAL_ARGUMENTS);
 			} else {
+				self->updateInfoPage();
 				co_await sendErrorResponse(managarm::posix::Errors::SUCCESS);
 			}
 		}else if(req.request_type() == managarm::posix::CntReqType::WAIT) {
@@ -897,20 +937,30 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 			}
 
 			uintptr_t hint = 0;
-			if(req->flags() & MAP_FIXED)
+			if(req->flags() & MAP_FIXED) {
 				hint = req->address_hint();
+				if(hint & 0xFFF) {
+					co_await sendErrorResponse(managarm::posix::Errors::ILLEGAL_ARGUMENTS);
+					continue;
+				}
+			}
 
 			void *address;
 			if(req->flags() & MAP_ANONYMOUS) {
 				assert(req->fd() == -1);
 				assert(!req->rel_offset());
 
-				// TODO: this is a waste of memory. Use some always-zero memory instead.
-				HelHandle handle;
-				HEL_CHECK(helAllocateMemory(req->size(), 0, nullptr, &handle));
+				// Private anonymous memory is copied from zero-filled memory;
+				// only shared anonymous memory needs its own memory object.
+				helix::UniqueDescriptor memory;
+				if(!copyOnWrite) {
+					HelHandle handle;
+					HEL_CHECK(helAllocateMemory(req->size(), 0, nullptr, &handle));
+					memory = helix::UniqueDescriptor{handle};
+				}
 
 				address = co_await self->vmContext()->mapFile(hint,
-						helix::UniqueDescriptor{handle}, nullptr,
+						std::move(memory), nullptr,
 						0, req->size(), copyOnWrite, nativeFlags);
 			}else{
 				auto file = self->fileContext()->getFile(req->fd());
@@ -935,11 +985,21 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 				std::cout << "posix: VM_REMAP" << std::endl;
 
 			helix::SendBuffer send_resp;
+			managarm::posix::SvrResponse resp;
+
+			if(req.address() & 0xFFF) {
+				resp.set_error(managarm::posix::Errors::ILLEGAL_ARGUMENTS);
+				auto ser = resp.SerializeAsString();
+				auto &&transmit = helix::submitAsync(conversation, helix::Dispatcher::global(),
+						helix::action(&send_resp, ser.data(), ser.size()));
+				co_await transmit.async_wait();
+				HEL_CHECK(send_resp.error());
+				continue;
+			}
 
 			auto address = co_await self->vmContext()->remapFile(
 					reinterpret_cast<void *>(req.address()), req.size(), req.new_size());
 
-			managarm::posix::SvrResponse resp;
 			resp.set_error(managarm::posix::Errors::SUCCESS);
 			resp.set_offset(reinterpret_cast<uintptr_t>(address));
 
@@ -972,10 +1032,15 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 			if(req.mode() & PROT_EXEC)
 				native_flags |= kHelMapProtExecute;
 
-			co_await self->vmContext()->protectFile(
+			auto error = co_await self->vmContext()->protectFile(
 					reinterpret_cast<void *>(req.address()), req.size(), native_flags);
 
-			resp.set_error(managarm::posix::Errors::SUCCESS);
+			if(error == Error::illegalArguments) {
+				resp.set_error(managarm::posix::Errors::ILLEGAL_ARGUMENTS);
+			}else{
+				assert(error == Error::success);
+				resp.set_error(managarm::posix::Errors::SUCCESS);
+			}
 			auto ser = resp.SerializeAsString();
 			auto &&transmit = helix::submitAsync(conversation, helix::Dispatcher::global(),
 					helix::action(&send_resp, ser.data(), ser.size()));
@@ -988,10 +1053,16 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 
 			helix::SendBuffer send_resp;
 
-			self->vmContext()->unmapFile(reinterpret_cast<void *>(req.address()), req.size());
+			auto error = self->vmContext()->unmapFile(
+					reinterpret_cast<void *>(req.address()), req.size());
 
 			managarm::posix::SvrResponse resp;
-			resp.set_error(managarm::posix::Errors::SUCCESS);
+			if(error == Error::illegalArguments) {
+				resp.set_error(managarm::posix::Errors::ILLEGAL_ARGUMENTS);
+			}else{
+				assert(error == Error::success);
+				resp.set_error(managarm::posix::Errors::SUCCESS);
+			}
 
 			auto ser = resp.SerializeAsString();
 			auto &&transmit = helix::submitAsync(conversation, helix::Dispatcher::global(),
@@ -1048,6 +1119,8 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 			if(logRequests)
 				std::cout << "posix:     MOUNT succeeds" << std::endl;
 
+			Process::invalidateWorkingDirectories(nullptr);
+
 			managarm::posix::SvrResponse resp;
 			resp.set_error(managarm::posix::Errors::SUCCESS);
 
@@ -1544,6 +1617,9 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 				continue;
 			}
 
+			// Renaming a directory changes the getcwd() result of processes below it.
+			Process::invalidateWorkingDirectories(nullptr);
+
 			co_await sendErrorResponse(managarm::posix::Errors::SUCCESS);
 		}else if(preamble.id() == managarm::posix::FstatAtRequest::message_id) {
 			std::vector<std::byte> tail(preamble.tail_size());
@@ -2407,13 +2483,9 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 
 			assert(!(req.flags() & ~(O_CLOEXEC | O_NONBLOCK)));
 
-			if(req.flags() & O_NONBLOCK)
-				std::cout << "\e[31mposix: pipe2(O_NONBLOCK)"
-						" is not implemented correctly\e[39m" << std::endl;
-
 			helix::SendBuffer send_resp;
 
-			auto pair = fifo::createPair();
+			auto pair = fifo::createPair(req.flags() & O_NONBLOCK);
 			auto r_fd = self->fileContext()->attachFile(std::get<0>(pair),
 					req.flags() & O_CLOEXEC);
 			auto w_fd = self->fileContext()->attachFile(std::get<1>(pair),
@@ -2434,6 +2506,7 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 				std::cout << "posix: SETSID" << std::endl;
 
 			auto session = TerminalSession::initializeNewSession(self.get());
+			self->updateInfoPage();
 
 			managarm::posix::SvrResponse resp;
 			resp.set_error(managarm::posix::Errors::SUCCESS);
@@ -2881,10 +2954,45 @@ async::result<void> serveRequests(std::shared_ptr<Process> self,
 
 			auto wd = inotify::addWatch(ifile.get(), resolver.currentLink()->getTarget(),
 					req->flags());
+			if(wd < 0) {
+				co_await sendErrorResponse(managarm::posix::Errors::ILLEGAL_ARGUMENTS);
+				continue;
+			}
 
 			resp.set_error(managarm::posix::Errors::SUCCESS);
 			resp.set_wd(wd);
 
+			auto [send_resp] = co_await helix_ng::exchangeMsgs(
+					conversation,
+					helix_ng::sendBragiHeadOnly(resp, frg::stl_allocator{})
+				);
+
+			HEL_CHECK(send_resp.error());
+		}else if(preamble.id() == managarm::posix::InotifyRmRequest::message_id) {
+			auto req = bragi::parse_head_only<managarm::posix::InotifyRmRequest>(recv_head);
+
+			if (!req) {
+				std::cout << "posix: Rejecting request due to decoding failure" << std::endl;
+				break;
+			}
+
+			if(logRequests)
+				std::cout << "posix: INOTIFY_RM" << std::endl;
+
+			auto ifile = self->fileContext()->getFile(req->fd());
+			if(!ifile) {
+				co_await sendErrorResponse(managarm::posix::Errors::BAD_FD);
+				continue;
+			}
+
+			if(!inotify::removeWatch(ifile.get(), req->wd())) {
+				co_await sendErrorResponse(managarm::posix::Errors::ILLEGAL_ARGUMENTS);
+				continue;
+			}
+
+			managarm::posix::SvrResponse resp;
+			resp.set_error(managarm::posix::Errors::SUCCESS);
+
 			auto [send_resp] = co_await helix_ng::exchangeMsgs(
 					conversation,
 					helix_ng::sendBragiHeadOnly(resp, frg::stl_allocator{})
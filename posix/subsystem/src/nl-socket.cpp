@@ -49,12 +49,15 @@ public:
 
 	OpenFile(int protocol)
 	: File{StructName::get("nl-socket"), File::defaultPipeLikeSeek}, _protocol{protocol},
-			_currentSeq{1}, _inSeq{0}, _socketPort{0}, _passCreds{false} { }
+			_currentSeq{1}, _inSeq{0}, _socketPort{0}, _passCreds{false} {
+		enablePollObservers();
+	}
 
 	void deliver(Packet packet) {
 		_recvQueue.push_back(std::move(packet));
 		_inSeq = ++_currentSeq;
 		_statusBell.ring();
+		notifyPollObservers(EPOLLIN | EPOLLOUT);
 	}
 
 	void handleClose() override {
@@ -146,10 +149,10 @@ public:
 			const void *addr_ptr, size_t addr_length,
 			std::vector<smarter::shared_ptr<File, FileHandle>> files) override;
 	
-	async::result<void> setOption(int option, int value) override {
+	async::result<protocols::fs::Error> setOption(int option, int value) override {
 		assert(option == SO_PASSCRED);
 		_passCreds = value;
-		co_return;
+		co_return protocols::fs::Error::none;
 	};
 	
 	expected<PollResult> poll(Process *, uint64_t past_seq,
@@ -2,6 +2,7 @@
 #include <signal.h>
 #include <string.h>
 #include <sys/auxv.h>
+#include <algorithm>
 
 #include "common.hpp"
 #include "clock.hpp"
@@ -17,6 +18,15 @@ void serve(std::shared_ptr<Process> self, std::shared_ptr<Generation> generation
 // VmContext.
 // ----------------------------------------------------------------------------
 
+// Like Linux, we require page aligned addresses and non-empty ranges
+// that do not wrap around once they are rounded up to whole pages.
+static bool isValidRange(uintptr_t address, size_t size) {
+	if((address & 0xFFF) || !size)
+		return false;
+	size_t alignedSize = (size + 0xFFF) & ~size_t(0xFFF);
+	return alignedSize && address + alignedSize > address;
+}
+
 std::shared_ptr<VmContext> VmContext::create() {
 	auto context = std::make_shared<VmContext>();
 
@@ -30,36 +40,40 @@ std::shared_ptr<VmContext> VmContext::create() {
 std::shared_ptr<VmContext> VmContext::clone(std::shared_ptr<VmContext> original) {
 	auto context = std::make_shared<VmContext>();
 
+	// The kernel forks all mappings in a single call. We only ask for the CoW memory objects
+	// of private areas since those are needed to move the area later on.
+	std::vector<HelForkedView> views;
+	for(const auto &entry : original->_areaTree) {
+		const auto &[address, area] = entry;
+		size_t progress = 0;
+		for(const auto &segment : area.copySegments) {
+			views.push_back({reinterpret_cast<void *>(address + progress), kHelNullHandle});
+			progress += segment.size;
+		}
+	}
+
 	HelHandle space;
-	HEL_CHECK(helCreateSpace(&space));
+	HEL_CHECK(helForkSpace(original->_space.getHandle(),
+			views.data(), views.size(), &space));
 	context->_space = helix::UniqueDescriptor(space);
 
+	auto view = views.begin();
 	for(const auto &entry : original->_areaTree) {
 		const auto &[address, area] = entry;
 
-		helix::UniqueDescriptor copyView;
-		if(area.copyOnWrite) {
-			HelHandle copyHandle;
-			HEL_CHECK(helForkMemory(area.copyView.getHandle(), &copyHandle));
-			copyView = helix::UniqueDescriptor{copyHandle};
-
-			void *pointer;
-			HEL_CHECK(helMapMemory(copyView.getHandle(), context->_space.getHandle(),
-					reinterpret_cast<void *>(address),
-					0, area.areaSize, area.nativeFlags, &pointer));
-		}else{
-			void *pointer;
-			HEL_CHECK(helMapMemory(area.fileView.getHandle(), context->_space.getHandle(),
-					reinterpret_cast<void *>(address),
-					area.offset, area.areaSize, area.nativeFlags, &pointer));
-		}
-
 		Area copy;
 		copy.copyOnWrite = area.copyOnWrite;
 		copy.areaSize = area.areaSize;
 		copy.nativeFlags = area.nativeFlags;
-		copy.fileView = area.fileView.dup();
-		copy.copyView = std::move(copyView);
+		if(area.fileView)
+			copy.fileView = area.fileView.dup();
+		for(const auto &segment : area.copySegments) {
+			assert(view != views.end());
+			assert(view->handle != kHelNullHandle);
+			copy.copySegments.push_back({segment.size,
+					helix::UniqueDescriptor{view->handle}, segment.viewOffset});
+			++view;
+		}
 		copy.file = area.file;
 		copy.offset = area.offset;
 		context->_areaTree.emplace(address, std::move(copy));
@@ -79,13 +93,18 @@ VmContext::mapFile(uintptr_t hint, helix::UniqueDescriptor memory,
 		intptr_t offset, size_t size, bool copyOnWrite, uint32_t nativeFlags) {
 	size_t alignedSize = (size + 0xFFF) & ~size_t(0xFFF);
 
+	// Fixed mappings replace existing ones.
+	if(hint)
+		unmapFile(reinterpret_cast<void *>(hint), alignedSize);
+
 	// Perform the actual mapping.
 	// POSIX specifies that non-page-size mappings are rounded up and filled with zeros.
 	helix::UniqueDescriptor copyView;
 	void *pointer;
 	if(copyOnWrite) {
+		// Anonymous private memory does not need a memory object to copy from.
 		HelHandle handle;
-		HEL_CHECK(helCopyOnWrite(memory.getHandle(),
+		HEL_CHECK(helCopyOnWrite(memory ? memory.getHandle() : kHelNullHandle,
 				offset, alignedSize, &handle));
 		copyView = helix::UniqueDescriptor{handle};
 
@@ -114,92 +133,233 @@ VmContext::mapFile(uintptr_t hint, helix::UniqueDescriptor memory,
 	area.areaSize = alignedSize;
 	area.nativeFlags = nativeFlags;
 	area.fileView = std::move(memory);
-	area.copyView = std::move(copyView);
+	if(copyOnWrite)
+		area.copySegments.push_back({alignedSize, std::move(copyView), 0});
 	area.file = std::move(file);
 	area.offset = offset;
-	_areaTree.emplace(address, std::move(area));
+	auto it = _areaTree.emplace(address, std::move(area)).first;
+	_mergeArea(it);
 
 	co_return pointer;
 }
 
 async::result<void *> VmContext::remapFile(void *oldPointer,
 		size_t oldSize, size_t newSize) {
+	auto oldAddress = reinterpret_cast<uintptr_t>(oldPointer);
 	size_t alignedOldSize = (oldSize + 0xFFF) & ~size_t(0xFFF);
 	size_t alignedNewSize = (newSize + 0xFFF) & ~size_t(0xFFF);
 
 //	std::cout << "posix: Remapping " << oldPointer << std::endl;
-	auto it = _areaTree.find(reinterpret_cast<uintptr_t>(oldPointer));
+	_splitArea(oldAddress);
+	_splitArea(oldAddress + alignedOldSize);
+	auto it = _areaTree.find(oldAddress);
 	assert(it != _areaTree.end());
 	assert(it->second.areaSize == alignedOldSize);
 
-	assert(!it->second.copyOnWrite);
+	// Shrinking never moves the area.
+	if(alignedNewSize <= alignedOldSize) {
+		if(alignedNewSize < alignedOldSize)
+			unmapFile(reinterpret_cast<void *>(oldAddress + alignedNewSize),
+					alignedOldSize - alignedNewSize);
+		co_return oldPointer;
+	}
 
-	auto memory = co_await it->second.file->accessMemory();
+	auto &area = it->second;
+	auto growth = alignedNewSize - alignedOldSize;
 
-	// Perform the actual mapping.
-	// POSIX specifies that non-page-size mappings are rounded up and filled with zeros.
+	// Obtain a memory object that covers the whole new area.
+	helix::UniqueDescriptor memory;
+	uintptr_t memoryOffset;
+	if(area.copyOnWrite) {
+		HelHandle handle;
+		HEL_CHECK(helCopyOnWrite(area.fileView ? area.fileView.getHandle() : kHelNullHandle,
+				area.offset, alignedNewSize, &handle));
+		memory = helix::UniqueDescriptor{handle};
+		memoryOffset = 0;
+	}else if(area.file) {
+		memory = co_await area.file->accessMemory();
+		memoryOffset = area.offset;
+	}else{
+		memory = area.fileView.dup();
+		memoryOffset = area.offset;
+	}
+
+	// Try to grow the area in place first.
+	auto succ = std::next(it);
+	if(succ == _areaTree.end() || succ->first >= oldAddress + alignedNewSize) {
+		void *pointer;
+		auto error = helMapMemory(memory.getHandle(), _space.getHandle(),
+				reinterpret_cast<void *>(oldAddress + alignedOldSize),
+				memoryOffset + alignedOldSize, growth, area.nativeFlags, &pointer);
+		if(error != kHelErrNoMemory) {
+			HEL_CHECK(error);
+			if(area.copyOnWrite)
+				area.copySegments.push_back({growth, std::move(memory), alignedOldSize});
+			area.areaSize = alignedNewSize;
+			_mergeArea(it);
+			co_return oldPointer;
+		}
+	}
+
+	// Otherwise, the area is moved. The new memory object reserves the new range;
+	// for private areas, its first part is replaced by the existing CoW memory.
 	void *pointer;
 	HEL_CHECK(helMapMemory(memory.getHandle(), _space.getHandle(),
-			nullptr, it->second.offset, alignedNewSize,
-			it->second.nativeFlags, &pointer));
+			nullptr, memoryOffset, alignedNewSize, area.nativeFlags, &pointer));
 //	std::cout << "posix: VM_REMAP returns " << pointer << std::endl;
+	auto address = reinterpret_cast<uintptr_t>(pointer);
+
+	if(area.copyOnWrite) {
+		HEL_CHECK(helUnmapMemory(_space.getHandle(), pointer, alignedOldSize));
+
+		size_t progress = 0;
+		for(const auto &segment : area.copySegments) {
+			void *segmentPointer;
+			HEL_CHECK(helMapMemory(segment.view.getHandle(), _space.getHandle(),
+					reinterpret_cast<void *>(address + progress),
+					segment.viewOffset, segment.size, area.nativeFlags, &segmentPointer));
+			progress += segment.size;
+		}
+		area.copySegments.push_back({growth, std::move(memory), alignedOldSize});
+	}
 
 	// Unmap the old area.
 	HEL_CHECK(helUnmapMemory(_space.getHandle(), oldPointer, alignedOldSize));
 
-	// Construct the new area from the old one.
-	Area area;
-	area.copyOnWrite = it->second.copyOnWrite;
-	area.areaSize = alignedNewSize;
-	area.nativeFlags = it->second.nativeFlags;
-	area.fileView = std::move(it->second.fileView);
-	area.copyView = std::move(it->second.copyView);
-	area.file = std::move(it->second.file);
-	area.offset = it->second.offset;
-	_areaTree.erase(it);
-
 	// Perform some sanity checking.
-	auto address = reinterpret_cast<uintptr_t>(pointer);
-	auto succ = _areaTree.lower_bound(address + alignedNewSize);
+	succ = _areaTree.lower_bound(address + alignedNewSize);
 	if(succ != _areaTree.begin()) {
 		auto pred = std::prev(succ);
 		assert(pred->first + pred->second.areaSize <= address);
 	}
 
-	_areaTree.insert({address, std::move(area)});
+	auto node = _areaTree.extract(it);
+	node.key() = address;
+	node.mapped().areaSize = alignedNewSize;
+	_mergeArea(_areaTree.insert(std::move(node)).position);
 
 	co_return pointer;
 }
 
-async::result<void> VmContext::protectFile(void *pointer, size_t size, uint32_t protectionFlags) {
+async::result<Error> VmContext::protectFile(void *pointer, size_t size, uint32_t protectionFlags) {
+	auto address = reinterpret_cast<uintptr_t>(pointer);
 	size_t alignedSize = (size + 0xFFF) & ~size_t(0xFFF);
+	if(!isValidRange(address, size))
+		co_return Error::illegalArguments;
+
+	_splitArea(address);
+	_splitArea(address + alignedSize);
+
+	for(auto it = _areaTree.lower_bound(address);
+			it != _areaTree.end() && it->first < address + alignedSize; ++it) {
+		helix::ProtectMemory protect;
+		auto &&submit = helix::submitProtectMemory(_space, &protect,
+				reinterpret_cast<void *>(it->first), it->second.areaSize,
+				protectionFlags, helix::Dispatcher::global());
+		co_await submit.async_wait();
+		HEL_CHECK(protect.error());
+		it->second.nativeFlags &= ~(kHelMapProtRead | kHelMapProtWrite | kHelMapProtExecute);
+		it->second.nativeFlags |= protectionFlags;
+	}
 
-	auto it = _areaTree.find(reinterpret_cast<uintptr_t>(pointer));
-	assert(it != _areaTree.end());
-	assert(it->second.areaSize == alignedSize);
+	co_return Error::success;
+}
+
+Error VmContext::unmapFile(void *pointer, size_t size) {
+	auto address = reinterpret_cast<uintptr_t>(pointer);
+	size_t alignedSize = (size + 0xFFF) & ~size_t(0xFFF);
+	if(!isValidRange(address, size))
+		return Error::illegalArguments;
 
-	helix::ProtectMemory protect;
-	auto &&submit = helix::submitProtectMemory(_space, &protect,
-			pointer, size, protectionFlags, helix::Dispatcher::global());
-	co_await submit.async_wait();
-	HEL_CHECK(protect.error());
-	it->second.nativeFlags &= ~(kHelMapProtRead | kHelMapProtWrite | kHelMapProtExecute);
-	it->second.nativeFlags |= protectionFlags;
+	_splitArea(address);
+	_splitArea(address + alignedSize);
 
-	co_return;
+	auto it = _areaTree.lower_bound(address);
+	while(it != _areaTree.end() && it->first < address + alignedSize) {
+		HEL_CHECK(helUnmapMemory(_space.getHandle(),
+				reinterpret_cast<void *>(it->first), it->second.areaSize));
+
+		// Update our idea of the process' VM space.
+		it = _areaTree.erase(it);
+	}
+	return Error::success;
 }
 
-void VmContext::unmapFile(void *pointer, size_t size) {
-	size_t aligned_size = (size + 0xFFF) & ~size_t(0xFFF);
+void VmContext::_splitArea(uintptr_t address) {
+	// Callers validate their ranges; the kernel cannot split mappings inside of pages.
+	assert(!(address & 0xFFF));
+	auto it = _areaTree.upper_bound(address);
+	if(it == _areaTree.begin())
+		return;
+	--it;
+	auto &[base, area] = *it;
+	if(base == address || base + area.areaSize <= address)
+		return;
+	auto split = address - base;
+
+	Area tail;
+	tail.copyOnWrite = area.copyOnWrite;
+	tail.areaSize = area.areaSize - split;
+	tail.nativeFlags = area.nativeFlags;
+	if(area.fileView)
+		tail.fileView = area.fileView.dup();
+	tail.file = area.file;
+	tail.offset = area.offset + split;
+
+	// Split the segments, too. The kernel does not necessarily split its mapping here
+	// but helForkSpace() resolves addresses inside of mappings.
+	std::vector<CopySegment> head;
+	size_t progress = 0;
+	for(auto &segment : area.copySegments) {
+		auto segmentSize = segment.size;
+		if(progress + segmentSize <= split) {
+			head.push_back(std::move(segment));
+		}else if(progress >= split) {
+			tail.copySegments.push_back(std::move(segment));
+		}else{
+			auto headSize = split - progress;
+			tail.copySegments.push_back({segmentSize - headSize,
+					segment.view.dup(), segment.viewOffset + headSize});
+			segment.size = headSize;
+			head.push_back(std::move(segment));
+		}
+		progress += segmentSize;
+	}
+	area.copySegments = std::move(head);
+	area.areaSize = split;
 
-	auto it = _areaTree.find(reinterpret_cast<uintptr_t>(pointer));
-	assert(it != _areaTree.end());
-	assert(it->second.areaSize == aligned_size);
+	_areaTree.emplace(address, std::move(tail));
+}
+
+void VmContext::_mergeArea(std::map<uintptr_t, Area>::iterator it) {
+	auto isMergeable = [&] (std::map<uintptr_t, Area>::iterator other) {
+		return other->second.copyOnWrite && !other->second.fileView
+				&& other->second.nativeFlags == it->second.nativeFlags;
+	};
+
+	auto append = [] (Area &area, Area &other) {
+		area.areaSize += other.areaSize;
+		for(auto &segment : other.copySegments)
+			area.copySegments.push_back(std::move(segment));
+	};
 
-	HEL_CHECK(helUnmapMemory(_space.getHandle(), pointer, aligned_size));
+	if(it->second.fileView || !it->second.copyOnWrite)
+		return;
+
+	auto succ = std::next(it);
+	if(succ != _areaTree.end() && isMergeable(succ)
+			&& it->first + it->second.areaSize == succ->first) {
+		append(it->second, succ->second);
+		_areaTree.erase(succ);
+	}
 
-	// Update our idea of the process' VM space.
-	_areaTree.erase(it);
+	if(it != _areaTree.begin()) {
+		auto pred = std::prev(it);
+		if(isMergeable(pred) && pred->first + pred->second.areaSize == it->first) {
+			append(pred->second, it->second);
+			_areaTree.erase(it);
+		}
+	}
 }
 
 // ----------------------------------------------------------------------------
@@ -234,10 +394,12 @@ ViewPath FsContext::getWorkingDirectory() {
 
 void FsContext::changeRoot(ViewPath root) {
 	_root = std::move(root);
+	Process::invalidateWorkingDirectories(this);
 }
 
 void FsContext::changeWorkingDirectory(ViewPath workdir) {
 	_workDir = std::move(workdir);
+	Process::invalidateWorkingDirectories(this);
 }
 
 // ----------------------------------------------------------------------------
@@ -457,9 +619,24 @@ void SignalContext::issueSignal(int sn, SignalInfo info) {
 	_slots[sn].raiseSeq = ++_currentSeq;
 	_slots[sn].asyncQueue.push_back(*item);
 	_activeSet |= (UINT64_C(1) << sn);
+
+	// Clients that unblock signals through their thread page need to see the signal.
+	for(auto page : _threadPages)
+		__atomic_fetch_or(&page->pendingSignals, UINT64_C(1) << sn, __ATOMIC_SEQ_CST);
+
 	_signalBell.ring();
 }
 
+void SignalContext::attachThreadPage(ThreadPage *page) {
+	_threadPages.push_back(page);
+}
+
+void SignalContext::detachThreadPage(ThreadPage *page) {
+	auto it = std::find(_threadPages.begin(), _threadPages.end(), page);
+	assert(it != _threadPages.end());
+	_threadPages.erase(it);
+}
+
 async::result<PollSignalResult>
 SignalContext::pollSignal(uint64_t in_seq, uint64_t mask,
 		async::cancellation_token cancellation) {
@@ -689,9 +866,46 @@ Process::Process(std::shared_ptr<PidHull> hull, Process *parent)
 
 Process::~Process() {
 	std::cout << "\e[33mposix: Process is destructed\e[39m" << std::endl;
+	if(_signalContext && _threadPageMapping.get())
+		_signalContext->detachThreadPage(accessThreadPage());
 	_pgPointer->dropProcess(this);
 }
 
+void Process::updatePendingSignals() {
+	auto activeSet = std::get<2>(_signalContext->checkSignal(UINT64_C(-1)));
+	__atomic_store_n(&accessThreadPage()->pendingSignals, activeSet, __ATOMIC_RELAXED);
+}
+
+void Process::updateInfoPage() {
+	auto page = accessInfoPage();
+	auto seq = __atomic_load_n(&page->seqlock, __ATOMIC_RELAXED);
+	__atomic_store_n(&page->seqlock, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	page->pid = pid();
+	page->ppid = _parent ? _parent->pid() : 0;
+	page->pgid = _pgPointer ? _pgPointer->getProcessGroupId() : 0;
+	auto session = _pgPointer ? _pgPointer->getSession() : nullptr;
+	page->sid = session ? session->getSessionId() : 0;
+	page->uid = _uid;
+	page->euid = _euid;
+	page->gid = _gid;
+	page->egid = _egid;
+
+	__atomic_store_n(&page->seqlock, seq + 2, __ATOMIC_RELEASE);
+}
+
+void Process::invalidateWorkingDirectories(FsContext *fsContext) {
+	for(auto &entry : globalPidMap) {
+		auto process = entry.second->getProcess();
+		if(!process || !process->_infoPageMapping.get())
+			continue;
+		if(fsContext && process->_fsContext.get() != fsContext)
+			continue;
+		__atomic_fetch_add(&process->accessInfoPage()->cwdGeneration, 1, __ATOMIC_RELEASE);
+	}
+}
+
 bool Process::checkSignalRaise() {
 	auto p = reinterpret_cast<unsigned int *>(accessThreadPage());
 	unsigned int gsf = __atomic_load_n(p, __ATOMIC_RELAXED);
@@ -729,9 +943,15 @@ async::result<std::shared_ptr<Process>> Process::init(std::string path) {
 	HEL_CHECK(helAllocateMemory(0x1000, 0, nullptr, &thread_memory));
 	process->_threadPageMemory = helix::UniqueDescriptor{thread_memory};
 	process->_threadPageMapping = helix::Mapping{process->_threadPageMemory, 0, 0x1000};
+	process->_signalContext->attachThreadPage(process->accessThreadPage());
+
+	HelHandle info_memory;
+	HEL_CHECK(helAllocateMemory(0x1000, 0, nullptr, &info_memory));
+	process->_infoPageMemory = helix::UniqueDescriptor{info_memory};
+	process->_infoPageMapping = helix::Mapping{process->_infoPageMemory, 0, 0x1000};
 
 	// The initial signal mask allows all signals.
-	process->_signalMask = 0;
+	process->setSignalMask(0);
 
 	auto [server_lane, client_lane] = helix::createStream();
 	HEL_CHECK(helTransferDescriptor(client_lane.getHandle(),
@@ -740,15 +960,19 @@ async::result<std::shared_ptr<Process>> Process::init(std::string path) {
 
 	HEL_CHECK(helMapMemory(process->_threadPageMemory.getHandle(),
 			process->_vmContext->getSpace().getHandle(),
-			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapProtWrite,
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapProtWrite | kHelMapDontInherit,
 			&process->_clientThreadPage));
+	HEL_CHECK(helMapMemory(process->_infoPageMemory.getHandle(),
+			process->_vmContext->getSpace().getHandle(),
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapDontInherit,
+			&process->_clientInfoPage));
 	HEL_CHECK(helMapMemory(process->_fileContext->fileTableMemory().getHandle(),
 			process->_vmContext->getSpace().getHandle(),
-			nullptr, 0, 0x1000, kHelMapProtRead,
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapDontInherit,
 			&process->_clientFileTable));
 	HEL_CHECK(helMapMemory(clk::trackerPageMemory().getHandle(),
 			process->_vmContext->getSpace().getHandle(),
-			nullptr, 0, 0x1000, kHelMapProtRead,
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapDontInherit,
 			&process->_clientClkTrackerPage));
 
 	process->_uid = 0;
@@ -756,6 +980,7 @@ async::result<std::shared_ptr<Process>> Process::init(std::string path) {
 	process->_gid = 0;
 	process->_egid = 0;
 	process->_hull->initializeProcess(process.get());
+	process->updateInfoPage();
 
 	// TODO: Do not pass an empty argument vector?
 	auto threadResult = co_await execute(process->_fsContext->getRoot(),
@@ -793,9 +1018,15 @@ std::shared_ptr<Process> Process::fork(std::shared_ptr<Process> original) {
 	HEL_CHECK(helAllocateMemory(0x1000, 0, nullptr, &thread_memory));
 	process->_threadPageMemory = helix::UniqueDescriptor{thread_memory};
 	process->_threadPageMapping = helix::Mapping{process->_threadPageMemory, 0, 0x1000};
+	process->_signalContext->attachThreadPage(process->accessThreadPage());
+
+	HelHandle info_memory;
+	HEL_CHECK(helAllocateMemory(0x1000, 0, nullptr, &info_memory));
+	process->_infoPageMemory = helix::UniqueDescriptor{info_memory};
+	process->_infoPageMapping = helix::Mapping{process->_infoPageMemory, 0, 0x1000};
 
 	// Signal masks are copied on fork().
-	process->_signalMask = original->_signalMask;
+	process->setSignalMask(original->signalMask());
 
 	auto [server_lane, client_lane] = helix::createStream();
 	HEL_CHECK(helTransferDescriptor(client_lane.getHandle(),
@@ -804,15 +1035,19 @@ std::shared_ptr<Process> Process::fork(std::shared_ptr<Process> original) {
 
 	HEL_CHECK(helMapMemory(process->_threadPageMemory.getHandle(),
 			process->_vmContext->getSpace().getHandle(),
-			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapProtWrite,
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapProtWrite | kHelMapDontInherit,
 			&process->_clientThreadPage));
+	HEL_CHECK(helMapMemory(process->_infoPageMemory.getHandle(),
+			process->_vmContext->getSpace().getHandle(),
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapDontInherit,
+			&process->_clientInfoPage));
 	HEL_CHECK(helMapMemory(process->_fileContext->fileTableMemory().getHandle(),
 			process->_vmContext->getSpace().getHandle(),
-			nullptr, 0, 0x1000, kHelMapProtRead,
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapDontInherit,
 			&process->_clientFileTable));
 	HEL_CHECK(helMapMemory(clk::trackerPageMemory().getHandle(),
 			process->_vmContext->getSpace().getHandle(),
-			nullptr, 0, 0x1000, kHelMapProtRead,
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapDontInherit,
 			&process->_clientClkTrackerPage));
 
 	process->_uid = original->_uid;
@@ -821,6 +1056,7 @@ std::shared_ptr<Process> Process::fork(std::shared_ptr<Process> original) {
 	process->_egid = original->_egid;
 	original->_children.push_back(process);
 	process->_hull->initializeProcess(process.get());
+	process->updateInfoPage();
 
 	HelHandle new_thread;
 	HEL_CHECK(helCreateThread(process->fileContext()->getUniverse().getHandle(),
@@ -852,9 +1088,15 @@ std::shared_ptr<Process> Process::clone(std::shared_ptr<Process> original, void
 	HEL_CHECK(helAllocateMemory(0x1000, 0, nullptr, &thread_memory));
 	process->_threadPageMemory = helix::UniqueDescriptor{thread_memory};
 	process->_threadPageMapping = helix::Mapping{process->_threadPageMemory, 0, 0x1000};
+	process->_signalContext->attachThreadPage(process->accessThreadPage());
+
+	HelHandle info_memory;
+	HEL_CHECK(helAllocateMemory(0x1000, 0, nullptr, &info_memory));
+	process->_infoPageMemory = helix::UniqueDescriptor{info_memory};
+	process->_infoPageMapping = helix::Mapping{process->_infoPageMemory, 0, 0x1000};
 
 	// Signal masks are copied on clone().
-	process->_signalMask = original->_signalMask;
+	process->setSignalMask(original->signalMask());
 
 	auto [server_lane, client_lane] = helix::createStream();
 	HEL_CHECK(helTransferDescriptor(client_lane.getHandle(),
@@ -863,8 +1105,12 @@ std::shared_ptr<Process> Process::clone(std::shared_ptr<Process> original, void
 
 	HEL_CHECK(helMapMemory(process->_threadPageMemory.getHandle(),
 			process->_vmContext->getSpace().getHandle(),
-			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapProtWrite,
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapProtWrite | kHelMapDontInherit,
 			&process->_clientThreadPage));
+	HEL_CHECK(helMapMemory(process->_infoPageMemory.getHandle(),
+			process->_vmContext->getSpace().getHandle(),
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapDontInherit,
+			&process->_clientInfoPage));
 
 	process->_clientFileTable = original->_clientFileTable;
 	process->_clientClkTrackerPage = original->_clientClkTrackerPage;
@@ -875,6 +1121,7 @@ std::shared_ptr<Process> Process::clone(std::shared_ptr<Process> original, void
 	process->_egid = original->_egid;
 	original->_children.push_back(process);
 	process->_hull->initializeProcess(process.get());
+	process->updateInfoPage();
 
 	HelHandle new_thread;
 	HEL_CHECK(helCreateThread(process->fileContext()->getUniverse().getHandle(),
@@ -919,19 +1166,24 @@ async::result<Error> Process::exec(std::shared_ptr<Process> process,
 	client_lane.release();
 
 	void *exec_thread_page;
+	void *exec_info_page;
 	void *exec_clk_tracker_page;
 	void *exec_client_table;
 	HEL_CHECK(helMapMemory(process->_threadPageMemory.getHandle(),
 			exec_vm_context->getSpace().getHandle(),
-			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapProtWrite,
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapProtWrite | kHelMapDontInherit,
 			&exec_thread_page));
+	HEL_CHECK(helMapMemory(process->_infoPageMemory.getHandle(),
+			exec_vm_context->getSpace().getHandle(),
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapDontInherit,
+			&exec_info_page));
 	HEL_CHECK(helMapMemory(clk::trackerPageMemory().getHandle(),
 			exec_vm_context->getSpace().getHandle(),
-			nullptr, 0, 0x1000, kHelMapProtRead,
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapDontInherit,
 			&exec_clk_tracker_page));
 	HEL_CHECK(helMapMemory(process->_fileContext->fileTableMemory().getHandle(),
 			exec_vm_context->getSpace().getHandle(),
-			nullptr, 0, 0x1000, kHelMapProtRead,
+			nullptr, 0, 0x1000, kHelMapProtRead | kHelMapDontInherit,
 			&exec_client_table));
 
 	// Kill the old thread.
@@ -954,6 +1206,7 @@ async::result<Error> Process::exec(std::shared_ptr<Process> process,
 	process->_vmContext = std::move(exec_vm_context);
 	process->_signalContext->resetHandlers();
 	process->_clientThreadPage = exec_thread_page;
+	process->_clientInfoPage = exec_info_page;
 	process->_clientPosixLane = exec_posix_lane;
 	process->_clientFileTable = exec_client_table;
 	process->_clientClkTrackerPage = exec_clk_tracker_page;
@@ -996,6 +1249,23 @@ async::result<void> Process::terminate(TerminationState state) {
 	//_signalContext = nullptr; // TODO: Migrate the notifications to PID 1.
 	_currentGeneration = nullptr;
 
+	// Like on Linux, orphaned children are adopted by PID 1.
+	// Children that already terminated remain in our notification queue.
+	auto init = findProcess(1);
+	if(init && init.get() != this) {
+		for(auto &child : _children) {
+			if(child->_notifyType != NotifyType::null)
+				continue;
+			child->_parent = init.get();
+			init->_children.push_back(child);
+			child->updateInfoPage();
+		}
+		_children.erase(std::remove_if(_children.begin(), _children.end(),
+				[&] (const std::shared_ptr<Process> &child) {
+					return child->_parent != this;
+				}), _children.end());
+	}
+
 	// Notify the parent of our status change.
 	assert(_notifyType == NotifyType::null);
 	_notifyType = NotifyType::terminated;
@@ -1060,6 +1330,10 @@ void ProcessGroup::dropProcess(Process *process) {
 	process->_pgPointer = nullptr;
 }
 
+pid_t ProcessGroup::getProcessGroupId() {
+	return hull_->getPid();
+}
+
 void ProcessGroup::issueSignalToGroup(int sn, SignalInfo info) {
 	for(auto &processRef : members_)
 		processRef.signalContext()->issueSignal(sn, info);
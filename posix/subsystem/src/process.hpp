@@ -3,11 +3,13 @@
 #include <map>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include <async/result.hpp>
 #include <async/oneshot-event.hpp>
 #include <async/doorbell.hpp>
 #include <boost/intrusive/list.hpp>
+#include <protocols/posix/data.hpp>
 
 #include "vfs.hpp"
 
@@ -38,21 +40,40 @@ struct VmContext {
 
 	async::result<void *> remapFile(void *old_pointer, size_t old_size, size_t new_size);
 
-	async::result<void> protectFile(void *pointer, size_t size, uint32_t protectionFlags);
+	// The following functions also accept ranges that only cover parts of areas.
+	// The pointer must be page aligned; the size is rounded up to whole pages.
+	// Returns Error::illegalArguments for unaligned or empty ranges.
+	async::result<Error> protectFile(void *pointer, size_t size, uint32_t protectionFlags);
 
-	void unmapFile(void *pointer, size_t size);
+	Error unmapFile(void *pointer, size_t size);
 
 private:
+	// Part of a private area that corresponds to a single kernel mapping of a CoW memory object.
+	struct CopySegment {
+		size_t size;
+		helix::UniqueDescriptor view;
+		uintptr_t viewOffset;
+	};
+
 	struct Area {
 		bool copyOnWrite;
 		size_t areaSize;
 		uint32_t nativeFlags;
+		// Null for anonymous private areas; those are copied from zero-filled memory.
 		helix::UniqueDescriptor fileView;
-		helix::UniqueDescriptor copyView;
+		// For private areas: the CoW memory objects that are mapped, in address order.
+		std::vector<CopySegment> copySegments;
 		smarter::shared_ptr<File, FileHandle> file;
 		intptr_t offset;
 	};
 
+	// Splits the area that contains the given address (if any) such that an area starts there.
+	// The address must be page aligned.
+	void _splitArea(uintptr_t address);
+
+	// Merges an anonymous private area with adjacent areas of the same kind and protection.
+	void _mergeArea(std::map<uintptr_t, Area>::iterator it);
+
 	helix::UniqueDescriptor _space;
 
 	std::map<uintptr_t, Area> _areaTree;
@@ -264,6 +285,11 @@ public:
 
 	SignalItem *fetchSignal(uint64_t mask);
 
+	// Thread pages of all processes that share this context.
+	// issueSignal() publishes new signals in their pendingSignals words.
+	void attachThreadPage(protocols::posix::ThreadPage *page);
+	void detachThreadPage(protocols::posix::ThreadPage *page);
+
 	// ------------------------------------------------------------------------
 	// Signal context manipulation.
 	// ------------------------------------------------------------------------
@@ -279,6 +305,8 @@ private:
 	async::doorbell _signalBell;
 	uint64_t _currentSeq;
 	uint64_t _activeSet;
+
+	std::vector<protocols::posix::ThreadPage *> _threadPages;
 };
 
 enum class NotifyType {
@@ -316,9 +344,8 @@ struct Generation {
 	async::oneshot_event requestsDone;
 };
 
-struct ThreadPage {
-	int globalSignalFlag;
-};
+using ThreadPage = protocols::posix::ThreadPage;
+using ProcessInfoPage = protocols::posix::ProcessInfoPage;
 
 // --------------------------------------------------------------------------------------
 // The 'Process' class.
@@ -482,23 +509,41 @@ public:
 	std::shared_ptr<FileContext> fileContext() { return _fileContext; }
 	SignalContext *signalContext() { return _signalContext.get(); }
 
+	// The signal mask lives in the thread page such that clients can change it without IPC.
 	void setSignalMask(uint64_t mask) {
-		_signalMask = mask;
+		__atomic_store_n(&accessThreadPage()->signalMask, mask, __ATOMIC_RELAXED);
 	}
 
 	uint64_t signalMask() {
-		return _signalMask;
+		return __atomic_load_n(&accessThreadPage()->signalMask, __ATOMIC_RELAXED);
 	}
 
+	// Publishes the signals that are currently pending to the thread page.
+	// Clients consult this after unblocking signals locally.
+	void updatePendingSignals();
+
 	HelHandle clientPosixLane() { return _clientPosixLane; }
 	void *clientThreadPage() { return _clientThreadPage; }
 	void *clientFileTable() { return _clientFileTable; }
 	void *clientClkTrackerPage() { return _clientClkTrackerPage; }
+	void *clientInfoPage() { return _clientInfoPage; }
 
 	ThreadPage *accessThreadPage() {
 		return reinterpret_cast<ThreadPage *>(_threadPageMapping.get());
 	}
 
+	ProcessInfoPage *accessInfoPage() {
+		return reinterpret_cast<ProcessInfoPage *>(_infoPageMapping.get());
+	}
+
+	// Writes the current IDs and credentials to the process info page.
+	// Must be called whenever one of them changes.
+	void updateInfoPage();
+
+	// Invalidates cached getcwd() results of all processes that use the given FsContext
+	// (or of all processes if fsContext is null).
+	static void invalidateWorkingDirectories(FsContext *fsContext);
+
 	// Like checkOrRequestSignalRaise() but only check if raising is possible.
 	bool checkSignalRaise();
 
@@ -537,13 +582,14 @@ private:
 
 	helix::UniqueDescriptor _threadPageMemory;
 	helix::Mapping _threadPageMapping;
+	helix::UniqueDescriptor _infoPageMemory;
+	helix::Mapping _infoPageMapping;
 
 	HelHandle _clientPosixLane;
 	void *_clientThreadPage;
 	void *_clientFileTable;
 	void *_clientClkTrackerPage;
-
-	uint64_t _signalMask;
+	void *_clientInfoPage;
 	std::vector<std::shared_ptr<Process>> _children;
 
 	// The following intrusive queue stores notifications for wait(). 
@@ -589,6 +635,12 @@ struct ProcessGroup : std::enable_shared_from_this<ProcessGroup> {
 
 	void issueSignalToGroup(int sn, SignalInfo info);
 
+	pid_t getProcessGroupId();
+
+	TerminalSession *getSession() {
+		return sessionPointer_.get();
+	}
+
 private:
 	std::shared_ptr<PidHull> hull_;
 
@@ -41,6 +41,7 @@ private:
 				_expirations++;
 				_theSeq++;
 				_seqBell.ring();
+				notifyPollObservers(EPOLLIN);
 			}else{
 				delete timer;
 				co_return;
@@ -68,6 +69,7 @@ private:
 				_expirations++;
 				_theSeq++;
 				_seqBell.ring();
+				notifyPollObservers(EPOLLIN);
 			}else{
 				delete timer;
 				co_return;
@@ -89,6 +91,7 @@ public:
 	: File{StructName::get("timerfd")}, _nonBlock{non_block},
 			_activeTimer{nullptr}, _expirations{0}, _theSeq{1} {
 		(void)_nonBlock;
+		enablePollObservers();
 	}
 
 	~OpenFile() {
@@ -1,6 +1,9 @@
 #include <fcntl.h>
 #include <unistd.h>
-#include <set>
+#include <algorithm>
+#include <list>
+#include <string_view>
+#include <unordered_map>
 
 #include <helix/memory.hpp>
 #include <protocols/fs/client.hpp>
@@ -204,6 +207,11 @@ public:
 		return _name;
 	}
 
+	// Unlike getName(), this does not copy the name.
+	const std::string &name() {
+		return _name;
+	}
+
 	std::shared_ptr<FsNode> getTarget() override {
 		return _target;
 	}
@@ -214,20 +222,9 @@ private:
 	std::shared_ptr<FsNode> _target;
 };
 
-struct LinkCompare {
-	struct is_transparent { };
-
-	bool operator() (const std::shared_ptr<Link> &link, const std::string &name) const {
-		return link->getName() < name;
-	}
-bool operator() (const std::string &name, const std::shared_ptr<Link> &link) const {
-	return name < link->getName();
-}
-
-bool operator() (const std::shared_ptr<Link> &a, const std::shared_ptr<Link> &b) const {
-	return a->getName() < b->getName();
-}
-};
+// Directory entries are kept in creation order (for readEntries()) and indexed by name.
+// The index keys point into the names of the links, which never change.
+using EntryList = std::list<std::shared_ptr<Link>>;
 
 struct DirectoryNode;
 
@@ -249,7 +246,7 @@ private:
 	helix::UniqueLane _passthrough;
 	async::cancellation_event _cancelServe;
 
-	std::set<std::shared_ptr<Link>, LinkCompare>::iterator _iter;
+	EntryList::iterator _iter;
 };
 
 struct DirectoryNode final : Node, std::enable_shared_from_this<DirectoryNode> {
@@ -280,18 +277,15 @@ private:
 
 
 	async::result<frg::expected<Error, std::shared_ptr<FsLink>>> getLink(std::string name) override {
-		auto it = _entries.find(name);
-		if(it != _entries.end())
-			co_return *it;
-		co_return nullptr; // TODO: Return an error code.
+		co_return _findEntry(name); // TODO: Return an error code if there is no entry.
 	}
 
 	async::result<frg::expected<Error, std::shared_ptr<FsLink>>> link(std::string name,
 			std::shared_ptr<FsNode> target) override {
-		if(!(_entries.find(name) == _entries.end()))
+		if(_findEntry(name))
 			co_return Error::alreadyExists;
 		auto link = std::make_shared<Link>(shared_from_this(), std::move(name), std::move(target));
-		_entries.insert(link);
+		_insertEntry(link);
 		co_return link;
 	}
 
@@ -307,10 +301,8 @@ private:
 	async::result<frg::expected<Error, std::shared_ptr<FsLink>>> mkfifo(std::string name, mode_t mode) override;
 
 	async::result<frg::expected<Error>> unlink(std::string name) override {
-		auto it = _entries.find(name);
-		if(it == _entries.end())
+		if(!_eraseEntry(name))
 			co_return Error::noSuchFile;
-		_entries.erase(it);
 
 		notifyObservers(FsObserver::deleteEvent, name, 0);
 		co_return {};
@@ -331,9 +323,36 @@ public:
 	DirectoryNode(Superblock *superblock);
 
 private:
+	std::shared_ptr<Link> _findEntry(std::string_view name) {
+		auto it = _index.find(name);
+		if(it == _index.end())
+			return nullptr;
+		return *it->second;
+	}
+
+	void _insertEntry(std::shared_ptr<Link> link) {
+		auto it = _entries.insert(_entries.end(), std::move(link));
+		auto [iit, inserted] = _index.insert({(*it)->name(), it});
+		(void)iit;
+		assert(inserted);
+		notifyObservers(FsObserver::createEvent, (*it)->name(), 0);
+	}
+
+	// Returns false if there is no such entry.
+	bool _eraseEntry(std::string_view name) {
+		auto iit = _index.find(name);
+		if(iit == _index.end())
+			return false;
+		auto it = iit->second;
+		_index.erase(iit);
+		_entries.erase(it);
+		return true;
+	}
+
 	// TODO: This creates a circular reference -- fix this.
 	std::shared_ptr<Link> _treeLink;
-	std::set<std::shared_ptr<Link>, LinkCompare> _entries;
+	EntryList _entries;
+	std::unordered_map<std::string_view, EntryList::iterator> _index;
 };
 
 // TODO: Remove this class in favor of MemoryNode.
@@ -440,29 +459,27 @@ struct MemoryNode final : Node {
 	}
 
 private:
-	void _resizeFile(size_t new_size) {
-		_fileSize = new_size;
-
-		size_t aligned_size = (new_size + 0xFFF) & ~size_t(0xFFF);
-		if(aligned_size <= _areaSize)
-			return;
-
-		if(_memory) {
-			HEL_CHECK(helResizeMemory(_memory.getHandle(), aligned_size));
-		}else{
-			HelHandle handle;
-			HEL_CHECK(helAllocateMemory(aligned_size, 0, nullptr, &handle));
-			_memory = helix::UniqueDescriptor{handle};
-		}
+	// The caller overwrites [written_offset, new_size) itself; that range is not zeroed.
+	void _resizeFile(size_t new_size, size_t written_offset);
 
-		_mapping = helix::Mapping{_memory, 0, aligned_size};
-		_areaSize = aligned_size;
+	void _resizeFile(size_t new_size) {
+		_resizeFile(new_size, new_size);
 	}
 
+	// read() and write() copy between this mapping and the request buffer;
+	// clients that mmap() the file share the pages of the same memory object.
+	// The mapping is only replaced when the area grows, which is rare since it grows
+	// geometrically.
+	// The kernel only allocates pages of the memory object once they are accessed,
+	// hence the area beyond the file size is not backed. Holes within the file are
+	// backed once they are read or written: read() touches them through the mapping,
+	// which allocates zero pages. Truncation does not free pages either.
 	helix::UniqueDescriptor _memory;
 	helix::Mapping _mapping;
 	size_t _areaSize;
 	size_t _fileSize;
+	// Data beyond the file size (up to this offset) may be stale after truncation.
+	size_t _staleSize = 0;
 };
 
 struct Superblock final : FsSuperblock {
@@ -482,19 +499,16 @@ struct Superblock final : FsSuperblock {
 		auto dest_dir = static_cast<DirectoryNode *>(dest_fs_dir);
 
 		auto src_dir = static_cast<DirectoryNode *>(src_link->getOwner().get());
-		auto it = src_dir->_entries.find(src_link->getName());
-		if(it == src_dir->_entries.end() || it->get() != src_link)
+		if(src_dir->_findEntry(src_link->getName()).get() != src_link)
 			co_return Error::alreadyExists;
 
 		// Unlink an existing link if such a link exists.
-		if(auto dest_it = dest_dir->_entries.find(dest_name);
-				dest_it != dest_dir->_entries.end())
-			dest_dir->_entries.erase(dest_it);
+		dest_dir->_eraseEntry(dest_name);
 
 		auto new_link = std::make_shared<Link>(dest_dir->shared_from_this(),
 				std::move(dest_name), src_link->getTarget());
-		src_dir->_entries.erase(it);
-		dest_dir->_entries.insert(new_link);
+		src_dir->_eraseEntry(src_link->getName());
+		dest_dir->_insertEntry(new_link);
 		co_return new_link;
 	}
 
@@ -510,9 +524,47 @@ private:
 // MemoryNode and MemoryFile implementation.
 // ----------------------------------------------------------------------------
 
+// The memory object of a file grows geometrically, starting at minAreaSize,
+// but at most by maxAreaGrowth at a time.
+constexpr size_t minAreaSize = 64 * 1024;
+constexpr size_t maxAreaGrowth = 64 * 1024 * 1024;
+
 MemoryNode::MemoryNode(Superblock *superblock)
 : Node{superblock}, _areaSize{0}, _fileSize{0} { }
 
+void MemoryNode::_resizeFile(size_t new_size, size_t written_offset) {
+	if(new_size < _fileSize) {
+		_staleSize = std::max(_staleSize, _fileSize);
+		_fileSize = new_size;
+		return;
+	}
+
+	size_t aligned_size = (new_size + 0xFFF) & ~size_t(0xFFF);
+	if(aligned_size > _areaSize) {
+		auto area_size = std::max({aligned_size, minAreaSize,
+				_areaSize + std::min(_areaSize, maxAreaGrowth)});
+		if(_memory) {
+			HEL_CHECK(helResizeMemory(_memory.getHandle(), area_size));
+		}else{
+			HelHandle handle;
+			HEL_CHECK(helAllocateMemory(area_size, 0, nullptr, &handle));
+			_memory = helix::UniqueDescriptor{handle};
+		}
+		_mapping = helix::Mapping{_memory, 0, area_size};
+		_areaSize = area_size;
+	}
+
+	// Data that was truncated away must read as zeros once the file grows again.
+	if(_fileSize < _staleSize) {
+		auto end = std::min(written_offset, _staleSize);
+		if(_fileSize < end)
+			memset(reinterpret_cast<char *>(_mapping.get()) + _fileSize, 0, end - _fileSize);
+		if(new_size >= _staleSize)
+			_staleSize = 0;
+	}
+	_fileSize = new_size;
+}
+
 void MemoryFile::handleClose() {
 	_cancelServe.cancel();
 }
@@ -535,7 +587,7 @@ async::result<frg::expected<Error, size_t>>
 MemoryFile::readSome(Process *, void *buffer, size_t max_length) {
 	auto node = static_cast<MemoryNode *>(associatedLink()->getTarget().get());
 
-	if(!(_offset <= node->_fileSize))
+	if(!(_offset < node->_fileSize))
 		co_return 0;
 	auto chunk = std::min(node->_fileSize - _offset, max_length);
 
@@ -549,8 +601,10 @@ async::result<frg::expected<Error>>
 MemoryFile::writeAll(Process *, const void *buffer, size_t length) {
 	auto node = static_cast<MemoryNode *>(associatedLink()->getTarget().get());
 
+	if(!length)
+		co_return {};
 	if(_offset + length > node->_fileSize)
-		node->_resizeFile(_offset + length);
+		node->_resizeFile(_offset + length, _offset);
 
 	memcpy(reinterpret_cast<char *>(node->_mapping.get()) + _offset, buffer, length);
 	_offset += length;
@@ -675,54 +729,54 @@ DirectoryNode::DirectoryNode(Superblock *superblock)
 
 async::result<std::variant<Error, std::shared_ptr<FsLink>>>
 DirectoryNode::mkdir(std::string name) {
-	if(!(_entries.find(name) == _entries.end()))
+	if(_findEntry(name))
 		co_return Error::alreadyExists;
 	auto node = std::make_shared<DirectoryNode>(static_cast<Superblock *>(superblock()));
 	auto the_node = node.get();
 	auto link = std::make_shared<Link>(shared_from_this(), std::move(name), std::move(node));
 	the_node->_treeLink = link;
-	_entries.insert(link);
+	_insertEntry(link);
 	co_return link;
 }
 
 async::result<std::variant<Error, std::shared_ptr<FsLink>>>
 DirectoryNode::symlink(std::string name, std::string path) {
-	if(!(_entries.find(name) == _entries.end()))
+	if(_findEntry(name))
 		co_return Error::alreadyExists;
 	auto node = std::make_shared<SymlinkNode>(static_cast<Superblock *>(superblock()),
 			std::move(path));
 	auto link = std::make_shared<Link>(shared_from_this(), std::move(name), std::move(node));
-	_entries.insert(link);
+	_insertEntry(link);
 	co_return link;
 }
 
 async::result<frg::expected<Error, std::shared_ptr<FsLink>>>
 DirectoryNode::mkdev(std::string name, VfsType type, DeviceId id) {
-	if(!(_entries.find(name) == _entries.end()))
+	if(_findEntry(name))
 		co_return Error::alreadyExists;
 	auto node = std::make_shared<DeviceNode>(static_cast<Superblock *>(superblock()),
 			type, id);
 	auto link = std::make_shared<Link>(shared_from_this(), std::move(name), std::move(node));
-	_entries.insert(link);
+	_insertEntry(link);
 	co_return link;
 }
 
 async::result<frg::expected<Error, std::shared_ptr<FsLink>>>
 DirectoryNode::mkfifo(std::string name, mode_t mode) {
-	if(!(_entries.find(name) == _entries.end()))
+	if(_findEntry(name))
 		co_return Error::alreadyExists;
 	auto node = std::make_shared<FifoNode>(static_cast<Superblock *>(superblock()), mode);
 	auto link = std::make_shared<Link>(shared_from_this(), std::move(name), std::move(node));
-	_entries.insert(link);
+	_insertEntry(link);
 	co_return link;
 }
 
 async::result<frg::expected<Error, std::shared_ptr<FsLink>>> DirectoryNode::mksocket(std::string name) {
-	if(!(_entries.find(name) == _entries.end()))
+	if(_findEntry(name))
 		co_return Error::alreadyExists;
 	auto node = std::make_shared<SocketNode>(static_cast<Superblock *>(superblock()));
 	auto link = std::make_shared<Link>(shared_from_this(), std::move(name), std::move(node));
-	_entries.insert(link);
+	_insertEntry(link);
 	co_return link;
 }
 
@@ -77,6 +77,7 @@ public:
 			_currentSeq{1}, _inSeq{0}, _ownerPid{0},
 			_remote{nullptr}, _passCreds{false}, nonBlock_{nonBlock},
 			_sockpath{}, _nameType{NameType::unnamed}, _isInherited{false} {
+		enablePollObservers();
 		if(process)
 			_ownerPid = process->pid();
 	}
@@ -92,6 +93,7 @@ public:
 			rf->_currentState = State::remoteShutDown;
 			rf->_hupSeq = ++rf->_currentSeq;
 			rf->_statusBell.ring();
+			rf->notifyPollObservers(EPOLLHUP | EPOLLOUT);
 			rf->_remote = nullptr;
 			_remote = nullptr;
 		}
@@ -144,6 +146,7 @@ public:
 		_remote->_recvQueue.push_back(std::move(packet));
 		_remote->_inSeq = ++_remote->_currentSeq;
 		_remote->_statusBell.ring();
+		_remote->notifyPollObservers(EPOLLIN | EPOLLOUT);
 		co_return {};
 	}
 
@@ -231,6 +234,7 @@ public:
 		_remote->_recvQueue.push_back(std::move(packet));
 		_remote->_inSeq = ++_remote->_currentSeq;
 		_remote->_statusBell.ring();
+		_remote->notifyPollObservers(EPOLLIN | EPOLLOUT);
 
 		co_return protocols::fs::SendResult { max_length };
 	}
@@ -242,10 +246,10 @@ public:
 		co_return _remote->_ownerPid;
 	}
 
-	async::result<void> setOption(int option, int value) override {
+	async::result<protocols::fs::Error> setOption(int option, int value) override {
 		assert(option == SO_PASSCRED);
 		_passCreds = value;
-		co_return;
+		co_return protocols::fs::Error::none;
 	}
 
 	async::result<frg::expected<Error, AcceptResult>> accept(Process *process) override {
@@ -380,6 +384,7 @@ public:
 			server->_acceptQueue.push_back(this);
 			server->_inSeq = ++server->_currentSeq;
 			server->_statusBell.ring();
+			server->notifyPollObservers(EPOLLIN | EPOLLOUT);
 
 			while(_currentState == State::null)
 				co_await _statusBell.async_wait();
@@ -401,6 +406,7 @@ public:
 			server->_acceptQueue.push_back(this);
 			server->_inSeq = ++server->_currentSeq;
 			server->_statusBell.ring();
+			server->notifyPollObservers(EPOLLIN | EPOLLOUT);
 
 			while(_currentState == State::null)
 				co_await _statusBell.async_wait();
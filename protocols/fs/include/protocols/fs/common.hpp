@@ -19,6 +19,7 @@ enum class Error {
 	brokenPipe = 7,
 	accessDenied = 8,
 	notDirectory = 20,
+	resourceBusy = 21,
 
 	afNotSupported = 9,
 	destAddrRequired = 10,
@@ -72,8 +72,8 @@ struct FileOperations {
 		read = f;
 		return *this;
 	}
-	constexpr FileOperations &withWrite(async::result<void> (*f)(void *object,
-			const char *, const void *buffer, size_t length)) {
+	constexpr FileOperations &withWrite(async::result<frg::expected<Error, size_t>> (*f)(
+			void *object, const char *, const void *buffer, size_t length)) {
 		write = f;
 		return *this;
 	}
@@ -90,6 +90,10 @@ struct FileOperations {
 		truncate = f;
 		return *this;
 	}
+	constexpr FileOperations &withFsync(async::result<void> (*f)(void *object)) {
+		fsync = f;
+		return *this;
+	}
 	constexpr FileOperations &withFallocate(async::result<void> (*f)(void *object,
 			int64_t offset, size_t size)) {
 		fallocate = f;
@@ -110,7 +114,7 @@ struct FileOperations {
 		getOption = f;
 		return *this;
 	}
-	constexpr FileOperations &withSetOption(async::result<void> (*f)(void *object,
+	constexpr FileOperations &withSetOption(async::result<Error> (*f)(void *object,
 			int option, int value)) {
 		setOption = f;
 		return *this;
@@ -153,17 +157,19 @@ struct FileOperations {
 			void *buffer, size_t length);
 	async::result<ReadResult> (*pread)(void *object, int64_t offset, const char *credentials,
 			void *buffer, size_t length);
-	async::result<void> (*write)(void *object, const char *credentials,
+	// Returns the number of bytes written; this is less than length for short writes.
+	async::result<frg::expected<Error, size_t>> (*write)(void *object, const char *credentials,
 			const void *buffer, size_t length);
 	async::result<ReadEntriesResult> (*readEntries)(void *object);
 	async::result<helix::BorrowedDescriptor>(*accessMemory)(void *object);
 	async::result<void> (*truncate)(void *object, size_t size);
+	async::result<void> (*fsync)(void *object);
 	async::result<void> (*fallocate)(void *object, int64_t offset, size_t size);
 	async::result<void> (*ioctl)(void *object, managarm::fs::CntRequest req,
 			helix::UniqueLane conversation);
 	async::result<protocols::fs::Error> (*flock)(void *object, int flags);
 	async::result<int> (*getOption)(void *object, int option);
-	async::result<void> (*setOption)(void *object, int option, int value);
+	async::result<Error> (*setOption)(void *object, int option, int value);
 	async::result<PollResult> (*poll)(void *object, uint64_t sequence,
 			async::cancellation_token cancellation);
 	async::result<Error> (*bind)(void *object, const char *credentials,
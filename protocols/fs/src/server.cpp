@@ -237,11 +237,21 @@ async::detached handlePassthrough(smarter::shared_ptr<void> file,
 		HEL_CHECK(extract_creds.error());
 		HEL_CHECK(recv_buffer.error());
 
-		co_await file_ops->write(file.get(), extract_creds.credentials(),
+		auto result = co_await file_ops->write(file.get(), extract_creds.credentials(),
 				buffer.data(), recv_buffer.actualLength());
 
 		managarm::fs::SvrResponse resp;
-		resp.set_error(managarm::fs::Errors::SUCCESS);
+		if(!result && result.error() == Error::wouldBlock) {
+			resp.set_error(managarm::fs::Errors::WOULD_BLOCK);
+		}else if(!result && result.error() == Error::brokenPipe) {
+			resp.set_error(managarm::fs::Errors::BROKEN_PIPE);
+		}else if(!result && result.error() == Error::illegalArguments) {
+			resp.set_error(managarm::fs::Errors::ILLEGAL_ARGUMENT);
+		}else{
+			assert(result);
+			resp.set_error(managarm::fs::Errors::SUCCESS);
+			resp.set_size(result.value());
+		}
 
 		auto ser = resp.SerializeAsString();
 		auto [send_resp] = co_await helix_ng::exchangeMsgs(
@@ -351,6 +361,30 @@ async::detached handlePassthrough(smarter::shared_ptr<void> file,
 		managarm::fs::SvrResponse resp;
 		resp.set_error(managarm::fs::Errors::SUCCESS);
 
+		auto ser = resp.SerializeAsString();
+		auto [send_resp] = co_await helix_ng::exchangeMsgs(
+			conversation,
+			helix_ng::sendBuffer(ser.data(), ser.size())
+		);
+		HEL_CHECK(send_resp.error());
+	}else if(req.req_type() == managarm::fs::CntReqType::PT_FSYNC) {
+		if(!file_ops->fsync) {
+			managarm::fs::SvrResponse resp;
+			resp.set_error(managarm::fs::Errors::ILLEGAL_OPERATION_TARGET);
+
+			auto ser = resp.SerializeAsString();
+			auto [send_resp] = co_await helix_ng::exchangeMsgs(
+				conversation,
+				helix_ng::sendBuffer(ser.data(), ser.size())
+			);
+			HEL_CHECK(send_resp.error());
+			co_return;
+		}
+		co_await file_ops->fsync(file.get());
+
+		managarm::fs::SvrResponse resp;
+		resp.set_error(managarm::fs::Errors::SUCCESS);
+
 		auto ser = resp.SerializeAsString();
 		auto [send_resp] = co_await helix_ng::exchangeMsgs(
 			conversation,
@@ -433,10 +467,19 @@ async::detached handlePassthrough(smarter::shared_ptr<void> file,
 			HEL_CHECK(send_resp.error());
 			co_return;
 		}
-		co_await file_ops->setOption(file.get(), req.command(), req.value());
+		auto result = co_await file_ops->setOption(file.get(), req.command(), req.value());
 
 		managarm::fs::SvrResponse resp;
-		resp.set_error(managarm::fs::Errors::SUCCESS);
+		if(result == Error::illegalArguments) {
+			resp.set_error(managarm::fs::Errors::ILLEGAL_ARGUMENT);
+		}else if(result == Error::insufficientPermissions) {
+			resp.set_error(managarm::fs::Errors::INSUFFICIENT_PERMISSIONS);
+		}else if(result == Error::resourceBusy) {
+			resp.set_error(managarm::fs::Errors::RESOURCE_BUSY);
+		}else{
+			assert(result == Error::none);
+			resp.set_error(managarm::fs::Errors::SUCCESS);
+		}
 
 		auto ser = resp.SerializeAsString();
 		auto [send_resp] = co_await helix_ng::exchangeMsgs(
@@ -29,6 +29,8 @@ struct Capability {
 struct PciInfo {
 	BarInfo barInfo[6];
 	std::vector<Capability> caps;
+	// Number of MSI (or MSI-X) vectors that can be obtained via accessMsi().
+	unsigned int numMsis;
 };
 
 struct FbInfo {
@@ -46,6 +48,10 @@ struct Device {
 	async::result<PciInfo> getPciInfo();
 	async::result<helix::UniqueDescriptor> accessBar(int index);
 	async::result<helix::UniqueDescriptor> accessIrq();
+	// Switches the device to MSIs and returns the IRQ of the given vector.
+	// If cpu is negative, the kernel chooses a CPU. Returns an empty descriptor
+	// if no interrupt vector is available.
+	async::result<helix::UniqueDescriptor> accessMsi(unsigned int index, int cpu = -1);
 
 	async::result<void> claimDevice();
 	async::result<void> enableBusIrq();
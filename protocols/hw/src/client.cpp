@@ -35,6 +35,7 @@ async::result<PciInfo> Device::getPciInfo() {
 	assert(resp.bars_size() == 6);
 
 	PciInfo info;
+	info.numMsis = resp.num_msis();
 
 	for(int i = 0; i < resp.capabilities_size(); i++)
 		info.caps.push_back({resp.capabilities(i).type()});
@@ -115,6 +116,39 @@ async::result<helix::UniqueDescriptor> Device::accessIrq() {
 	co_return pull_irq.descriptor();
 }
 
+async::result<helix::UniqueDescriptor> Device::accessMsi(unsigned int index, int cpu) {
+	helix::Offer offer;
+	helix::SendBuffer send_req;
+	helix::RecvInline recv_resp;
+	helix::PullDescriptor pull_irq;
+
+	managarm::hw::CntRequest req;
+	req.set_req_type(managarm::hw::CntReqType::ACCESS_MSI);
+	req.set_index(index);
+	req.set_cpu(cpu);
+
+	auto ser = req.SerializeAsString();
+	auto &&transmit = helix::submitAsync(_lane, helix::Dispatcher::global(),
+			helix::action(&offer, kHelItemAncillary),
+			helix::action(&send_req, ser.data(), ser.size(), kHelItemChain),
+			helix::action(&recv_resp, kHelItemChain),
+			helix::action(&pull_irq));
+	co_await transmit.async_wait();
+	HEL_CHECK(offer.error());
+	HEL_CHECK(send_req.error());
+	HEL_CHECK(recv_resp.error());
+
+	managarm::hw::SvrResponse resp;
+	resp.ParseFromArray(recv_resp.data(), recv_resp.length());
+	// The server does not push a descriptor if the vector could not be allocated.
+	if(resp.error() == managarm::hw::Errors::RESOURCE_EXHAUSTED)
+		co_return helix::UniqueDescriptor{};
+	assert(resp.error() == managarm::hw::Errors::SUCCESS);
+	HEL_CHECK(pull_irq.error());
+
+	co_return pull_irq.descriptor();
+}
+
 async::result<void> Device::claimDevice() {
 	helix::Offer offer;
 	helix::SendBuffer send_req;
@@ -163,9 +163,10 @@ async::detached handleObserver(std::shared_ptr<Connection> connection,
 	while(true) {
 		helix::RecvBuffer recv_req;
 
-		char buffer[1024];
+		// mbus batches attach events up to (roughly) half of this size.
+		char buffer[16384];
 		auto &&header = helix::submitAsync(lane, helix::Dispatcher::global(),
-				helix::action(&recv_req, buffer, 1024));
+				helix::action(&recv_req, buffer, 16384));
 		co_await header.async_wait();
 		HEL_CHECK(recv_req.error());
 
@@ -177,6 +178,14 @@ async::detached handleObserver(std::shared_ptr<Connection> connection,
 				properties.insert({ kv.name(), StringItem{kv.item().string_item().value()} });
 
 			handler.attach(Entity{connection, req.id()}, std::move(properties));
+		}else if(req.req_type() == managarm::mbus::SvrReqType::ATTACH_BATCH) {
+			for(auto &entity : req.entities()) {
+				Properties properties;
+				for(auto &kv : entity.properties())
+					properties.insert({ kv.name(), StringItem{kv.item().string_item().value()} });
+
+				handler.attach(Entity{connection, entity.id()}, std::move(properties));
+			}
 		}else{
 			throw std::runtime_error("Unexpected request type");
 		}
@@ -0,0 +1,74 @@
+#ifndef PROTOCOLS_POSIX_DATA_HPP
+#define PROTOCOLS_POSIX_DATA_HPP
+
+#include <stdint.h>
+
+namespace protocols {
+namespace posix {
+
+// Supercall that returns the address of the ProcessInfoPage.
+// Servers that implement this supercall also implement ThreadPage::signalMask.
+inline constexpr int superGetProcessInfoPage = 12;
+
+// Page that is shared (read-write) between the posix subsystem and each thread.
+struct ThreadPage {
+	// 0: signals can be raised; 1: the thread blocks signal delivery;
+	// 2: the server requested the thread to issue SIG_RAISE.
+	int globalSignalFlag;
+	int padding;
+
+	// Current signal mask. Clients can block signals by changing this word directly.
+	// After unblocking signals that are set in pendingSignals, clients must issue
+	// the SIG_RAISE supercall to receive them.
+	uint64_t signalMask;
+
+	// Signals that might be pending. The server sets bits as soon as signals are issued
+	// and recomputes the word when it inspects the thread. Hence, this is a superset
+	// of the signals that still need to be raised.
+	uint64_t pendingSignals;
+};
+
+// Read-only page that the posix subsystem maps into each process.
+// It allows clients to implement getpid() & friends without IPC.
+//
+// The server updates the page under a seqlock: it increments seqlock to an odd value,
+// updates the fields and increments seqlock again. Clients retry reads that
+// observe an odd seqlock or a seqlock that changed during the read.
+struct ProcessInfoPage {
+	uint64_t seqlock;
+
+	int32_t pid;
+	int32_t ppid;
+	int32_t pgid;
+	int32_t sid;
+	int32_t uid;
+	int32_t euid;
+	int32_t gid;
+	int32_t egid;
+
+	// Incremented whenever the result of getcwd() might change, i.e., on chdir(),
+	// fchdir() and chroot(), and on renames and mounts anywhere in the VFS.
+	// Clients can cache the result of GETCWD as long as this does not change.
+	uint64_t cwdGeneration;
+};
+
+static_assert(sizeof(ThreadPage) <= 0x1000);
+static_assert(sizeof(ProcessInfoPage) <= 0x1000);
+
+// Client-side consistent read of the ProcessInfoPage.
+inline ProcessInfoPage readProcessInfo(const ProcessInfoPage *page) {
+	ProcessInfoPage copy;
+	while(true) {
+		auto seq = __atomic_load_n(&page->seqlock, __ATOMIC_ACQUIRE);
+		if(seq & 1)
+			continue;
+		__builtin_memcpy(&copy, const_cast<const ProcessInfoPage *>(page), sizeof(ProcessInfoPage));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&page->seqlock, __ATOMIC_RELAXED) == seq)
+			return copy;
+	}
+}
+
+} } // namespace protocols::posix
+
+#endif // PROTOCOLS_POSIX_DATA_HPP
@@ -273,9 +273,13 @@ struct Tcp4Socket {
 		co_return std::get<protocols::fs::RecvData>(result).dataLength;
 	}
 
-	static async::result<void> write(void *object, const char *creds,
-			const void *data, size_t size) {
-		co_await sendMsg(object, creds, 0, const_cast<void *>(data), size, nullptr, 0, {});
+	static async::result<frg::expected<protocols::fs::Error, size_t>> write(void *object,
+			const char *creds, const void *data, size_t size) {
+		auto result = co_await sendMsg(object, creds, 0,
+				const_cast<void *>(data), size, nullptr, 0, {});
+		if(auto error = std::get_if<protocols::fs::Error>(&result); error)
+			co_return *error;
+		co_return std::get<size_t>(result);
 	}
 
 	static async::result<protocols::fs::RecvResult> recvMsg(void *object,
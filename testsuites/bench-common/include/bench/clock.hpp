@@ -0,0 +1,18 @@
+#ifndef BENCH_CLOCK_HPP
+#define BENCH_CLOCK_HPP
+
+#include <stdint.h>
+#include <time.h>
+
+namespace bench {
+
+// Returns the monotonic clock in nanoseconds.
+inline uint64_t clockNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+} // namespace bench
+
+#endif // BENCH_CLOCK_HPP
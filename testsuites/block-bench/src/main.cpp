@@ -0,0 +1,113 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <bench/clock.hpp>
+
+// Measures the read throughput of the block device that backs a file.
+// The file is split into equally sized parts that are read concurrently by
+// separate processes; this allows drivers to keep multiple commands in flight.
+// In random mode, each process reads the 4 KiB blocks of its part in random order
+// to measure IOPS instead of streaming throughput.
+//
+// Since libblockfs caches file contents, only the first run after boot measures
+// the driver. To compare drivers (e.g., block-ata, block-ahci and block-nvme), boot
+// with the disk attached to the respective controller and run the benchmark on a large file.
+
+namespace {
+
+constexpr size_t sequentialBlockSize = 128 << 10; // In bytes.
+constexpr size_t randomBlockSize = 4 << 10; // In bytes.
+
+void runReader(const char *path, off_t offset, off_t length, bool random, int seed) {
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		perror("block-bench: open() failed");
+		_exit(1);
+	}
+
+	auto blockSize = random ? randomBlockSize : sequentialBlockSize;
+	std::vector<off_t> blocks;
+	for(off_t progress = 0; progress < length; progress += blockSize)
+		blocks.push_back(progress);
+	if(random)
+		std::shuffle(blocks.begin(), blocks.end(), std::minstd_rand{static_cast<unsigned>(seed)});
+
+	std::vector<char> buffer(blockSize);
+	for(auto block : blocks) {
+		auto chunk = pread(fd, buffer.data(),
+				std::min(static_cast<off_t>(blockSize), length - block),
+				offset + block);
+		if(chunk < 0) {
+			perror("block-bench: pread() failed");
+			_exit(1);
+		}
+	}
+	close(fd);
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+	if(argc < 2) {
+		std::cerr << "Usage: block-bench FILE [READERS] [random]" << std::endl;
+		return 1;
+	}
+	auto path = argv[1];
+	int numReaders = (argc > 2) ? atoi(argv[2]) : 1;
+	bool random = (argc > 3) && !strcmp(argv[3], "random");
+	assert(numReaders >= 1);
+
+	struct stat st;
+	if(stat(path, &st)) {
+		perror("block-bench: stat() failed");
+		return 1;
+	}
+	off_t part = (st.st_size + numReaders - 1) / numReaders;
+
+	auto start = bench::clockNow();
+	std::vector<pid_t> children;
+	for(int i = 0; i < numReaders; i++) {
+		auto offset = i * part;
+		if(offset >= st.st_size)
+			break;
+		auto child = fork();
+		if(child < 0) {
+			perror("block-bench: fork() failed");
+			return 1;
+		}else if(!child) {
+			runReader(path, offset, std::min(part, st.st_size - offset), random, i);
+			_exit(0);
+		}
+		children.push_back(child);
+	}
+
+	for(auto child : children) {
+		int status;
+		if(waitpid(child, &status, 0) < 0) {
+			perror("block-bench: waitpid() failed");
+			return 1;
+		}
+		assert(WIFEXITED(status) && !WEXITSTATUS(status));
+	}
+	auto elapsed = bench::clockNow() - start;
+
+	auto blockSize = random ? randomBlockSize : sequentialBlockSize;
+	auto numBlocks = (st.st_size + blockSize - 1) / blockSize;
+	std::cout << "block-bench: Read " << st.st_size << " bytes "
+			<< (random ? "randomly" : "sequentially") << " with "
+			<< children.size() << " readers: " << std::fixed << std::setprecision(2)
+			<< st.st_size * 1e3 / elapsed << " MB/s, "
+			<< numBlocks * 1e9 / elapsed << " IOPS" << std::endl;
+}
@@ -0,0 +1,57 @@
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include <hel.h>
+#include <hel-syscalls.h>
+
+#include <bench/clock.hpp>
+
+// Measures the context switch latency by passing a token between two threads.
+// Each round trip involves two futex wakeups and (on a single CPU) two context switches.
+
+namespace {
+
+constexpr int roundTrips = 100'000;
+
+// Thread 0 owns the token if the counter is even, thread 1 if it is odd.
+void pingPong(std::atomic<int> *counter, int self, bool dirtySimd) {
+	volatile double value = 1.0;
+	for(int i = 0; i < roundTrips; i++) {
+		while(true) {
+			auto seq = counter->load(std::memory_order_acquire);
+			if((seq & 1) == self)
+				break;
+			HEL_CHECK(helFutexWait(reinterpret_cast<int *>(counter), seq, -1));
+		}
+
+		// Modify the SSE registers such that the kernel has to save them.
+		if(dirtySimd)
+			value = value * 1.000001 + 0.5;
+
+		counter->fetch_add(1, std::memory_order_release);
+		HEL_CHECK(helFutexWake(reinterpret_cast<int *>(counter)));
+	}
+}
+
+void runPingPong(bool dirtySimd) {
+	std::atomic<int> counter{0};
+
+	auto start = bench::clockNow();
+	std::thread other{pingPong, &counter, 1, dirtySimd};
+	pingPong(&counter, 0, dirtySimd);
+	other.join();
+	auto elapsed = bench::clockNow() - start;
+
+	std::cout << "context-switch-bench: Ping-pong" << (dirtySimd ? " with SIMD" : "")
+			<< ": " << elapsed / roundTrips << " ns per round trip" << std::endl;
+}
+
+} // anonymous namespace
+
+int main() {
+	runPingPong(false);
+	runPingPong(true);
+}
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <bench/clock.hpp>
+#include <core/drm/blit.hpp>
+
+// Measures the throughput of the drm_core software blitting kernels
+// on a full 1920x1080 frame for each implementation that the CPU supports.
+
+namespace {
+
+constexpr size_t frameWidth = 1920;
+constexpr size_t frameHeight = 1080;
+constexpr uint64_t minDuration = 500'000'000; // In nanoseconds.
+
+struct Kernel {
+	const char *name;
+	size_t srcBpp;
+	size_t destBpp;
+	void (*run)(void *dest, const void *src, size_t count);
+};
+
+void runCopy(void *dest, const void *src, size_t count) {
+	drm_core::blitCopy(dest, src, count * 4);
+}
+
+const Kernel kernels[] = {
+	{"copy", 4, 4, &runCopy},
+	{"xrgb8888->rgb565", 4, 2, &drm_core::convertXrgb8888ToRgb565},
+	{"rgb565->xrgb8888", 2, 4, &drm_core::convertRgb565ToXrgb8888},
+	{"xrgb8888->xbgr8888", 4, 4, &drm_core::convertXrgb8888ToXbgr8888},
+	{"blend-argb8888", 4, 4, &drm_core::blendArgb8888},
+};
+
+} // anonymous namespace
+
+int main() {
+	std::vector<uint32_t> src(frameWidth * frameHeight);
+	std::vector<uint32_t> dest(frameWidth * frameHeight);
+	for(size_t i = 0; i < src.size(); i++)
+		src[i] = static_cast<uint32_t>(i * 2654435761u) | 0x80000000;
+	memset(dest.data(), 0, dest.size() * sizeof(uint32_t));
+
+	std::cout << "drm-blit-bench: Default implementation is "
+			<< drm_core::blitImplementation() << std::endl;
+
+	for(auto impl : {"generic", "sse2", "avx2"}) {
+		if(!drm_core::selectBlitImplementation(impl)) {
+			std::cout << "drm-blit-bench: " << impl << " is not supported" << std::endl;
+			continue;
+		}
+
+		for(auto &kernel : kernels) {
+			// Process whole frames row by row, just like the drivers do.
+			uint64_t frames = 0;
+			auto start = bench::clockNow();
+			uint64_t elapsed;
+			do {
+				auto s = reinterpret_cast<const char *>(src.data());
+				auto d = reinterpret_cast<char *>(dest.data());
+				for(size_t y = 0; y < frameHeight; y++)
+					kernel.run(d + y * frameWidth * kernel.destBpp,
+							s + y * frameWidth * kernel.srcBpp, frameWidth);
+				frames++;
+				elapsed = bench::clockNow() - start;
+			} while(elapsed < minDuration);
+
+			// Count bytes that are read plus bytes that are written.
+			auto bytes = frames * frameWidth * frameHeight * (kernel.srcBpp + kernel.destBpp);
+			std::cout << "drm-blit-bench: " << std::setw(8) << std::left << impl
+					<< std::setw(20) << kernel.name << std::right << std::fixed
+					<< std::setprecision(2) << std::setw(8)
+					<< static_cast<double>(bytes) / elapsed << " GB/s, "
+					<< std::setw(8) << frames * 1e9 / elapsed << " frames/s" << std::endl;
+		}
+	}
+}
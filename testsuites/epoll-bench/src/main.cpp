@@ -0,0 +1,120 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <bench/clock.hpp>
+
+// Measures the latency of epoll_wait() depending on the number of registered items.
+// Most items are idle eventfds; in each iteration, a few hot eventfds are signaled,
+// reported by epoll_wait() and drained again. If the cost of epoll_wait() depends
+// on the number of idle items, epoll does not scale.
+
+namespace {
+
+constexpr int numIterations = 1000;
+constexpr int numHot = 4;
+
+void signalFd(int fd) {
+	uint64_t n = 1;
+	if(write(fd, &n, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		perror("epoll-bench: write() failed");
+		_exit(1);
+	}
+}
+
+void drainFd(int fd) {
+	uint64_t n;
+	if(read(fd, &n, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		perror("epoll-bench: read() failed");
+		_exit(1);
+	}
+}
+
+int addFd(int epfd, uint32_t events, uint64_t cookie) {
+	int fd = eventfd(0, 0);
+	if(fd < 0) {
+		perror("epoll-bench: eventfd() failed");
+		_exit(1);
+	}
+
+	epoll_event evt{};
+	evt.events = events;
+	evt.data.u64 = cookie;
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &evt)) {
+		perror("epoll-bench: epoll_ctl() failed");
+		_exit(1);
+	}
+	return fd;
+}
+
+} // anonymous namespace
+
+int main() {
+	struct rlimit limit;
+	if(!getrlimit(RLIMIT_NOFILE, &limit)) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	for(auto mode : {uint32_t{0}, static_cast<uint32_t>(EPOLLET)}) {
+		for(size_t numIdle : {0, 100, 1000, 10000}) {
+			int epfd = epoll_create1(0);
+			if(epfd < 0) {
+				perror("epoll-bench: epoll_create1() failed");
+				return 1;
+			}
+
+			std::vector<int> hot;
+			std::vector<int> idle;
+			for(int i = 0; i < numHot; i++)
+				hot.push_back(addFd(epfd, EPOLLIN | mode, i));
+			for(size_t i = 0; i < numIdle; i++)
+				idle.push_back(addFd(epfd, EPOLLIN | mode, numHot + i));
+
+			// Skip the initial report of all items.
+			epoll_event events[16];
+			while(epoll_wait(epfd, events, 16, 0) > 0)
+				;
+
+			auto start = bench::clockNow();
+			for(int k = 0; k < numIterations; k++) {
+				for(auto fd : hot)
+					signalFd(fd);
+
+				int seen = 0;
+				while(seen < numHot) {
+					auto n = epoll_wait(epfd, events, 16, -1);
+					if(n < 0) {
+						perror("epoll-bench: epoll_wait() failed");
+						return 1;
+					}
+					for(int i = 0; i < n; i++) {
+						assert(events[i].data.u64 < static_cast<uint64_t>(numHot));
+						drainFd(hot[events[i].data.u64]);
+						seen++;
+					}
+				}
+			}
+			auto elapsed = bench::clockNow() - start;
+
+			std::cout << "epoll-bench: " << (mode ? "Edge" : "Level") << "-triggered, "
+					<< numHot << " hot and " << std::setw(5) << numIdle << " idle items: "
+					<< std::fixed << std::setprecision(2)
+					<< elapsed / 1000.0 / numIterations << " us per iteration" << std::endl;
+
+			for(auto fd : hot)
+				close(fd);
+			for(auto fd : idle)
+				close(fd);
+			close(epfd);
+		}
+	}
+}
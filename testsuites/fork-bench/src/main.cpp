@@ -0,0 +1,72 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <bench/clock.hpp>
+
+// Measures the latency of fork() (including the child's _exit() and the parent's
+// waitpid()) depending on the number of memory mappings of the parent process.
+// Each additional mapping is private, anonymous and has one dirty page,
+// such that fork() needs to set up copy-on-write for all of them.
+
+namespace {
+
+constexpr int numIterations = 200;
+constexpr size_t mappingSize = 4 << 12; // In bytes.
+
+} // anonymous namespace
+
+int main() {
+	std::vector<void *> mappings;
+	for(size_t numMappings : {0, 100, 250, 500, 1000}) {
+		while(mappings.size() < numMappings) {
+			// Alternate the protection such that consecutive mappings cannot be merged.
+			auto prot = (mappings.size() % 2) ? PROT_READ : (PROT_READ | PROT_WRITE);
+			auto pointer = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(pointer == MAP_FAILED) {
+				perror("fork-bench: mmap() failed");
+				return 1;
+			}
+			*reinterpret_cast<volatile char *>(pointer) = 0x42;
+			if(mprotect(pointer, mappingSize, prot)) {
+				perror("fork-bench: mprotect() failed");
+				return 1;
+			}
+			mappings.push_back(pointer);
+		}
+
+		auto start = bench::clockNow();
+		for(int i = 0; i < numIterations; i++) {
+			auto child = fork();
+			if(child < 0) {
+				perror("fork-bench: fork() failed");
+				return 1;
+			}else if(!child) {
+				_exit(0);
+			}
+
+			int status;
+			if(waitpid(child, &status, 0) < 0) {
+				perror("fork-bench: waitpid() failed");
+				return 1;
+			}
+			assert(WIFEXITED(status) && !WEXITSTATUS(status));
+		}
+		auto elapsed = bench::clockNow() - start;
+
+		std::cout << "fork-bench: " << std::setw(4) << numMappings << " mappings: "
+				<< std::fixed << std::setprecision(1)
+				<< elapsed / 1e3 / numIterations << " us per fork()" << std::endl;
+	}
+
+	for(auto pointer : mappings)
+		munmap(pointer, mappingSize);
+}
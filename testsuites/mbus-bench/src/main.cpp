@@ -0,0 +1,163 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <async/oneshot-event.hpp>
+#include <bench/clock.hpp>
+#include <protocols/mbus/client.hpp>
+
+// Synthetic load on mbus: creates many objects and links many observers
+// (similar to the boot process, where drivers observe PCI, USB and input entities).
+// Reports how long mbus takes to create objects and to deliver attach events.
+
+namespace {
+
+constexpr int numObjects = 1024;
+constexpr int numBuckets = 16;
+constexpr int numObservers = 256;
+
+void report(const char *name, std::vector<uint64_t> &latencies) {
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&] (double p) -> uint64_t {
+		auto k = std::min(latencies.size() - 1, static_cast<size_t>(latencies.size() * p));
+		return latencies[k];
+	};
+	uint64_t total = 0;
+	for(auto l : latencies)
+		total += l;
+
+	std::cout << "mbus-bench: " << std::setw(28) << std::left << name
+			<< std::right << std::fixed << std::setprecision(2)
+			<< std::setw(8) << latencies.size() << " ops, "
+			<< std::setw(10) << latencies.size() * 1e9 / total << " ops/s, p50: "
+			<< std::setw(8) << percentile(0.5) / 1000.0 << " us, p99: "
+			<< std::setw(8) << percentile(0.99) / 1000.0 << " us" << std::endl;
+}
+
+// Waits until a number of attach events were received.
+struct AttachCounter {
+	AttachCounter(int expected)
+	: expected{expected} { }
+
+	void attach() {
+		if(++received == expected)
+			done.raise();
+	}
+
+	int expected;
+	int received = 0;
+	async::oneshot_event done;
+};
+
+async::result<void> run() {
+	auto root = co_await mbus::Instance::global().getRoot();
+	// Distinguishes the objects of multiple runs of the benchmark.
+	auto run = std::to_string(getpid());
+
+	auto properties = [&] (int i) {
+		return mbus::Properties{
+			{"class", mbus::StringItem{"mbus-bench"}},
+			{"mbus-bench-run", mbus::StringItem{run}},
+			{"mbus-bench-index", mbus::StringItem{std::to_string(i)}},
+			{"mbus-bench-bucket", mbus::StringItem{std::to_string(i % numBuckets)}}
+		};
+	};
+
+	auto indexFilter = [&] (int i) {
+		return mbus::Conjunction({
+			mbus::EqualsFilter("mbus-bench-run", run),
+			mbus::EqualsFilter("mbus-bench-index", std::to_string(i))
+		});
+	};
+
+	// Link observers for objects that do not exist yet. Each new object
+	// needs to be checked against them (and all other observers in the system).
+	std::vector<uint64_t> linkLatencies;
+	std::vector<uint64_t> createTimes(numObjects);
+	std::vector<uint64_t> attachLatencies;
+	AttachCounter futureAttaches{numObservers};
+	for(int i = 0; i < numObservers; i++) {
+		auto handler = mbus::ObserverHandler{}
+		.withAttach([&, i] (mbus::Entity, mbus::Properties) {
+			attachLatencies.push_back(bench::clockNow() - createTimes[i]);
+			futureAttaches.attach();
+		});
+
+		auto start = bench::clockNow();
+		co_await root.linkObserver(indexFilter(i), std::move(handler));
+		linkLatencies.push_back(bench::clockNow() - start);
+	}
+	report("link (no match)", linkLatencies);
+
+	std::vector<uint64_t> createLatencies;
+	for(int i = 0; i < numObjects; i++) {
+		auto handler = mbus::ObjectHandler{}
+		.withBind([] () -> async::result<helix::UniqueDescriptor> {
+			throw std::runtime_error("mbus-bench: Objects cannot be bound");
+		});
+
+		auto start = bench::clockNow();
+		createTimes[i] = start;
+		co_await root.createObject("mbus-bench", properties(i), std::move(handler));
+		createLatencies.push_back(bench::clockNow() - start);
+	}
+	report("create object", createLatencies);
+
+	co_await futureAttaches.done.wait();
+	report("create -> attach", attachLatencies);
+
+	// Link observers that match a single existing object.
+	linkLatencies.clear();
+	for(int i = 0; i < numObservers; i++) {
+		AttachCounter counter{1};
+		auto handler = mbus::ObserverHandler{}
+		.withAttach([&] (mbus::Entity, mbus::Properties) {
+			counter.attach();
+		});
+
+		auto start = bench::clockNow();
+		co_await root.linkObserver(indexFilter(numObjects - 1 - i), std::move(handler));
+		co_await counter.done.wait();
+		linkLatencies.push_back(bench::clockNow() - start);
+	}
+	report("link -> attach (1 match)", linkLatencies);
+
+	// Link observers that match many existing objects.
+	linkLatencies.clear();
+	for(int b = 0; b < numBuckets; b++) {
+		AttachCounter counter{numObjects / numBuckets};
+		auto handler = mbus::ObserverHandler{}
+		.withAttach([&] (mbus::Entity, mbus::Properties) {
+			counter.attach();
+		});
+
+		auto start = bench::clockNow();
+		co_await root.linkObserver(mbus::Conjunction({
+			mbus::EqualsFilter("mbus-bench-run", run),
+			mbus::EqualsFilter("mbus-bench-bucket", std::to_string(b))
+		}), std::move(handler));
+		co_await counter.done.wait();
+		linkLatencies.push_back(bench::clockNow() - start);
+	}
+	report("link -> attach (64 matches)", linkLatencies);
+
+	exit(0);
+}
+
+} // anonymous namespace
+
+int main() {
+	{
+		async::queue_scope scope{helix::globalQueue()};
+		async::detach(run());
+	}
+
+	async::run_forever(helix::globalQueue()->run_token(), helix::currentDispatcher);
+}
@@ -0,0 +1,93 @@
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <bench/clock.hpp>
+
+// Measures the throughput of pipes between two processes
+// for a range of transfer sizes.
+
+namespace {
+
+constexpr uint64_t transferSize = 64 << 20; // In bytes.
+
+void runWriter(int fd, size_t blockSize) {
+	std::vector<char> buffer(blockSize, 0x42);
+	uint64_t progress = 0;
+	while(progress < transferSize) {
+		auto chunk = write(fd, buffer.data(), blockSize);
+		if(chunk < 0) {
+			perror("pipe-bench: write() failed");
+			_exit(1);
+		}
+		progress += chunk;
+	}
+}
+
+// Returns the number of read() calls that were necessary.
+uint64_t runReader(int fd, size_t blockSize) {
+	std::vector<char> buffer(blockSize);
+	uint64_t progress = 0;
+	uint64_t calls = 0;
+	while(true) {
+		auto chunk = read(fd, buffer.data(), blockSize);
+		if(chunk < 0) {
+			perror("pipe-bench: read() failed");
+			exit(1);
+		}
+		if(!chunk)
+			break;
+		progress += chunk;
+		calls++;
+	}
+	assert(progress == transferSize);
+	return calls;
+}
+
+} // anonymous namespace
+
+int main() {
+	for(size_t blockSize : {64, 512, 4096, 16384, 65536}) {
+		int fds[2];
+		if(pipe(fds)) {
+			perror("pipe-bench: pipe() failed");
+			return 1;
+		}
+
+		auto start = bench::clockNow();
+		auto child = fork();
+		if(child < 0) {
+			perror("pipe-bench: fork() failed");
+			return 1;
+		}else if(!child) {
+			close(fds[0]);
+			runWriter(fds[1], blockSize);
+			close(fds[1]);
+			_exit(0);
+		}
+
+		close(fds[1]);
+		auto calls = runReader(fds[0], blockSize);
+		close(fds[0]);
+		auto elapsed = bench::clockNow() - start;
+
+		int status;
+		if(waitpid(child, &status, 0) < 0) {
+			perror("pipe-bench: waitpid() failed");
+			return 1;
+		}
+		assert(WIFEXITED(status) && !WEXITSTATUS(status));
+
+		std::cout << "pipe-bench: " << std::setw(6) << blockSize << " byte blocks: "
+				<< std::fixed << std::setprecision(2) << std::setw(8)
+				<< transferSize * 1e3 / elapsed << " MB/s, "
+				<< std::setw(8) << static_cast<double>(transferSize) / calls
+				<< " bytes/read" << std::endl;
+	}
+}
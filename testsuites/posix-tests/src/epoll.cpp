@@ -47,3 +47,95 @@ DEFINE_TEST(epoll_mod_active, ([] {
 	close(epfd);
 	close(fd);
 }))
+
+DEFINE_TEST(epoll_edge_triggered, ([] {
+	int e;
+	int pending;
+
+	int fd = eventfd(0, 0);
+	assert(fd >= 0);
+
+	int epfd = epoll_create1(0);
+	assert(epfd >= 0);
+
+	epoll_event evt;
+
+	memset(&evt, 0, sizeof(epoll_event));
+	evt.events = EPOLLIN | EPOLLET;
+	e = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &evt);
+	assert(!e);
+
+	uint64_t n = 1;
+	auto written = write(fd, &n, sizeof(uint64_t));
+	assert(written == sizeof(uint64_t));
+
+	memset(&evt, 0, sizeof(epoll_event));
+	pending = epoll_wait(epfd, &evt, 1, 0);
+	assert(pending == 1);
+	assert(evt.events & EPOLLIN);
+
+	// The FD is still readable but there was no new edge.
+	memset(&evt, 0, sizeof(epoll_event));
+	pending = epoll_wait(epfd, &evt, 1, 0);
+	assert(!pending);
+
+	written = write(fd, &n, sizeof(uint64_t));
+	assert(written == sizeof(uint64_t));
+
+	memset(&evt, 0, sizeof(epoll_event));
+	pending = epoll_wait(epfd, &evt, 1, 0);
+	assert(pending == 1);
+	assert(evt.events & EPOLLIN);
+
+	close(epfd);
+	close(fd);
+}))
+
+DEFINE_TEST(epoll_oneshot, ([] {
+	int e;
+	int pending;
+
+	int fd = eventfd(0, 0);
+	assert(fd >= 0);
+
+	int epfd = epoll_create1(0);
+	assert(epfd >= 0);
+
+	epoll_event evt;
+
+	memset(&evt, 0, sizeof(epoll_event));
+	evt.events = EPOLLIN | EPOLLONESHOT;
+	e = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &evt);
+	assert(!e);
+
+	uint64_t n = 1;
+	auto written = write(fd, &n, sizeof(uint64_t));
+	assert(written == sizeof(uint64_t));
+
+	memset(&evt, 0, sizeof(epoll_event));
+	pending = epoll_wait(epfd, &evt, 1, 0);
+	assert(pending == 1);
+	assert(evt.events & EPOLLIN);
+
+	// The item is disabled, even after new edges.
+	written = write(fd, &n, sizeof(uint64_t));
+	assert(written == sizeof(uint64_t));
+
+	memset(&evt, 0, sizeof(epoll_event));
+	pending = epoll_wait(epfd, &evt, 1, 0);
+	assert(!pending);
+
+	// Modifying the item re-enables it.
+	memset(&evt, 0, sizeof(epoll_event));
+	evt.events = EPOLLIN | EPOLLONESHOT;
+	e = epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &evt);
+	assert(!e);
+
+	memset(&evt, 0, sizeof(epoll_event));
+	pending = epoll_wait(epfd, &evt, 1, 0);
+	assert(pending == 1);
+	assert(evt.events & EPOLLIN);
+
+	close(epfd);
+	close(fd);
+}))
@@ -43,10 +43,226 @@ DEFINE_TEST(inotify_unlink_child, ([] {
 	assert(evtHeader.wd == wd);
 	assert(evtHeader.mask & IN_DELETE);
 
-	std::string evtName{buffer + sizeof(inotify_event), evtHeader.len};
+	std::string evtName{buffer + sizeof(inotify_event)};
 	assert(evtName == "foobar");
 
 	close(ifd);
 	//e = rmdir(dirPath);
 	//assert(!e);
 }))
+
+DEFINE_TEST(inotify_create_child, ([] {
+	char dirPath[64];
+	strcpy(dirPath, "/tmp/posix-tests.XXXXXX");
+	if(!mkdtemp(dirPath))
+		assert(!"mkdtemp() failed");
+
+	int ifd = inotify_init();
+	assert(ifd > 0);
+	int wd = inotify_add_watch(ifd, dirPath, IN_CREATE | IN_DELETE);
+	assert(wd >= 0);
+
+	// Watches for the same directory share their descriptor.
+	int wd2 = inotify_add_watch(ifd, dirPath, IN_CREATE | IN_DELETE);
+	assert(wd2 == wd);
+
+	// Trigger inotify.
+	char filePath[64];
+	sprintf(filePath, "%s/foobar", dirPath);
+	int ffd = creat(filePath, 0644);
+	assert(ffd > 0);
+	close(ffd);
+
+	int e = unlink(filePath);
+	assert(!e);
+
+	// Both events are returned by a single read().
+	char buffer[2 * (sizeof(inotify_event) + NAME_MAX + 1)];
+	auto chunk = read(ifd, buffer, sizeof(buffer));
+	assert(chunk > 0);
+
+	inotify_event evtHeader;
+	memcpy(&evtHeader, buffer, sizeof(inotify_event));
+	assert(evtHeader.wd == wd);
+	assert(evtHeader.mask & IN_CREATE);
+	assert(std::string{buffer + sizeof(inotify_event)} == "foobar");
+
+	auto offset = sizeof(inotify_event) + evtHeader.len;
+	assert(static_cast<size_t>(chunk) > offset);
+	memcpy(&evtHeader, buffer + offset, sizeof(inotify_event));
+	assert(evtHeader.wd == wd);
+	assert(evtHeader.mask & IN_DELETE);
+	assert(std::string{buffer + offset + sizeof(inotify_event)} == "foobar");
+
+	close(ifd);
+}))
+
+DEFINE_TEST(inotify_coalesce_events, ([] {
+	char dirPath[64];
+	strcpy(dirPath, "/tmp/posix-tests.XXXXXX");
+	if(!mkdtemp(dirPath))
+		assert(!"mkdtemp() failed");
+
+	int ifd = inotify_init();
+	assert(ifd > 0);
+	int wd = inotify_add_watch(ifd, dirPath, IN_CREATE);
+	assert(wd >= 0);
+
+	// Since we do not watch IN_DELETE, this generates two identical IN_CREATE events.
+	char filePath[64];
+	sprintf(filePath, "%s/foobar", dirPath);
+	for(int i = 0; i < 2; i++) {
+		int ffd = creat(filePath, 0644);
+		assert(ffd > 0);
+		close(ffd);
+		int e = unlink(filePath);
+		assert(!e);
+	}
+
+	char buffer[2 * (sizeof(inotify_event) + NAME_MAX + 1)];
+	auto chunk = read(ifd, buffer, sizeof(buffer));
+	assert(chunk > 0);
+
+	inotify_event evtHeader;
+	memcpy(&evtHeader, buffer, sizeof(inotify_event));
+	assert(evtHeader.wd == wd);
+	assert(evtHeader.mask == IN_CREATE);
+	assert(std::string{buffer + sizeof(inotify_event)} == "foobar");
+	assert(static_cast<size_t>(chunk) == sizeof(inotify_event) + evtHeader.len);
+
+	close(ifd);
+}))
+
+DEFINE_TEST(inotify_queue_overflow, ([] {
+	char dirPath[64];
+	strcpy(dirPath, "/tmp/posix-tests.XXXXXX");
+	if(!mkdtemp(dirPath))
+		assert(!"mkdtemp() failed");
+
+	int ifd = inotify_init();
+	assert(ifd > 0);
+	int wd = inotify_add_watch(ifd, dirPath, IN_CREATE | IN_DELETE);
+	assert(wd >= 0);
+
+	// Alternating events are not coalesced; this is more than the queue can hold.
+	char filePath[64];
+	sprintf(filePath, "%s/foobar", dirPath);
+	for(int i = 0; i < 4096; i++) {
+		int ffd = creat(filePath, 0644);
+		assert(ffd > 0);
+		close(ffd);
+		int e = unlink(filePath);
+		assert(!e);
+	}
+
+	// The last queued event is IN_Q_OVERFLOW; all events before it are regular.
+	bool overflow = false;
+	while(!overflow) {
+		char buffer[64 * (sizeof(inotify_event) + NAME_MAX + 1)];
+		auto chunk = read(ifd, buffer, sizeof(buffer));
+		assert(chunk > 0);
+
+		for(size_t offset = 0; offset < static_cast<size_t>(chunk); ) {
+			assert(!overflow);
+			inotify_event evtHeader;
+			memcpy(&evtHeader, buffer + offset, sizeof(inotify_event));
+			if(evtHeader.mask & IN_Q_OVERFLOW) {
+				assert(evtHeader.wd == -1);
+				overflow = true;
+			}else{
+				assert(evtHeader.wd == wd);
+				assert(evtHeader.mask == IN_CREATE || evtHeader.mask == IN_DELETE);
+			}
+			offset += sizeof(inotify_event) + evtHeader.len;
+		}
+	}
+
+	close(ifd);
+}))
+
+DEFINE_TEST(inotify_oneshot_ignored, ([] {
+	char dirPath[64];
+	strcpy(dirPath, "/tmp/posix-tests.XXXXXX");
+	if(!mkdtemp(dirPath))
+		assert(!"mkdtemp() failed");
+
+	int ifd = inotify_init();
+	assert(ifd > 0);
+	int wd = inotify_add_watch(ifd, dirPath, IN_CREATE | IN_ONESHOT);
+	assert(wd >= 0);
+
+	char filePath[64];
+	sprintf(filePath, "%s/foobar", dirPath);
+	int ffd = creat(filePath, 0644);
+	assert(ffd > 0);
+	close(ffd);
+
+	// The event is followed by IN_IGNORED since the watch is removed.
+	char buffer[2 * (sizeof(inotify_event) + NAME_MAX + 1)];
+	size_t progress = 0;
+	while(progress < 2 * sizeof(inotify_event) + strlen("foobar") + 1) {
+		auto chunk = read(ifd, buffer + progress, sizeof(buffer) - progress);
+		assert(chunk > 0);
+		progress += chunk;
+	}
+
+	inotify_event evtHeader;
+	memcpy(&evtHeader, buffer, sizeof(inotify_event));
+	assert(evtHeader.wd == wd);
+	assert(evtHeader.mask == IN_CREATE);
+
+	auto offset = sizeof(inotify_event) + evtHeader.len;
+	assert(progress == offset + sizeof(inotify_event));
+	memcpy(&evtHeader, buffer + offset, sizeof(inotify_event));
+	assert(evtHeader.wd == wd);
+	assert(evtHeader.mask == IN_IGNORED);
+	assert(!evtHeader.len);
+
+	// The watch is gone.
+	int e = inotify_rm_watch(ifd, wd);
+	assert(e == -1 && errno == EINVAL);
+
+	close(ifd);
+}))
+
+DEFINE_TEST(inotify_rm_watch_ignored, ([] {
+	char dirPath[64];
+	strcpy(dirPath, "/tmp/posix-tests.XXXXXX");
+	if(!mkdtemp(dirPath))
+		assert(!"mkdtemp() failed");
+
+	int ifd = inotify_init();
+	assert(ifd > 0);
+	int wd = inotify_add_watch(ifd, dirPath, IN_CREATE);
+	assert(wd >= 0);
+
+	int e = inotify_rm_watch(ifd, wd);
+	assert(!e);
+
+	char buffer[sizeof(inotify_event) + NAME_MAX + 1];
+	auto chunk = read(ifd, buffer, sizeof(buffer));
+	assert(chunk == sizeof(inotify_event));
+
+	inotify_event evtHeader;
+	memcpy(&evtHeader, buffer, sizeof(inotify_event));
+	assert(evtHeader.wd == wd);
+	assert(evtHeader.mask == IN_IGNORED);
+
+	e = inotify_rm_watch(ifd, wd);
+	assert(e == -1 && errno == EINVAL);
+
+	close(ifd);
+}))
+
+DEFINE_TEST(inotify_non_inotify_fd, ([] {
+	int fd = open("/tmp", O_RDONLY | O_DIRECTORY);
+	assert(fd > 0);
+
+	int wd = inotify_add_watch(fd, "/tmp", IN_CREATE);
+	assert(wd == -1 && errno == EINVAL);
+
+	int e = inotify_rm_watch(fd, 1);
+	assert(e == -1 && errno == EINVAL);
+
+	close(fd);
+}))
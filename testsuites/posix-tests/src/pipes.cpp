@@ -1,6 +1,8 @@
 #include <cassert>
 #include <cstring>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
 #include <poll.h>
 
@@ -37,3 +39,69 @@ DEFINE_TEST(pipe_close_reader, ([] {
 	assert(pfd.revents & POLLERR);
 	assert(!(pfd.revents & POLLHUP));
 }))
+
+DEFINE_TEST(pipe_read_drains_writes, ([] {
+	int fds[2];
+	int e = pipe(fds);
+	assert(!e);
+
+	// A single read() returns the data of multiple write() calls.
+	for(int i = 0; i < 4; i++) {
+		char c = 'a' + i;
+		auto written = write(fds[1], &c, 1);
+		assert(written == 1);
+	}
+
+	char buffer[16];
+	auto chunk = read(fds[0], buffer, sizeof(buffer));
+	assert(chunk == 4);
+	assert(!memcmp(buffer, "abcd", 4));
+
+	close(fds[0]);
+	close(fds[1]);
+}))
+
+DEFINE_TEST(pipe_nonblock_full, ([] {
+	int fds[2];
+	int e = pipe2(fds, O_NONBLOCK);
+	assert(!e);
+
+	char buffer[PIPE_BUF];
+	memset(buffer, 0x42, PIPE_BUF);
+
+	// An empty pipe does not block readers.
+	auto chunk = read(fds[0], buffer, PIPE_BUF);
+	assert(chunk == -1);
+	assert(errno == EAGAIN);
+
+	// Fill the pipe; writes of PIPE_BUF bytes are never split.
+	size_t capacity = 0;
+	while(true) {
+		auto written = write(fds[1], buffer, PIPE_BUF);
+		if(written == -1) {
+			assert(errno == EAGAIN);
+			break;
+		}
+		assert(written == PIPE_BUF);
+		capacity += PIPE_BUF;
+		assert(capacity <= 1024 * 1024);
+	}
+	assert(capacity);
+
+	pollfd pfd;
+	memset(&pfd, 0, sizeof(pollfd));
+	pfd.fd = fds[1];
+	pfd.events = POLLOUT;
+	e = poll(&pfd, 1, 0);
+	assert(!e);
+
+	// Reading makes the pipe writable again.
+	chunk = read(fds[0], buffer, PIPE_BUF);
+	assert(chunk == PIPE_BUF);
+	e = poll(&pfd, 1, 0);
+	assert(e == 1);
+	assert(pfd.revents & POLLOUT);
+
+	close(fds[0]);
+	close(fds[1]);
+}))
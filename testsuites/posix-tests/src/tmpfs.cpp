@@ -0,0 +1,163 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "testsuite.hpp"
+
+DEFINE_TEST(tmpfs_truncate_zeroes, ([] {
+	int e;
+
+	char path[64];
+	strcpy(path, "/tmp/posix-tests.XXXXXX");
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+
+	char buffer[16];
+	memset(buffer, 'x', sizeof(buffer));
+	auto written = write(fd, buffer, sizeof(buffer));
+	assert(written == sizeof(buffer));
+
+	// Data that was truncated away must not reappear once the file grows again.
+	e = ftruncate(fd, 4);
+	assert(!e);
+	e = ftruncate(fd, 8192);
+	assert(!e);
+
+	struct stat st;
+	e = fstat(fd, &st);
+	assert(!e);
+	assert(st.st_size == 8192);
+
+	memset(buffer, 0, sizeof(buffer));
+	auto chunk = pread(fd, buffer, sizeof(buffer), 0);
+	assert(chunk == sizeof(buffer));
+	for(size_t i = 0; i < sizeof(buffer); i++)
+		assert(buffer[i] == (i < 4 ? 'x' : 0));
+
+	close(fd);
+	e = unlink(path);
+	assert(!e);
+}))
+
+DEFINE_TEST(tmpfs_holes, ([] {
+	int e;
+
+	char path[64];
+	strcpy(path, "/tmp/posix-tests.XXXXXX");
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+
+	// The second write is far beyond the initial size of the file's memory.
+	const off_t farOffset = (1 << 20) + 100;
+	auto written = pwrite(fd, "abc", 3, 0);
+	assert(written == 3);
+	written = pwrite(fd, "xyz", 3, farOffset);
+	assert(written == 3);
+
+	struct stat st;
+	e = fstat(fd, &st);
+	assert(!e);
+	assert(st.st_size == farOffset + 3);
+
+	// The hole reads as zeros, including the part right before the second write.
+	char buffer[8192];
+	for(off_t offset : {off_t{0}, off_t{4096}, farOffset - 4096}) {
+		memset(buffer, 'x', sizeof(buffer));
+		auto chunk = pread(fd, buffer, 4096, offset);
+		assert(chunk == 4096);
+		for(size_t i = (offset ? 0 : 3); i < 4096; i++)
+			assert(!buffer[i]);
+	}
+
+	memset(buffer, 0, sizeof(buffer));
+	auto chunk = pread(fd, buffer, sizeof(buffer), farOffset - 1);
+	assert(chunk == 4);
+	assert(!buffer[0]);
+	assert(!memcmp(buffer + 1, "xyz", 3));
+
+	close(fd);
+	e = unlink(path);
+	assert(!e);
+}))
+
+DEFINE_TEST(tmpfs_mmap_shared, ([] {
+	int e;
+
+	char path[64];
+	strcpy(path, "/tmp/posix-tests.XXXXXX");
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	e = ftruncate(fd, 8192);
+	assert(!e);
+
+	auto p = reinterpret_cast<char *>(mmap(nullptr, 8192, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0));
+	assert(p != MAP_FAILED);
+
+	// Stores to the mapping are visible to read() and vice versa.
+	memcpy(p + 4096, "abc", 3);
+	char buffer[4];
+	auto chunk = pread(fd, buffer, 3, 4096);
+	assert(chunk == 3);
+	assert(!memcmp(buffer, "abc", 3));
+
+	auto written = pwrite(fd, "xyz", 3, 100);
+	assert(written == 3);
+	assert(!memcmp(p + 100, "xyz", 3));
+
+	// Growing the file must not detach existing mappings from the file's pages.
+	written = pwrite(fd, "end", 3, 1 << 20);
+	assert(written == 3);
+	written = pwrite(fd, "def", 3, 200);
+	assert(written == 3);
+	assert(!memcmp(p + 200, "def", 3));
+	memcpy(p + 300, "ghi", 3);
+	chunk = pread(fd, buffer, 3, 300);
+	assert(chunk == 3);
+	assert(!memcmp(buffer, "ghi", 3));
+
+	e = munmap(p, 8192);
+	assert(!e);
+	close(fd);
+	e = unlink(path);
+	assert(!e);
+}))
+
+DEFINE_TEST(tmpfs_many_entries, ([] {
+	int e;
+
+	char dirPath[64];
+	strcpy(dirPath, "/tmp/posix-tests.XXXXXX");
+	if(!mkdtemp(dirPath))
+		assert(!"mkdtemp() failed");
+
+	char filePath[128];
+	for(int i = 0; i < 1000; i++) {
+		sprintf(filePath, "%s/file%d", dirPath, i);
+		int fd = creat(filePath, 0644);
+		assert(fd >= 0);
+		close(fd);
+	}
+
+	for(int i = 0; i < 1000; i++) {
+		sprintf(filePath, "%s/file%d", dirPath, i);
+		struct stat st;
+		e = stat(filePath, &st);
+		assert(!e);
+		e = unlink(filePath);
+		assert(!e);
+	}
+
+	sprintf(filePath, "%s/file0", dirPath);
+	struct stat st;
+	e = stat(filePath, &st);
+	assert(e == -1);
+
+	e = rmdir(dirPath);
+	assert(!e);
+}))
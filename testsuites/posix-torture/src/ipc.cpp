@@ -0,0 +1,87 @@
+#include <cassert>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "testsuite.hpp"
+
+namespace {
+
+struct fd_pair {
+	int fds[2];
+};
+
+fd_pair make_pipe() {
+	fd_pair p;
+	int e = pipe(p.fds);
+	assert(!e);
+	return p;
+}
+
+fd_pair make_socketpair() {
+	fd_pair p;
+	int e = socketpair(AF_UNIX, SOCK_STREAM, 0, p.fds);
+	assert(!e);
+	return p;
+}
+
+} // anonymous namespace
+
+DEFINE_TEST(pipe_create_close, ([] {
+	int fds[2];
+	int e = pipe(fds);
+	assert(!e);
+	close(fds[0]);
+	close(fds[1]);
+}))
+
+DEFINE_TEST(pipe_write_read, ([] {
+	static fd_pair p = make_pipe();
+	char buffer[64] = {};
+	auto written = write(p.fds[1], buffer, sizeof(buffer));
+	assert(written == sizeof(buffer));
+	auto chunk = read(p.fds[0], buffer, sizeof(buffer));
+	assert(chunk == sizeof(buffer));
+}))
+
+DEFINE_TEST(unix_stream_send_recv, ([] {
+	static fd_pair p = make_socketpair();
+	char buffer[64] = {};
+	auto sent = send(p.fds[0], buffer, sizeof(buffer), 0);
+	assert(sent == sizeof(buffer));
+	auto received = recv(p.fds[1], buffer, sizeof(buffer), 0);
+	assert(received == sizeof(buffer));
+}))
+
+DEFINE_TEST(epoll_ctl_add_del, ([] {
+	static int epfd = epoll_create1(0);
+	static fd_pair p = make_pipe();
+	assert(epfd >= 0);
+	struct epoll_event ev = {};
+	ev.events = EPOLLIN;
+	int e = epoll_ctl(epfd, EPOLL_CTL_ADD, p.fds[0], &ev);
+	assert(!e);
+	e = epoll_ctl(epfd, EPOLL_CTL_DEL, p.fds[0], nullptr);
+	assert(!e);
+}))
+
+DEFINE_TEST(epoll_wait_ready, ([] {
+	static int epfd = [] {
+		// The pipe always contains data, i.e., it is always readable.
+		auto p = make_pipe();
+		char c = 0;
+		auto written = write(p.fds[1], &c, 1);
+		assert(written == 1);
+
+		int fd = epoll_create1(0);
+		assert(fd >= 0);
+		struct epoll_event ev = {};
+		ev.events = EPOLLIN;
+		int e = epoll_ctl(fd, EPOLL_CTL_ADD, p.fds[0], &ev);
+		assert(!e);
+		return fd;
+	}();
+	struct epoll_event ev;
+	int n = epoll_wait(epfd, &ev, 1, 0);
+	assert(n == 1);
+}))
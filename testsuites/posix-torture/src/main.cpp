@@ -1,8 +1,25 @@
+#include <getopt.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <string>
 #include <vector>
 
+#include <bench/clock.hpp>
+
 #include "testsuite.hpp"
 
+// By default, posix-torture runs all cases for an increasing number of iterations
+// to find leaks and crashes. With --bench, each case is run for a fixed duration
+// and its throughput and latency percentiles are reported.
+
+const char *program_name = "posix-torture";
+
 std::vector<abstract_test_case *> &test_case_ptrs() {
 	static std::vector<abstract_test_case *> singleton;
 	return singleton;
@@ -12,14 +29,175 @@ void abstract_test_case::register_case(abstract_test_case *tcp) {
 	test_case_ptrs().push_back(tcp);
 }
 
-int main() {
-	for(int s = 10; s < 24; s++) {
-		int n = 1 << s;
-		for(abstract_test_case *tcp : test_case_ptrs()) {
-			std::cout << "posix-torture: Running " << tcp->name()
-					<< " for " << n << " iterations" << std::endl;
-			for(int i = 0; i < n; i++)
-				tcp->run();
+namespace {
+
+struct bench_result {
+	const char *name;
+	uint64_t iterations;
+	uint64_t elapsed; // In nanoseconds.
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+
+	double ops_per_second() const {
+		if(!elapsed)
+			return 0;
+		return iterations * 1e9 / elapsed;
+	}
+};
+
+bench_result run_bench(abstract_test_case *tcp, uint64_t duration) {
+	// Warm up caches and lazily initialized state of the case.
+	for(int i = 0; i < 16; i++)
+		tcp->run();
+
+	std::vector<uint64_t> latencies;
+	latencies.reserve(1 << 16);
+	auto start = bench::clockNow();
+	auto now = start;
+	// Run at least one iteration such that the percentiles are well-defined.
+	do {
+		tcp->run();
+		auto after = bench::clockNow();
+		latencies.push_back(after - now);
+		now = after;
+	} while(now - start < duration);
+
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&] (double p) -> uint64_t {
+		auto k = std::min(latencies.size() - 1, static_cast<size_t>(latencies.size() * p));
+		return latencies[k];
+	};
+
+	return bench_result{tcp->name(), latencies.size(), now - start,
+			percentile(0.5), percentile(0.99), percentile(0.999), latencies.back()};
+}
+
+void print_json(std::ostream &os, const std::vector<bench_result> &results) {
+	os << "{\"results\": [";
+	for(size_t i = 0; i < results.size(); i++) {
+		auto &r = results[i];
+		if(i)
+			os << ", ";
+		os << "{\"name\": \"" << r.name << "\""
+				<< ", \"iterations\": " << r.iterations
+				<< ", \"elapsed_ns\": " << r.elapsed
+				<< std::fixed << std::setprecision(2)
+				<< ", \"ops_per_second\": " << r.ops_per_second()
+				<< ", \"p50_ns\": " << r.p50
+				<< ", \"p99_ns\": " << r.p99
+				<< ", \"p999_ns\": " << r.p999
+				<< ", \"max_ns\": " << r.max << "}";
+	}
+	os << "]}" << std::endl;
+}
+
+void usage() {
+	std::cerr << "usage: posix-torture [--bench] [--filter SUBSTRING]... [--duration MS]"
+			" [--json PATH|-] [--list]" << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+	program_name = argv[0];
+
+	// Used by the fork_exec_waitpid case.
+	if(argc == 2 && !strcmp(argv[1], "--exit"))
+		return 0;
+
+	bool bench = false;
+	bool list = false;
+	uint64_t duration = 1000;
+	std::vector<std::string> filters;
+	const char *json_path = nullptr;
+
+	static const struct option options[] = {
+		{"bench", no_argument, nullptr, 'b'},
+		{"filter", required_argument, nullptr, 'f'},
+		{"duration", required_argument, nullptr, 'd'},
+		{"json", required_argument, nullptr, 'j'},
+		{"list", no_argument, nullptr, 'l'},
+		{nullptr, 0, nullptr, 0}
+	};
+
+	int c;
+	while((c = getopt_long(argc, argv, "bf:d:j:l", options, nullptr)) != -1) {
+		switch(c) {
+		case 'b':
+			bench = true;
+			break;
+		case 'f':
+			filters.push_back(optarg);
+			break;
+		case 'd':
+			duration = strtoull(optarg, nullptr, 10);
+			break;
+		case 'j':
+			json_path = optarg;
+			bench = true;
+			break;
+		case 'l':
+			list = true;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	std::vector<abstract_test_case *> cases;
+	for(abstract_test_case *tcp : test_case_ptrs()) {
+		if(!filters.empty() && std::none_of(filters.begin(), filters.end(),
+				[&] (const std::string &f) { return strstr(tcp->name(), f.c_str()); }))
+			continue;
+		cases.push_back(tcp);
+	}
+
+	if(list) {
+		for(abstract_test_case *tcp : cases)
+			std::cout << tcp->name() << std::endl;
+		return 0;
+	}
+
+	if(!bench) {
+		for(int s = 10; s < 24; s++) {
+			int n = 1 << s;
+			for(abstract_test_case *tcp : cases) {
+				std::cout << "posix-torture: Running " << tcp->name()
+						<< " for " << n << " iterations" << std::endl;
+				for(int i = 0; i < n; i++)
+					tcp->run();
+			}
+		}
+		return 0;
+	}
+
+	// If JSON goes to stdout, human-readable output goes to stderr.
+	bool json_to_stdout = json_path && !strcmp(json_path, "-");
+	std::ostream &log = json_to_stdout ? std::cerr : std::cout;
+
+	std::vector<bench_result> results;
+	for(abstract_test_case *tcp : cases) {
+		auto r = run_bench(tcp, duration * 1'000'000);
+		log << "posix-torture: " << std::setw(28) << std::left << r.name
+				<< std::right << std::fixed << std::setprecision(2)
+				<< std::setw(12) << r.ops_per_second() << " ops/s, p50: "
+				<< std::setw(8) << r.p50 / 1000.0 << " us, p99: "
+				<< std::setw(8) << r.p99 / 1000.0 << " us, p999: "
+				<< std::setw(8) << r.p999 / 1000.0 << " us" << std::endl;
+		results.push_back(r);
+	}
+
+	if(json_to_stdout) {
+		print_json(std::cout, results);
+	}else if(json_path) {
+		std::ofstream f{json_path};
+		if(!f) {
+			std::cerr << "posix-torture: Could not open " << json_path << std::endl;
+			return 1;
 		}
+		print_json(f, results);
 	}
 }
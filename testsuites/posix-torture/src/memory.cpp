@@ -9,3 +9,14 @@ DEFINE_TEST(map_unmap_anonymous, ([] {
 	assert(window != MAP_FAILED);
 	munmap(window, 0x1000);
 }))
+
+DEFINE_TEST(fault_anonymous, ([] {
+	constexpr size_t size = 0x10000;
+	auto window = static_cast<char *>(mmap(nullptr, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	assert(window != MAP_FAILED);
+	// Touch each page to trigger page faults.
+	for(size_t offset = 0; offset < size; offset += 0x1000)
+		window[offset] = 1;
+	munmap(window, size);
+}))
@@ -1,6 +1,8 @@
 #include <cassert>
+#include <fcntl.h>
 #include <linux/netlink.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/timerfd.h>
 #include <unistd.h>
 
@@ -23,3 +25,38 @@ DEFINE_TEST(open_close_unix, ([] {
 	assert(fd > 0);
 	close(fd);
 }))
+
+DEFINE_TEST(open_close_file, ([] {
+	// Create the file once; the test itself only opens and closes it.
+	static bool created = [] {
+		int fd = open("/tmp/posix-torture-file", O_RDWR | O_CREAT, 0644);
+		assert(fd > 0);
+		close(fd);
+		return true;
+	}();
+	(void)created;
+
+	int fd = open("/tmp/posix-torture-file", O_RDONLY);
+	assert(fd > 0);
+	close(fd);
+}))
+
+DEFINE_TEST(open_close_dir, ([] {
+	int fd = open("/", O_RDONLY | O_DIRECTORY);
+	assert(fd > 0);
+	close(fd);
+}))
+
+DEFINE_TEST(stat_path, ([] {
+	struct stat st;
+	int e = stat("/usr/bin", &st);
+	assert(!e);
+}))
+
+DEFINE_TEST(fstat_fd, ([] {
+	static int fd = open("/", O_RDONLY | O_DIRECTORY);
+	assert(fd > 0);
+	struct stat st;
+	int e = fstat(fd, &st);
+	assert(!e);
+}))
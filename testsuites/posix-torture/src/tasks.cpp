@@ -16,3 +16,17 @@ DEFINE_TEST(fork_exit_waitpid, ([] {
 		assert(res > 0);
 	}
 }))
+
+DEFINE_TEST(fork_exec_waitpid, ([] {
+	int pid = fork();
+	assert(pid >= 0);
+	if(!pid) {
+		execlp(program_name, program_name, "--exit", nullptr);
+		_exit(1);
+	}else{
+		int status;
+		auto res = waitpid(pid, &status, 0);
+		assert(res > 0);
+		assert(WIFEXITED(status) && !WEXITSTATUS(status));
+	}
+}))
@@ -5,6 +5,9 @@
 #define DEFINE_TEST(s, f) \
 	static test_case test_ ## s{#s, f};
 
+// argv[0] of posix-torture; used by cases that exec() the test binary.
+extern const char *program_name;
+
 struct abstract_test_case {
 private:
 	static void register_case(abstract_test_case *tcp);
@@ -0,0 +1,96 @@
+#include <assert.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <iomanip>
+#include <iostream>
+
+#include <bench/clock.hpp>
+#include <hel.h>
+#include <hel-syscalls.h>
+#include <protocols/posix/data.hpp>
+
+// Measures the rate of simple POSIX calls. For each call, the rate of the
+// libc function (which may involve IPC to the posix subsystem) is compared
+// to the rate of reading the same information from the process info page
+// (resp. of changing the signal mask through the thread page).
+
+namespace {
+
+constexpr uint64_t minDuration = 500'000'000; // In nanoseconds.
+
+template<typename F>
+void measure(const char *name, F functor) {
+	uint64_t calls = 0;
+	auto start = bench::clockNow();
+	uint64_t elapsed;
+	do {
+		for(int i = 0; i < 64; i++)
+			functor();
+		calls += 64;
+		elapsed = bench::clockNow() - start;
+	} while(elapsed < minDuration);
+
+	std::cout << "syscall-bench: " << std::setw(28) << std::left << name
+			<< std::right << std::fixed << std::setprecision(2) << std::setw(12)
+			<< calls * 1e9 / elapsed << " calls/s, "
+			<< std::setw(8) << static_cast<double>(elapsed) / calls << " ns/call" << std::endl;
+}
+
+// Must match the structure that the posix subsystem returns from GET_PROCESS_DATA.
+struct ManagarmProcessData {
+	HelHandle posixLane;
+	void *threadPage;
+	HelHandle *fileTable;
+	void *clockTrackerPage;
+};
+
+} // anonymous namespace
+
+int main() {
+	measure("getpid()", [] { (void)getpid(); });
+	measure("getppid()", [] { (void)getppid(); });
+	measure("getuid()", [] { (void)getuid(); });
+	measure("getcwd()", [] {
+		char buffer[PATH_MAX];
+		(void)getcwd(buffer, PATH_MAX);
+	});
+	measure("sigprocmask() block/unblock", [] {
+		sigset_t set;
+		sigemptyset(&set);
+		sigaddset(&set, SIGUSR1);
+		sigprocmask(SIG_BLOCK, &set, nullptr);
+		sigprocmask(SIG_UNBLOCK, &set, nullptr);
+	});
+
+	HelWord infoWord;
+	HEL_CHECK(helSyscall0_1(kHelCallSuper + protocols::posix::superGetProcessInfoPage,
+			&infoWord));
+	auto infoPage = reinterpret_cast<const protocols::posix::ProcessInfoPage *>(infoWord);
+
+	ManagarmProcessData data;
+	HEL_CHECK(helSyscall1(kHelCallSuper + 1, reinterpret_cast<HelWord>(&data)));
+	auto threadPage = reinterpret_cast<protocols::posix::ThreadPage *>(data.threadPage);
+
+	auto info = protocols::posix::readProcessInfo(infoPage);
+	assert(info.pid == getpid());
+	assert(info.ppid == getppid());
+	assert(static_cast<uid_t>(info.uid) == getuid());
+
+	measure("info page: pid", [&] {
+		(void)protocols::posix::readProcessInfo(infoPage).pid;
+	});
+	measure("info page: cwd generation", [&] {
+		(void)__atomic_load_n(&infoPage->cwdGeneration, __ATOMIC_ACQUIRE);
+	});
+	measure("thread page: block/unblock", [&] {
+		// This is the fast path that clients use for sigprocmask().
+		uint64_t bit = UINT64_C(1) << SIGUSR1;
+		auto former = __atomic_fetch_or(&threadPage->signalMask, bit, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&threadPage->signalMask, former, __ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&threadPage->pendingSignals, __ATOMIC_SEQ_CST) & bit)
+			HEL_CHECK(helSyscall0(kHelCallSuper + 8));
+	});
+}
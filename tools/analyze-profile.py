@@ -1,59 +1,243 @@
 #!/usr/bin/env python3
 
+# Analyzes kernel profiles that were dumped by virtio-console.
+#
+# The input is a sequence of chunks (one stream per CPU), each consisting of
+# a 16 byte header (magic "PROF", CPU, size) followed by the chunk data.
+# Each CPU's stream is a sequence of samples; see ProfileSampleHeader in
+# kernel/thor/generic/thor-internal/profile.hpp.
+#
+# By default, a flat profile of the sampled IPs is printed.
+# With --folded, the call stacks are printed in the "folded" format
+# that is understood by flamegraph.pl and similar tools.
+
 import argparse
+import collections
 import struct
 import subprocess
+import sys
+
+CHUNK_MAGIC = 0x464F5250 # "PROF"
+OTHER_CHUNK_MAGICS = {0x43415254} # "TRAC"
+SAMPLE_MAGIC = 0x4C504D53 # "SMPL"
+CHUNK_HEADER = struct.Struct('<IIQ')
+SAMPLE_HEADER = struct.Struct('<IHHQQ')
+MAX_FRAMES = 32
 
 parser = argparse.ArgumentParser()
 parser.add_argument('profile_path', type=str)
+parser.add_argument('--kernel', type=str,
+		default='pkg-builds/managarm-kernel/kernel/thor/thor',
+		help='path to the kernel binary')
+parser.add_argument('--user-binary', type=str, action='append', default=[],
+		metavar='PATH[@BASE]',
+		help='user space binary to resolve addresses against;'
+			' BASE is the load address of PIEs and shared objects')
+parser.add_argument('--cpu', type=int, action='append',
+		help='only consider samples from this CPU')
+parser.add_argument('--thread', type=int, action='append',
+		help='only consider samples from this thread ID')
+parser.add_argument('--folded', action='store_true',
+		help='emit folded stacks instead of a flat profile')
+parser.add_argument('--by-thread', action='store_true',
+		help='prefix folded stacks by the thread ID')
 parser.add_argument('--line', action='store_true')
 parser.add_argument('--isn', action='store_true')
 
 args = parser.parse_args()
 
-profile = dict()
+# ----------------------------------------------------------------------------
+# Input parsing.
+# ----------------------------------------------------------------------------
 
-addr2line = subprocess.Popen(
-	[
-		'addr2line', '-sfC',
-		'-e', 'pkg-builds/managarm-kernel/kernel/thor/thor'
-	],
-	encoding='ascii',
-	stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+Sample = collections.namedtuple('Sample', ['cpu', 'thread', 'space', 'frames'])
 
-n_user = 0
-n_kernel = 0
+def read_streams(path):
+	streams = collections.defaultdict(bytearray)
+	with open(path, 'rb') as f:
+		data = f.read()
+	offset = 0
+	while offset + CHUNK_HEADER.size <= len(data):
+		magic, cpu, size = CHUNK_HEADER.unpack_from(data, offset)
+		if magic in OTHER_CHUNK_MAGICS:
+			offset += CHUNK_HEADER.size + size
+			continue
+		if magic != CHUNK_MAGIC:
+			# Resynchronize on the next chunk header.
+			offset += 1
+			continue
+		offset += CHUNK_HEADER.size
+		streams[cpu] += data[offset:offset + size]
+		offset += size
+	return streams
 
-with open(args.profile_path, 'rb') as f:
-	while True:
-		rec = f.read(8)
-		if not rec:
+def parse_samples(stream):
+	offset = 0
+	n_lost = 0
+	while offset + SAMPLE_HEADER.size <= len(stream):
+		magic, cpu, n_frames, thread, space = SAMPLE_HEADER.unpack_from(stream, offset)
+		if magic != SAMPLE_MAGIC or not n_frames or n_frames > MAX_FRAMES:
+			# The kernel ring overflowed; skip to the next sample.
+			offset += 1
+			n_lost += 1
+			continue
+		end = offset + SAMPLE_HEADER.size + 8 * n_frames
+		if end > len(stream):
 			break
-		ip = struct.unpack('Q', rec)[0]
-		if ip < (1 << 63):
-			n_user += 1
+		frames = struct.unpack_from('<{}Q'.format(n_frames), stream,
+				offset + SAMPLE_HEADER.size)
+		yield Sample(cpu, thread, space, frames)
+		offset = end
+	if n_lost:
+		print('Warning: skipped {} bytes of corrupted data'.format(n_lost), file=sys.stderr)
+
+# ----------------------------------------------------------------------------
+# Symbolization.
+# ----------------------------------------------------------------------------
+
+def is_kernel(ip):
+	return ip >= (1 << 63)
+
+def elf_segments(path):
+	# Returns the ELF type and the address ranges of all PT_LOAD segments.
+	with open(path, 'rb') as f:
+		ident = f.read(64)
+		if ident[:4] != b'\x7fELF' or ident[4] != 2:
+			raise RuntimeError('{} is not a 64-bit ELF file'.format(path))
+		e_type = struct.unpack_from('<H', ident, 16)[0]
+		e_phoff, = struct.unpack_from('<Q', ident, 32)
+		e_phentsize, e_phnum = struct.unpack_from('<HH', ident, 54)
+		segments = []
+		for i in range(e_phnum):
+			f.seek(e_phoff + i * e_phentsize)
+			p_type, _, _, p_vaddr, _, _, p_memsz, _ = struct.unpack('<IIQQQQQQ', f.read(56))
+			if p_type == 1: # PT_LOAD
+				segments.append((p_vaddr, p_vaddr + p_memsz))
+		return e_type, segments
+
+class Binary:
+	def __init__(self, spec):
+		path, _, base = spec.partition('@')
+		self.path = path
+		self.name = path.rsplit('/', 1)[-1]
+		e_type, self.segments = elf_segments(path)
+		self.base = int(base, 0) if base else 0
+		if e_type == 3 and not base: # ET_DYN
+			print('Warning: {} is position independent but no base was given'.format(path),
+					file=sys.stderr)
+
+	def contains(self, ip):
+		return any(lo <= ip - self.base < hi for lo, hi in self.segments)
+
+def addr2line(path, addresses):
+	# Resolves all addresses with a single addr2line invocation.
+	if not addresses:
+		return {}
+	proc = subprocess.run(['addr2line', '-sfC', '-e', path],
+			input='\n'.join(hex(a) for a in addresses) + '\n',
+			encoding='ascii', stdout=subprocess.PIPE, check=True)
+	lines = proc.stdout.splitlines()
+	result = {}
+	for i, a in enumerate(addresses):
+		result[a] = (lines[2 * i], lines[2 * i + 1])
+	return result
+
+user_binaries = [Binary(spec) for spec in args.user_binary]
+
+samples = []
+for cpu, stream in sorted(read_streams(args.profile_path).items()):
+	for sample in parse_samples(stream):
+		if args.cpu is not None and sample.cpu not in args.cpu:
 			continue
+		if args.thread is not None and sample.thread not in args.thread:
+			continue
+		samples.append(sample)
+
+# Return addresses point after the call instruction; subtract one to get the call site.
+def lookup_address(frames, i):
+	return frames[i] if i == 0 else frames[i] - 1
+
+kernel_addresses = set()
+user_addresses = collections.defaultdict(set)
+def owner(ip):
+	if is_kernel(ip):
+		return None
+	for b in user_binaries:
+		if b.contains(ip):
+			return b
+	return None
+
+for sample in samples:
+	for i in range(len(sample.frames)):
+		ip = lookup_address(sample.frames, i)
+		if is_kernel(ip):
+			kernel_addresses.add(ip)
 		else:
-			n_kernel += 1
-		addr2line.stdin.write(hex(ip) + '\n')
-		addr2line.stdin.flush()
-		func = addr2line.stdout.readline().rstrip()
-		line = addr2line.stdout.readline().rstrip()
-		if args.line:
-			loc = (func, line)
-		elif args.isn:
-			loc = (func, line.split(':')[0] + ':' + hex(ip))
-		else:
-			loc = (func, line.split(':')[0])
-		if loc in profile:
-			profile[loc] += 1
-		else:
-			profile[loc] = 1
+			b = owner(ip)
+			if b is not None:
+				user_addresses[b].add(ip)
+
+symbols = {}
+symbols.update(addr2line(args.kernel, sorted(kernel_addresses)))
+for b, addresses in user_addresses.items():
+	resolved = addr2line(b.path, sorted(a - b.base for a in addresses))
+	for a in addresses:
+		func, line = resolved[a - b.base]
+		if func == '??':
+			func = '[{}+{}]'.format(b.name, hex(a - b.base))
+		symbols[a] = (func, line)
+
+def resolve(ip):
+	if ip in symbols:
+		return symbols[ip]
+	if is_kernel(ip):
+		return ('[kernel {}]'.format(hex(ip)), '??:0')
+	return ('[user {}]'.format(hex(ip)), '??:0')
+
+# ----------------------------------------------------------------------------
+# Output.
+# ----------------------------------------------------------------------------
+
+if args.folded:
+	stacks = collections.Counter()
+	for sample in samples:
+		names = [resolve(lookup_address(sample.frames, i))[0]
+				for i in range(len(sample.frames))]
+		names.reverse()
+		if args.by_thread:
+			names.insert(0, 'thread-{}'.format(sample.thread) if sample.thread else 'kernel')
+		stacks[';'.join(n.replace(';', ':') for n in names)] += 1
+	for stack, count in sorted(stacks.items()):
+		print('{} {}'.format(stack, count))
+	sys.exit(0)
+
+profile = collections.Counter()
+n_user = 0
+n_kernel = 0
+for sample in samples:
+	ip = sample.frames[0]
+	if is_kernel(ip):
+		n_kernel += 1
+	else:
+		n_user += 1
+	func, line = resolve(ip)
+	if args.line:
+		loc = (func, line)
+	elif args.isn:
+		loc = (func, line.split(':')[0] + ':' + hex(ip))
+	else:
+		loc = (func, line.split(':')[0])
+	profile[loc] += 1
 
 n_all = n_user + n_kernel
+if not n_all:
+	print('No samples')
+	sys.exit(0)
 
 out = sorted(profile.keys(), key=lambda loc: profile[loc])
 for loc in out:
 	print("{:.2f}% ({} samples) in:".format(profile[loc]/n_all*100, profile[loc]))
 	print("    {} in {}".format(loc[0], loc[1]))
-print("{:.2f}% of all samples in the kernel".format(n_kernel/(n_user + n_kernel)*100))
+print("{:.2f}% of all samples in the kernel".format(n_kernel/n_all*100))
+print("Samples per CPU: {}".format(', '.join('{}: {}'.format(cpu, n)
+		for cpu, n in sorted(collections.Counter(s.cpu for s in samples).items()))))
@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+
+# Converts kernel traces that were dumped by virtio-console into the
+# Chrome trace event format (JSON), which can be loaded into chrome://tracing
+# or ui.perfetto.dev.
+#
+# The input is a sequence of chunks (one stream per CPU), each consisting of
+# a 16 byte header (magic "TRAC", CPU, size) followed by the chunk data.
+# Each CPU's stream is a sequence of fixed-size records; see TraceRecord in
+# kernel/thor/generic/thor-internal/trace.hpp. Chunks of other streams
+# (e.g., "PROF" chunks of the profiler) are skipped.
+#
+# Tracing is enabled by passing kernel-trace on the kernel command line.
+
+import argparse
+import collections
+import json
+import struct
+import sys
+
+CHUNK_MAGIC = 0x43415254 # "TRAC"
+OTHER_CHUNK_MAGICS = {0x464F5250} # "PROF"
+RECORD_MAGIC = 0x45435254 # "TRCE"
+CHUNK_HEADER = struct.Struct('<IIQ')
+RECORD = struct.Struct('<IHHQQQ')
+
+# Keep this in sync with TraceEvent in thor-internal/trace.hpp.
+EV_SCHED_SWITCH = 1
+EV_IPC_SUBMIT = 2
+EV_IPC_COMPLETE = 3
+EV_PAGE_FAULT_BEGIN = 4
+EV_PAGE_FAULT_END = 5
+EV_FUTEX_WAIT_BEGIN = 6
+EV_FUTEX_WAIT_END = 7
+EV_FUTEX_WAKE = 8
+EV_IRQ_ENTER = 9
+EV_IRQ_EXIT = 10
+
+# Process IDs of the tracks in the output.
+PID_CPUS = 0
+PID_THREADS = 1
+
+parser = argparse.ArgumentParser()
+parser.add_argument('trace_path', type=str)
+parser.add_argument('-o', '--output', type=str, default='-',
+		help='path of the JSON output (default: stdout)')
+parser.add_argument('--cpu', type=int, action='append',
+		help='only consider records from this CPU')
+parser.add_argument('--summary', action='store_true',
+		help='print latency statistics instead of JSON')
+
+args = parser.parse_args()
+
+# ----------------------------------------------------------------------------
+# Input parsing.
+# ----------------------------------------------------------------------------
+
+Record = collections.namedtuple('Record', ['cpu', 'event', 'timestamp', 'arg0', 'arg1'])
+
+def read_streams(path):
+	streams = collections.defaultdict(bytearray)
+	with open(path, 'rb') as f:
+		data = f.read()
+	offset = 0
+	while offset + CHUNK_HEADER.size <= len(data):
+		magic, cpu, size = CHUNK_HEADER.unpack_from(data, offset)
+		if magic in OTHER_CHUNK_MAGICS:
+			offset += CHUNK_HEADER.size + size
+			continue
+		if magic != CHUNK_MAGIC:
+			# Resynchronize on the next chunk header.
+			offset += 1
+			continue
+		offset += CHUNK_HEADER.size
+		streams[cpu] += data[offset:offset + size]
+		offset += size
+	return streams
+
+def parse_records(stream):
+	offset = 0
+	n_lost = 0
+	while offset + RECORD.size <= len(stream):
+		magic, cpu, event, timestamp, arg0, arg1 = RECORD.unpack_from(stream, offset)
+		if magic != RECORD_MAGIC:
+			# The kernel ring overflowed; skip to the next record.
+			offset += 1
+			n_lost += 1
+			continue
+		yield Record(cpu, event, timestamp, arg0, arg1)
+		offset += RECORD.size
+	if n_lost:
+		print('Warning: skipped {} bytes of corrupted data'.format(n_lost), file=sys.stderr)
+
+records = []
+for cpu, stream in sorted(read_streams(args.trace_path).items()):
+	for record in parse_records(stream):
+		if args.cpu is not None and record.cpu not in args.cpu:
+			continue
+		records.append(record)
+records.sort(key=lambda r: r.timestamp)
+
+if not records:
+	print('No trace records', file=sys.stderr)
+	sys.exit(1)
+
+# ----------------------------------------------------------------------------
+# Conversion.
+# ----------------------------------------------------------------------------
+
+base = records[0].timestamp
+
+def us(timestamp):
+	return (timestamp - base) / 1000
+
+events = []
+latencies = collections.defaultdict(list)
+
+def complete(name, cat, pid, tid, begin, end, fields=None):
+	event = {'name': name, 'cat': cat, 'ph': 'X', 'pid': pid, 'tid': tid,
+			'ts': us(begin), 'dur': (end - begin) / 1000}
+	if fields:
+		event['args'] = fields
+	events.append(event)
+	latencies[name].append(end - begin)
+
+def instant(name, cat, pid, tid, timestamp, fields=None):
+	event = {'name': name, 'cat': cat, 'ph': 'i', 's': 't', 'pid': pid, 'tid': tid,
+			'ts': us(timestamp)}
+	if fields:
+		event['args'] = fields
+	events.append(event)
+
+# Currently running entity per CPU: (entity, since).
+running = {}
+# Begin records of page faults and futex waits, indexed by thread ID.
+faults = {}
+futex_waits = {}
+# Stack of IRQs per CPU.
+irqs = collections.defaultdict(list)
+# Outstanding IPC submissions, indexed by context.
+submissions = {}
+threads = set()
+cpus = set()
+
+for r in records:
+	cpus.add(r.cpu)
+	if r.event == EV_SCHED_SWITCH:
+		if r.cpu in running:
+			entity, since = running[r.cpu]
+			if entity:
+				complete('entity {}'.format(hex(entity)), 'sched', PID_CPUS, r.cpu,
+						since, r.timestamp)
+		running[r.cpu] = (r.arg0, r.timestamp)
+	elif r.event == EV_IPC_SUBMIT:
+		submissions[r.arg0] = r
+	elif r.event == EV_IPC_COMPLETE:
+		begin = submissions.pop(r.arg0, None)
+		if begin is not None:
+			events.append({'name': 'ipc', 'cat': 'ipc', 'ph': 'b', 'pid': PID_CPUS,
+					'tid': begin.cpu, 'id': hex(r.arg0), 'ts': us(begin.timestamp),
+					'args': {'actions': begin.arg1}})
+			events.append({'name': 'ipc', 'cat': 'ipc', 'ph': 'e', 'pid': PID_CPUS,
+					'tid': r.cpu, 'id': hex(r.arg0), 'ts': us(r.timestamp)})
+			latencies['ipc'].append(r.timestamp - begin.timestamp)
+	elif r.event == EV_PAGE_FAULT_BEGIN:
+		faults[r.arg0] = r
+		threads.add(r.arg0)
+	elif r.event == EV_PAGE_FAULT_END:
+		begin = faults.pop(r.arg0, None)
+		if begin is not None:
+			complete('page fault', 'page-fault', PID_THREADS, r.arg0,
+					begin.timestamp, r.timestamp,
+					{'address': hex(begin.arg1), 'handled': bool(r.arg1)})
+	elif r.event == EV_FUTEX_WAIT_BEGIN:
+		futex_waits[r.arg0] = r
+		threads.add(r.arg0)
+	elif r.event == EV_FUTEX_WAIT_END:
+		begin = futex_waits.pop(r.arg0, None)
+		if begin is not None:
+			complete('futex wait', 'futex', PID_THREADS, r.arg0,
+					begin.timestamp, r.timestamp, {'address': hex(r.arg1)})
+	elif r.event == EV_FUTEX_WAKE:
+		threads.add(r.arg0)
+		instant('futex wake', 'futex', PID_THREADS, r.arg0, r.timestamp,
+				{'address': hex(r.arg1)})
+	elif r.event == EV_IRQ_ENTER:
+		irqs[r.cpu].append(r)
+	elif r.event == EV_IRQ_EXIT:
+		if irqs[r.cpu] and irqs[r.cpu][-1].arg0 == r.arg0:
+			begin = irqs[r.cpu].pop()
+			complete('irq {}'.format(r.arg0), 'irq', PID_CPUS, r.cpu,
+					begin.timestamp, r.timestamp)
+
+# ----------------------------------------------------------------------------
+# Output.
+# ----------------------------------------------------------------------------
+
+if args.summary:
+	def percentile(values, p):
+		return values[min(len(values) - 1, int(len(values) * p))]
+
+	print('{:<16} {:>8} {:>12} {:>12} {:>12} {:>12}'.format(
+			'event', 'count', 'p50 (us)', 'p99 (us)', 'p999 (us)', 'max (us)'))
+	for name, values in sorted(latencies.items()):
+		if name.startswith('entity '):
+			continue
+		values.sort()
+		print('{:<16} {:>8} {:>12.2f} {:>12.2f} {:>12.2f} {:>12.2f}'.format(name, len(values),
+				percentile(values, 0.5) / 1000, percentile(values, 0.99) / 1000,
+				percentile(values, 0.999) / 1000, values[-1] / 1000))
+	sys.exit(0)
+
+metadata = [
+	{'name': 'process_name', 'ph': 'M', 'pid': PID_CPUS, 'args': {'name': 'CPUs'}},
+	{'name': 'process_name', 'ph': 'M', 'pid': PID_THREADS, 'args': {'name': 'Threads'}},
+]
+for cpu in sorted(cpus):
+	metadata.append({'name': 'thread_name', 'ph': 'M', 'pid': PID_CPUS, 'tid': cpu,
+			'args': {'name': 'CPU {}'.format(cpu)}})
+for thread in sorted(threads):
+	metadata.append({'name': 'thread_name', 'ph': 'M', 'pid': PID_THREADS, 'tid': thread,
+			'args': {'name': 'thread {}'.format(thread)}})
+
+out = {'traceEvents': metadata + events, 'displayTimeUnit': 'ns'}
+if args.output == '-':
+	json.dump(out, sys.stdout)
+else:
+	with open(args.output, 'w') as f:
+		json.dump(out, f)